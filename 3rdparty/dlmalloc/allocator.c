@@ -4,6 +4,7 @@
 #include <openenclave/advanced/allocator.h>
 #include <openenclave/advanced/mallinfo.h>
 #include <openenclave/enclave.h>
+#include <openenclave/internal/heapwatermark.h>
 
 #define HAVE_MMAP 0
 #define LACKS_UNISTD_H
@@ -58,6 +59,9 @@ void* dlmalloc_sbrk(ptrdiff_t increment)
         {
             ptr = _heap_next;
             _heap_next += increment;
+
+            // The heap watermarks are only checked when the heap changes.
+            oe_heap_watermark_update((size_t)(_heap_next - _heap_start));
         }
     }
     RELEASE_LOCK(&_lock);
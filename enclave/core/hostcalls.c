@@ -12,6 +12,7 @@
 #include <openenclave/internal/stack_alloc.h>
 
 #include "core_t.h"
+#include "hostheap.h"
 
 /**
  * Declare the prototypes of the following functions to avoid the
@@ -51,7 +52,7 @@ oe_result_t _oe_write_ocall(int device, const char* str, size_t maxlen)
 }
 OE_WEAK_ALIAS(_oe_write_ocall, oe_write_ocall);
 
-void* oe_host_malloc(size_t size)
+void* oe_host_malloc_for_host(size_t size)
 {
     uint64_t arg_in = size;
     uint64_t arg_out = 0;
@@ -67,6 +68,17 @@ void* oe_host_malloc(size_t size)
     return (void*)arg_out;
 }
 
+void* oe_host_malloc(size_t size)
+{
+    // Small allocations are served from the host heap without an OCALL.
+    void* ptr = oe_host_heap_malloc(size);
+
+    if (ptr)
+        return ptr;
+
+    return oe_host_malloc_for_host(size);
+}
+
 void* oe_host_calloc(size_t nmemb, size_t size)
 {
     size_t total_size;
@@ -94,10 +106,31 @@ OE_WEAK_ALIAS(_oe_realloc_ocall, oe_realloc_ocall);
 void* oe_host_realloc(void* ptr, size_t size)
 {
     void* retval = NULL;
+    size_t block_size = 0;
 
     if (!ptr)
         return oe_host_malloc(size);
 
+    // The host cannot resize blocks of the host heap, so they are moved.
+    if ((block_size = oe_host_heap_block_size(ptr)) != 0)
+    {
+        if (size == 0)
+        {
+            oe_host_heap_free(ptr);
+            return NULL;
+        }
+
+        if (size <= block_size)
+            return ptr;
+
+        if (!(retval = oe_host_malloc(size)))
+            return NULL;
+
+        oe_memcpy_s(retval, size, ptr, block_size);
+        oe_host_heap_free(ptr);
+        return retval;
+    }
+
     if (oe_realloc_ocall(&retval, ptr, size) != OE_OK)
         return NULL;
 
@@ -112,6 +145,9 @@ void* oe_host_realloc(void* ptr, size_t size)
 
 void oe_host_free(void* ptr)
 {
+    if (ptr && oe_host_heap_free(ptr))
+        return;
+
     oe_ocall(OE_OCALL_FREE, (uint64_t)ptr, NULL);
 }
 
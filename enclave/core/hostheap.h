@@ -0,0 +1,38 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_HOSTHEAP_H
+#define _OE_HOSTHEAP_H
+
+#include <openenclave/bits/result.h>
+#include <openenclave/bits/types.h>
+
+/* Start allocating host memory from the given region, which the enclave
+ * owns from now on. Once the region is used up, regions of the same size are
+ * allocated from the host, up to max_size bytes in total. */
+oe_result_t oe_host_heap_initialize(
+    void* region,
+    size_t region_size,
+    size_t max_size);
+
+/* Allocate a block from the host heap, or return NULL if the heap is not
+ * initialized, is out of memory, or does not serve blocks of this size */
+void* oe_host_heap_malloc(size_t size);
+
+/* Free a block of the host heap. Return false if ptr is not in the heap.
+ * After oe_host_heap_teardown(), frees of pointers into the returned regions
+ * are dropped and return true */
+bool oe_host_heap_free(void* ptr);
+
+/* Return the size of a block of the host heap, or 0 if ptr is not in the
+ * heap */
+size_t oe_host_heap_block_size(const void* ptr);
+
+/* Return the regions of the host heap to the host. Their ranges are kept */
+void oe_host_heap_teardown(void);
+
+/* Allocate host memory with an OCALL, bypassing the host heap. Use it for
+ * memory that the host frees with free() */
+void* oe_host_malloc_for_host(size_t size);
+
+#endif /* _OE_HOSTHEAP_H */
@@ -6,6 +6,8 @@
 #include <openenclave/corelibc/stdlib.h>
 #include <openenclave/internal/fault.h>
 #include <openenclave/internal/globals.h>
+#include <openenclave/internal/heapprofile.h>
+#include <openenclave/internal/heapstats.h>
 #include <openenclave/internal/malloc.h>
 #include <openenclave/internal/raise.h>
 #include <openenclave/internal/safecrt.h>
@@ -13,6 +15,21 @@
 
 static oe_allocation_failure_callback_t _failure_callback;
 
+/* The heap statistics count the usable size of the blocks, which is what the
+ * allocator takes from the heap, so that allocations and frees balance. It
+ * is only looked up while the statistics are enabled */
+static void _record_allocation(void* ptr)
+{
+    if (oe_heap_statistics_enabled && ptr)
+        oe_heap_statistics_record_allocation(
+            oe_allocator_malloc_usable_size(ptr));
+}
+
+static size_t _get_block_size(void* ptr)
+{
+    return ptr ? oe_allocator_malloc_usable_size(ptr) : 0;
+}
+
 void oe_set_allocation_failure_callback(
     oe_allocation_failure_callback_t function)
 {
@@ -23,6 +40,11 @@ void* oe_malloc(size_t size)
 {
     void* p = oe_allocator_malloc(size);
 
+    _record_allocation(p);
+
+    if (oe_heap_profiler_enabled)
+        oe_heap_profiler_record_allocation(p, size);
+
     if (!p && size)
     {
         oe_errno = OE_ENOMEM;
@@ -35,6 +57,13 @@ void* oe_malloc(size_t size)
 
 void oe_free(void* ptr)
 {
+    // Drop the sample before the block can be reallocated.
+    if (oe_heap_profiler_enabled)
+        oe_heap_profiler_record_free(ptr);
+
+    if (oe_heap_statistics_enabled && ptr)
+        oe_heap_statistics_record_free(oe_allocator_malloc_usable_size(ptr));
+
     oe_allocator_free(ptr);
 }
 
@@ -42,6 +71,11 @@ void* oe_calloc(size_t nmemb, size_t size)
 {
     void* p = oe_allocator_calloc(nmemb, size);
 
+    _record_allocation(p);
+
+    if (oe_heap_profiler_enabled)
+        oe_heap_profiler_record_allocation(p, nmemb * size);
+
     if (!p && nmemb && size)
     {
         oe_errno = OE_ENOMEM;
@@ -54,7 +88,31 @@ void* oe_calloc(size_t nmemb, size_t size)
 
 void* oe_realloc(void* ptr, size_t size)
 {
-    void* p = oe_allocator_realloc(ptr, size);
+    void* p = NULL;
+    bool count = oe_heap_statistics_enabled;
+    size_t old_size = count ? _get_block_size(ptr) : 0;
+    oe_heap_profile_sample_t sample;
+    bool sampled = false;
+
+    // Take the sample of the old block first: once the allocator frees it,
+    // another thread may get the block and sample it.
+    if (oe_heap_profiler_enabled)
+        sampled = oe_heap_profiler_take_sample(ptr, &sample);
+
+    p = oe_allocator_realloc(ptr, size);
+
+    // A failed realloc() leaves the old block allocated.
+    if (count && ptr && (p || !size))
+        oe_heap_statistics_record_free(old_size);
+
+    _record_allocation(p);
+
+    // A failed realloc() leaves the old block allocated, so it keeps its
+    // sample.
+    if (sampled && !p && size)
+        oe_heap_profiler_restore_sample(ptr, &sample);
+    else if (oe_heap_profiler_enabled)
+        oe_heap_profiler_record_allocation(p, size);
 
     if (!p && size)
     {
@@ -97,6 +155,12 @@ int oe_posix_memalign(void** memptr, size_t alignment, size_t size)
 
     int rc = oe_allocator_posix_memalign(memptr, alignment, size);
 
+    if (rc == 0)
+        _record_allocation(*memptr);
+
+    if (rc == 0 && oe_heap_profiler_enabled)
+        oe_heap_profiler_record_allocation(*memptr, size);
+
     if (rc != 0 && size)
     {
         if (_failure_callback)
@@ -71,3 +71,9 @@ oe_result_t oe_call_host_function(
         output_bytes_written,
         false /* non-switchless */);
 }
+
+oe_result_t oe_flush_async_ocalls(void)
+{
+    // OP-TEE has no switchless calls, so no asynchronous call is ever pending.
+    return OE_OK;
+}
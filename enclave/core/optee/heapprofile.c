@@ -0,0 +1,35 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/heapprofile.h>
+
+/* The heap profiler is not supported on OP-TEE, so it is never enabled */
+
+bool oe_heap_profiler_enabled;
+
+void oe_heap_profiler_record_allocation(void* ptr, size_t size)
+{
+    OE_UNUSED(ptr);
+    OE_UNUSED(size);
+}
+
+void oe_heap_profiler_record_free(void* ptr)
+{
+    OE_UNUSED(ptr);
+}
+
+bool oe_heap_profiler_take_sample(void* ptr, oe_heap_profile_sample_t* sample)
+{
+    OE_UNUSED(ptr);
+    OE_UNUSED(sample);
+    return false;
+}
+
+void oe_heap_profiler_restore_sample(
+    void* ptr,
+    const oe_heap_profile_sample_t* sample)
+{
+    OE_UNUSED(ptr);
+    OE_UNUSED(sample);
+}
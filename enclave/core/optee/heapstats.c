@@ -0,0 +1,19 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/heapstats.h>
+
+/* Heap statistics are not supported on OP-TEE, so they are never enabled */
+
+bool oe_heap_statistics_enabled;
+
+void oe_heap_statistics_record_allocation(size_t size)
+{
+    OE_UNUSED(size);
+}
+
+void oe_heap_statistics_record_free(size_t size)
+{
+    OE_UNUSED(size);
+}
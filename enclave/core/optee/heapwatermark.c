@@ -0,0 +1,37 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/heapwatermark.h>
+#include <openenclave/internal/malloc.h>
+
+/* Heap watermarks are not supported on OP-TEE, so none is ever pending */
+
+bool oe_heap_watermark_pending;
+
+void oe_heap_watermark_update(size_t heap_used)
+{
+    OE_UNUSED(heap_used);
+}
+
+void oe_heap_watermark_notify(void)
+{
+}
+
+void oe_poll_heap_watermarks(void)
+{
+}
+
+oe_result_t oe_set_heap_watermarks(
+    const uint32_t* percents,
+    size_t num_percents,
+    oe_heap_watermark_callback_t callback,
+    void* arg)
+{
+    OE_UNUSED(percents);
+    OE_UNUSED(num_percents);
+    OE_UNUSED(callback);
+    OE_UNUSED(arg);
+
+    return OE_UNSUPPORTED;
+}
@@ -4,6 +4,7 @@
 #include <openenclave/corelibc/stdlib.h>
 #include <openenclave/edger8r/enclave.h>
 #include <openenclave/enclave.h>
+#include "../hostheap.h"
 
 // Function used by oeedger8r for allocating ocall buffers. This function can be
 // optimized by allocating a buffer for making ocalls and pass it in to the
@@ -35,3 +36,36 @@ void oe_deallocate_arena(void* buffer)
 {
     OE_UNUSED(buffer);
 }
+
+// OP-TEE has no host heap, so host allocations always make an OCALL.
+void* oe_host_heap_malloc(size_t size)
+{
+    OE_UNUSED(size);
+    return NULL;
+}
+
+bool oe_host_heap_free(void* ptr)
+{
+    OE_UNUSED(ptr);
+    return false;
+}
+
+size_t oe_host_heap_block_size(const void* ptr)
+{
+    OE_UNUSED(ptr);
+    return 0;
+}
+
+oe_result_t oe_get_shared_memory_arena_statistics(
+    oe_shared_memory_arena_statistics_t* statistics)
+{
+    OE_UNUSED(statistics);
+    return OE_UNSUPPORTED;
+}
+
+oe_result_t oe_get_ocall_buffer_statistics(
+    oe_ocall_buffer_statistics_t* statistics)
+{
+    OE_UNUSED(statistics);
+    return OE_UNSUPPORTED;
+}
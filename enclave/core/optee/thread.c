@@ -9,6 +9,7 @@
 #include <openenclave/internal/raise.h>
 #include <openenclave/internal/safecrt.h>
 #include <openenclave/internal/thread.h>
+#include <openenclave/internal/threadpool.h>
 
 /*
 **==============================================================================
@@ -469,3 +470,35 @@ void oe_thread_destruct_specific(void)
         oe_spin_unlock(&_lock);
     }
 }
+
+/*
+**==============================================================================
+**
+** Thread pool
+**
+**==============================================================================
+*/
+
+oe_result_t oe_thread_pool_create(
+    oe_thread_pool_task_t** task,
+    void* (*start_routine)(void*),
+    void* arg)
+{
+    OE_UNUSED(task);
+    OE_UNUSED(start_routine);
+    OE_UNUSED(arg);
+    return OE_UNSUPPORTED;
+}
+
+oe_result_t oe_thread_pool_join(oe_thread_pool_task_t* task, void** retval)
+{
+    OE_UNUSED(task);
+    OE_UNUSED(retval);
+    return OE_UNSUPPORTED;
+}
+
+oe_result_t oe_thread_pool_detach(oe_thread_pool_task_t* task)
+{
+    OE_UNUSED(task);
+    return OE_UNSUPPORTED;
+}
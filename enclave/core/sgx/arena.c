@@ -2,8 +2,10 @@
 // Licensed under the MIT License.
 
 #include "arena.h"
+#include <openenclave/corelibc/stdlib.h>
 #include <openenclave/corelibc/string.h>
 #include <openenclave/edger8r/common.h>
+#include <openenclave/enclave.h>
 #include <openenclave/internal/print.h>
 #include <openenclave/internal/raise.h>
 #include <openenclave/internal/safemath.h>
@@ -11,14 +13,45 @@
 #include <openenclave/internal/thread.h>
 #include <openenclave/internal/utils.h>
 
-// Default shared memory arena capacity is 1 mb
-static size_t _capacity = 1024 * 1024;
+/*
+**==============================================================================
+**
+** Shared memory arena
+**
+**     Each thread allocates shared memory from a stack of chunks of host
+**     memory. A chunk is added when the current one is full, so an arena only
+**     fails when the host is out of memory or the arena would exceed its max
+**     size. The chunks are described by enclave memory so that the host
+**     cannot redirect allocations. Released chunks are kept for reuse until
+**     the arena is torn down at the end of the outermost ECALL.
+**
+**==============================================================================
+*/
+
+// Default chunk size is 1 mb
+static size_t _chunk_size = 1024 * 1024;
+
+// Default max size of the chunks of a thread is 1 gb
+static size_t _max_size = 1 << 30;
 
 static const size_t _max_capacity = 1 << 30;
 
+// Statistics across all the threads.
+static uint64_t _high_water;
+static uint64_t _num_chunk_allocations;
+static uint64_t _num_failures;
+
 void* oe_allocate_arena(size_t capacity);
 void oe_deallocate_arena(void* buffer);
 
+typedef struct _oe_arena_chunk
+{
+    uint8_t* buffer;
+    uint64_t capacity;
+    uint64_t used;
+    struct _oe_arena_chunk* next;
+} oe_arena_chunk_t;
+
 static oe_shared_memory_arena_t* _get_arena()
 {
     /* Note: arenas are zero-initialized by td_init() */
@@ -31,51 +64,129 @@ bool oe_configure_arena_capacity(size_t cap)
     {
         return false;
     }
-    __atomic_store_n(&_capacity, cap, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&_chunk_size, cap, __ATOMIC_SEQ_CST);
     return true;
 }
 
-void* oe_arena_malloc(size_t size)
+oe_result_t oe_configure_arena(size_t chunk_size, size_t max_size)
 {
     oe_result_t result = OE_UNEXPECTED;
-    size_t total_size = 0;
-    const size_t align = OE_EDGER8R_BUFFER_ALIGNMENT;
-    oe_shared_memory_arena_t* arena = _get_arena();
 
-    // Create the arena if it hasn't been created.
-    if (arena->buffer == NULL)
+    if (chunk_size > _max_capacity || max_size > _max_capacity)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    if (chunk_size && max_size && chunk_size > max_size)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    if (chunk_size)
+        __atomic_store_n(&_chunk_size, chunk_size, __ATOMIC_SEQ_CST);
+
+    if (max_size)
+        __atomic_store_n(&_max_size, max_size, __ATOMIC_SEQ_CST);
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+static void _update_high_water(oe_shared_memory_arena_t* arena)
+{
+    if (arena->used <= arena->high_water)
+        return;
+
+    arena->high_water = arena->used;
+
+    uint64_t high_water = __atomic_load_n(&_high_water, __ATOMIC_RELAXED);
+    while (arena->used > high_water &&
+           !__atomic_compare_exchange_n(
+               &_high_water,
+               &high_water,
+               arena->used,
+               true,
+               __ATOMIC_RELAXED,
+               __ATOMIC_RELAXED))
+        ;
+}
+
+/* Push a chunk with room for size bytes, reusing a spare chunk if possible */
+static oe_arena_chunk_t* _push_chunk(
+    oe_shared_memory_arena_t* arena,
+    size_t size)
+{
+    oe_arena_chunk_t** link = &arena->spare_chunks;
+    oe_arena_chunk_t* chunk = NULL;
+
+    while (*link && (*link)->capacity < size)
+        link = &(*link)->next;
+
+    if ((chunk = *link) != NULL)
+    {
+        *link = chunk->next;
+    }
+    else
     {
-        arena->capacity = __atomic_load_n(&_capacity, __ATOMIC_SEQ_CST);
-        void* buffer = oe_allocate_arena(arena->capacity);
-        if (buffer == NULL)
+        size_t capacity = __atomic_load_n(&_chunk_size, __ATOMIC_SEQ_CST);
+        size_t max_size = __atomic_load_n(&_max_size, __ATOMIC_SEQ_CST);
+
+        if (capacity < size)
+            capacity = size;
+
+        if (arena->capacity > max_size || capacity > max_size - arena->capacity)
+            return NULL;
+
+        if (!(chunk = (oe_arena_chunk_t*)oe_malloc(sizeof(*chunk))))
+            return NULL;
+
+        if (!(chunk->buffer = (uint8_t*)oe_allocate_arena(capacity)))
         {
-            arena->capacity = 0;
+            oe_free(chunk);
             return NULL;
         }
-        arena->buffer = (uint8_t*)buffer;
-        arena->used = 0;
+
+        chunk->capacity = capacity;
+        arena->capacity += capacity;
+        __atomic_add_fetch(&_num_chunk_allocations, 1, __ATOMIC_RELAXED);
     }
 
+    chunk->used = 0;
+    chunk->next = arena->chunks;
+    arena->chunks = chunk;
+
+    return chunk;
+}
+
+void* oe_arena_malloc(size_t size)
+{
+    size_t total_size = 0;
+    const size_t align = OE_EDGER8R_BUFFER_ALIGNMENT;
+    oe_shared_memory_arena_t* arena = _get_arena();
+    oe_arena_chunk_t* chunk = arena->chunks;
+    uint8_t* addr = NULL;
+
     // Round up to the nearest alignment size.
     total_size = oe_round_up_to_multiple(size, align);
 
     // check for overflow
     if (total_size < size)
-        return NULL;
+        goto failed;
 
-    // check for capacity
-    size_t used_after;
-    OE_CHECK(oe_safe_add_sizet(arena->used, total_size, &used_after));
-
-    // Ok if the incoming malloc puts us below the capacity.
-    if (used_after <= arena->capacity)
+    // Chain a new chunk if the current one does not have room.
+    if (!chunk || chunk->capacity - chunk->used < total_size)
     {
-        uint8_t* addr = arena->buffer + arena->used;
-        arena->used = used_after;
-        return addr;
+        if (!(chunk = _push_chunk(arena, total_size)))
+            goto failed;
     }
 
-done:
+    addr = chunk->buffer + chunk->used;
+    chunk->used += total_size;
+    arena->used += total_size;
+    _update_high_water(arena);
+
+    return addr;
+
+failed:
+    __atomic_add_fetch(&_num_failures, 1, __ATOMIC_RELAXED);
     return NULL;
 }
 
@@ -93,10 +204,54 @@ void* oe_arena_calloc(size_t num, size_t size)
     return ptr;
 }
 
-void oe_arena_free_all()
+oe_arena_mark_t oe_arena_mark(void)
+{
+    oe_shared_memory_arena_t* arena = _get_arena();
+    oe_arena_mark_t mark = {arena->chunks, 0};
+
+    if (arena->chunks)
+        mark.used = arena->chunks->used;
+
+    return mark;
+}
+
+void oe_arena_release(oe_arena_mark_t mark)
 {
     oe_shared_memory_arena_t* arena = _get_arena();
-    arena->used = 0;
+    oe_arena_chunk_t* chunk = NULL;
+
+    // Move the chunks chained after the mark to the spare chunks.
+    while ((chunk = arena->chunks) != NULL && chunk != mark.chunk)
+    {
+        arena->chunks = chunk->next;
+        arena->used -= chunk->used;
+        chunk->used = 0;
+        chunk->next = arena->spare_chunks;
+        arena->spare_chunks = chunk;
+    }
+
+    if (chunk && chunk->used > mark.used)
+    {
+        arena->used -= chunk->used - mark.used;
+        chunk->used = mark.used;
+    }
+}
+
+void oe_arena_free_all()
+{
+    oe_arena_mark_t mark = {NULL, 0};
+    oe_arena_release(mark);
+}
+
+static void _free_chunks(oe_arena_chunk_t* chunk)
+{
+    while (chunk)
+    {
+        oe_arena_chunk_t* next = chunk->next;
+        oe_deallocate_arena(chunk->buffer);
+        oe_free(chunk);
+        chunk = next;
+    }
 }
 
 // Free the arena in the current thread.
@@ -104,7 +259,40 @@ void oe_teardown_arena()
 {
     oe_shared_memory_arena_t* arena = _get_arena();
 
-    if (arena->buffer != NULL)
-        oe_deallocate_arena(arena->buffer);
+    _free_chunks(arena->chunks);
+    _free_chunks(arena->spare_chunks);
     memset(arena, 0, sizeof(oe_shared_memory_arena_t));
 }
+
+oe_result_t oe_get_shared_memory_arena_statistics(
+    oe_shared_memory_arena_statistics_t* statistics)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_shared_memory_arena_t* arena = NULL;
+
+    if (!statistics)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    arena = _get_arena();
+    memset(statistics, 0, sizeof(*statistics));
+
+    statistics->used = arena->used;
+    statistics->capacity = arena->capacity;
+    statistics->thread_high_water = arena->high_water;
+    for (oe_arena_chunk_t* chunk = arena->chunks; chunk; chunk = chunk->next)
+        statistics->num_chunks++;
+    for (oe_arena_chunk_t* chunk = arena->spare_chunks; chunk;
+         chunk = chunk->next)
+        statistics->num_chunks++;
+
+    statistics->high_water = __atomic_load_n(&_high_water, __ATOMIC_RELAXED);
+    statistics->num_chunk_allocations =
+        __atomic_load_n(&_num_chunk_allocations, __ATOMIC_RELAXED);
+    statistics->num_failures =
+        __atomic_load_n(&_num_failures, __ATOMIC_RELAXED);
+
+    result = OE_OK;
+
+done:
+    return result;
+}
@@ -4,14 +4,32 @@
 #ifndef _OE_ARENA_H
 #define _OE_ARENA_H
 
+#include <openenclave/bits/result.h>
 #include <openenclave/bits/types.h>
 
+/* The state of the arena of the current thread, see oe_arena_mark() */
+typedef struct _oe_arena_mark
+{
+    struct _oe_arena_chunk* chunk;
+    uint64_t used;
+} oe_arena_mark_t;
+
 bool oe_configure_arena_capacity(size_t cap);
 
+/* Set the size of the chunks of the arenas and the max size of the chunks of
+ * one thread. Zero keeps the current value. */
+oe_result_t oe_configure_arena(size_t chunk_size, size_t max_size);
+
 void* oe_arena_malloc(size_t size);
 
 void* oe_arena_calloc(size_t num, size_t size);
 
+/* Record the state of the arena of the current thread so that the
+ * allocations made after it can be released by oe_arena_release() */
+oe_arena_mark_t oe_arena_mark(void);
+
+void oe_arena_release(oe_arena_mark_t mark);
+
 void oe_arena_free_all();
 
 void oe_teardown_arena();
@@ -15,6 +15,9 @@
 #include <openenclave/internal/crypto/init.h>
 #include <openenclave/internal/fault.h>
 #include <openenclave/internal/globals.h>
+#include <openenclave/internal/heapprofile.h>
+#include <openenclave/internal/heapstats.h>
+#include <openenclave/internal/heapwatermark.h>
 #include <openenclave/internal/jump.h>
 #include <openenclave/internal/malloc.h>
 #include <openenclave/internal/print.h>
@@ -24,17 +27,20 @@
 #include <openenclave/internal/sgx/ecall_context.h>
 #include <openenclave/internal/sgx/td.h>
 #include <openenclave/internal/thread.h>
+#include <openenclave/internal/threadpool.h>
 #include <openenclave/internal/trace.h>
 #include <openenclave/internal/types.h>
 #include <openenclave/internal/utils.h>
 #include "../../../common/sgx/sgxmeasure.h"
 #include "../../sgx/report.h"
 #include "../atexit.h"
+#include "../hostheap.h"
 #include "../tracee.h"
 #include "arena.h"
 #include "asmdefs.h"
 #include "core_t.h"
 #include "cpuid.h"
+#include "ecallbuffer.h"
 #include "handle_ecall.h"
 #include "init.h"
 #include "platform_t.h"
@@ -209,6 +215,8 @@ oe_result_t oe_handle_call_enclave_function(uint64_t arg_in)
     size_t buffer_size = 0;
     size_t output_bytes_written = 0;
     ecall_table_t ecall_table;
+    oe_heap_ecall_scope_t heap_scope;
+    bool attribute_heap_usage = false;
 
     // Ensure that args lies outside the enclave.
     if (!oe_is_outside_enclave(
@@ -258,8 +266,9 @@ oe_result_t oe_handle_call_enclave_function(uint64_t arg_in)
     if (func == NULL)
         OE_RAISE(OE_NOT_FOUND);
 
-    // Allocate buffers in enclave memory
-    buffer = input_buffer = oe_malloc(buffer_size);
+    // Get buffers in enclave memory. The buffer of the current thread is
+    // reused across calls.
+    buffer = input_buffer = oe_ecall_buffer_acquire(buffer_size);
     if (buffer == NULL)
         OE_RAISE(OE_OUT_OF_MEMORY);
 
@@ -272,13 +281,25 @@ oe_result_t oe_handle_call_enclave_function(uint64_t arg_in)
     output_buffer = buffer + args.input_buffer_size;
     memset(output_buffer, 0, args.output_buffer_size);
 
-    // Call the function.
+    // Call the function, attributing its heap usage to it if the heap
+    // statistics of the ECALLs are started. Only a scope that was entered is
+    // exited, even if they start during the call.
+    attribute_heap_usage = oe_heap_statistics_ecalls_enabled;
+    if (attribute_heap_usage)
+        oe_heap_statistics_enter_ecall(&heap_scope, args.function_id);
     func(
         input_buffer,
         args.input_buffer_size,
         output_buffer,
         args.output_buffer_size,
         &output_bytes_written);
+    if (attribute_heap_usage)
+        oe_heap_statistics_exit_ecall(&heap_scope);
+
+    // The function holds no lock once it returns, so this is a safe point to
+    // deliver the heap watermarks that it crossed.
+    if (oe_heap_watermark_pending)
+        oe_heap_watermark_notify();
 
     /*
      * The output_buffer is expected to point to a marshaling struct.
@@ -320,8 +341,9 @@ oe_result_t oe_handle_call_enclave_function(uint64_t arg_in)
                     return_args_ptr->deepcopy_out_buffer_size))
                 OE_RAISE(OE_UNEXPECTED);
 
-            void* host_buffer =
-                oe_host_malloc(return_args_ptr->deepcopy_out_buffer_size);
+            /* The host frees the buffer, so it bypasses the host heap. */
+            void* host_buffer = oe_host_malloc_for_host(
+                return_args_ptr->deepcopy_out_buffer_size);
             /* Copy the deep-copied content to host memory. */
             memcpy(
                 host_buffer,
@@ -335,14 +357,16 @@ oe_result_t oe_handle_call_enclave_function(uint64_t arg_in)
         // Copy outputs to host memory.
         memcpy(args.output_buffer, output_buffer, args.output_buffer_size);
 
-        // The ecall succeeded.
+        // The ecall succeeded. Switchless callers poll the result, so it
+        // must be set last.
         args_ptr->output_bytes_written = output_bytes_written;
+        OE_ATOMIC_MEMORY_BARRIER_RELEASE();
         args_ptr->result = OE_OK;
     }
 
 done:
     if (buffer)
-        oe_free(buffer);
+        oe_ecall_buffer_release(buffer, buffer_size);
 
     if (result != OE_OK && return_args_ptr && args.output_buffer)
     {
@@ -358,6 +382,102 @@ done:
     return result;
 }
 
+/*
+**==============================================================================
+**
+** oe_handle_call_enclave_function_batch()
+**
+**     Handle OE_ECALL_CALL_ENCLAVE_FUNCTION_BATCH. The host passes an array of
+**     oe_call_enclave_function_args_t, which are executed in order within the
+**     current enclave entry. Each call goes through
+**     oe_handle_call_enclave_function() and hence is validated and copied in
+**     exactly like a single ECALL. A failing call does not stop the batch; its
+**     error is reported through its own result field.
+**
+**==============================================================================
+*/
+oe_result_t oe_handle_call_enclave_function_batch(uint64_t arg_in)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_call_enclave_function_batch_args_t args = {0}, *args_ptr;
+    size_t calls_size = 0;
+
+    // Ensure that args lies outside the enclave.
+    if (!oe_is_outside_enclave(
+            (void*)arg_in, sizeof(oe_call_enclave_function_batch_args_t)))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Copy args to enclave memory to avoid TOCTOU issues.
+    args_ptr = (oe_call_enclave_function_batch_args_t*)arg_in;
+    args = *args_ptr;
+
+    OE_CHECK(oe_safe_mul_u64(
+        args.num_calls, sizeof(oe_call_enclave_function_args_t), &calls_size));
+
+    // Ensure that the array of calls lies outside the enclave.
+    if (args.calls == NULL || args.num_calls == 0 ||
+        !oe_is_outside_enclave(args.calls, calls_size))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    /* lfence after checks. */
+    oe_lfence();
+
+    for (size_t i = 0; i < args.num_calls; i++)
+    {
+        oe_call_enclave_function_args_t* call = &args.calls[i];
+        oe_result_t call_result =
+            oe_handle_call_enclave_function((uint64_t)call);
+
+        // oe_handle_call_enclave_function only sets the result on success.
+        if (call_result != OE_OK)
+            call->result = call_result;
+
+        args_ptr->num_completed = i + 1;
+    }
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+/*
+**==============================================================================
+**
+** _handle_configure_shared_memory()
+**
+**     Handle OE_ECALL_CONFIGURE_SHARED_MEMORY, which applies the
+**     OE_ENCLAVE_SETTING_SHARED_MEMORY setting at enclave creation.
+**
+**==============================================================================
+*/
+static oe_result_t _handle_configure_shared_memory(uint64_t arg_in)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_configure_shared_memory_args_t args = {0};
+
+    // Ensure that args lies outside the enclave.
+    if (!oe_is_outside_enclave(
+            (void*)arg_in, sizeof(oe_configure_shared_memory_args_t)))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Copy args to enclave memory to avoid TOCTOU issues.
+    args = *(oe_configure_shared_memory_args_t*)arg_in;
+
+    OE_CHECK(oe_configure_arena(args.arena_chunk_size, args.arena_max_size));
+
+    /* The enclave owns the region of the host heap once it is initialized,
+     * so this is done last. */
+    if (args.host_heap)
+        OE_CHECK(oe_host_heap_initialize(
+            args.host_heap, args.host_heap_size, args.host_heap_max_size));
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
 /*
 **==============================================================================
 **
@@ -432,6 +552,12 @@ static oe_result_t _enclave_destructor(void)
         /* Cleanup verifiers */
         oe_verifier_shutdown();
 
+        /* Free the cached ECALL buffers of all threads */
+        oe_ecall_buffer_teardown();
+
+        /* Return the regions of the host heap to the host */
+        oe_host_heap_teardown();
+
         /* If memory still allocated, print a trace and return an error */
         OE_CHECK(oe_check_memory_leaks());
 
@@ -528,6 +654,51 @@ static void _handle_ecall(
             arg_out = oe_handle_call_enclave_function(arg_in);
             break;
         }
+        case OE_ECALL_CALL_ENCLAVE_FUNCTION_BATCH:
+        {
+            arg_out = oe_handle_call_enclave_function_batch(arg_in);
+            break;
+        }
+        case OE_ECALL_CONFIGURE_SHARED_MEMORY:
+        {
+            arg_out = _handle_configure_shared_memory(arg_in);
+            break;
+        }
+        case OE_ECALL_START_THREAD_POOL:
+        {
+            arg_out = oe_start_thread_pool(arg_in);
+            break;
+        }
+        case OE_ECALL_THREAD_POOL_WORKER:
+        {
+            arg_out = oe_run_thread_pool_worker();
+            break;
+        }
+        case OE_ECALL_STOP_THREAD_POOL:
+        {
+            arg_out = oe_stop_thread_pool();
+            break;
+        }
+        case OE_ECALL_START_HEAP_PROFILER:
+        {
+            arg_out = oe_handle_start_heap_profiler(arg_in);
+            break;
+        }
+        case OE_ECALL_GET_HEAP_PROFILE:
+        {
+            arg_out = oe_handle_get_heap_profile(arg_in);
+            break;
+        }
+        case OE_ECALL_GET_HEAP_STATISTICS:
+        {
+            arg_out = oe_handle_get_heap_statistics(arg_in);
+            break;
+        }
+        case OE_ECALL_START_HEAP_STATISTICS:
+        {
+            arg_out = oe_handle_start_heap_statistics(arg_in);
+            break;
+        }
         case OE_ECALL_CALL_AT_EXIT_FUNCTIONS:
         {
             _call_at_exit_functions();
@@ -786,6 +957,8 @@ oe_result_t oe_ocall(uint16_t func, uint64_t arg_in, uint64_t* arg_out)
     /* Save call site where execution will resume after OCALL */
     if (oe_setjmp(&callsite->jmpbuf) == 0)
     {
+        td->ocall_depth++;
+
         /* Exit, giving control back to the host so it can handle OCALL */
         _handle_exit(OE_CODE_OCALL, func, arg_in);
 
@@ -794,6 +967,8 @@ oe_result_t oe_ocall(uint16_t func, uint64_t arg_in, uint64_t* arg_out)
     }
     else
     {
+        td->ocall_depth--;
+
         OE_CHECK_NO_TRACE(result = (oe_result_t)td->oret_result);
 
         if (arg_out)
@@ -828,6 +1003,7 @@ oe_result_t oe_call_host_function_internal(
     oe_result_t result = OE_UNEXPECTED;
     oe_call_host_function_args_t* args = NULL;
     oe_call_function_return_args_t return_args, *return_args_ptr = NULL;
+    oe_arena_mark_t arena_mark = oe_arena_mark();
 
     /* Reject invalid parameters */
     if (!input_buffer || input_buffer_size == 0)
@@ -837,7 +1013,8 @@ oe_result_t oe_call_host_function_internal(
      * oe_post_switchless_ocall (below) can make a regular ocall to wake up the
      * host worker thread, and will end up using the ecall context's args.
      * Therefore, for switchless calls, allocate args in the arena so that it is
-     * is not overwritten by oe_post_switchless_ocall.
+     * is not overwritten by oe_post_switchless_ocall. The args are released
+     * before returning, so repeated calls do not grow the arena.
      */
     args =
         (oe_call_host_function_args_t*)(switchless ? oe_arena_malloc(sizeof(*args)) : oe_ecall_context_get_ocall_args());
@@ -855,6 +1032,7 @@ oe_result_t oe_call_host_function_internal(
     args->output_buffer = output_buffer;
     args->output_buffer_size = output_buffer_size;
     args->result = OE_UNEXPECTED;
+    args->flags = 0;
 
     /* Call the host function with this address */
     if (switchless && oe_is_switchless_initialized())
@@ -957,6 +1135,9 @@ done:
         return_args_ptr->deepcopy_out_buffer_size = 0;
     }
 
+    if (switchless)
+        oe_arena_release(arena_mark);
+
     return result;
 }
 
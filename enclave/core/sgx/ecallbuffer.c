@@ -0,0 +1,156 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include "ecallbuffer.h"
+#include <openenclave/corelibc/stdlib.h>
+#include <openenclave/corelibc/string.h>
+#include <openenclave/enclave.h>
+#include <openenclave/internal/sgx/td.h>
+#include <openenclave/internal/thread.h>
+
+/* Threads whose buffer must be freed by oe_ecall_buffer_teardown() */
+static oe_sgx_td_t* _threads;
+static oe_spinlock_t _lock = OE_SPINLOCK_INITIALIZER;
+
+static oe_ecall_buffer_t* _get_ecall_buffer(void)
+{
+    /* Note: the td page is zero-filled when the enclave is created */
+    return &oe_sgx_get_td()->ecall_buffer;
+}
+
+/*
+**==============================================================================
+**
+** oe_ecall_buffer_acquire()
+**
+**     Return an enclave buffer of at least the given size for the marshalling
+**     arguments of an incoming ECALL. The buffer of the current thread is
+**     reused, and grown geometrically, unless it is already used by an outer
+**     ECALL or the size exceeds OE_ECALL_BUFFER_MAX_CAPACITY, in which case
+**     a new buffer is allocated.
+**
+**==============================================================================
+*/
+
+void* oe_ecall_buffer_acquire(size_t size)
+{
+    oe_sgx_td_t* td = oe_sgx_get_td();
+    oe_ecall_buffer_t* buffer = &td->ecall_buffer;
+    size_t capacity;
+
+    if (buffer->in_use || size > OE_ECALL_BUFFER_MAX_CAPACITY)
+    {
+        buffer->misses++;
+        return oe_malloc(size);
+    }
+
+    if (size <= buffer->capacity)
+    {
+        buffer->hits++;
+        buffer->in_use = 1;
+        return buffer->data;
+    }
+
+    buffer->misses++;
+
+    capacity = buffer->capacity ? buffer->capacity * 2
+                                : OE_ECALL_BUFFER_MIN_CAPACITY;
+    while (capacity < size)
+        capacity *= 2;
+
+    if (capacity > OE_ECALL_BUFFER_MAX_CAPACITY)
+        capacity = OE_ECALL_BUFFER_MAX_CAPACITY;
+
+    oe_free(buffer->data);
+    buffer->capacity = 0;
+    buffer->underused_calls = 0;
+
+    if (!(buffer->data = (uint8_t*)oe_malloc(capacity)))
+        return NULL;
+
+    buffer->capacity = capacity;
+    buffer->in_use = 1;
+
+    if (!buffer->registered)
+    {
+        oe_spin_lock(&_lock);
+        buffer->next = _threads;
+        _threads = td;
+        oe_spin_unlock(&_lock);
+        buffer->registered = 1;
+    }
+
+    return buffer->data;
+}
+
+/*
+**==============================================================================
+**
+** oe_ecall_buffer_release()
+**
+**     Release a buffer returned by oe_ecall_buffer_acquire() for a call of
+**     the given size. The buffer of the current thread is freed once it has
+**     been mostly unused for OE_ECALL_BUFFER_TRIM_CALLS consecutive calls.
+**
+**==============================================================================
+*/
+
+void oe_ecall_buffer_release(void* data, size_t size)
+{
+    oe_ecall_buffer_t* buffer = _get_ecall_buffer();
+
+    if (!data)
+        return;
+
+    if (data != buffer->data || !buffer->in_use)
+    {
+        oe_free(data);
+        return;
+    }
+
+    buffer->in_use = 0;
+
+    if (buffer->capacity > OE_ECALL_BUFFER_MIN_CAPACITY &&
+        size <= buffer->capacity / 4)
+    {
+        if (++buffer->underused_calls >= OE_ECALL_BUFFER_TRIM_CALLS)
+        {
+            oe_free(buffer->data);
+            buffer->data = NULL;
+            buffer->capacity = 0;
+            buffer->underused_calls = 0;
+        }
+    }
+    else
+    {
+        buffer->underused_calls = 0;
+    }
+}
+
+/*
+**==============================================================================
+**
+** oe_ecall_buffer_teardown()
+**
+**     Free the buffers of all the threads. This is called by the enclave
+**     destructor, when no other ECALL is in progress, so that the buffers are
+**     not reported as leaked.
+**
+**==============================================================================
+*/
+
+void oe_ecall_buffer_teardown(void)
+{
+    oe_spin_lock(&_lock);
+
+    while (_threads)
+    {
+        oe_ecall_buffer_t* buffer = &_threads->ecall_buffer;
+
+        _threads = buffer->next;
+        oe_free(buffer->data);
+        memset(buffer, 0, sizeof(*buffer));
+    }
+
+    oe_spin_unlock(&_lock);
+}
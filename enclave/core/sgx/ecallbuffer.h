@@ -0,0 +1,25 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_ECALLBUFFER_H
+#define _OE_ECALLBUFFER_H
+
+#include <openenclave/bits/types.h>
+
+/* Buffers are allocated in powers of two starting from this size */
+#define OE_ECALL_BUFFER_MIN_CAPACITY 256
+
+/* Larger requests are allocated and freed on every call */
+#define OE_ECALL_BUFFER_MAX_CAPACITY (64 * 1024)
+
+/* The buffer is freed after this many consecutive calls that used at most a
+ * quarter of it, so that a single large call does not pin a large buffer */
+#define OE_ECALL_BUFFER_TRIM_CALLS 1024
+
+void* oe_ecall_buffer_acquire(size_t size);
+
+void oe_ecall_buffer_release(void* buffer, size_t size);
+
+void oe_ecall_buffer_teardown(void);
+
+#endif /* _OE_ECALLBUFFER_H */
@@ -9,4 +9,6 @@
 
 oe_result_t oe_handle_call_enclave_function(uint64_t arg);
 
+oe_result_t oe_handle_call_enclave_function_batch(uint64_t arg);
+
 #endif // _HANDLE_ECALL_H
@@ -0,0 +1,452 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/advanced/allocator.h>
+#include <openenclave/corelibc/string.h>
+#include <openenclave/enclave.h>
+#include <openenclave/internal/backtrace.h>
+#include <openenclave/internal/heapprofile.h>
+#include <openenclave/internal/raise.h>
+#include <openenclave/internal/rdrand.h>
+#include <openenclave/internal/safemath.h>
+#include <openenclave/internal/sgx/td.h>
+#include <openenclave/internal/thread.h>
+
+/*
+**==============================================================================
+**
+** Sampling heap profiler
+**
+**     Each thread counts down the bytes that it allocates. When the count
+**     runs out, the allocation that did it is sampled and a new count is
+**     drawn from an exponential distribution whose mean is the sample
+**     interval. Only the sampled allocations pay for a backtrace and the
+**     lock of the table.
+**
+**     The samples of the live allocations are kept in a fixed pool of
+**     records. A hash table with open addressing maps the address of each
+**     sampled block to its record. oe_free() probes the table without the
+**     lock, since the key of a sampled block is visible to any thread that
+**     can free the block, and only takes the lock if it finds the key.
+**     Removed keys leave tombstones. When too many accumulate, the table is
+**     rebuilt under a sequence count, and probes that overlap a rebuild are
+**     retried under the lock.
+**
+**==============================================================================
+*/
+
+#define DEFAULT_SAMPLE_INTERVAL (512 * 1024)
+#define DEFAULT_MAX_SAMPLES 1024
+#define MAX_MAX_SAMPLES (64 * 1024)
+
+#define EMPTY_KEY ((uintptr_t)0)
+#define TOMBSTONE_KEY ((uintptr_t)1)
+
+/* ln(2) in 16.16 fixed point */
+#define LN2_Q16 45426
+
+typedef struct _record
+{
+    /* Address of the sampled block, or zero if the record is free */
+    uintptr_t ptr;
+    oe_heap_profile_sample_t sample;
+} record_t;
+
+typedef struct _slot
+{
+    uintptr_t key;
+    uint32_t record;
+} slot_t;
+
+bool oe_heap_profiler_enabled;
+
+/* Overridden by OE_ALLOW_HEAP_PROFILER() in the enclave */
+OE_WEAK const bool oe_heap_profiler_allowed = false;
+
+static oe_spinlock_t _lock = OE_SPINLOCK_INITIALIZER;
+static uint64_t _sample_interval;
+
+static record_t* _records;
+static uint32_t* _free_records;
+static uint32_t _max_samples;
+static uint32_t _num_free_records;
+
+static slot_t* _slots;
+static uint64_t _num_slots;
+static uint64_t _num_used_slots;
+
+/* Live samples, read without the lock by oe_free() */
+static uint64_t _num_samples;
+
+/* Samples dropped because all the records were in use */
+static uint64_t _num_dropped;
+
+/* Odd while the table is rebuilt */
+static uint64_t _rebuild_sequence;
+
+static uint64_t _hash(uintptr_t ptr)
+{
+    return ((uint64_t)ptr >> 4) * 0x9e3779b97f4a7c15ULL;
+}
+
+/* Find the slot of a key. Return _num_slots if there is none. This may be
+ * called without the lock, so the keys are loaded atomically */
+static uint64_t _find_slot(uintptr_t ptr)
+{
+    uint64_t mask = _num_slots - 1;
+    uint64_t index = _hash(ptr) & mask;
+
+    for (uint64_t i = 0; i < _num_slots; i++, index = (index + 1) & mask)
+    {
+        uintptr_t key = __atomic_load_n(&_slots[index].key, __ATOMIC_ACQUIRE);
+
+        if (key == ptr)
+            return index;
+
+        if (key == EMPTY_KEY)
+            break;
+    }
+
+    return _num_slots;
+}
+
+/* Add a key to the table. Called with the lock */
+static void _insert_slot(uintptr_t ptr, uint32_t record)
+{
+    uint64_t mask = _num_slots - 1;
+    uint64_t index = _hash(ptr) & mask;
+
+    while (_slots[index].key != EMPTY_KEY &&
+           _slots[index].key != TOMBSTONE_KEY)
+        index = (index + 1) & mask;
+
+    if (_slots[index].key == EMPTY_KEY)
+        _num_used_slots++;
+
+    _slots[index].record = record;
+    __atomic_store_n(&_slots[index].key, ptr, __ATOMIC_RELEASE);
+}
+
+/* Drop the tombstones by inserting the live records into an empty table.
+ * Called with the lock */
+static void _rebuild(void)
+{
+    __atomic_add_fetch(&_rebuild_sequence, 1, __ATOMIC_SEQ_CST);
+
+    for (uint64_t i = 0; i < _num_slots; i++)
+        __atomic_store_n(&_slots[i].key, EMPTY_KEY, __ATOMIC_RELAXED);
+
+    _num_used_slots = 0;
+
+    for (uint32_t i = 0; i < _max_samples; i++)
+    {
+        if (_records[i].ptr)
+            _insert_slot(_records[i].ptr, i);
+    }
+
+    __atomic_add_fetch(&_rebuild_sequence, 1, __ATOMIC_SEQ_CST);
+}
+
+/* Return -ln(u) in 16.16 fixed point, where u = r / 2^26 and 0 < r < 2^26 */
+static uint64_t _neg_log_q16(uint64_t r)
+{
+    uint64_t exponent = 63 - (uint64_t)__builtin_clzll(r);
+    uint64_t log2_q16 = exponent << 16;
+
+    // Compute the fraction of log2(r) bit by bit, by squaring the mantissa
+    // in 2.30 fixed point.
+    uint64_t mantissa = (r << 30) >> exponent;
+    for (uint64_t bit = 1ULL << 15; bit; bit >>= 1)
+    {
+        mantissa = (mantissa * mantissa) >> 30;
+        if (mantissa >= 2ULL << 30)
+        {
+            mantissa >>= 1;
+            log2_q16 |= bit;
+        }
+    }
+
+    return (((26ULL << 16) - log2_q16) * LN2_Q16) >> 16;
+}
+
+/* Draw the bytes until the next sample of a thread */
+static int64_t _next_sample_interval(oe_sgx_td_t* td)
+{
+    uint64_t x = td->heap_profile_random;
+    uint64_t r = 0;
+
+    // xorshift64
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    td->heap_profile_random = x;
+
+    if (!(r = x >> 38))
+        r = 1;
+
+    return (int64_t)((_sample_interval * _neg_log_q16(r)) >> 16) + 1;
+}
+
+/* Add the sample of a block to the table, or drop it if all the records are
+ * in use */
+static void _add_sample(void* ptr, const oe_heap_profile_sample_t* sample)
+{
+    uint32_t index = 0;
+
+    oe_spin_lock(&_lock);
+
+    if (!_num_free_records)
+    {
+        _num_dropped++;
+        goto done;
+    }
+
+    // Keep a quarter of the slots empty, tombstones included, so that
+    // probes stay short.
+    if ((_num_used_slots + 1) * 4 > _num_slots * 3)
+        _rebuild();
+
+    index = _free_records[--_num_free_records];
+    _records[index].ptr = (uintptr_t)ptr;
+    _records[index].sample = *sample;
+
+    _insert_slot((uintptr_t)ptr, index);
+    __atomic_add_fetch(&_num_samples, 1, __ATOMIC_RELAXED);
+
+done:
+    oe_spin_unlock(&_lock);
+}
+
+/* Record a sample. Called from oe_heap_profiler_record_allocation() so that
+ * the backtrace starts at its caller, oe_malloc() or a sibling */
+OE_NEVER_INLINE
+static void _sample(void* ptr, size_t size, void** start_frame)
+{
+    void* frames[OE_HEAP_PROFILE_MAX_FRAMES];
+    int num_frames =
+        oe_backtrace_impl(start_frame, frames, OE_HEAP_PROFILE_MAX_FRAMES);
+    oe_heap_profile_sample_t sample;
+
+    sample.size = size;
+    sample.num_frames = (uint64_t)num_frames;
+    for (int i = 0; i < num_frames; i++)
+        sample.frames[i] = (uint64_t)frames[i];
+
+    _add_sample(ptr, &sample);
+}
+
+OE_NEVER_INLINE
+void oe_heap_profiler_record_allocation(void* ptr, size_t size)
+{
+    oe_sgx_td_t* td = NULL;
+
+    if (!ptr)
+        return;
+
+    td = oe_sgx_get_td();
+
+    // Seed the intervals of the thread on its first allocation.
+    if (!td->heap_profile_random)
+    {
+        if (!(td->heap_profile_random = oe_rdrand()))
+            td->heap_profile_random = (uint64_t)td | 1;
+
+        td->heap_profile_bytes_left = _next_sample_interval(td);
+    }
+
+    if ((td->heap_profile_bytes_left -= (int64_t)size) > 0)
+        return;
+
+    td->heap_profile_bytes_left = _next_sample_interval(td);
+    _sample(ptr, size, __builtin_frame_address(0));
+}
+
+/* Drop the sample of a block and copy it to sample if it is not NULL. Return
+ * true if the block had one */
+static bool _remove_sample(void* ptr, oe_heap_profile_sample_t* sample)
+{
+    bool found = false;
+
+    uint64_t sequence = 0;
+    uint64_t index = 0;
+
+    if (!ptr || !__atomic_load_n(&_num_samples, __ATOMIC_RELAXED))
+        return false;
+
+    // Most blocks are not sampled. Do not take the lock for them unless the
+    // probe overlapped a rebuild.
+    sequence = __atomic_load_n(&_rebuild_sequence, __ATOMIC_ACQUIRE);
+    if (_find_slot((uintptr_t)ptr) == _num_slots && !(sequence & 1))
+    {
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&_rebuild_sequence, __ATOMIC_RELAXED) == sequence)
+            return false;
+    }
+
+    oe_spin_lock(&_lock);
+
+    if ((index = _find_slot((uintptr_t)ptr)) != _num_slots)
+    {
+        uint32_t record = _slots[index].record;
+
+        if (sample)
+            *sample = _records[record].sample;
+
+        __atomic_store_n(&_slots[index].key, TOMBSTONE_KEY, __ATOMIC_RELEASE);
+        _records[record].ptr = 0;
+        _free_records[_num_free_records++] = record;
+        __atomic_sub_fetch(&_num_samples, 1, __ATOMIC_RELAXED);
+        found = true;
+    }
+
+    oe_spin_unlock(&_lock);
+
+    return found;
+}
+
+void oe_heap_profiler_record_free(void* ptr)
+{
+    _remove_sample(ptr, NULL);
+}
+
+bool oe_heap_profiler_take_sample(void* ptr, oe_heap_profile_sample_t* sample)
+{
+    return _remove_sample(ptr, sample);
+}
+
+void oe_heap_profiler_restore_sample(
+    void* ptr,
+    const oe_heap_profile_sample_t* sample)
+{
+    if (ptr && sample)
+        _add_sample(ptr, sample);
+}
+
+oe_result_t oe_handle_start_heap_profiler(uint64_t arg_in)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_start_heap_profiler_args_t args = {0};
+    uint64_t num_slots = 1;
+    bool locked = false;
+
+    // The enclave did not consent to disclose its allocations to the host.
+    if (!oe_heap_profiler_allowed)
+        OE_RAISE_MSG(
+            OE_UNSUPPORTED,
+            "the enclave does not use OE_ALLOW_HEAP_PROFILER()",
+            NULL);
+
+    // Ensure that args lies outside the enclave.
+    if (!oe_is_outside_enclave(
+            (void*)arg_in, sizeof(oe_start_heap_profiler_args_t)))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Copy args to enclave memory to avoid TOCTOU issues.
+    args = *(oe_start_heap_profiler_args_t*)arg_in;
+
+    if (!args.sample_interval)
+        args.sample_interval = DEFAULT_SAMPLE_INTERVAL;
+
+    if (!args.max_samples)
+        args.max_samples = DEFAULT_MAX_SAMPLES;
+
+    if (args.sample_interval > OE_UINT32_MAX ||
+        args.max_samples > MAX_MAX_SAMPLES)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Twice as many slots as records, rounded up to a power of two.
+    while (num_slots < args.max_samples * 2)
+        num_slots <<= 1;
+
+    oe_spin_lock(&_lock);
+    locked = true;
+
+    if (oe_heap_profiler_enabled)
+        OE_RAISE(OE_ALREADY_INITIALIZED);
+
+    // The tables come from the allocator directly so that they are not
+    // sampled themselves.
+    _records = oe_allocator_calloc(args.max_samples, sizeof(record_t));
+    _free_records = oe_allocator_calloc(args.max_samples, sizeof(uint32_t));
+    _slots = oe_allocator_calloc(num_slots, sizeof(slot_t));
+
+    if (!_records || !_free_records || !_slots)
+    {
+        oe_allocator_free(_records);
+        oe_allocator_free(_free_records);
+        oe_allocator_free(_slots);
+        _records = NULL;
+        _free_records = NULL;
+        _slots = NULL;
+        OE_RAISE(OE_OUT_OF_MEMORY);
+    }
+
+    _sample_interval = args.sample_interval;
+    _max_samples = (uint32_t)args.max_samples;
+    _num_slots = num_slots;
+
+    for (uint32_t i = 0; i < _max_samples; i++)
+        _free_records[i] = _max_samples - 1 - i;
+    _num_free_records = _max_samples;
+
+    __atomic_store_n(&oe_heap_profiler_enabled, true, __ATOMIC_RELEASE);
+
+    result = OE_OK;
+
+done:
+    if (locked)
+        oe_spin_unlock(&_lock);
+
+    return result;
+}
+
+oe_result_t oe_handle_get_heap_profile(uint64_t arg_in)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_get_heap_profile_args_t* host_args = (oe_get_heap_profile_args_t*)arg_in;
+    oe_get_heap_profile_args_t args = {0};
+    uint64_t samples_size = 0;
+    uint64_t num_samples = 0;
+    bool locked = false;
+
+    // Ensure that args lies outside the enclave.
+    if (!oe_is_outside_enclave(host_args, sizeof(oe_get_heap_profile_args_t)))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Copy args to enclave memory to avoid TOCTOU issues.
+    args = *host_args;
+
+    if (!__atomic_load_n(&oe_heap_profiler_enabled, __ATOMIC_ACQUIRE))
+        OE_RAISE_NO_TRACE(OE_UNSUPPORTED);
+
+    OE_CHECK(oe_safe_mul_u64(
+        args.max_samples, sizeof(oe_heap_profile_sample_t), &samples_size));
+
+    if (samples_size && !oe_is_outside_enclave(args.samples, samples_size))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    oe_spin_lock(&_lock);
+    locked = true;
+
+    num_samples = _max_samples - _num_free_records;
+    host_args->num_samples = num_samples;
+    host_args->sample_interval = _sample_interval;
+    host_args->num_dropped = _num_dropped;
+
+    if (num_samples > args.max_samples)
+        OE_RAISE_NO_TRACE(OE_BUFFER_TOO_SMALL);
+
+    for (uint32_t i = 0, n = 0; i < _max_samples; i++)
+    {
+        if (_records[i].ptr)
+            args.samples[n++] = _records[i].sample;
+    }
+
+    result = OE_OK;
+
+done:
+    if (locked)
+        oe_spin_unlock(&_lock);
+
+    return result;
+}
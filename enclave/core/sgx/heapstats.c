@@ -0,0 +1,331 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/advanced/allocator.h>
+#include <openenclave/corelibc/string.h>
+#include <openenclave/enclave.h>
+#include <openenclave/internal/heapstats.h>
+#include <openenclave/internal/raise.h>
+#include <openenclave/internal/safemath.h>
+#include <openenclave/internal/sgx/td.h>
+#include <openenclave/internal/thread.h>
+#include "../calls.h"
+#include "td.h"
+
+/*
+**==============================================================================
+**
+** Heap statistics
+**
+**     The statistics are off until the host starts them at enclave
+**     creation, so that allocations do not pay for the usable size of their
+**     blocks otherwise.
+**
+**     Each thread counts its allocations in its oe_sgx_td_t, which lives as
+**     long as its TCS, so the counts of a TCS add up across ECALLs. Only the
+**     thread itself writes its counters, so counting takes no lock and no
+**     atomic operation. A thread joins the list of threads with statistics
+**     on its first allocation.
+**
+**     ECALLs are attributed their heap usage when they return, or when they
+**     make a nested ECALL, from the difference between the counters of the
+**     thread and those at the start of the ECALL. Only the innermost ECALL
+**     of a thread is attributed what the thread does. The counters of the
+**     ECALLs are shared, so they are added atomically, but only once per
+**     call.
+**
+**==============================================================================
+*/
+
+bool oe_heap_statistics_enabled;
+bool oe_heap_statistics_ecalls_enabled;
+
+/* Threads with statistics */
+static oe_sgx_td_t* _threads;
+static oe_spinlock_t _lock = OE_SPINLOCK_INITIALIZER;
+
+/* Counters of the ECALLs, indexed by function id. Allocated on the first
+ * attribution */
+static oe_heap_ecall_counters_t* _ecalls;
+
+static oe_thread_heap_statistics_t* _get_statistics(void)
+{
+    oe_sgx_td_t* td = oe_sgx_get_td();
+    oe_thread_heap_statistics_t* statistics = &td->heap_statistics;
+
+    /* Note: the td page is zero-filled when the enclave is created */
+    if (!statistics->registered)
+    {
+        oe_spin_lock(&_lock);
+        statistics->next = _threads;
+        _threads = td;
+        oe_spin_unlock(&_lock);
+        statistics->registered = 1;
+    }
+
+    return statistics;
+}
+
+static oe_heap_ecall_counters_t* _get_ecall_counters(uint64_t function_id)
+{
+    oe_heap_ecall_counters_t* ecalls = NULL;
+
+    if (function_id >= oe_ecalls_table_size)
+        return NULL;
+
+    if (!(ecalls = __atomic_load_n(&_ecalls, __ATOMIC_ACQUIRE)))
+    {
+        oe_spin_lock(&_lock);
+
+        // The table comes from the allocator directly so that it is not
+        // counted itself.
+        if (!(ecalls = _ecalls))
+        {
+            ecalls = oe_allocator_calloc(
+                oe_ecalls_table_size, sizeof(oe_heap_ecall_counters_t));
+            __atomic_store_n(&_ecalls, ecalls, __ATOMIC_RELEASE);
+        }
+
+        oe_spin_unlock(&_lock);
+    }
+
+    return ecalls ? &ecalls[function_id] : NULL;
+}
+
+static void _start_scope(
+    const oe_thread_heap_statistics_t* statistics,
+    oe_heap_ecall_scope_t* scope)
+{
+    scope->allocations = statistics->allocations;
+    scope->frees = statistics->frees;
+    scope->bytes_allocated = statistics->bytes_allocated;
+    scope->bytes_freed = statistics->bytes_freed;
+}
+
+/* Add the heap usage of the thread since the start of the scope to the
+ * counters of its ECALL */
+static void _attribute(
+    const oe_thread_heap_statistics_t* statistics,
+    oe_heap_ecall_scope_t* scope,
+    bool returned)
+{
+    oe_heap_ecall_counters_t* counters =
+        _get_ecall_counters(scope->function_id);
+
+    if (counters)
+    {
+        if (returned)
+            __atomic_add_fetch(&counters->calls, 1, __ATOMIC_RELAXED);
+
+        if (statistics->allocations != scope->allocations)
+        {
+            __atomic_add_fetch(
+                &counters->allocations,
+                statistics->allocations - scope->allocations,
+                __ATOMIC_RELAXED);
+            __atomic_add_fetch(
+                &counters->bytes_allocated,
+                statistics->bytes_allocated - scope->bytes_allocated,
+                __ATOMIC_RELAXED);
+        }
+
+        if (statistics->frees != scope->frees)
+        {
+            __atomic_add_fetch(
+                &counters->frees,
+                statistics->frees - scope->frees,
+                __ATOMIC_RELAXED);
+            __atomic_add_fetch(
+                &counters->bytes_freed,
+                statistics->bytes_freed - scope->bytes_freed,
+                __ATOMIC_RELAXED);
+        }
+    }
+
+    _start_scope(statistics, scope);
+}
+
+void oe_heap_statistics_record_allocation(size_t size)
+{
+    oe_thread_heap_statistics_t* statistics = _get_statistics();
+    int64_t in_flight;
+
+    statistics->allocations++;
+    statistics->bytes_allocated += size;
+
+    // The bytes in flight of a thread that frees the blocks of other threads
+    // can be negative.
+    in_flight =
+        (int64_t)(statistics->bytes_allocated - statistics->bytes_freed);
+    if (in_flight > (int64_t)statistics->peak_bytes_in_flight)
+        statistics->peak_bytes_in_flight = (uint64_t)in_flight;
+}
+
+void oe_heap_statistics_record_free(size_t size)
+{
+    oe_thread_heap_statistics_t* statistics = _get_statistics();
+
+    statistics->frees++;
+    statistics->bytes_freed += size;
+}
+
+void oe_heap_statistics_enter_ecall(
+    oe_heap_ecall_scope_t* scope,
+    uint64_t function_id)
+{
+    oe_thread_heap_statistics_t* statistics = _get_statistics();
+
+    // The outer ECALL is not attributed what the nested one does.
+    if (statistics->ecall_scope)
+        _attribute(statistics, statistics->ecall_scope, false);
+
+    scope->function_id = function_id;
+    scope->outer = statistics->ecall_scope;
+    _start_scope(statistics, scope);
+
+    statistics->ecall_scope = scope;
+    statistics->ecall_function_id = function_id + 1;
+}
+
+void oe_heap_statistics_exit_ecall(oe_heap_ecall_scope_t* scope)
+{
+    oe_thread_heap_statistics_t* statistics = _get_statistics();
+    oe_heap_ecall_scope_t* outer = scope->outer;
+
+    _attribute(statistics, scope, true);
+
+    statistics->ecall_scope = outer;
+    statistics->ecall_function_id = 0;
+
+    if (outer)
+    {
+        _start_scope(statistics, outer);
+        statistics->ecall_function_id = outer->function_id + 1;
+    }
+}
+
+oe_result_t oe_handle_start_heap_statistics(uint64_t arg_in)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_start_heap_statistics_args_t args = {0};
+    bool locked = false;
+
+    // Ensure that args lies outside the enclave.
+    if (!oe_is_outside_enclave(
+            (void*)arg_in, sizeof(oe_start_heap_statistics_args_t)))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Copy args to enclave memory to avoid TOCTOU issues.
+    args = *(oe_start_heap_statistics_args_t*)arg_in;
+
+    oe_spin_lock(&_lock);
+    locked = true;
+
+    if (oe_heap_statistics_enabled)
+        OE_RAISE(OE_ALREADY_INITIALIZED);
+
+    if (args.attribute_ecalls)
+        __atomic_store_n(
+            &oe_heap_statistics_ecalls_enabled, true, __ATOMIC_RELEASE);
+
+    __atomic_store_n(&oe_heap_statistics_enabled, true, __ATOMIC_RELEASE);
+
+    result = OE_OK;
+
+done:
+    if (locked)
+        oe_spin_unlock(&_lock);
+
+    return result;
+}
+
+oe_result_t oe_handle_get_heap_statistics(uint64_t arg_in)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_get_heap_statistics_args_t* host_args =
+        (oe_get_heap_statistics_args_t*)arg_in;
+    oe_get_heap_statistics_args_t args = {0};
+    oe_heap_ecall_counters_t* ecalls = NULL;
+    uint64_t threads_size = 0;
+    uint64_t ecalls_size = 0;
+    uint64_t num_threads = 0;
+    uint64_t num_ecalls = 0;
+    bool locked = false;
+
+    // Ensure that args lies outside the enclave.
+    if (!oe_is_outside_enclave(
+            host_args, sizeof(oe_get_heap_statistics_args_t)))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Copy args to enclave memory to avoid TOCTOU issues.
+    args = *host_args;
+
+    OE_CHECK(oe_safe_mul_u64(
+        args.max_threads, sizeof(oe_heap_thread_counters_t), &threads_size));
+    OE_CHECK(oe_safe_mul_u64(
+        args.max_ecalls, sizeof(oe_heap_ecall_counters_t), &ecalls_size));
+
+    if ((threads_size && !oe_is_outside_enclave(args.threads, threads_size)) ||
+        (ecalls_size && !oe_is_outside_enclave(args.ecalls, ecalls_size)))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    oe_spin_lock(&_lock);
+    locked = true;
+
+    for (oe_sgx_td_t* td = _threads; td; td = td->heap_statistics.next)
+        num_threads++;
+
+    if ((ecalls = _ecalls))
+        num_ecalls = oe_ecalls_table_size;
+
+    host_args->num_threads = num_threads;
+    host_args->num_ecalls = num_ecalls;
+
+    if (num_threads > args.max_threads || num_ecalls > args.max_ecalls)
+        OE_RAISE_NO_TRACE(OE_BUFFER_TOO_SMALL);
+
+    // The counters are read while the threads update them, so they are not
+    // a consistent snapshot.
+    num_threads = 0;
+    for (oe_sgx_td_t* td = _threads; td; td = td->heap_statistics.next)
+    {
+        const oe_thread_heap_statistics_t* from = &td->heap_statistics;
+        oe_heap_thread_counters_t* to = &args.threads[num_threads++];
+
+        to->tcs = (uint64_t)td_to_tcs(td);
+        to->ecall_function_id =
+            __atomic_load_n(&from->ecall_function_id, __ATOMIC_RELAXED);
+        to->allocations =
+            __atomic_load_n(&from->allocations, __ATOMIC_RELAXED);
+        to->frees = __atomic_load_n(&from->frees, __ATOMIC_RELAXED);
+        to->bytes_allocated =
+            __atomic_load_n(&from->bytes_allocated, __ATOMIC_RELAXED);
+        to->bytes_freed =
+            __atomic_load_n(&from->bytes_freed, __ATOMIC_RELAXED);
+        to->peak_bytes_in_flight =
+            __atomic_load_n(&from->peak_bytes_in_flight, __ATOMIC_RELAXED);
+    }
+
+    for (uint64_t i = 0; i < num_ecalls; i++)
+    {
+        const oe_heap_ecall_counters_t* from = &ecalls[i];
+        oe_heap_ecall_counters_t* to = &args.ecalls[i];
+
+        to->calls = __atomic_load_n(&from->calls, __ATOMIC_RELAXED);
+        to->allocations =
+            __atomic_load_n(&from->allocations, __ATOMIC_RELAXED);
+        to->frees = __atomic_load_n(&from->frees, __ATOMIC_RELAXED);
+        to->bytes_allocated =
+            __atomic_load_n(&from->bytes_allocated, __ATOMIC_RELAXED);
+        to->bytes_freed =
+            __atomic_load_n(&from->bytes_freed, __ATOMIC_RELAXED);
+    }
+
+    result = OE_OK;
+
+done:
+    if (locked)
+        oe_spin_unlock(&_lock);
+
+    return result;
+}
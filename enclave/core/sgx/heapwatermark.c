@@ -0,0 +1,189 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/calls.h>
+#include <openenclave/internal/globals.h>
+#include <openenclave/internal/heapwatermark.h>
+#include <openenclave/internal/malloc.h>
+#include <openenclave/internal/raise.h>
+#include <openenclave/internal/thread.h>
+
+/*
+**==============================================================================
+**
+** Heap watermarks
+**
+**     The allocator reports its heap usage when it grows or shrinks its part
+**     of the heap, which is rare compared to allocations. The report is only
+**     compared with the bounds of the current level, the range of usage that
+**     crosses no watermark. When the usage leaves it, the level is updated
+**     and a notification is left pending.
+**
+**     The allocator holds its lock when it reports, and the caller of the
+**     allocation may hold other locks, such as those of oecore, so the
+**     callback cannot be called from allocations. The pending notifications
+**     are delivered at safe points instead: when an ECALL of the application
+**     returns, when a pthread of the thread pool returns, and from
+**     oe_poll_heap_watermarks(). They are delivered one crossing at a time,
+**     so that the callback may allocate and free memory.
+**
+**==============================================================================
+*/
+
+bool oe_heap_watermark_pending;
+
+static oe_spinlock_t _lock = OE_SPINLOCK_INITIALIZER;
+
+/* Watermarks, by increasing percent, and their thresholds in bytes */
+static uint32_t _percents[OE_MAX_HEAP_WATERMARKS];
+static size_t _thresholds[OE_MAX_HEAP_WATERMARKS];
+static size_t _num_watermarks;
+
+static oe_heap_watermark_callback_t _callback;
+static void* _callback_arg;
+
+/* Heap usage last reported by the allocator */
+static size_t _heap_used;
+
+/* Number of watermarks that the heap usage reached, and number of them that
+ * were notified as exceeded */
+static size_t _level;
+static size_t _notified_level;
+
+/* The heap usage stays at the current level while it is in [_low, _high) */
+static size_t _low;
+static size_t _high = OE_SIZE_MAX;
+
+/* Called with _lock held */
+static void _update_level(void)
+{
+    size_t level = 0;
+
+    while (level < _num_watermarks && _heap_used >= _thresholds[level])
+        level++;
+
+    _level = level;
+    __atomic_store_n(
+        &_low, level ? _thresholds[level - 1] : 0, __ATOMIC_RELAXED);
+    __atomic_store_n(
+        &_high,
+        level < _num_watermarks ? _thresholds[level] : OE_SIZE_MAX,
+        __ATOMIC_RELAXED);
+
+    if (_level != _notified_level)
+        __atomic_store_n(&oe_heap_watermark_pending, true, __ATOMIC_RELEASE);
+}
+
+void oe_heap_watermark_update(size_t heap_used)
+{
+    __atomic_store_n(&_heap_used, heap_used, __ATOMIC_RELAXED);
+
+    if (heap_used < __atomic_load_n(&_low, __ATOMIC_RELAXED) ||
+        heap_used >= __atomic_load_n(&_high, __ATOMIC_RELAXED))
+    {
+        oe_spin_lock(&_lock);
+        _update_level();
+        oe_spin_unlock(&_lock);
+    }
+}
+
+void oe_heap_watermark_notify(void)
+{
+    const size_t heap_size = __oe_get_heap_size();
+
+    if (!__atomic_exchange_n(
+            &oe_heap_watermark_pending, false, __ATOMIC_ACQUIRE))
+        return;
+
+    // Crossings made while the callback runs, maybe by the callback itself,
+    // are delivered by this loop too.
+    for (;;)
+    {
+        oe_heap_watermark_callback_t callback;
+        void* arg;
+        uint32_t percent;
+        bool exceeded;
+
+        oe_spin_lock(&_lock);
+
+        if (_notified_level == _level)
+        {
+            oe_spin_unlock(&_lock);
+            break;
+        }
+
+        exceeded = _notified_level < _level;
+        percent = exceeded ? _percents[_notified_level++]
+                           : _percents[--_notified_level];
+        callback = _callback;
+        arg = _callback_arg;
+
+        oe_spin_unlock(&_lock);
+
+        if (callback)
+            callback(
+                percent,
+                exceeded,
+                __atomic_load_n(&_heap_used, __ATOMIC_RELAXED),
+                heap_size,
+                arg);
+
+        // The host may not take the notification, for instance before the
+        // enclave is initialized. That does not affect the enclave.
+        oe_ocall(
+            OE_OCALL_HEAP_WATERMARK,
+            oe_make_heap_watermark_arg(percent, exceeded),
+            NULL);
+    }
+}
+
+void oe_poll_heap_watermarks(void)
+{
+    if (oe_heap_watermark_pending)
+        oe_heap_watermark_notify();
+}
+
+oe_result_t oe_set_heap_watermarks(
+    const uint32_t* percents,
+    size_t num_percents,
+    oe_heap_watermark_callback_t callback,
+    void* arg)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    const size_t heap_size = __oe_get_heap_size();
+
+    if (num_percents > OE_MAX_HEAP_WATERMARKS || (num_percents && !percents))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    for (size_t i = 0; i < num_percents; i++)
+    {
+        if (percents[i] == 0 || percents[i] > 100 ||
+            (i && percents[i] <= percents[i - 1]))
+            OE_RAISE(OE_INVALID_PARAMETER);
+    }
+
+    oe_spin_lock(&_lock);
+
+    for (size_t i = 0; i < num_percents; i++)
+    {
+        _percents[i] = percents[i];
+        _thresholds[i] = heap_size / 100 * percents[i] +
+                         heap_size % 100 * percents[i] / 100;
+    }
+
+    _num_watermarks = num_percents;
+    _callback = callback;
+    _callback_arg = arg;
+
+    // Notify the new watermarks that the heap usage already exceeds.
+    _notified_level = 0;
+    _update_level();
+
+    oe_spin_unlock(&_lock);
+
+    result = OE_OK;
+
+done:
+    return result;
+}
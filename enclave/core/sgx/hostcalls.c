@@ -1,12 +1,64 @@
 // Copyright (c) Open Enclave SDK contributors.
 // Licensed under the MIT License.
 
+#include <openenclave/corelibc/string.h>
 #include <openenclave/edger8r/enclave.h>
 #include <openenclave/enclave.h>
+#include <openenclave/internal/raise.h>
 #include <openenclave/internal/sgx/ecall_context.h>
 #include <openenclave/internal/sgx/td.h>
+#include <openenclave/internal/thread.h>
 #include "td.h"
 
+/*
+**==============================================================================
+**
+** OCALL buffer sizing
+**
+**     The host passes a buffer with each ECALL for the parameters of the
+**     OCALLs made by the ECALL. Larger OCALLs allocate their buffer from the
+**     host instead, which costs two more OCALLs. The sizes of these misses
+**     are counted in a histogram of powers of two. Once a size misses often
+**     enough, the enclave asks the host to grow the buffers to that size
+**     through the ecall context. The host applies it at the next outermost
+**     ECALL of each thread.
+**
+**     Each thread counts its allocations and misses in its td, so that the
+**     OCALLs of different threads do not contend on shared counters.
+**     oe_get_ocall_buffer_statistics() sums the counts of the threads.
+**
+**==============================================================================
+*/
+
+/* The number of misses of a size before the buffers are grown to it */
+#define OCALL_BUFFER_GROWTH_MISSES 4
+
+static uint64_t _requested_buffer_size;
+static uint64_t _miss_histogram[OE_OCALL_BUFFER_HISTOGRAM_SIZE];
+
+/* Threads with OCALL buffer counters */
+static oe_sgx_td_t* _threads;
+static oe_spinlock_t _lock = OE_SPINLOCK_INITIALIZER;
+
+static oe_thread_ocall_buffer_statistics_t* _get_statistics(void)
+{
+    oe_sgx_td_t* td = oe_sgx_get_td();
+    oe_thread_ocall_buffer_statistics_t* statistics =
+        &td->ocall_buffer_statistics;
+
+    /* Note: the td page is zero-filled when the enclave is created */
+    if (!statistics->registered)
+    {
+        oe_spin_lock(&_lock);
+        statistics->next = _threads;
+        _threads = td;
+        oe_spin_unlock(&_lock);
+        statistics->registered = 1;
+    }
+
+    return statistics;
+}
+
 /**
  * Validate and fetch this thread's ecall context.
  */
@@ -47,9 +99,54 @@ void* oe_ecall_context_get_ocall_buffer(uint64_t size)
     return NULL;
 }
 
+static size_t _get_histogram_bucket(uint64_t size)
+{
+    size_t bucket = 0;
+
+    while (bucket < OE_OCALL_BUFFER_HISTOGRAM_SIZE - 1 &&
+           (1ULL << bucket) < size)
+        bucket++;
+
+    return bucket;
+}
+
+/* Record a miss and ask the host for larger buffers if the size keeps
+ * missing */
+static void _record_miss(uint64_t size)
+{
+    size_t bucket = _get_histogram_bucket(size);
+    uint64_t count = 0;
+    uint64_t requested = 0;
+    oe_ecall_context_t* ecall_context = NULL;
+
+    _get_statistics()->misses++;
+    count = __atomic_add_fetch(&_miss_histogram[bucket], 1, __ATOMIC_RELAXED);
+
+    requested = __atomic_load_n(&_requested_buffer_size, __ATOMIC_RELAXED);
+    while (count >= OCALL_BUFFER_GROWTH_MISSES &&
+           (1ULL << bucket) > requested &&
+           !__atomic_compare_exchange_n(
+               &_requested_buffer_size,
+               &requested,
+               1ULL << bucket,
+               true,
+               __ATOMIC_RELAXED,
+               __ATOMIC_RELAXED))
+        ;
+
+    // The host caps the size it grows the buffers to, so the value written
+    // to host memory needs no validation.
+    requested = __atomic_load_n(&_requested_buffer_size, __ATOMIC_RELAXED);
+    if ((ecall_context = _get_ecall_context()) != NULL &&
+        requested > ecall_context->ocall_buffer_size)
+        ecall_context->ocall_buffer_requested_size = requested;
+}
+
 // Function used by oeedger8r for allocating ocall buffers.
 void* oe_allocate_ocall_buffer(size_t size)
 {
+    _get_statistics()->allocations++;
+
     // Fetch the ecall context's ocall buffer if it is equal to or larger than
     // given size. Use it if available.
     void* buffer = oe_ecall_context_get_ocall_buffer(size);
@@ -58,6 +155,8 @@ void* oe_allocate_ocall_buffer(size_t size)
         return buffer;
     }
 
+    _record_miss(size);
+
     // Perform host allocation by making an ocall.
     return oe_host_malloc(size);
 }
@@ -83,6 +182,45 @@ void oe_free_ocall_buffer(void* buffer)
     oe_host_free(buffer);
 }
 
+oe_result_t oe_get_ocall_buffer_statistics(
+    oe_ocall_buffer_statistics_t* statistics)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_ecall_context_t* ecall_context = NULL;
+
+    if (!statistics)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    memset(statistics, 0, sizeof(*statistics));
+
+    // The counts of other threads may be being updated, which only makes
+    // the sum slightly stale.
+    oe_spin_lock(&_lock);
+    for (oe_sgx_td_t* td = _threads; td; td = td->ocall_buffer_statistics.next)
+    {
+        statistics->num_allocations += __atomic_load_n(
+            &td->ocall_buffer_statistics.allocations, __ATOMIC_RELAXED);
+        statistics->num_misses += __atomic_load_n(
+            &td->ocall_buffer_statistics.misses, __ATOMIC_RELAXED);
+    }
+    oe_spin_unlock(&_lock);
+
+    statistics->requested_buffer_size =
+        __atomic_load_n(&_requested_buffer_size, __ATOMIC_RELAXED);
+
+    if ((ecall_context = _get_ecall_context()) != NULL)
+        statistics->buffer_size = ecall_context->ocall_buffer_size;
+
+    for (size_t i = 0; i < OE_OCALL_BUFFER_HISTOGRAM_SIZE; i++)
+        statistics->miss_histogram[i] =
+            __atomic_load_n(&_miss_histogram[i], __ATOMIC_RELAXED);
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
 void* oe_allocate_arena(size_t capacity)
 {
     return oe_host_malloc(capacity);
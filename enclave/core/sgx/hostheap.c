@@ -0,0 +1,473 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include "../hostheap.h"
+#include <openenclave/corelibc/stdlib.h>
+#include <openenclave/corelibc/string.h>
+#include <openenclave/edger8r/common.h>
+#include <openenclave/enclave.h>
+#include <openenclave/internal/calls.h>
+#include <openenclave/internal/raise.h>
+#include <openenclave/internal/thread.h>
+#include <openenclave/internal/utils.h>
+
+/*
+**==============================================================================
+**
+** Host heap
+**
+**     oe_host_malloc() and oe_host_free() make an OCALL each. When the host
+**     donates a region of its memory at enclave creation (see the
+**     OE_ENCLAVE_SETTING_SHARED_MEMORY setting), small host allocations are
+**     served from that region instead, without leaving the enclave.
+**
+**     The regions are split into slabs. Each slab holds blocks of one size
+**     class, from 16 bytes to 4 KB. Larger allocations are still made with an
+**     OCALL. All the bookkeeping lives in enclave memory, so the host cannot
+**     make the enclave write outside of the regions by tampering with them.
+**     When the regions are used up, another region is allocated from the
+**     host with an OCALL, up to a max size.
+**
+**     The host cannot free blocks of the regions with free(). Memory whose
+**     ownership passes to the host is allocated with
+**     oe_host_malloc_for_host() instead.
+**
+**==============================================================================
+*/
+
+#define SLAB_SIZE (64 * 1024)
+#define MIN_BLOCK_SIZE OE_EDGER8R_BUFFER_ALIGNMENT
+#define NUM_SIZE_CLASSES 9
+#define MAX_BLOCK_SIZE (MIN_BLOCK_SIZE << (NUM_SIZE_CLASSES - 1))
+#define MAX_BLOCKS_PER_SLAB (SLAB_SIZE / MIN_BLOCK_SIZE)
+
+OE_STATIC_ASSERT(MAX_BLOCK_SIZE == 4096);
+
+typedef struct _slab
+{
+    uint8_t* base;
+
+    /* Next and previous slab of the partial or free list */
+    struct _slab* next;
+    struct _slab* prev;
+
+    uint32_t size_class;
+    uint32_t num_blocks;
+    uint32_t num_free;
+
+    /* Whether the slab is on the partial list of its size class */
+    bool is_partial;
+
+    /* One bit per block, set if the block is free */
+    uint64_t free_bits[MAX_BLOCKS_PER_SLAB / 64];
+} slab_t;
+
+typedef struct _region
+{
+    uint8_t* base;
+    size_t size;
+
+    /* The slabs carved out of the region so far */
+    size_t num_slabs;
+    size_t num_carved;
+    slab_t** slabs;
+
+    struct _region* next;
+} region_t;
+
+static oe_spinlock_t _lock = OE_SPINLOCK_INITIALIZER;
+static region_t* _regions;
+static size_t _region_size;
+static size_t _max_size;
+static size_t _total_size;
+static bool _is_refilling;
+
+/* Regions returned to the host at teardown. Only their ranges are kept */
+static region_t* _torn_down_regions;
+
+/* Slabs with free blocks, by size class */
+static slab_t* _partial_slabs[NUM_SIZE_CLASSES];
+
+/* Slabs without allocated blocks, which can take any size class */
+static slab_t* _free_slabs;
+
+static void _push(slab_t** list, slab_t* slab)
+{
+    slab->prev = NULL;
+    slab->next = *list;
+    if (*list)
+        (*list)->prev = slab;
+    *list = slab;
+}
+
+static void _remove(slab_t** list, slab_t* slab)
+{
+    if (slab->prev)
+        slab->prev->next = slab->next;
+    else
+        *list = slab->next;
+
+    if (slab->next)
+        slab->next->prev = slab->prev;
+
+    slab->next = NULL;
+    slab->prev = NULL;
+}
+
+static size_t _get_size_class(size_t size)
+{
+    size_t size_class = 0;
+
+    while ((size_t)MIN_BLOCK_SIZE << size_class < size)
+        size_class++;
+
+    return size_class;
+}
+
+static void _format_slab(slab_t* slab, size_t size_class)
+{
+    size_t block_size = (size_t)MIN_BLOCK_SIZE << size_class;
+    size_t num_blocks = SLAB_SIZE / block_size;
+
+    slab->size_class = (uint32_t)size_class;
+    slab->num_blocks = (uint32_t)num_blocks;
+    slab->num_free = (uint32_t)num_blocks;
+
+    memset(slab->free_bits, 0, sizeof(slab->free_bits));
+    for (size_t i = 0; i < num_blocks / 64; i++)
+        slab->free_bits[i] = OE_UINT64_MAX;
+    if (num_blocks % 64)
+        slab->free_bits[num_blocks / 64] = (1ULL << (num_blocks % 64)) - 1;
+}
+
+static region_t* _find_region(region_t* regions, const void* ptr)
+{
+    for (region_t* region = regions; region; region = region->next)
+    {
+        if ((const uint8_t*)ptr >= region->base &&
+            (const uint8_t*)ptr < region->base + region->size)
+            return region;
+    }
+
+    return NULL;
+}
+
+/* Get a slab of the size class with a free block. Called with the lock */
+static slab_t* _get_slab(size_t size_class)
+{
+    slab_t* slab = _partial_slabs[size_class];
+
+    if (slab)
+        return slab;
+
+    if ((slab = _free_slabs) != NULL)
+    {
+        _remove(&_free_slabs, slab);
+    }
+    else
+    {
+        // Carve a new slab out of the first region that has room.
+        region_t* region = _regions;
+        while (region && region->num_carved == region->num_slabs)
+            region = region->next;
+
+        if (!region)
+            return NULL;
+
+        if (!(slab = (slab_t*)oe_calloc(1, sizeof(slab_t))))
+            return NULL;
+
+        slab->base = region->base + region->num_carved * SLAB_SIZE;
+        region->slabs[region->num_carved++] = slab;
+    }
+
+    _format_slab(slab, size_class);
+    _push(&_partial_slabs[size_class], slab);
+    slab->is_partial = true;
+
+    return slab;
+}
+
+/* Add a region to the heap. Called with the lock */
+static oe_result_t _add_region(void* base, size_t size)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    region_t* region = NULL;
+
+    if (!(region = (region_t*)oe_calloc(1, sizeof(region_t))))
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    // The tail of the region that does not make a whole slab is not used,
+    // and pointers into it are not blocks of the region.
+    region->base = (uint8_t*)base;
+    region->num_slabs = size / SLAB_SIZE;
+    region->size = region->num_slabs * SLAB_SIZE;
+
+    if (!(region->slabs =
+              (slab_t**)oe_calloc(region->num_slabs, sizeof(slab_t*))))
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    region->next = _regions;
+    _regions = region;
+    _total_size += size;
+    region = NULL;
+
+    result = OE_OK;
+
+done:
+    if (region)
+        oe_free(region);
+
+    return result;
+}
+
+/* Allocate another region from the host. Called with the lock, which is
+ * released during the OCALL. Only one thread refills at a time; the others
+ * fall back to OCALLs meanwhile */
+static bool _refill(void)
+{
+    void* base = NULL;
+    bool added = false;
+
+    if (_is_refilling || _region_size > _max_size - _total_size)
+        return false;
+
+    _is_refilling = true;
+    oe_spin_unlock(&_lock);
+
+    base = oe_host_malloc_for_host(_region_size);
+
+    oe_spin_lock(&_lock);
+    _is_refilling = false;
+
+    if (base && _add_region(base, _region_size) == OE_OK)
+        added = true;
+    else if (base)
+        oe_ocall(OE_OCALL_FREE, (uint64_t)base, NULL);
+
+    return added;
+}
+
+oe_result_t oe_host_heap_initialize(
+    void* region,
+    size_t region_size,
+    size_t max_size)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    bool locked = false;
+
+    if (!region || region_size < SLAB_SIZE || max_size < region_size)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Ensure that the region lies outside the enclave and that the blocks
+    // are aligned.
+    if (!oe_is_outside_enclave(region, region_size) ||
+        (uint64_t)region % MIN_BLOCK_SIZE)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    oe_spin_lock(&_lock);
+    locked = true;
+
+    if (_regions)
+        OE_RAISE(OE_ALREADY_INITIALIZED);
+
+    _region_size = region_size;
+    _max_size = max_size;
+
+    OE_CHECK(_add_region(region, region_size));
+
+    result = OE_OK;
+
+done:
+    if (locked)
+        oe_spin_unlock(&_lock);
+
+    return result;
+}
+
+void* oe_host_heap_malloc(size_t size)
+{
+    void* ptr = NULL;
+    size_t size_class = 0;
+    slab_t* slab = NULL;
+
+    // Reading _regions without the lock is fine: it is set once, before
+    // the enclave serves regular ECALLs.
+    if (!_regions || size > MAX_BLOCK_SIZE)
+        return NULL;
+
+    size_class = _get_size_class(size);
+
+    oe_spin_lock(&_lock);
+
+    if (!(slab = _get_slab(size_class)))
+    {
+        if (_refill())
+            slab = _get_slab(size_class);
+    }
+
+    if (slab)
+    {
+        size_t i = 0;
+
+        while (slab->free_bits[i] == 0)
+            i++;
+
+        size_t bit = (size_t)__builtin_ctzll(slab->free_bits[i]);
+        slab->free_bits[i] &= ~(1ULL << bit);
+
+        ptr = slab->base + (i * 64 + bit) * ((size_t)MIN_BLOCK_SIZE
+                                             << size_class);
+
+        if (--slab->num_free == 0)
+        {
+            _remove(&_partial_slabs[size_class], slab);
+            slab->is_partial = false;
+        }
+    }
+
+    oe_spin_unlock(&_lock);
+
+    return ptr;
+}
+
+/* Find the slab of a block and the index of the block. Abort if ptr is in a
+ * region but is not a block. Called with the lock */
+static slab_t* _find_block(const void* ptr, size_t* index)
+{
+    region_t* region = _find_region(_regions, ptr);
+    slab_t* slab = NULL;
+    size_t offset = 0;
+    size_t block_size = 0;
+
+    if (!region)
+        return NULL;
+
+    offset = (size_t)((const uint8_t*)ptr - region->base);
+    if (!(slab = region->slabs[offset / SLAB_SIZE]))
+        oe_abort();
+
+    offset %= SLAB_SIZE;
+    block_size = (size_t)MIN_BLOCK_SIZE << slab->size_class;
+    if (offset % block_size || offset / block_size >= slab->num_blocks)
+        oe_abort();
+
+    *index = offset / block_size;
+    return slab;
+}
+
+bool oe_host_heap_free(void* ptr)
+{
+    slab_t* slab = NULL;
+    size_t index = 0;
+
+    // Once the regions are returned to the host, freeing their blocks with an
+    // OCALL would corrupt the host heap. The enclave is terminating, so drop
+    // these frees. Other pointers are still freed with an OCALL.
+    if (_torn_down_regions)
+    {
+        bool found = false;
+
+        oe_spin_lock(&_lock);
+        found = _find_region(_torn_down_regions, ptr) != NULL;
+        oe_spin_unlock(&_lock);
+
+        return found;
+    }
+
+    if (!_regions)
+        return false;
+
+    oe_spin_lock(&_lock);
+
+    if (!(slab = _find_block(ptr, &index)))
+    {
+        oe_spin_unlock(&_lock);
+        return false;
+    }
+
+    // Abort on double free.
+    uint64_t mask = 1ULL << (index % 64);
+    if (slab->free_bits[index / 64] & mask)
+        oe_abort();
+
+    slab->free_bits[index / 64] |= mask;
+    slab->num_free++;
+
+    if (!slab->is_partial)
+    {
+        _push(&_partial_slabs[slab->size_class], slab);
+        slab->is_partial = true;
+    }
+
+    // Let an empty slab take another size class.
+    if (slab->num_free == slab->num_blocks)
+    {
+        _remove(&_partial_slabs[slab->size_class], slab);
+        slab->is_partial = false;
+        _push(&_free_slabs, slab);
+    }
+
+    oe_spin_unlock(&_lock);
+
+    return true;
+}
+
+size_t oe_host_heap_block_size(const void* ptr)
+{
+    slab_t* slab = NULL;
+    size_t index = 0;
+    size_t size = 0;
+
+    if (!_regions)
+        return 0;
+
+    oe_spin_lock(&_lock);
+
+    if ((slab = _find_block(ptr, &index)) != NULL)
+        size = (size_t)MIN_BLOCK_SIZE << slab->size_class;
+
+    oe_spin_unlock(&_lock);
+
+    return size;
+}
+
+void oe_host_heap_teardown(void)
+{
+    region_t* region = NULL;
+    region_t* torn_down = NULL;
+
+    oe_spin_lock(&_lock);
+    region = _regions;
+    _regions = NULL;
+    oe_spin_unlock(&_lock);
+
+    while (region)
+    {
+        region_t* next = region->next;
+
+        for (size_t i = 0; i < region->num_carved; i++)
+            oe_free(region->slabs[i]);
+
+        oe_free(region->slabs);
+        region->slabs = NULL;
+        region->num_slabs = 0;
+        region->num_carved = 0;
+
+        // Keep the range of the region before the host can free it, so that
+        // frees of its blocks made from now on are dropped.
+        region->next = torn_down;
+        torn_down = region;
+
+        oe_spin_lock(&_lock);
+        _torn_down_regions = torn_down;
+        oe_spin_unlock(&_lock);
+
+        oe_ocall(OE_OCALL_FREE, (uint64_t)region->base, NULL);
+        region = next;
+    }
+
+    memset(_partial_slabs, 0, sizeof(_partial_slabs));
+    _free_slabs = NULL;
+    _total_size = 0;
+}
@@ -8,18 +8,35 @@
 #include <openenclave/host.h>
 #endif
 
-/* Set the spinlock value to 1 and return the old value */
-static unsigned int _spin_set_locked(oe_spinlock_t* spinlock)
+/*
+**==============================================================================
+**
+** Ticket spinlock
+**
+**     A test-and-set spinlock makes all the waiting threads write its cache
+**     line, and hands it to whichever thread wins the race. So the spinlock is
+**     a ticket lock instead. The high 16 bits of oe_spinlock_t hold the next
+**     ticket and the low 16 bits the ticket of the owner. A thread takes a
+**     ticket and waits for the owner to reach it, so the waiters only read
+**     the spinlock and obtain it in FIFO order. Waiters back off in proportion
+**     to the number of threads ahead of them, so that mostly the next owner
+**     polls the spinlock. OE_SPINLOCK_INITIALIZER (0) is an unlocked spinlock.
+**
+**==============================================================================
+*/
+
+#define TICKET_SHIFT 16
+#define NEXT_TICKET (1U << TICKET_SHIFT)
+#define SPINS_PER_WAITER 8
+
+static uint16_t _get_owner(uint32_t value)
 {
-    unsigned int value = 1;
-
-    asm volatile("lock xchg %0, %1;"
-                 : "=r"(value)     /* %0 */
-                 : "m"(*spinlock), /* %1 */
-                   "0"(value)      /* also %2 */
-                 : "memory");
+    return (uint16_t)value;
+}
 
-    return value;
+static uint16_t _get_next(uint32_t value)
+{
+    return (uint16_t)(value >> TICKET_SHIFT);
 }
 
 oe_result_t oe_spin_init(oe_spinlock_t* spinlock)
@@ -34,17 +51,25 @@ oe_result_t oe_spin_init(oe_spinlock_t* spinlock)
 
 oe_result_t oe_spin_lock(oe_spinlock_t* spinlock)
 {
+    uint32_t value = 0;
+    uint16_t ticket = 0;
+
     if (!spinlock)
         return OE_INVALID_PARAMETER;
 
-    while (_spin_set_locked((volatile unsigned int*)spinlock) != 0)
+    value = __atomic_fetch_add(spinlock, NEXT_TICKET, __ATOMIC_ACQUIRE);
+    ticket = _get_next(value);
+
+    while (_get_owner(value) != ticket)
     {
-        /* Spin while waiting for spinlock to be released (become 1) */
-        while (*spinlock)
-        {
-            /* Yield to CPU */
+        uint32_t ahead = (uint16_t)(ticket - _get_owner(value));
+
+        /* Yield to CPU */
+        for (uint32_t i = (ahead - 1) * SPINS_PER_WAITER; i > 0; i--)
             asm volatile("pause");
-        }
+        asm volatile("pause");
+
+        value = __atomic_load_n(spinlock, __ATOMIC_ACQUIRE);
     }
 
     return OE_OK;
@@ -52,10 +77,21 @@ oe_result_t oe_spin_lock(oe_spinlock_t* spinlock)
 
 oe_result_t oe_spin_trylock(oe_spinlock_t* spinlock)
 {
+    uint32_t value = 0;
+
     if (!spinlock)
         return OE_INVALID_PARAMETER;
 
-    if (_spin_set_locked((volatile unsigned int*)spinlock) == 0)
+    value = __atomic_load_n(spinlock, __ATOMIC_RELAXED);
+
+    if (_get_owner(value) == _get_next(value) &&
+        __atomic_compare_exchange_n(
+            spinlock,
+            &value,
+            value + NEXT_TICKET,
+            false,
+            __ATOMIC_ACQUIRE,
+            __ATOMIC_RELAXED))
     {
         return OE_OK;
     }
@@ -65,13 +101,14 @@ oe_result_t oe_spin_trylock(oe_spinlock_t* spinlock)
 
 oe_result_t oe_spin_unlock(oe_spinlock_t* spinlock)
 {
+    /* Only the owner writes the low half (x86 is little-endian) */
+    volatile uint16_t* owner = (volatile uint16_t*)spinlock;
+
     if (!spinlock)
         return OE_INVALID_PARAMETER;
 
-    asm volatile("movl %0, %1;"
-                 :
-                 : "r"(OE_SPINLOCK_INITIALIZER), "m"(*spinlock) /* %1 */
-                 : "memory");
+    /* Incrementing the whole spinlock would carry into the next ticket */
+    __atomic_store_n(owner, (uint16_t)(*owner + 1), __ATOMIC_RELEASE);
 
     return OE_OK;
 }
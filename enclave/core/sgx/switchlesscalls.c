@@ -7,7 +7,9 @@
 #include <openenclave/internal/atomic.h>
 #include <openenclave/internal/defs.h>
 #include <openenclave/internal/raise.h>
+#include <openenclave/internal/sgx/td.h>
 #include <openenclave/internal/utils.h>
+#include "../hostheap.h"
 #include "arena.h"
 #include "handle_ecall.h"
 #include "openenclave/internal/safemath.h"
@@ -19,6 +21,26 @@ static size_t _host_worker_count = 0;
 // The array of host worker contexts. Initialized by host through ECALL
 static oe_host_worker_context_t* _host_worker_contexts = NULL;
 
+// The queue of a host worker, copied into enclave memory and validated once
+// during initialization so that the host cannot redirect it afterwards.
+typedef struct _host_worker_queue
+{
+    void** slots;
+    uint64_t mask;
+} host_worker_queue_t;
+
+// The array of host worker queues. Initialized by host through ECALL
+static host_worker_queue_t* _host_worker_queues = NULL;
+
+// Whether enclave threads post to their preferred host worker whenever its
+// queue has room. Copied from the first host worker context during
+// initialization.
+static bool _caller_affinity = false;
+
+// Spreads the enclave threads that make switchless OCALLs across the host
+// workers. See oe_switchless_get_preferred_worker().
+static uint64_t _next_caller = 0;
+
 // Flag to denote if switchless calls have already been initialized.
 static bool _is_switchless_initialized = false;
 
@@ -87,6 +109,36 @@ bool oe_is_switchless_initialized()
     return is_initialized;
 }
 
+/*
+**==============================================================================
+**
+** _validate_queue()
+**
+** Check that a worker queue supplied by the host is a power-of-two sized ring
+** that lies entirely outside the enclave.
+**
+**==============================================================================
+*/
+static oe_result_t _validate_queue(void** slots, uint64_t mask)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    if (slots == NULL || mask >= OE_SWITCHLESS_MAX_QUEUE_DEPTH ||
+        (mask & (mask + 1)) != 0)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    if (!oe_is_outside_enclave(slots, (mask + 1) * sizeof(void*)))
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    /* lfence after checks. */
+    oe_lfence();
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
 /*
 **==============================================================================
 **
@@ -103,6 +155,7 @@ oe_result_t oe_sgx_init_context_switchless_ecall(
 {
     oe_result_t result = OE_UNEXPECTED;
     uint64_t contexts_size = 0;
+    host_worker_queue_t* queues = NULL;
 
     if (!oe_atomic_compare_and_swap(
             &_switchless_init_in_progress, (int64_t) false, (int64_t) true))
@@ -128,15 +181,31 @@ oe_result_t oe_sgx_init_context_switchless_ecall(
     /* lfence after checks. */
     oe_lfence();
 
+    queues = (host_worker_queue_t*)oe_calloc(num_host_workers, sizeof(*queues));
+    if (queues == NULL)
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    for (size_t i = 0; i < num_host_workers; i++)
+    {
+        queues[i].slots = host_worker_contexts[i].queue;
+        queues[i].mask = host_worker_contexts[i].queue_mask;
+        OE_CHECK(_validate_queue(queues[i].slots, queues[i].mask));
+    }
+
     // Stash host worker information in enclave memory.
+    _caller_affinity = host_worker_contexts[0].caller_affinity != 0;
     _host_worker_count = num_host_workers;
     _host_worker_contexts = host_worker_contexts;
+    _host_worker_queues = queues;
+    queues = NULL;
 
     __atomic_store_n(&_is_switchless_initialized, true, __ATOMIC_SEQ_CST);
 
     result = OE_OK;
 
 done:
+    oe_free(queues);
+
     __atomic_store_n(&_switchless_init_in_progress, false, __ATOMIC_SEQ_CST);
 
     return result;
@@ -145,46 +214,85 @@ done:
 /*
 **==============================================================================
 **
-** oe_post_switchless_ocall()
+** _post_switchless_ocall()
 **
 **  Post the function call (wrapped in args) to a free host worker thread
-**  by writing to its context.
+**  by writing to its context. Unless the call is asynchronous, wait until
+**  the worker takes it. An asynchronous call belongs to the host worker once
+**  it is posted, so args must not be accessed afterwards.
 **
 **==============================================================================
 */
-oe_result_t oe_post_switchless_ocall(oe_call_host_function_args_t* args)
+static oe_result_t _post_switchless_ocall(
+    oe_call_host_function_args_t* args,
+    bool is_async)
 {
     oe_result_t result = OE_UNEXPECTED;
+    oe_sgx_td_t* td = oe_sgx_get_td();
+    uint64_t slot = 0;
+    size_t preferred = oe_switchless_get_preferred_worker(
+        td->switchless_hint, &_next_caller, _host_worker_count);
 
     OE_ATOMIC_MEMORY_BARRIER_RELEASE();
     args->result = __OE_RESULT_MAX; // Means the call hasn't been processed.
 
-    // Cycle through the worker contexts until we find a free worker.
-    size_t tries = _host_worker_count;
-    while (tries--)
+    // Prefer a worker whose queue is empty (pass 0) so that the call is
+    // handled immediately. Otherwise, queue the call behind the pending calls
+    // of any worker with room (pass 1). Each thread starts at its preferred
+    // worker so that concurrent callers do not all race for the same queue.
+    // With caller affinity, the preferred worker is used whenever it has
+    // room.
+    for (int pass = 0; pass < 2; pass++)
     {
-        // Check if the worker's slot is free.
-        if (_host_worker_contexts[tries].call_arg == NULL)
+        // Cycle through the worker contexts until we find a free worker.
+        for (size_t i = 0; i < _host_worker_count; i++)
         {
-            // Try to atomically grab the slot by placing args in the slot.
-            // If the atomic operation was successful, then the worker thread
-            // will execute this switchless ocall. If the atomic operation
-            // failed, this means that the slot was grabbed by another
-            // switchless ocall and therefore, we must scan for another worker
-            // thread with a free slot.
-            if (oe_atomic_compare_and_swap_ptr(
-                    (void* volatile*)&_host_worker_contexts[tries].call_arg,
-                    NULL,
-                    args))
+            size_t index = preferred + i;
+            if (index >= _host_worker_count)
+                index -= _host_worker_count;
+
+            oe_host_worker_context_t* context = &_host_worker_contexts[index];
+            host_worker_queue_t* queue = &_host_worker_queues[index];
+            if (context->is_parked)
+                continue;
+
+            uint64_t head = oe_atomic_load(&context->queue_head);
+            uint64_t tail = oe_atomic_load(&context->queue_tail);
+            bool is_idle = (head == tail);
+            bool is_full = (tail - head > queue->mask);
+            bool is_affine = (_caller_affinity && i == 0);
+
+            if (is_full || (pass == 0 && !is_idle && !is_affine))
+                continue;
+
+            // Try to atomically claim a slot in the worker's queue. If the
+            // atomic operation was successful, then the worker thread will
+            // execute this switchless ocall. If it failed, the queue was
+            // filled by other switchless ocalls and therefore, we must scan
+            // for another worker thread with room. Note that the slot index
+            // is masked with the validated enclave copy of the mask, so the
+            // host cannot direct the write outside of the validated ring.
+            if (oe_switchless_queue_post(
+                    queue->slots,
+                    queue->mask,
+                    &context->queue_head,
+                    &context->queue_tail,
+                    &context->cas_failure_count,
+                    args,
+                    &slot))
             {
-                // The worker thread has been marked to execute this switchless
-                // call. Determine if it needs to be woken up or not.
+                td->switchless_hint = (uint32_t)oe_switchless_update_hint(
+                    preferred, index, _caller_affinity);
+
+                // The worker thread has been marked to execute this
+                // switchless call. Determine if it needs to be woken up or
+                // not.
                 //
-                // If event is 0, it means that it has gone to sleep. Wake it by
-                // making an ocall (oe_sgx_wake_switchless_worker_ocall).
+                // If event is 0, it means that it has gone to sleep. Wake it
+                // by making an ocall (oe_sgx_wake_switchless_worker_ocall).
                 // Note: it is important to use an atomic cas operation to set
-                // the value to 1 before making the ocall. Setting the value to
-                // 1 prevents the host worker from simulataneously going to
+                // the value to 1 before making the ocall. Setting the value
+                // to 1 prevents the host worker from simulataneously going to
                 // sleep. If instead, just a compare operation is used to
                 // determine if the host thread is sleeping or not, the host
                 // thread could go to sleep after the enclave has determined
@@ -197,30 +305,57 @@ oe_result_t oe_post_switchless_ocall(oe_call_host_function_args_t* args)
                 // We need a strong operation.
                 bool weak = false;
                 if (__atomic_compare_exchange_n(
-                        &_host_worker_contexts[tries].event,
+                        &context->event,
                         &oldval,
                         newval,
                         weak,
                         __ATOMIC_ACQ_REL,
                         __ATOMIC_ACQUIRE))
                 {
-                    // The pevious value of the event was 0 which means that the
-                    // worker was previously sleeping.
+                    // The pevious value of the event was 0 which means that
+                    // the worker was previously sleeping.
                     // Wake it via an ocall.
-                    oe_sgx_wake_switchless_worker_ocall(
-                        &_host_worker_contexts[tries]);
+                    oe_atomic_increment(&context->wake_count);
+                    oe_sgx_wake_switchless_worker_ocall(context);
                 }
 
+                // Asynchronous callers do not wait, so their calls are not
+                // recorded in the queue wait histogram.
+                if (is_async)
+                    return OE_OK;
+
+                oe_switchless_wait_for_worker(
+                    queue->slots,
+                    queue->mask,
+                    slot,
+                    args,
+                    context->queue_wait_histogram);
+
                 return OE_OK;
             }
         }
     }
 
+    // Record the miss so that an elastic pool can grow.
+    oe_atomic_increment(&_host_worker_contexts[0].miss_count);
+
     result = OE_CONTEXT_SWITCHLESS_OCALL_MISSED;
 
     return result;
 }
 
+/*
+**==============================================================================
+**
+** oe_post_switchless_ocall()
+**
+**==============================================================================
+*/
+oe_result_t oe_post_switchless_ocall(oe_call_host_function_args_t* args)
+{
+    return _post_switchless_ocall(args, false);
+}
+
 /*
 **==============================================================================
 **
@@ -247,6 +382,145 @@ oe_result_t oe_switchless_call_host_function(
         true /* switchless */);
 }
 
+/*
+**==============================================================================
+**
+** Asynchronous OCALLs
+**
+**     An asynchronous OCALL is posted to a host worker like a switchless
+**     OCALL, but the caller returns as soon as the call is posted. Its args,
+**     input and output buffers are a single block of host memory obtained
+**     from oe_allocate_async_ocall_buffer(), which the host worker frees after
+**     handling the call. If no host worker has room, the call is made as a
+**     regular OCALL and the block is freed by the caller. Calls posted to
+**     different workers may run concurrently and in any order;
+**     oe_flush_async_ocalls() waits until all the posted calls have run.
+**
+**     When the enclave is terminated, the host workers are stopped after the
+**     atexit functions of the enclave have run, and each worker handles the
+**     calls left in its queue before it exits. So every asynchronous OCALL
+**     posted before the enclave is terminated runs.
+**
+**==============================================================================
+*/
+
+/* Precedes the buffers of an asynchronous OCALL. Its size preserves the
+ * alignment of the buffers */
+typedef struct _async_ocall_header
+{
+    oe_call_host_function_args_t args;
+    uint64_t padding;
+} async_ocall_header_t;
+
+OE_STATIC_ASSERT(
+    sizeof(async_ocall_header_t) % OE_EDGER8R_BUFFER_ALIGNMENT == 0);
+
+void* oe_allocate_async_ocall_buffer(size_t size)
+{
+    async_ocall_header_t* header = NULL;
+
+    if (size > OE_SIZE_MAX - sizeof(*header))
+        return NULL;
+
+    // The host worker frees the block, so it bypasses the host heap.
+    if (!(header = (async_ocall_header_t*)oe_host_malloc_for_host(
+              sizeof(*header) + size)))
+        return NULL;
+
+    return header + 1;
+}
+
+void oe_free_async_ocall_buffer(void* buffer)
+{
+    if (buffer)
+        oe_host_free((async_ocall_header_t*)buffer - 1);
+}
+
+oe_result_t oe_call_host_function_async(
+    size_t function_id,
+    void* buffer,
+    size_t input_buffer_size,
+    size_t output_buffer_size)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    async_ocall_header_t* header = NULL;
+    oe_call_host_function_args_t* args = NULL;
+
+    if (!buffer)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // The block is owned by this function from here on.
+    header = (async_ocall_header_t*)buffer - 1;
+
+    if (input_buffer_size == 0 || output_buffer_size == 0)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    args = &header->args;
+    args->function_id = function_id;
+    args->input_buffer = buffer;
+    args->input_buffer_size = input_buffer_size;
+    args->output_buffer = (uint8_t*)buffer + input_buffer_size;
+    args->output_buffer_size = output_buffer_size;
+    args->output_bytes_written = 0;
+    args->result = OE_UNEXPECTED;
+    args->flags = OE_CALL_HOST_FUNCTION_FLAG_ASYNC;
+
+    if (oe_is_switchless_initialized())
+    {
+        result = _post_switchless_ocall(args, true);
+
+        // The host worker frees the block.
+        if (result == OE_OK)
+        {
+            header = NULL;
+            goto done;
+        }
+
+        if (result != OE_CONTEXT_SWITCHLESS_OCALL_MISSED)
+            OE_RAISE(result);
+    }
+
+    // Fall back to a regular OCALL if host worker threads are unavailable.
+    OE_CHECK(oe_ocall(OE_OCALL_CALL_HOST_FUNCTION, (uint64_t)args, NULL));
+    OE_CHECK(args->result);
+
+    result = OE_OK;
+
+done:
+    if (header)
+        oe_host_free(header);
+
+    return result;
+}
+
+/*
+**==============================================================================
+**
+** oe_flush_async_ocalls()
+**
+**  Wait until each host worker has handled the calls that were in its queue
+**  when this function was called. The workers advance queue_head after
+**  handling a call.
+**
+**==============================================================================
+*/
+oe_result_t oe_flush_async_ocalls(void)
+{
+    if (!oe_is_switchless_initialized())
+        return OE_OK;
+
+    for (size_t i = 0; i < _host_worker_count; i++)
+    {
+        oe_host_worker_context_t* context = &_host_worker_contexts[i];
+        uint64_t tail = oe_atomic_load(&context->queue_tail);
+
+        while ((int64_t)(tail - oe_atomic_load(&context->queue_head)) > 0)
+            oe_yield_cpu();
+    }
+
+    return OE_OK;
+}
+
 void oe_sgx_switchless_enclave_worker_thread_ecall(
     oe_enclave_worker_context_t* context)
 {
@@ -257,27 +531,70 @@ void oe_sgx_switchless_enclave_worker_thread_ecall(
     // Prevent speculative execution.
     oe_lfence();
 
-    const uint64_t spin_count_threshold = context->spin_count_threshold;
+    // Copy the queue to enclave memory to avoid TOCTOU issues.
+    void* volatile* const slots = context->queue;
+    const uint64_t mask = context->queue_mask;
+    if (_validate_queue((void**)slots, mask) != OE_OK)
+        return;
+
+    const uint64_t adaptive_spin_count_max = context->adaptive_spin_count_max;
+    uint64_t spin_count_threshold = context->spin_count_threshold;
+    uint64_t average_gap = 0;
+    uint64_t gap = 0;
+    uint64_t head = context->queue_head;
     while (!context->is_stopping)
     {
         volatile oe_call_enclave_function_args_t* local_call_arg = NULL;
-        if ((local_call_arg = context->call_arg) != NULL)
+        if ((local_call_arg = slots[head & mask]) != NULL)
         {
-            // Handle the switchless call, but do not clear the slot yet. Since
-            // the slot is not empty, any new incoming switchless call request
-            // will be scheduled in another available work thread and get
-            // handled immediately.
-            oe_handle_call_enclave_function((uint64_t)local_call_arg);
-
-            // After handling the switchless call, mark this worker thread
-            // as free by clearing the slot.
+            // Take the call. The caller waits for the slot to be cleared to
+            // measure how long the call was queued.
+            slots[head & mask] = NULL;
+
+            // Handle the switchless call. The caller waits for the result
+            // field to be set.
+            oe_result_t result =
+                oe_handle_call_enclave_function((uint64_t)local_call_arg);
+
+            // oe_handle_call_enclave_function only sets the result on
+            // success. Ensure that args lies outside the enclave before
+            // reporting the failure through it.
+            if (result != OE_OK && oe_is_outside_enclave(
+                                       (void*)local_call_arg,
+                                       sizeof(*local_call_arg)))
+            {
+                OE_ATOMIC_MEMORY_BARRIER_RELEASE();
+                local_call_arg->result = result;
+            }
+
+            // Move on to the next slot. Advancing the head allows callers to
+            // reuse the slot, which was cleared above.
             OE_ATOMIC_MEMORY_BARRIER_RELEASE();
-            context->call_arg = NULL;
+            context->queue_head = ++head;
+
+            // Adapt the spin budget to the gap that preceded this message.
+            // The gap is host-provided but only affects performance; it is
+            // clamped by oe_switchless_adapt_spin_count_threshold.
+            if (adaptive_spin_count_max)
+            {
+                spin_count_threshold =
+                    oe_switchless_adapt_spin_count_threshold(
+                        &average_gap,
+                        gap + context->spin_count,
+                        adaptive_spin_count_max);
+                context->spin_count_threshold = spin_count_threshold;
+                gap = 0;
+            }
 
             // Reset spin count for next message.
             context->total_spin_count += context->spin_count;
             context->spin_count = 0;
         }
+        else if (context->is_parked)
+        {
+            // Return to the host to release the TCS while parked.
+            break;
+        }
         else
         {
             // If there is no message, increment spin count until threshold is
@@ -286,10 +603,12 @@ void oe_sgx_switchless_enclave_worker_thread_ecall(
             {
                 // Reset spin count and return to host to sleep.
                 context->total_spin_count += context->spin_count;
+                gap += context->spin_count;
                 context->spin_count = 0;
 
                 // Make an ocall to sleep until messages arrive.
                 oe_sgx_sleep_switchless_worker_ocall(context);
+                gap += context->sleep_spin_count;
             }
 
             // In Release builds, the following pause has been observed to be
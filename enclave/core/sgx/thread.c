@@ -9,6 +9,7 @@
 #include <openenclave/internal/raise.h>
 #include <openenclave/internal/safecrt.h>
 #include <openenclave/internal/thread.h>
+#include <openenclave/internal/utils.h>
 #include "platform_t.h"
 #include "td.h"
 
@@ -70,6 +71,22 @@ done:
     return ret;
 }
 
+oe_result_t _oe_sgx_thread_wake_multiple_ocall(
+    oe_enclave_t* enclave,
+    const uint64_t* tcs,
+    size_t num_tcs)
+{
+    OE_UNUSED(enclave);
+    OE_UNUSED(tcs);
+    OE_UNUSED(num_tcs);
+
+    return OE_UNSUPPORTED;
+}
+
+OE_WEAK_ALIAS(
+    _oe_sgx_thread_wake_multiple_ocall,
+    oe_sgx_thread_wake_multiple_ocall);
+
 /*
 **==============================================================================
 **
@@ -129,6 +146,57 @@ static __inline__ bool _queue_empty(Queue* queue)
     return queue->front ? false : true;
 }
 
+/* The number of threads woken by a single OCALL */
+#define WAKE_BATCH_SIZE 64
+
+static void _thread_wake_batch(oe_sgx_td_t** threads, size_t num_threads)
+{
+    uint64_t tcs[WAKE_BATCH_SIZE];
+
+    if (num_threads == 1)
+    {
+        _thread_wake(threads[0]);
+        return;
+    }
+
+    for (size_t i = 0; i < num_threads; i++)
+        tcs[i] = (uint64_t)td_to_tcs(threads[i]);
+
+    if (oe_sgx_thread_wake_multiple_ocall(
+            oe_get_enclave(), tcs, num_threads) != OE_OK)
+    {
+        /* The enclave does not import the OCALL */
+        for (size_t i = 0; i < num_threads; i++)
+            _thread_wake(threads[i]);
+    }
+}
+
+/* Wake all the threads of a queue that has been detached from its
+ * primitive, with as few OCALLs as possible */
+static void _thread_wake_all(Queue* waiters)
+{
+    oe_sgx_td_t* batch[WAKE_BATCH_SIZE];
+    size_t num_threads = 0;
+    oe_sgx_td_t* p;
+
+    // A woken thread could immediately use a synchronization primitive that
+    // modifies its next field. Therefore each thread is popped before any
+    // thread of its batch is woken.
+    while ((p = _queue_pop_front(waiters)))
+    {
+        batch[num_threads++] = p;
+
+        if (num_threads == WAKE_BATCH_SIZE)
+        {
+            _thread_wake_batch(batch, num_threads);
+            num_threads = 0;
+        }
+    }
+
+    if (num_threads)
+        _thread_wake_batch(batch, num_threads);
+}
+
 /*
 **==============================================================================
 **
@@ -228,6 +296,89 @@ static int _mutex_lock(oe_mutex_impl_t* m, oe_sgx_td_t* self)
     return -1;
 }
 
+/*
+** Waiting for a mutex by sleeping on the host costs two OCALLs, which is far
+** more than most critical sections. So a thread first spins while the owner
+** runs in the enclave and no thread is queued. The spin limit of a mutex
+** follows the number of spins that recent waits took, up to MUTEX_MAX_SPINS.
+** oe_mutex_t has no room for it, so the limits are kept in a table indexed
+** by a hash of the mutex address.
+*/
+#define MUTEX_MIN_SPINS 16
+#define MUTEX_MAX_SPINS 4096
+#define MUTEX_NUM_SPIN_ESTIMATES 64
+
+static uint32_t _spin_estimates[MUTEX_NUM_SPIN_ESTIMATES];
+
+static uint32_t* _get_spin_estimate(oe_mutex_impl_t* m)
+{
+    uint64_t hash = ((uint64_t)m >> 5) * 0x9E3779B97F4A7C15ULL;
+    return &_spin_estimates[hash >> 58];
+}
+
+/* Whether the owner of a mutex may release it soon */
+static bool _owner_is_running(oe_sgx_td_t* owner)
+{
+    return __atomic_load_n(&owner->ocall_depth, __ATOMIC_RELAXED) == 0;
+}
+
+/* Spin until the mutex is obtained or it is not worth spinning anymore */
+static bool _mutex_spin_lock(oe_mutex_impl_t* m, oe_sgx_td_t* self)
+{
+    uint32_t* estimate = _get_spin_estimate(m);
+    uint32_t max_spins = __atomic_load_n(estimate, __ATOMIC_RELAXED);
+    uint32_t spins = 0;
+    bool locked = false;
+
+    max_spins = 2 * max_spins + MUTEX_MIN_SPINS;
+    if (max_spins > MUTEX_MAX_SPINS)
+        max_spins = MUTEX_MAX_SPINS;
+
+    for (;;)
+    {
+        oe_sgx_td_t* owner;
+        bool queued;
+
+        oe_spin_lock(&m->lock);
+        {
+            locked = _mutex_lock(m, self) == 0;
+            owner = m->owner;
+            queued = m->queue.front != NULL;
+        }
+        oe_spin_unlock(&m->lock);
+
+        /* Do not track uncontended locks, which would make the estimates
+         * bounce between the cores */
+        if (locked && spins == 0)
+            return true;
+
+        /* Spinning threads do not overtake queued ones */
+        if (locked || queued)
+            break;
+
+        while (spins < max_spins && owner && _owner_is_running(owner))
+        {
+            OE_CPU_RELAX();
+            spins++;
+            owner = __atomic_load_n(&m->owner, __ATOMIC_RELAXED);
+        }
+
+        /* Give up if the owner is still holding the mutex */
+        if (owner)
+            break;
+    }
+
+    /* Move the estimate an eighth of the way to this wait */
+    uint32_t value = __atomic_load_n(estimate, __ATOMIC_RELAXED);
+    if (spins > value)
+        value += (spins - value + 7) / 8;
+    else
+        value -= (value - spins) / 8;
+    __atomic_store_n(estimate, value, __ATOMIC_RELAXED);
+
+    return locked;
+}
+
 oe_result_t oe_mutex_lock(oe_mutex_t* mutex)
 {
     oe_mutex_impl_t* m = (oe_mutex_impl_t*)mutex;
@@ -236,6 +387,9 @@ oe_result_t oe_mutex_lock(oe_mutex_t* mutex)
     if (!m)
         return OE_INVALID_PARAMETER;
 
+    if (_mutex_spin_lock(m, self))
+        return OE_OK;
+
     /* Loop until SELF obtains mutex */
     for (;;)
     {
@@ -502,15 +656,7 @@ oe_result_t oe_cond_broadcast(oe_cond_t* condition)
     }
     oe_spin_unlock(&cond->lock);
 
-    oe_sgx_td_t* p_next = NULL;
-    for (oe_sgx_td_t* p = waiters.front; p; p = p_next)
-    {
-        // p could wake up and immediately use a synchronization
-        // primitive that could modify the next field.
-        // Therefore fetch the next thread before waking up p.
-        p_next = p->next;
-        _thread_wake(p);
-    }
+    _thread_wake_all(&waiters);
 
     return OE_OK;
 }
@@ -523,13 +669,47 @@ oe_result_t oe_cond_broadcast(oe_cond_t* condition)
 **==============================================================================
 */
 
+/*
+** Readers that hold the spinlock of a rwlock even briefly all write to its
+** cache line, which then bounces between the cores. So a rwlock can be
+** biased towards readers. A reader of a biased rwlock publishes the rwlock
+** in one of the reader slots of its thread instead, and touches the rwlock
+** only to read the bias. Each thread (TCS) owns a row of slots, which fills
+** a cache line.
+**
+** A writer first revokes the bias, so that new readers go through the
+** spinlock, and waits for the rwlock to leave the slots of all the threads.
+** It then obtains the rwlock as usual. The revocation is costly, so the bias
+** is restored only after READER_BIAS_READS readers in a row went through the
+** spinlock without a writer.
+*/
+#define NUM_READER_ROWS OE_SGX_MAX_TCS
+#define NUM_READER_SLOTS 8
+#define READER_BIAS_READS 64
+#define REVOKE_SPINS 1024
+
+/* Bits of oe_rwlock_impl_t.bias: whether readers may use their slots, and
+ * the number of writers that are revoking the bias */
+#define BIAS_READERS 1U
+#define BIAS_ONE_REVOKER 2U
+
+typedef struct _reader_row
+{
+    struct _oe_rwlock_impl* volatile slots[NUM_READER_SLOTS];
+} reader_row_t;
+
+OE_STATIC_ASSERT(sizeof(reader_row_t) == 64);
+
+static OE_ALIGNED(64) reader_row_t _reader_rows[NUM_READER_ROWS];
+static uint32_t _num_reader_rows;
+
 /* Internal readers-writer lock variable implementation. */
 typedef struct _oe_rwlock_impl
 {
     /* Spinlock for synchronizing readers and writers.*/
     oe_spinlock_t lock;
 
-    /* Number of reader threads owning this lock. */
+    /* Number of reader threads owning this lock through the spinlock. */
     uint32_t readers;
 
     /* The writer thread that currently owns this lock.*/
@@ -538,10 +718,236 @@ typedef struct _oe_rwlock_impl
     /* Queue of threads waiting on this variable. */
     Queue queue;
 
+    /* Reader bias and revoking writers (see BIAS_READERS). */
+    volatile uint32_t bias;
+
+    /* Readers through the spinlock since the last writer. */
+    uint32_t slow_reads;
 } oe_rwlock_impl_t;
 
 OE_STATIC_ASSERT(sizeof(oe_rwlock_impl_t) <= sizeof(oe_rwlock_t));
 
+static void _queue_remove(Queue* queue, oe_sgx_td_t* thread)
+{
+    oe_sgx_td_t* prev = NULL;
+
+    for (oe_sgx_td_t* p = queue->front; p; prev = p, p = p->next)
+    {
+        if (p == thread)
+        {
+            if (prev)
+                prev->next = p->next;
+            else
+                queue->front = p->next;
+
+            if (queue->back == p)
+                queue->back = prev;
+
+            return;
+        }
+    }
+}
+
+// The current thread must hold the spinlock.
+// _wake_waiters releases ownership of the spinlock.
+static oe_result_t _wake_waiters(oe_rwlock_impl_t* rw_lock)
+{
+    oe_sgx_td_t* p = NULL;
+    Queue waiters = {NULL, NULL};
+
+    // Take a snapshot of current list of waiters.
+    while ((p = _queue_pop_front(&rw_lock->queue)))
+        _queue_push_back(&waiters, p);
+
+    // Release the lock and wake up the waiters. This allows waiter that is
+    // woken up to immediately acquire the spinlock and subsequently, the
+    // ownership of the rw_lock.
+    oe_spin_unlock(&rw_lock->lock);
+
+    // Wake the waiters in FIFO order. However actual acquisition of the lock
+    // will be dependent on OS scheduling of the threads.
+    _thread_wake_all(&waiters);
+
+    return OE_OK;
+}
+
+/* Get the slot of the rwlock in the row of the thread, or NULL if the thread
+ * has no row */
+static oe_rwlock_impl_t* volatile* _get_reader_slot(
+    oe_rwlock_impl_t* rw_lock,
+    oe_sgx_td_t* self)
+{
+    uint32_t row = self->reader_row;
+
+    // Rows are assigned on first use and kept by the TCS.
+    if (row == 0)
+    {
+        row = __atomic_fetch_add(&_num_reader_rows, 1, __ATOMIC_SEQ_CST);
+        row = row < NUM_READER_ROWS ? row + 1 : OE_UINT16_MAX;
+        self->reader_row = (uint16_t)row;
+    }
+
+    if (row > NUM_READER_ROWS)
+        return NULL;
+
+    uint64_t hash = ((uint64_t)rw_lock >> 3) * 0x9E3779B97F4A7C15ULL;
+    return &_reader_rows[row - 1].slots[hash >> 61];
+}
+
+/* Try to read-lock the rwlock through the slot of the thread */
+static bool _rwlock_fast_rdlock(oe_rwlock_impl_t* rw_lock, oe_sgx_td_t* self)
+{
+    oe_rwlock_impl_t* volatile* slot = NULL;
+    oe_rwlock_impl_t* expected = NULL;
+
+    if (__atomic_load_n(&rw_lock->bias, __ATOMIC_RELAXED) != BIAS_READERS)
+        return false;
+
+    if (!(slot = _get_reader_slot(rw_lock, self)))
+        return false;
+
+    // The slot is taken by another rwlock that this thread holds.
+    if (!__atomic_compare_exchange_n(
+            slot,
+            &expected,
+            rw_lock,
+            false,
+            __ATOMIC_SEQ_CST,
+            __ATOMIC_SEQ_CST))
+        return false;
+
+    // Recheck the bias, which a writer may have revoked before seeing the
+    // slot.
+    if (__atomic_load_n(&rw_lock->bias, __ATOMIC_SEQ_CST) & BIAS_READERS)
+        return true;
+
+    __atomic_store_n(slot, NULL, __ATOMIC_SEQ_CST);
+    return false;
+}
+
+/* Read-unlock the rwlock if the thread holds it through its slot */
+static bool _rwlock_fast_rdunlock(oe_rwlock_impl_t* rw_lock, oe_sgx_td_t* self)
+{
+    oe_rwlock_impl_t* volatile* slot = NULL;
+
+    if (self->reader_row == 0 || self->reader_row > NUM_READER_ROWS)
+        return false;
+
+    slot = _get_reader_slot(rw_lock, self);
+    if (*slot != rw_lock)
+        return false;
+
+    __atomic_store_n(slot, NULL, __ATOMIC_SEQ_CST);
+
+    // Wake the writers that may be waiting for this thread to leave.
+    if (!(__atomic_load_n(&rw_lock->bias, __ATOMIC_SEQ_CST) & BIAS_READERS))
+    {
+        oe_spin_lock(&rw_lock->lock);
+        _wake_waiters(rw_lock);
+    }
+
+    return true;
+}
+
+/* Wait for a reader to release the rwlock from its slot */
+static void _rwlock_wait_for_slot(
+    oe_rwlock_impl_t* rw_lock,
+    oe_rwlock_impl_t* volatile* slot,
+    oe_sgx_td_t* self)
+{
+    size_t spins = 0;
+
+    while (__atomic_load_n(slot, __ATOMIC_SEQ_CST) == rw_lock)
+    {
+        if (spins++ < REVOKE_SPINS)
+        {
+            OE_CPU_RELAX();
+            continue;
+        }
+
+        // The reader may hold the rwlock for long. It wakes the waiters of
+        // the rwlock when it leaves the slot.
+        oe_spin_lock(&rw_lock->lock);
+
+        if (__atomic_load_n(slot, __ATOMIC_SEQ_CST) == rw_lock)
+        {
+            if (!_queue_contains(&rw_lock->queue, self))
+                _queue_push_back(&rw_lock->queue, self);
+
+            oe_spin_unlock(&rw_lock->lock);
+            _thread_wait(self);
+            oe_spin_lock(&rw_lock->lock);
+        }
+
+        // A thread must not stay on a queue that it does not wait on.
+        _queue_remove(&rw_lock->queue, self);
+        oe_spin_unlock(&rw_lock->lock);
+    }
+}
+
+/* Revoke the bias of the rwlock and wait for the readers that hold it
+ * through their slots. Without wait, fail instead if there are such readers.
+ * The bias stays revoked until _rwlock_end_revoke() */
+static bool _rwlock_revoke_bias(
+    oe_rwlock_impl_t* rw_lock,
+    oe_sgx_td_t* self,
+    bool wait)
+{
+    uint32_t bias = 0;
+    uint32_t num_rows = 0;
+
+    bias = __atomic_fetch_add(
+        &rw_lock->bias, BIAS_ONE_REVOKER, __ATOMIC_SEQ_CST);
+
+    // Neither biased nor being revoked: no reader uses a slot.
+    if (bias == 0)
+        return true;
+
+    __atomic_fetch_and(&rw_lock->bias, ~BIAS_READERS, __ATOMIC_SEQ_CST);
+
+    num_rows = __atomic_load_n(&_num_reader_rows, __ATOMIC_SEQ_CST);
+    if (num_rows > NUM_READER_ROWS)
+        num_rows = NUM_READER_ROWS;
+
+    for (uint32_t i = 0; i < num_rows; i++)
+    {
+        for (size_t j = 0; j < NUM_READER_SLOTS; j++)
+        {
+            oe_rwlock_impl_t* volatile* slot = &_reader_rows[i].slots[j];
+
+            if (__atomic_load_n(slot, __ATOMIC_SEQ_CST) != rw_lock)
+                continue;
+
+            if (!wait)
+                return false;
+
+            _rwlock_wait_for_slot(rw_lock, slot, self);
+        }
+    }
+
+    return true;
+}
+
+/* Stop revoking the bias. If readers still hold the rwlock through their
+ * slots, the bias must be restored for the next revocation to see them */
+static void _rwlock_end_revoke(oe_rwlock_impl_t* rw_lock, bool restore)
+{
+    uint32_t bias = BIAS_ONE_REVOKER;
+
+    // Another revoking writer waits for the readers, so the bias can only be
+    // restored by the last one.
+    if (restore && __atomic_compare_exchange_n(
+                       &rw_lock->bias,
+                       &bias,
+                       BIAS_READERS,
+                       false,
+                       __ATOMIC_SEQ_CST,
+                       __ATOMIC_SEQ_CST))
+        return;
+
+    __atomic_fetch_sub(&rw_lock->bias, BIAS_ONE_REVOKER, __ATOMIC_SEQ_CST);
+}
+
 oe_result_t oe_rwlock_init(oe_rwlock_t* read_write_lock)
 {
     oe_rwlock_impl_t* rw_lock = (oe_rwlock_impl_t*)read_write_lock;
@@ -558,6 +964,28 @@ oe_result_t oe_rwlock_init(oe_rwlock_t* read_write_lock)
     return result;
 }
 
+/* Count a reader that went through the spinlock, and restore the bias after
+ * enough of them. Called with the spinlock */
+static void _rwlock_add_slow_reader(oe_rwlock_impl_t* rw_lock)
+{
+    uint32_t bias = 0;
+
+    rw_lock->readers++;
+
+    if (++rw_lock->slow_reads >= READER_BIAS_READS)
+    {
+        // Fails if the rwlock is biased or a writer is revoking the bias.
+        rw_lock->slow_reads = 0;
+        __atomic_compare_exchange_n(
+            &rw_lock->bias,
+            &bias,
+            BIAS_READERS,
+            false,
+            __ATOMIC_SEQ_CST,
+            __ATOMIC_SEQ_CST);
+    }
+}
+
 oe_result_t oe_rwlock_rdlock(oe_rwlock_t* read_write_lock)
 {
     oe_rwlock_impl_t* rw_lock = (oe_rwlock_impl_t*)read_write_lock;
@@ -566,6 +994,9 @@ oe_result_t oe_rwlock_rdlock(oe_rwlock_t* read_write_lock)
     if (!rw_lock)
         return OE_INVALID_PARAMETER;
 
+    if (_rwlock_fast_rdlock(rw_lock, self))
+        return OE_OK;
+
     oe_spin_lock(&rw_lock->lock);
 
     // Wait for writer to finish.
@@ -585,7 +1016,7 @@ oe_result_t oe_rwlock_rdlock(oe_rwlock_t* read_write_lock)
     }
 
     // Increment number of readers.
-    rw_lock->readers++;
+    _rwlock_add_slow_reader(rw_lock);
 
     oe_spin_unlock(&rw_lock->lock);
 
@@ -599,6 +1030,9 @@ oe_result_t oe_rwlock_tryrdlock(oe_rwlock_t* read_write_lock)
     if (!rw_lock)
         return OE_INVALID_PARAMETER;
 
+    if (_rwlock_fast_rdlock(rw_lock, oe_sgx_get_td()))
+        return OE_OK;
+
     oe_spin_lock(&rw_lock->lock);
 
     oe_result_t result = OE_BUSY;
@@ -606,7 +1040,7 @@ oe_result_t oe_rwlock_tryrdlock(oe_rwlock_t* read_write_lock)
     // If no writer is active, then lock is successful.
     if (rw_lock->writer == NULL)
     {
-        rw_lock->readers++;
+        _rwlock_add_slow_reader(rw_lock);
         result = OE_OK;
     }
 
@@ -615,30 +1049,6 @@ oe_result_t oe_rwlock_tryrdlock(oe_rwlock_t* read_write_lock)
     return result;
 }
 
-// The current thread must hold the spinlock.
-// _wake_waiters releases ownership of the spinlock.
-static oe_result_t _wake_waiters(oe_rwlock_impl_t* rw_lock)
-{
-    oe_sgx_td_t* p = NULL;
-    Queue waiters = {NULL, NULL};
-
-    // Take a snapshot of current list of waiters.
-    while ((p = _queue_pop_front(&rw_lock->queue)))
-        _queue_push_back(&waiters, p);
-
-    // Release the lock and wake up the waiters. This allows waiter that is
-    // woken up to immediately acquire the spinlock and subsequently, the
-    // ownership of the rw_lock.
-    oe_spin_unlock(&rw_lock->lock);
-
-    // Wake the waiters in FIFO order. However actual acquisition of the lock
-    // will be dependent on OS scheduling of the threads.
-    while ((p = _queue_pop_front(&waiters)))
-        _thread_wake(p);
-
-    return OE_OK;
-}
-
 static oe_result_t _rwlock_rdunlock(oe_rwlock_t* read_write_lock)
 {
     oe_rwlock_impl_t* rw_lock = (oe_rwlock_impl_t*)read_write_lock;
@@ -646,6 +1056,9 @@ static oe_result_t _rwlock_rdunlock(oe_rwlock_t* read_write_lock)
     if (!rw_lock)
         return OE_INVALID_PARAMETER;
 
+    if (_rwlock_fast_rdunlock(rw_lock, oe_sgx_get_td()))
+        return OE_OK;
+
     oe_spin_lock(&rw_lock->lock);
 
     // There must be at least 1 reader and no writers.
@@ -683,6 +1096,13 @@ oe_result_t oe_rwlock_wrlock(oe_rwlock_t* read_write_lock)
         return OE_BUSY;
     }
 
+    oe_spin_unlock(&rw_lock->lock);
+
+    // Keep new readers off the slots, and wait for the current ones.
+    _rwlock_revoke_bias(rw_lock, self, true);
+
+    oe_spin_lock(&rw_lock->lock);
+
     // Wait for all readers and any other writer to finish.
     while (rw_lock->readers > 0 || rw_lock->writer != NULL)
     {
@@ -700,6 +1120,8 @@ oe_result_t oe_rwlock_wrlock(oe_rwlock_t* read_write_lock)
     }
 
     rw_lock->writer = self;
+    rw_lock->slow_reads = 0;
+    _rwlock_end_revoke(rw_lock, false);
     oe_spin_unlock(&rw_lock->lock);
 
     return OE_OK;
@@ -719,8 +1141,18 @@ oe_result_t oe_rwlock_trywrlock(oe_rwlock_t* read_write_lock)
     // If no readers and no writers are active, then lock is successful.
     if (rw_lock->readers == 0 && rw_lock->writer == NULL)
     {
-        rw_lock->writer = self;
-        result = OE_OK;
+        if (_rwlock_revoke_bias(rw_lock, self, false))
+        {
+            rw_lock->writer = self;
+            rw_lock->slow_reads = 0;
+            _rwlock_end_revoke(rw_lock, false);
+            result = OE_OK;
+        }
+        else
+        {
+            // Readers hold the lock through their slots.
+            _rwlock_end_revoke(rw_lock, true);
+        }
     }
 
     oe_spin_unlock(&rw_lock->lock);
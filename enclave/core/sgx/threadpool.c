@@ -0,0 +1,455 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/corelibc/stdlib.h>
+#include <openenclave/enclave.h>
+#include <openenclave/internal/heapwatermark.h>
+#include <openenclave/internal/raise.h>
+#include <openenclave/internal/sgx/td.h>
+#include <openenclave/internal/thread.h>
+#include <openenclave/internal/threadpool.h>
+
+/*
+**==============================================================================
+**
+** Thread pool
+**
+**     The host starts the pool with OE_ECALL_START_THREAD_POOL and then
+**     donates threads that enter with OE_ECALL_THREAD_POOL_WORKER. Each
+**     worker has a deque of tasks. A worker pushes the tasks that it creates
+**     to the back of its deque and pops them from the back, so that nested
+**     parallel work runs depth first on the same thread. Idle workers steal
+**     from the front of the deques of the other workers. Tasks created by
+**     threads that are not workers go to a shared queue. Workers without
+**     tasks sleep on a condition variable.
+**
+**     A task is claimed by whoever moves it from TASK_QUEUED to TASK_RUNNING
+**     first: a worker, or a thread that joins the task before a worker got
+**     to it. So joining never waits for a free worker. The queue entries of
+**     tasks that were claimed by joiners are skipped when they are popped,
+**     and dropped by the workers when the pool stops.
+**
+**     Threads that are not workers cannot create tasks once the pool is
+**     stopping, since no worker may be left to run them.
+**
+**==============================================================================
+*/
+
+#define MAX_WORKERS OE_SGX_MAX_TCS
+#define DEQUE_SIZE 64
+
+typedef enum _task_state
+{
+    TASK_QUEUED,
+    TASK_RUNNING,
+    TASK_DONE
+} task_state_t;
+
+struct _oe_thread_pool_task
+{
+    void* (*start_routine)(void*);
+    void* arg;
+    void* retval;
+    volatile uint32_t state;
+
+    /* One reference for the queue entry and one for the handle of the
+     * creator, which is dropped by join or detach */
+    uint32_t refs;
+
+    /* Signaled when the task is done, if a thread joins it */
+    bool has_joiner;
+    oe_cond_t done;
+
+    /* Next task of the shared queue */
+    struct _oe_thread_pool_task* next;
+};
+
+typedef struct _deque
+{
+    oe_spinlock_t lock;
+    uint32_t front;
+    uint32_t back;
+    oe_thread_pool_task_t* tasks[DEQUE_SIZE];
+} deque_t;
+
+static deque_t _deques[MAX_WORKERS];
+
+static oe_spinlock_t _shared_lock = OE_SPINLOCK_INITIALIZER;
+static oe_thread_pool_task_t* _shared_front;
+static oe_thread_pool_task_t* _shared_back;
+
+/* Guards the sleep of idle workers and the completion of tasks */
+static oe_mutex_t _mutex = OE_MUTEX_INITIALIZER;
+static oe_cond_t _work_available = OE_COND_INITIALIZER;
+
+static uint32_t _max_workers;
+static uint32_t _num_workers;
+static uint32_t _num_idle;
+static bool _is_stopping;
+
+/* Tasks that are not claimed yet */
+static uint64_t _num_queued;
+
+static bool _deque_push_back(deque_t* deque, oe_thread_pool_task_t* task)
+{
+    bool pushed = false;
+
+    oe_spin_lock(&deque->lock);
+
+    if (deque->back - deque->front < DEQUE_SIZE)
+    {
+        deque->tasks[deque->back % DEQUE_SIZE] = task;
+        __atomic_store_n(&deque->back, deque->back + 1, __ATOMIC_RELAXED);
+        pushed = true;
+    }
+
+    oe_spin_unlock(&deque->lock);
+
+    return pushed;
+}
+
+static oe_thread_pool_task_t* _deque_pop_back(deque_t* deque)
+{
+    oe_thread_pool_task_t* task = NULL;
+
+    oe_spin_lock(&deque->lock);
+
+    if (deque->back != deque->front)
+    {
+        __atomic_store_n(&deque->back, deque->back - 1, __ATOMIC_RELAXED);
+        task = deque->tasks[deque->back % DEQUE_SIZE];
+    }
+
+    oe_spin_unlock(&deque->lock);
+
+    return task;
+}
+
+static oe_thread_pool_task_t* _deque_pop_front(deque_t* deque)
+{
+    oe_thread_pool_task_t* task = NULL;
+
+    // Do not take the lock of deques that look empty.
+    if (__atomic_load_n(&deque->back, __ATOMIC_RELAXED) ==
+        __atomic_load_n(&deque->front, __ATOMIC_RELAXED))
+        return NULL;
+
+    oe_spin_lock(&deque->lock);
+
+    if (deque->back != deque->front)
+    {
+        task = deque->tasks[deque->front % DEQUE_SIZE];
+        __atomic_store_n(&deque->front, deque->front + 1, __ATOMIC_RELAXED);
+    }
+
+    oe_spin_unlock(&deque->lock);
+
+    return task;
+}
+
+static void _shared_push_back(oe_thread_pool_task_t* task)
+{
+    oe_spin_lock(&_shared_lock);
+
+    task->next = NULL;
+    if (_shared_back)
+        _shared_back->next = task;
+    else
+        __atomic_store_n(&_shared_front, task, __ATOMIC_RELAXED);
+    _shared_back = task;
+
+    oe_spin_unlock(&_shared_lock);
+}
+
+static oe_thread_pool_task_t* _shared_pop_front(void)
+{
+    oe_thread_pool_task_t* task = NULL;
+
+    if (!__atomic_load_n(&_shared_front, __ATOMIC_RELAXED))
+        return NULL;
+
+    oe_spin_lock(&_shared_lock);
+
+    if ((task = _shared_front) != NULL)
+    {
+        __atomic_store_n(&_shared_front, task->next, __ATOMIC_RELAXED);
+        if (!_shared_front)
+            _shared_back = NULL;
+    }
+
+    oe_spin_unlock(&_shared_lock);
+
+    return task;
+}
+
+/* Pop a queue entry for the worker: its own newest task first, then the
+ * oldest shared task, then the oldest task of another worker */
+static oe_thread_pool_task_t* _get_task(uint32_t worker)
+{
+    oe_thread_pool_task_t* task = NULL;
+    uint32_t max_workers = _max_workers;
+
+    if ((task = _deque_pop_back(&_deques[worker])) != NULL)
+        return task;
+
+    if ((task = _shared_pop_front()) != NULL)
+        return task;
+
+    for (uint32_t i = 1; i < max_workers; i++)
+    {
+        if ((task = _deque_pop_front(&_deques[(worker + i) % max_workers])))
+            return task;
+    }
+
+    return NULL;
+}
+
+static void _release(oe_thread_pool_task_t* task)
+{
+    if (__atomic_sub_fetch(&task->refs, 1, __ATOMIC_ACQ_REL) == 0)
+    {
+        oe_cond_destroy(&task->done);
+        oe_free(task);
+    }
+}
+
+static bool _claim(oe_thread_pool_task_t* task)
+{
+    uint32_t state = TASK_QUEUED;
+
+    if (!__atomic_compare_exchange_n(
+            &task->state,
+            &state,
+            TASK_RUNNING,
+            false,
+            __ATOMIC_ACQ_REL,
+            __ATOMIC_ACQUIRE))
+        return false;
+
+    __atomic_sub_fetch(&_num_queued, 1, __ATOMIC_SEQ_CST);
+    return true;
+}
+
+static void _run(oe_thread_pool_task_t* task)
+{
+    task->retval = task->start_routine(task->arg);
+
+    // The workers do not return from their ECALL between pthreads, so
+    // deliver the heap watermarks that the pthread crossed here.
+    if (oe_heap_watermark_pending)
+        oe_heap_watermark_notify();
+
+    oe_mutex_lock(&_mutex);
+    __atomic_store_n(&task->state, TASK_DONE, __ATOMIC_RELEASE);
+    if (task->has_joiner)
+        oe_cond_broadcast(&task->done);
+    oe_mutex_unlock(&_mutex);
+}
+
+oe_result_t oe_start_thread_pool(uint64_t num_workers)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    if (num_workers == 0 || num_workers > MAX_WORKERS)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    if (__atomic_load_n(&_max_workers, __ATOMIC_SEQ_CST))
+        OE_RAISE(OE_ALREADY_INITIALIZED);
+
+    __atomic_store_n(&_max_workers, (uint32_t)num_workers, __ATOMIC_SEQ_CST);
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+oe_result_t oe_run_thread_pool_worker(void)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_sgx_td_t* td = oe_sgx_get_td();
+    uint32_t worker = 0;
+    oe_thread_pool_task_t* task = NULL;
+
+    if (!_max_workers)
+        OE_RAISE(OE_UNSUPPORTED);
+
+    worker = __atomic_fetch_add(&_num_workers, 1, __ATOMIC_SEQ_CST);
+    if (worker >= _max_workers)
+    {
+        __atomic_sub_fetch(&_num_workers, 1, __ATOMIC_SEQ_CST);
+        OE_RAISE(OE_OUT_OF_THREADS);
+    }
+
+    td->thread_pool_worker = (uint16_t)(worker + 1);
+
+    for (;;)
+    {
+        bool stop = false;
+
+        if ((task = _get_task(worker)) != NULL)
+        {
+            if (_claim(task))
+                _run(task);
+
+            _release(task);
+            continue;
+        }
+
+        // Sleep until a task is queued. Creators check _num_idle after
+        // queuing, so either they see this worker or it sees their task.
+        oe_mutex_lock(&_mutex);
+        __atomic_add_fetch(&_num_idle, 1, __ATOMIC_SEQ_CST);
+
+        while (!__atomic_load_n(&_num_queued, __ATOMIC_SEQ_CST) &&
+               !_is_stopping)
+            oe_cond_wait(&_work_available, &_mutex);
+
+        __atomic_sub_fetch(&_num_idle, 1, __ATOMIC_SEQ_CST);
+
+        // Finish the queued tasks before stopping.
+        stop = _is_stopping &&
+               !__atomic_load_n(&_num_queued, __ATOMIC_SEQ_CST);
+        oe_mutex_unlock(&_mutex);
+
+        if (stop)
+            break;
+    }
+
+    // All the tasks are claimed, but the queue entries of the tasks that
+    // joiners claimed still hold a reference to them. Drop these entries.
+    while ((task = _get_task(worker)) != NULL)
+    {
+        if (_claim(task))
+            _run(task);
+
+        _release(task);
+    }
+
+    td->thread_pool_worker = 0;
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+oe_result_t oe_stop_thread_pool(void)
+{
+    oe_mutex_lock(&_mutex);
+    __atomic_store_n(&_is_stopping, true, __ATOMIC_SEQ_CST);
+    oe_cond_broadcast(&_work_available);
+    oe_mutex_unlock(&_mutex);
+
+    return OE_OK;
+}
+
+oe_result_t oe_thread_pool_create(
+    oe_thread_pool_task_t** task_out,
+    void* (*start_routine)(void*),
+    void* arg)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_thread_pool_task_t* task = NULL;
+    uint16_t worker = oe_sgx_get_td()->thread_pool_worker;
+
+    if (!task_out || !start_routine)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Not an error worth tracing: pthread_create() probes the pool.
+    if (!__atomic_load_n(&_max_workers, __ATOMIC_SEQ_CST))
+    {
+        result = OE_UNSUPPORTED;
+        goto done;
+    }
+
+    if (!(task = (oe_thread_pool_task_t*)oe_calloc(1, sizeof(*task))))
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    task->start_routine = start_routine;
+    task->arg = arg;
+    task->state = TASK_QUEUED;
+    task->refs = 2;
+    OE_CHECK(oe_cond_init(&task->done));
+
+    // Count the task before queuing it, so that a worker that claims it
+    // right away does not see the count drop below zero.
+    __atomic_add_fetch(&_num_queued, 1, __ATOMIC_SEQ_CST);
+
+    // A worker only stops once it sees no queued task after the pool is
+    // stopping. So if the pool is not stopping yet, some worker will see
+    // this task. Workers that create tasks are still running themselves.
+    if (!worker && __atomic_load_n(&_is_stopping, __ATOMIC_SEQ_CST))
+    {
+        __atomic_sub_fetch(&_num_queued, 1, __ATOMIC_SEQ_CST);
+        OE_RAISE_NO_TRACE(OE_OUT_OF_THREADS);
+    }
+
+    if (!worker || !_deque_push_back(&_deques[worker - 1], task))
+        _shared_push_back(task);
+
+    if (__atomic_load_n(&_num_idle, __ATOMIC_SEQ_CST))
+    {
+        oe_mutex_lock(&_mutex);
+        oe_cond_signal(&_work_available);
+        oe_mutex_unlock(&_mutex);
+    }
+
+    *task_out = task;
+    task = NULL;
+    result = OE_OK;
+
+done:
+    if (task)
+        oe_free(task);
+
+    return result;
+}
+
+oe_result_t oe_thread_pool_join(oe_thread_pool_task_t* task, void** retval)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    if (!task)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // Run the task here if no worker has started it yet.
+    if (_claim(task))
+    {
+        _run(task);
+    }
+    else
+    {
+        oe_mutex_lock(&_mutex);
+
+        while (task->state != TASK_DONE)
+        {
+            task->has_joiner = true;
+            oe_cond_wait(&task->done, &_mutex);
+        }
+
+        oe_mutex_unlock(&_mutex);
+    }
+
+    if (retval)
+        *retval = task->retval;
+
+    _release(task);
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+oe_result_t oe_thread_pool_detach(oe_thread_pool_task_t* task)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    if (!task)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    _release(task);
+    result = OE_OK;
+
+done:
+    return result;
+}
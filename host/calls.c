@@ -3,10 +3,18 @@
 
 #include <openenclave/host.h>
 #include <openenclave/internal/raise.h>
+#include <openenclave/internal/safemath.h>
+#include <stdlib.h>
 
 #include "calls.h"
 #include "ecall_ids.h"
 
+/*
+** Batches up to this size are marshalled on the stack. Larger batches are
+** marshalled into a heap buffer.
+*/
+#define OE_ECALL_BATCH_STACK_SIZE 16
+
 /*
 **==============================================================================
 **
@@ -109,3 +117,92 @@ oe_result_t oe_call_enclave_function(
 done:
     return result;
 }
+
+/*
+**==============================================================================
+**
+** oe_call_enclave_function_batch()
+**
+** Call a batch of enclave functions in the default function table with a
+** single enclave entry.
+**
+**==============================================================================
+*/
+
+oe_result_t oe_call_enclave_function_batch(
+    oe_enclave_t* enclave,
+    oe_enclave_function_call_t* calls,
+    size_t num_calls)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_call_enclave_function_args_t stack_args[OE_ECALL_BATCH_STACK_SIZE];
+    oe_call_enclave_function_args_t* args = stack_args;
+    oe_call_enclave_function_batch_args_t batch_args;
+    size_t args_size = 0;
+
+    /* Reject invalid parameters */
+    if (!enclave || !calls || num_calls == 0)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    if (num_calls > OE_COUNTOF(stack_args))
+    {
+        OE_CHECK(oe_safe_mul_sizet(
+            num_calls, sizeof(oe_call_enclave_function_args_t), &args_size));
+
+        if (!(args = (oe_call_enclave_function_args_t*)malloc(args_size)))
+            OE_RAISE(OE_OUT_OF_MEMORY);
+    }
+
+    /* Initialize the call_enclave_args structure of each call */
+    for (size_t i = 0; i < num_calls; i++)
+    {
+        uint64_t function_id = OE_UINT64_MAX;
+
+        calls[i].output_bytes_written = 0;
+        calls[i].result = OE_UNEXPECTED;
+
+        OE_CHECK(oe_get_ecall_ids(
+            enclave, calls[i].name, calls[i].global_id, &function_id));
+
+        args[i].function_id = function_id;
+        args[i].input_buffer = calls[i].input_buffer;
+        args[i].input_buffer_size = calls[i].input_buffer_size;
+        args[i].output_buffer = calls[i].output_buffer;
+        args[i].output_buffer_size = calls[i].output_buffer_size;
+        args[i].output_bytes_written = 0;
+        args[i].result = OE_UNEXPECTED;
+    }
+
+    batch_args.calls = args;
+    batch_args.num_calls = num_calls;
+    batch_args.num_completed = 0;
+
+    /* Perform the ECALL */
+    {
+        uint64_t arg_out = 0;
+
+        OE_CHECK(oe_ecall(
+            enclave,
+            OE_ECALL_CALL_ENCLAVE_FUNCTION_BATCH,
+            (uint64_t)&batch_args,
+            &arg_out));
+        OE_CHECK((oe_result_t)arg_out);
+    }
+
+    /* Report the per-call results */
+    for (size_t i = 0; i < batch_args.num_completed && i < num_calls; i++)
+    {
+        calls[i].result = args[i].result;
+
+        if (args[i].result == OE_OK)
+            calls[i].output_bytes_written = args[i].output_bytes_written;
+    }
+
+    result = OE_OK;
+
+done:
+    if (args != stack_args)
+        free(args);
+
+    return result;
+}
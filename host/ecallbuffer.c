@@ -0,0 +1,176 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/edger8r/host.h>
+#include <openenclave/internal/utils.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "hostthread.h"
+
+/*
+**==============================================================================
+**
+** Ecall buffer pool
+**
+**     oeedger8r-generated host stubs marshal the arguments of every ecall
+**     into a buffer obtained from oe_allocate_ecall_buffer(). To avoid a
+**     malloc() and free() per ecall, freed buffers are kept in a pool that is
+**     private to each host thread. Buffers are rounded up to a power of two
+**     between OE_ECALL_BUFFER_MIN_SIZE and OE_ECALL_BUFFER_MAX_SIZE, and each
+**     size class keeps up to OE_ECALL_BUFFER_POOL_DEPTH free buffers, since
+**     ecalls made from ocalls are in flight at the same time as the outer
+**     ecall. Larger buffers are not pooled. The pool of a thread is freed when
+**     the thread exits.
+**
+**==============================================================================
+*/
+
+#define OE_ECALL_BUFFER_MIN_SIZE 64
+#define OE_ECALL_BUFFER_MAX_SIZE (64 * 1024)
+#define OE_ECALL_BUFFER_NUM_CLASSES 11
+#define OE_ECALL_BUFFER_POOL_DEPTH 4
+
+OE_STATIC_ASSERT(
+    OE_ECALL_BUFFER_MIN_SIZE << (OE_ECALL_BUFFER_NUM_CLASSES - 1) ==
+    OE_ECALL_BUFFER_MAX_SIZE);
+
+/* Precedes each buffer. Its size preserves the alignment of malloc() */
+typedef struct _ecall_buffer_header
+{
+    /* The size class, or OE_ECALL_BUFFER_NUM_CLASSES if not pooled */
+    uint64_t size_class;
+    uint64_t padding;
+} ecall_buffer_header_t;
+
+OE_STATIC_ASSERT(sizeof(ecall_buffer_header_t) == OE_EDGER8R_BUFFER_ALIGNMENT);
+
+typedef struct _ecall_buffer_pool
+{
+    ecall_buffer_header_t* buffers[OE_ECALL_BUFFER_NUM_CLASSES]
+                                  [OE_ECALL_BUFFER_POOL_DEPTH];
+    size_t num_buffers[OE_ECALL_BUFFER_NUM_CLASSES];
+} ecall_buffer_pool_t;
+
+static oe_once_type _pool_once = OE_H_ONCE_INITIALIZER;
+static oe_thread_key _pool_key;
+static bool _pool_key_created;
+
+static void _free_pool(void* arg)
+{
+    ecall_buffer_pool_t* pool = (ecall_buffer_pool_t*)arg;
+
+    for (size_t i = 0; i < OE_ECALL_BUFFER_NUM_CLASSES; i++)
+    {
+        for (size_t j = 0; j < pool->num_buffers[i]; j++)
+            free(pool->buffers[i][j]);
+    }
+
+    free(pool);
+}
+
+static void _create_pool_key(void)
+{
+    _pool_key_created =
+        oe_thread_key_create_with_destructor(&_pool_key, _free_pool) == 0;
+}
+
+/* Return the pool of the calling thread, or NULL if it cannot be created */
+static ecall_buffer_pool_t* _get_pool(void)
+{
+    ecall_buffer_pool_t* pool;
+
+    oe_once(&_pool_once, _create_pool_key);
+
+    if (!_pool_key_created)
+        return NULL;
+
+    if (!(pool = (ecall_buffer_pool_t*)oe_thread_getspecific(_pool_key)))
+    {
+        if ((pool = (ecall_buffer_pool_t*)calloc(1, sizeof(*pool))) &&
+            oe_thread_setspecific(_pool_key, pool) != 0)
+        {
+            free(pool);
+            pool = NULL;
+        }
+    }
+
+    return pool;
+}
+
+/*
+**==============================================================================
+**
+** oe_allocate_ecall_buffer()
+**
+**==============================================================================
+*/
+
+void* oe_allocate_ecall_buffer(size_t size)
+{
+    ecall_buffer_header_t* header;
+    size_t size_class = OE_ECALL_BUFFER_NUM_CLASSES;
+    size_t buffer_size = size;
+
+    if (size <= OE_ECALL_BUFFER_MAX_SIZE)
+    {
+        ecall_buffer_pool_t* pool = _get_pool();
+
+        size_class = 0;
+        buffer_size = OE_ECALL_BUFFER_MIN_SIZE;
+
+        while (buffer_size < size)
+        {
+            buffer_size *= 2;
+            size_class++;
+        }
+
+        if (pool && pool->num_buffers[size_class])
+        {
+            header = pool->buffers[size_class][--pool->num_buffers[size_class]];
+            return header + 1;
+        }
+    }
+    else if (size > SIZE_MAX - sizeof(ecall_buffer_header_t))
+    {
+        return NULL;
+    }
+
+    if (!(header = (ecall_buffer_header_t*)malloc(
+              sizeof(ecall_buffer_header_t) + buffer_size)))
+        return NULL;
+
+    header->size_class = size_class;
+    return header + 1;
+}
+
+/*
+**==============================================================================
+**
+** oe_free_ecall_buffer()
+**
+**==============================================================================
+*/
+
+void oe_free_ecall_buffer(void* buffer)
+{
+    ecall_buffer_header_t* header;
+
+    if (!buffer)
+        return;
+
+    header = (ecall_buffer_header_t*)buffer - 1;
+
+    if (header->size_class < OE_ECALL_BUFFER_NUM_CLASSES)
+    {
+        ecall_buffer_pool_t* pool = _get_pool();
+        size_t size_class = header->size_class;
+
+        if (pool && pool->num_buffers[size_class] < OE_ECALL_BUFFER_POOL_DEPTH)
+        {
+            pool->buffers[size_class][pool->num_buffers[size_class]++] = header;
+            return;
+        }
+    }
+
+    free(header);
+}
@@ -206,6 +206,22 @@ int oe_mutex_destroy(oe_mutex* mutex);
  */
 int oe_thread_key_create(oe_thread_key* key);
 
+/**
+ * Create a key for accessing thread-specific data, with a destructor.
+ *
+ * This function behaves like oe_thread_key_create(). In addition, when a
+ * thread exits while its TSD entry is not NULL, the destructor is called with
+ * the value of the entry.
+ *
+ * @param key Set this key to refer to the newly allocated TSD entry.
+ * @param destructor The function to call on thread exit.
+ *
+ * @return Returns zero on success.
+ */
+int oe_thread_key_create_with_destructor(
+    oe_thread_key* key,
+    void (*destructor)(void* value));
+
 /**
  * Delete a key for accessing thread-specific data.
  *
@@ -95,6 +95,13 @@ int oe_thread_key_create(oe_thread_key* key)
     return pthread_key_create(key, NULL);
 }
 
+int oe_thread_key_create_with_destructor(
+    oe_thread_key* key,
+    void (*destructor)(void* value))
+{
+    return pthread_key_create(key, destructor);
+}
+
 int oe_thread_key_delete(oe_thread_key key)
 {
     return pthread_key_delete(key);
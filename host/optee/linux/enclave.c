@@ -582,3 +582,48 @@ oe_result_t oe_terminate_enclave(oe_enclave_t* enclave)
 done:
     return result;
 }
+
+oe_result_t oe_get_switchless_statistics(
+    oe_enclave_t* enclave,
+    oe_switchless_statistics_t* statistics)
+{
+    OE_UNUSED(enclave);
+    OE_UNUSED(statistics);
+
+    /* Switchless calls are not supported on OP-TEE */
+    return OE_UNSUPPORTED;
+}
+
+oe_result_t oe_get_heap_profile(
+    oe_enclave_t* enclave,
+    uint8_t** profile,
+    size_t* profile_size)
+{
+    OE_UNUSED(enclave);
+    OE_UNUSED(profile);
+    OE_UNUSED(profile_size);
+
+    /* The heap profiler is not supported on OP-TEE */
+    return OE_UNSUPPORTED;
+}
+
+void oe_free_heap_profile(uint8_t* profile)
+{
+    OE_UNUSED(profile);
+}
+
+oe_result_t oe_get_heap_statistics(
+    oe_enclave_t* enclave,
+    oe_heap_statistics_t** statistics)
+{
+    OE_UNUSED(enclave);
+    OE_UNUSED(statistics);
+
+    /* Heap statistics are not supported on OP-TEE */
+    return OE_UNSUPPORTED;
+}
+
+void oe_free_heap_statistics(oe_heap_statistics_t* statistics)
+{
+    OE_UNUSED(statistics);
+}
@@ -20,6 +20,7 @@
 
 #include <openenclave/bits/sgx/sgxtypes.h>
 #include <openenclave/host.h>
+#include <openenclave/internal/atomic.h>
 #include <openenclave/internal/calls.h>
 #include <openenclave/internal/debugrt/host.h>
 #include <openenclave/internal/raise.h>
@@ -34,6 +35,7 @@
 #include "../ocalls/ocalls.h"
 #include "asmdefs.h"
 #include "enclave.h"
+#include "heapwatermark.h"
 #include "ocalls/ocalls.h"
 
 /*
@@ -50,9 +52,13 @@
 static oe_once_type _thread_binding_once;
 static oe_thread_key _thread_binding_key;
 
+/* The binding most recently released by the current thread */
+static oe_thread_key _cached_binding_key;
+
 static void _create_thread_binding_key(void)
 {
     oe_thread_key_create(&_thread_binding_key);
+    oe_thread_key_create(&_cached_binding_key);
 }
 
 static void _set_thread_binding(oe_thread_binding_t* binding)
@@ -285,7 +291,8 @@ static const char* oe_ocall_str(oe_func_t ocall)
         "THREAD_WAIT",
         "MALLOC",
         "FREE",
-        "GET_TIME"
+        "GET_TIME",
+        "HEAP_WATERMARK"
     };
     // clang-format on
 
@@ -306,7 +313,16 @@ static const char* oe_ecall_str(oe_func_t ecall)
         "INIT_ENCLAVE",
         "CALL_ENCLAVE_FUNCTION",
         "VIRTUAL_EXCEPTION_HANDLER",
-        "CALL_AT_EXIT_FUNCTIONS"
+        "CALL_AT_EXIT_FUNCTIONS",
+        "CALL_ENCLAVE_FUNCTION_BATCH",
+        "CONFIGURE_SHARED_MEMORY",
+        "START_THREAD_POOL",
+        "THREAD_POOL_WORKER",
+        "STOP_THREAD_POOL",
+        "START_HEAP_PROFILER",
+        "GET_HEAP_PROFILE",
+        "GET_HEAP_STATISTICS",
+        "START_HEAP_STATISTICS"
     };
     // clang-format on
 
@@ -377,6 +393,10 @@ static oe_result_t _handle_ocall(
             oe_handle_get_time(arg_in, arg_out);
             break;
 
+        case OE_OCALL_HEAP_WATERMARK:
+            oe_handle_heap_watermark(enclave, arg_in);
+            break;
+
         default:
         {
             /* No function found with the number */
@@ -448,6 +468,84 @@ int __oe_dispatch_ocall(
     return 1;
 }
 
+/*
+**==============================================================================
+**
+** _find_nested_binding()
+**
+**     Find the busy binding of the given enclave that is owned by the calling
+**     thread, if any. The thread binding in TSD is checked first. It does not
+**     refer to the enclave if the calling thread is in an OCALL that made an
+**     ECALL into another enclave, or if that ECALL returned, which clears the
+**     TSD. In both cases the busy bindings of the enclave are scanned.
+**
+**     A nested ECALL must run on the TCS of the outer one: the enclave only
+**     accepts the ECALLs that handle exceptions and terminate the enclave
+**     there, and rejects the others with OE_REENTRANT_ECALL. On another TCS,
+**     they would run as if the thread were not in the enclave.
+**
+**     The thread field of a binding is only set to the current thread by the
+**     current thread, so it can be read without holding the enclave lock.
+**
+**==============================================================================
+*/
+
+static oe_thread_binding_t* _find_nested_binding(
+    oe_enclave_t* enclave,
+    oe_thread_t thread)
+{
+    oe_thread_binding_t* binding = oe_get_thread_binding();
+    uint64_t busy_bindings;
+
+    if (binding && binding->enclave == enclave)
+        return binding;
+
+    /* Only the bindings missing from the free bitmap can be busy */
+    busy_bindings = ~oe_atomic_load(&enclave->free_bindings);
+
+    for (size_t i = 0; i < enclave->num_bindings; i++)
+    {
+        if (!(busy_bindings & (1ULL << i)))
+            continue;
+
+        binding = &enclave->bindings[i];
+
+        if ((binding->flags & _OE_THREAD_BUSY) && binding->thread == thread)
+            return binding;
+    }
+
+    return NULL;
+}
+
+/*
+**==============================================================================
+**
+** _claim_binding()
+**
+**     Atomically remove the given binding from the enclave's free bitmap.
+**     Returns false if another thread claimed it first.
+**
+**==============================================================================
+*/
+
+static bool _claim_binding(oe_enclave_t* enclave, size_t index)
+{
+    const uint64_t mask = 1ULL << index;
+    uint64_t free_bindings;
+
+    do
+    {
+        free_bindings = oe_atomic_load(&enclave->free_bindings);
+        if (!(free_bindings & mask))
+            return false;
+    } while (!oe_atomic_compare_and_swap(
+        (volatile int64_t*)&enclave->free_bindings,
+        (int64_t)free_bindings,
+        (int64_t)(free_bindings & ~mask)));
+
+    return true;
+}
+
 /*
 **==============================================================================
 **
@@ -458,72 +556,81 @@ int __oe_dispatch_ocall(
 **         - an enclave thread context
 **
 **     If such a binding already exists, the binding's count in incremented.
-**     Else, the calling host thread is bound to the first available enclave
-**     thread context.
+**     Else, the calling host thread is bound to an available enclave thread
+**     context, preferring the one it used last.
+**
+**     Available bindings are tracked in the enclave's free bitmap, so no lock
+**     is taken: a binding belongs to the thread that cleared its bit until
+**     the bit is set again by _release_tcs().
 **
-**     Returns the address of the thread control structure (TCS) corresponding
-**     to the enclave thread context.
+**     Returns the binding of the enclave thread context.
 **
 **==============================================================================
 */
 
-static void* _assign_tcs(oe_enclave_t* enclave)
+static oe_thread_binding_t* _assign_tcs(oe_enclave_t* enclave)
 {
-    void* tcs = NULL;
-    size_t i;
     oe_thread_t thread = oe_thread_self();
+    oe_thread_binding_t* binding;
 
-    oe_mutex_lock(&enclave->lock);
+    /* First attempt to find a busy binding owned by this thread */
+    if ((binding = _find_nested_binding(enclave, thread)))
     {
-        /* First attempt to find a busy oe_sgx_td_t owned by this thread */
-        for (i = 0; i < enclave->num_bindings; i++)
-        {
-            oe_thread_binding_t* binding = &enclave->bindings[i];
+        binding->count++;
 
-            if ((binding->flags & _OE_THREAD_BUSY) && binding->thread == thread)
-            {
-                binding->count++;
-                tcs = (void*)binding->tcs;
+        /* Notify the debugger runtime */
+        if (enclave->debug && enclave->debug_enclave != NULL)
+            oe_debug_push_thread_binding(
+                enclave->debug_enclave, (sgx_tcs_t*)binding->tcs);
 
-                /* Notify the debugger runtime */
-                if (enclave->debug && enclave->debug_enclave != NULL)
-                    oe_debug_push_thread_binding(
-                        enclave->debug_enclave, (sgx_tcs_t*)tcs);
-                break;
-            }
-        }
+        return binding;
+    }
 
-        /* If binding not found above, look for an available ThreadBinding */
-        if (!tcs)
+    /* Then try the binding this thread used last. The cached pointer may be
+     * stale, so it is only compared against this enclave's bindings and never
+     * dereferenced otherwise */
+    binding = (oe_thread_binding_t*)oe_thread_getspecific(_cached_binding_key);
+
+    if (!(binding >= enclave->bindings &&
+          binding < enclave->bindings + enclave->num_bindings &&
+          _claim_binding(enclave, (size_t)(binding - enclave->bindings))))
+    {
+        binding = NULL;
+
+        /* Look for any available binding */
+        for (;;)
         {
-            for (i = 0; i < enclave->num_bindings; i++)
+            uint64_t free_bindings = oe_atomic_load(&enclave->free_bindings);
+            size_t i = 0;
+
+            if (!free_bindings)
+                return NULL;
+
+            while (!(free_bindings & (1ULL << i)))
+                i++;
+
+            if (_claim_binding(enclave, i))
             {
-                oe_thread_binding_t* binding = &enclave->bindings[i];
-
-                if (!(binding->flags & _OE_THREAD_BUSY))
-                {
-                    binding->flags |= _OE_THREAD_BUSY;
-                    binding->thread = thread;
-                    binding->count = 1;
-
-                    tcs = (void*)binding->tcs;
-
-                    /* Set into TSD so asynchronous exceptions can get it */
-                    _set_thread_binding(binding);
-                    assert(oe_get_thread_binding() == binding);
-
-                    /* Notify the debugger runtime */
-                    if (enclave->debug && enclave->debug_enclave != NULL)
-                        oe_debug_push_thread_binding(
-                            enclave->debug_enclave, (sgx_tcs_t*)tcs);
-                    break;
-                }
+                binding = &enclave->bindings[i];
+                break;
             }
         }
     }
-    oe_mutex_unlock(&enclave->lock);
 
-    return tcs;
+    binding->flags |= _OE_THREAD_BUSY;
+    binding->thread = thread;
+    binding->count = 1;
+
+    /* Set into TSD so asynchronous exceptions can get it */
+    _set_thread_binding(binding);
+    assert(oe_get_thread_binding() == binding);
+
+    /* Notify the debugger runtime */
+    if (enclave->debug && enclave->debug_enclave != NULL)
+        oe_debug_push_thread_binding(
+            enclave->debug_enclave, (sgx_tcs_t*)binding->tcs);
+
+    return binding;
 }
 
 /*
@@ -531,44 +638,44 @@ static void* _assign_tcs(oe_enclave_t* enclave)
 **
 ** _release_tcs()
 **
-**     Decrement the ThreadBinding.count field of the binding associated with
-**     the given TCS. If the field becomes zero, the binding is dissolved.
+**     Decrement the count field of the given binding. If the field becomes
+**     zero, the binding is dissolved and returned to the enclave's free
+**     bitmap.
 **
 **==============================================================================
 */
 
-static void _release_tcs(oe_enclave_t* enclave, void* tcs)
+static void _release_tcs(oe_enclave_t* enclave, oe_thread_binding_t* binding)
 {
-    size_t i;
+    const uint64_t mask = 1ULL << (binding - enclave->bindings);
+    uint64_t free_bindings;
+
+    binding->count--;
+
+    /* Notify the debugger runtime */
+    if (enclave->debug && enclave->debug_enclave != NULL)
+        oe_debug_pop_thread_binding();
 
-    oe_mutex_lock(&enclave->lock);
+    if (binding->count == 0)
     {
-        for (i = 0; i < enclave->num_bindings; i++)
-        {
-            oe_thread_binding_t* binding = &enclave->bindings[i];
+        binding->flags &= (~_OE_THREAD_BUSY);
+        binding->thread = 0;
+        memset(&binding->event, 0, sizeof(binding->event));
+        _set_thread_binding(NULL);
+        assert(oe_get_thread_binding() == NULL);
+        oe_thread_setspecific(_cached_binding_key, binding);
 
-            if ((binding->flags & _OE_THREAD_BUSY) &&
-                (void*)binding->tcs == tcs)
-            {
-                binding->count--;
-
-                /* Notify the debugger runtime */
-                if (enclave->debug && enclave->debug_enclave != NULL)
-                    oe_debug_pop_thread_binding();
-
-                if (binding->count == 0)
-                {
-                    binding->flags &= (~_OE_THREAD_BUSY);
-                    binding->thread = 0;
-                    memset(&binding->event, 0, sizeof(binding->event));
-                    _set_thread_binding(NULL);
-                    assert(oe_get_thread_binding() == NULL);
-                }
-                break;
-            }
-        }
+        /* Publish the binding only after it has been reset */
+        OE_ATOMIC_MEMORY_BARRIER_RELEASE();
+
+        do
+        {
+            free_bindings = oe_atomic_load(&enclave->free_bindings);
+        } while (!oe_atomic_compare_and_swap(
+            (volatile int64_t*)&enclave->free_bindings,
+            (int64_t)free_bindings,
+            (int64_t)(free_bindings | mask)));
     }
-    oe_mutex_unlock(&enclave->lock);
 }
 
 /*
@@ -588,7 +695,7 @@ oe_result_t oe_ecall(
     uint64_t* arg_out_ptr)
 {
     oe_result_t result = OE_UNEXPECTED;
-    void* tcs = NULL;
+    oe_thread_binding_t* binding = NULL;
     oe_code_t code = OE_CODE_ECALL;
     oe_code_t code_out = 0;
     uint16_t func_out = 0;
@@ -599,7 +706,7 @@ oe_result_t oe_ecall(
         OE_RAISE(OE_INVALID_PARAMETER);
 
     /* Assign a oe_sgx_td_t for this operation */
-    if (!(tcs = _assign_tcs(enclave)))
+    if (!(binding = _assign_tcs(enclave)))
         OE_RAISE(OE_OUT_OF_THREADS);
 
     oe_log(
@@ -607,13 +714,16 @@ oe_result_t oe_ecall(
         "%s 0x%x %s: %s\n",
         enclave->path,
         enclave->start_address,
-        func == OE_ECALL_CALL_ENCLAVE_FUNCTION ? "EDL_ECALL" : "OE_ECALL",
+        (func == OE_ECALL_CALL_ENCLAVE_FUNCTION ||
+         func == OE_ECALL_CALL_ENCLAVE_FUNCTION_BATCH)
+            ? "EDL_ECALL"
+            : "OE_ECALL",
         oe_ecall_str(func));
 
     /* Perform ECALL or ORET */
     OE_CHECK(_do_eenter(
         enclave,
-        tcs,
+        (void*)binding->tcs,
         OE_AEP_ADDRESS,
         code,
         func,
@@ -634,8 +744,8 @@ oe_result_t oe_ecall(
 
 done:
 
-    if (enclave && tcs)
-        _release_tcs(enclave, tcs);
+    if (enclave && binding)
+        _release_tcs(enclave, binding);
 
     /* ATTN: this causes an assertion with call nesting. */
     /* ATTN: make enclave argument a cookie. */
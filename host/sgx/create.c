@@ -59,8 +59,12 @@ static char* get_fullpath(const char* path)
 #include "cpuid.h"
 #include "enclave.h"
 #include "exception.h"
+#include "heapprofile.h"
+#include "heapstats.h"
+#include "heapwatermark.h"
 #include "platform_u.h"
 #include "sgxload.h"
+#include "threadpool.h"
 #include "xstate.h"
 
 #if !defined(OEHOSTMR)
@@ -219,6 +223,7 @@ static oe_result_t _add_control_pages(
             OE_RAISE_MSG(
                 OE_FAILURE, "OE_SGX_MAX_TCS (%d) hit\n", OE_SGX_MAX_TCS);
 
+        enclave->free_bindings |= 1ULL << enclave->num_bindings;
         enclave->bindings[enclave->num_bindings].enclave = enclave;
         enclave->bindings[enclave->num_bindings++].tcs =
             enclave->start_address + *vaddr;
@@ -487,6 +492,97 @@ done:
     return result;
 }
 
+/*
+** _configure_shared_memory()
+**
+** Apply the settings of the memory shared with the host inside the enclave.
+*/
+static oe_result_t _configure_shared_memory(
+    oe_enclave_t* enclave,
+    const oe_enclave_setting_shared_memory_t* setting)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_configure_shared_memory_args_t args = {0};
+    uint64_t result_out = 0;
+
+    if (!setting)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    if (setting->ocall_buffer_size && setting->ocall_buffer_max_size &&
+        setting->ocall_buffer_size > setting->ocall_buffer_max_size)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    args.arena_chunk_size = setting->arena_chunk_size;
+    args.arena_max_size = setting->arena_max_size;
+
+    // Donate the first region of the host heap. The enclave owns it once
+    // the ECALL succeeds.
+    if (setting->host_heap_size)
+    {
+        args.host_heap_size = setting->host_heap_size;
+        args.host_heap_max_size = setting->host_heap_max_size;
+
+        if (!args.host_heap_max_size)
+        {
+            if (args.host_heap_size > OE_SIZE_MAX / 8)
+                OE_RAISE(OE_INVALID_PARAMETER);
+
+            args.host_heap_max_size = 8 * args.host_heap_size;
+        }
+
+        if (!(args.host_heap = malloc(args.host_heap_size)))
+            OE_RAISE(OE_OUT_OF_MEMORY);
+    }
+
+    OE_CHECK(oe_ecall(
+        enclave,
+        OE_ECALL_CONFIGURE_SHARED_MEMORY,
+        (uint64_t)&args,
+        &result_out));
+
+    if (result_out > OE_UINT32_MAX)
+        OE_RAISE(OE_FAILURE);
+
+    if (!oe_is_valid_result((uint32_t)result_out))
+        OE_RAISE(OE_FAILURE);
+
+    OE_CHECK((oe_result_t)result_out);
+
+    args.host_heap = NULL;
+
+    // The ocall buffers of the bindings are sized on the host. Buffers that
+    // were allocated by earlier ECALLs grow on the next ECALL.
+    enclave->ocall_buffer_size = setting->ocall_buffer_size;
+    enclave->ocall_buffer_max_size = setting->ocall_buffer_max_size;
+
+    result = OE_OK;
+
+done:
+    free(args.host_heap);
+
+    return result;
+}
+
+/*
+** _find_setting()
+**
+** Find the first setting of the given type, or return NULL.
+*/
+
+static const oe_enclave_setting_t* _find_setting(
+    const oe_enclave_setting_t* settings,
+    uint32_t setting_count,
+    oe_enclave_setting_type_t setting_type)
+{
+    for (uint32_t i = 0; i < setting_count; i++)
+    {
+        if (settings[i].setting_type == setting_type)
+            return &settings[i];
+    }
+
+    return NULL;
+}
+
 /*
 ** _config_enclave()
 **
@@ -499,6 +595,8 @@ static oe_result_t _configure_enclave(
     uint32_t setting_count)
 {
     oe_result_t result = OE_UNEXPECTED;
+    const oe_enclave_setting_t* workers_setting = _find_setting(
+        settings, setting_count, OE_ENCLAVE_SETTING_SWITCHLESS_WORKERS);
 
     for (uint32_t i = 0; i < setting_count; i++)
     {
@@ -507,14 +605,61 @@ static oe_result_t _configure_enclave(
             // Configure the switchless ocalls, such as the number of workers.
             case OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS:
             {
-                size_t max_host_workers =
-                    settings[i].u.context_switchless_setting->max_host_workers;
-                size_t max_enclave_workers =
-                    settings[i]
-                        .u.context_switchless_setting->max_enclave_workers;
-
                 OE_CHECK(oe_start_switchless_manager(
-                    enclave, max_host_workers, max_enclave_workers));
+                    enclave,
+                    settings[i].u.context_switchless_setting,
+                    workers_setting
+                        ? workers_setting->u.switchless_workers_setting
+                        : NULL));
+                break;
+            }
+            // Tune the switchless workers. The setting is applied above.
+            case OE_ENCLAVE_SETTING_SWITCHLESS_WORKERS:
+            {
+                if (!_find_setting(
+                        settings,
+                        setting_count,
+                        OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS))
+                    OE_RAISE_MSG(
+                        OE_INVALID_PARAMETER,
+                        "OE_ENCLAVE_SETTING_SWITCHLESS_WORKERS requires "
+                        "OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS",
+                        NULL);
+                break;
+            }
+            // Configure the shared memory, such as the size of the arenas.
+            case OE_ENCLAVE_SETTING_SHARED_MEMORY:
+            {
+                OE_CHECK(_configure_shared_memory(
+                    enclave, settings[i].u.shared_memory_setting));
+                break;
+            }
+            // Donate threads that run the pthreads of the enclave.
+            case OE_ENCLAVE_SETTING_THREAD_POOL:
+            {
+                OE_CHECK(oe_start_enclave_thread_pool(
+                    enclave, settings[i].u.thread_pool_setting));
+                break;
+            }
+            // Make the enclave sample its allocations.
+            case OE_ENCLAVE_SETTING_HEAP_PROFILER:
+            {
+                OE_CHECK(oe_start_enclave_heap_profiler(
+                    enclave, settings[i].u.heap_profiler_setting));
+                break;
+            }
+            // Make the enclave count its allocations.
+            case OE_ENCLAVE_SETTING_HEAP_STATISTICS:
+            {
+                OE_CHECK(oe_start_enclave_heap_statistics(
+                    enclave, settings[i].u.heap_statistics_setting));
+                break;
+            }
+            // Notify the host of the heap watermarks of the enclave.
+            case OE_ENCLAVE_SETTING_HEAP_WATERMARK:
+            {
+                OE_CHECK(oe_configure_enclave_heap_watermark(
+                    enclave, settings[i].u.heap_watermark_setting));
                 break;
             }
             case OE_SGX_ENCLAVE_CONFIG_DATA:
@@ -1134,6 +1279,7 @@ oe_result_t oe_create_enclave(
     oe_result_t result = OE_UNEXPECTED;
     oe_enclave_t* enclave = NULL;
     oe_sgx_load_context_t context;
+    bool pushed = false;
 
     _initialize_enclave_host();
 
@@ -1211,6 +1357,7 @@ oe_result_t oe_create_enclave(
     {
         OE_RAISE(OE_FAILURE);
     }
+    pushed = true;
 
     // Notify debugger above the enclave and any modules.
     if (enclave->debug)
@@ -1264,6 +1411,15 @@ done:
 
     if (result != OE_OK && enclave)
     {
+        /* Stop the threads that the settings started in the enclave */
+        oe_stop_enclave_thread_pool(enclave);
+        oe_stop_switchless_manager(enclave);
+
+        /* Remove the enclave from the global list and the TCS index before
+         * its memory can be reused by another enclave */
+        if (pushed)
+            oe_remove_enclave_instance(enclave);
+
         free(enclave);
     }
 
@@ -1280,6 +1436,13 @@ oe_result_t oe_terminate_enclave(oe_enclave_t* enclave)
     if (!enclave || enclave->magic != ENCLAVE_MAGIC)
         OE_RAISE(OE_INVALID_PARAMETER);
 
+    /* Stop the thread pool before calling exit functions, so that no pthread
+     * of the pool runs while they tear down the state of the enclave. The
+     * pool finishes the queued pthreads first, and pthread_create() fails
+     * in the exit functions. Stop it before the switchless manager too,
+     * which the pool threads may use */
+    OE_CHECK(oe_stop_enclave_thread_pool(enclave));
+
     /* Call the atexit functions (e.g., registered by atexit or the
      * destructor attribute) */
     result = oe_ecall(enclave, OE_ECALL_CALL_AT_EXIT_FUNCTIONS, 0, NULL);
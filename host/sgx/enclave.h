@@ -114,6 +114,9 @@ typedef struct _oe_enclave
     size_t num_bindings;
     oe_mutex lock;
 
+    /* Bitmap of the bindings that are not assigned to a host thread */
+    volatile uint64_t free_bindings;
+
     /* Hash of enclave (MRENCLAVE) */
     OE_SHA256 hash;
 
@@ -134,10 +137,22 @@ typedef struct _oe_enclave
     /* Manager for switchless calls */
     oe_switchless_call_manager_t* switchless_manager;
 
+    /* Threads donated to the enclave (see threadpool.c) */
+    struct _oe_thread_pool* thread_pool;
+
+    /* Callback of the heap watermarks of the enclave (see heapwatermark.c) */
+    oe_enclave_heap_watermark_callback_t heap_watermark_callback;
+    void* heap_watermark_context;
+
     /* Table of global to local ecall ids */
     oe_ecall_id_t* ecall_id_table;
     size_t ecall_id_table_size;
     size_t num_ecalls;
+
+    /* Size of the ocall buffers of the bindings, which grows when the
+     * enclave asks for it, and its max. 0 means the default */
+    volatile uint64_t ocall_buffer_size;
+    uint64_t ocall_buffer_max_size;
 } oe_enclave_t;
 
 /* Get the event for the given TCS */
@@ -3,8 +3,10 @@
 
 #include <assert.h>
 #include <openenclave/host.h>
+#include <openenclave/internal/atomic.h>
 #include <openenclave/internal/queue.h>
 #include <openenclave/internal/trace.h>
+#include <openenclave/internal/utils.h>
 #include "enclave.h"
 
 static OE_LIST_HEAD(EnclaveListHead, _enclave_entry) oe_enclave_list_head;
@@ -16,6 +18,252 @@ typedef struct _enclave_entry
     oe_enclave_t* enclave;
 } EnclaveEntry;
 
+/*
+**==============================================================================
+**
+** TCS index
+**
+**     Open-addressing hash table that maps the address of every TCS of the
+**     enclaves in the global list to its enclave. The table is only modified
+**     with oe_enclave_list_lock held, and is read without any lock by
+**     oe_query_enclave_instance(), which runs on the exception path.
+**
+**     An entry is published by writing its enclave before its TCS, and is
+**     removed by clearing its enclave before replacing its TCS with
+**     _TCS_INDEX_REMOVED. Readers check that the TCS of an entry did not
+**     change while they read its enclave.
+**
+**     When the table fills up with entries or removed entries, it is rebuilt
+**     into a new table. The old table is kept on the retired list of the new
+**     one and is freed once no reader is active.
+**
+**==============================================================================
+*/
+
+#define _TCS_INDEX_MIN_CAPACITY 64
+#define _TCS_INDEX_REMOVED ((uint64_t)-1)
+
+typedef struct _tcs_index_entry
+{
+    volatile uint64_t tcs;
+    oe_enclave_t* volatile enclave;
+} tcs_index_entry_t;
+
+typedef struct _tcs_index
+{
+    /* Power of two */
+    size_t capacity;
+
+    /* Number of entries in use */
+    size_t count;
+
+    /* Number of entries in use or removed */
+    size_t used;
+
+    /* The tables that this table replaced */
+    struct _tcs_index* retired;
+
+    tcs_index_entry_t entries[];
+} tcs_index_t;
+
+static tcs_index_t* volatile _tcs_index;
+
+/* Number of threads in _tcs_index_find() */
+static volatile uint64_t _tcs_index_readers;
+
+static size_t _tcs_index_hash(uint64_t tcs, size_t capacity)
+{
+    /* TCS pages are page aligned; spread the page numbers over the table */
+    return (size_t)(((tcs >> 12) * 0x9E3779B97F4A7C15ULL) >> 32) &
+           (capacity - 1);
+}
+
+/* Called with oe_enclave_list_lock held */
+static void _tcs_index_insert(
+    tcs_index_t* index,
+    uint64_t tcs,
+    oe_enclave_t* enclave)
+{
+    size_t i = _tcs_index_hash(tcs, index->capacity);
+
+    for (;;)
+    {
+        tcs_index_entry_t* entry = &index->entries[i];
+
+        if (entry->tcs == 0 || entry->tcs == _TCS_INDEX_REMOVED)
+        {
+            if (entry->tcs == 0)
+                index->used++;
+
+            entry->enclave = enclave;
+            OE_ATOMIC_MEMORY_BARRIER_RELEASE();
+            entry->tcs = tcs;
+            index->count++;
+            return;
+        }
+
+        i = (i + 1) & (index->capacity - 1);
+    }
+}
+
+/* Called with oe_enclave_list_lock held */
+static void _tcs_index_remove(tcs_index_t* index, uint64_t tcs)
+{
+    size_t i = _tcs_index_hash(tcs, index->capacity);
+
+    for (size_t n = 0; n < index->capacity; n++)
+    {
+        tcs_index_entry_t* entry = &index->entries[i];
+
+        if (entry->tcs == 0)
+            return;
+
+        if (entry->tcs == tcs)
+        {
+            entry->enclave = NULL;
+            OE_ATOMIC_MEMORY_BARRIER_RELEASE();
+            entry->tcs = _TCS_INDEX_REMOVED;
+            index->count--;
+            return;
+        }
+
+        i = (i + 1) & (index->capacity - 1);
+    }
+}
+
+/* Free the retired tables if no reader can be using them. Called with
+ * oe_enclave_list_lock held */
+static void _tcs_index_reclaim(void)
+{
+    tcs_index_t* index = _tcs_index;
+
+    if (index && index->retired && oe_atomic_load(&_tcs_index_readers) == 0)
+    {
+        tcs_index_t* retired = index->retired;
+
+        index->retired = NULL;
+
+        while (retired)
+        {
+            tcs_index_t* next = retired->retired;
+            free(retired);
+            retired = next;
+        }
+    }
+}
+
+/* Add all the TCSs of the enclave to the index, rebuilding it if needed.
+ * Called with oe_enclave_list_lock held */
+static bool _tcs_index_add_enclave(oe_enclave_t* enclave)
+{
+    tcs_index_t* index = _tcs_index;
+    size_t count = (index ? index->count : 0) + enclave->num_bindings;
+    size_t used = (index ? index->used : 0) + enclave->num_bindings;
+
+    /* Keep at most half of the entries in use and a quarter of them free */
+    if (!index || count * 2 > index->capacity || used * 4 > index->capacity * 3)
+    {
+        size_t capacity = _TCS_INDEX_MIN_CAPACITY;
+        tcs_index_t* new_index;
+
+        while (count * 2 > capacity)
+            capacity *= 2;
+
+        if (!(new_index = (tcs_index_t*)calloc(
+                  1,
+                  sizeof(tcs_index_t) + capacity * sizeof(tcs_index_entry_t))))
+            return false;
+
+        new_index->capacity = capacity;
+
+        if (index)
+        {
+            for (size_t i = 0; i < index->capacity; i++)
+            {
+                tcs_index_entry_t* entry = &index->entries[i];
+
+                if (entry->tcs != 0 && entry->tcs != _TCS_INDEX_REMOVED)
+                    _tcs_index_insert(new_index, entry->tcs, entry->enclave);
+            }
+        }
+
+        new_index->retired = index;
+
+        /* Publish the table only after it has been filled. This is a full
+         * barrier, which orders it before the load of the reader count in
+         * _tcs_index_reclaim() */
+        if (!oe_atomic_compare_and_swap_ptr(
+                (void* volatile*)&_tcs_index, index, new_index))
+            abort();
+
+        index = new_index;
+    }
+
+    for (size_t i = 0; i < enclave->num_bindings; i++)
+        _tcs_index_insert(index, enclave->bindings[i].tcs, enclave);
+
+    return true;
+}
+
+/* Remove all the TCSs of the enclave from the index. Called with
+ * oe_enclave_list_lock held */
+static void _tcs_index_remove_enclave(oe_enclave_t* enclave)
+{
+    if (_tcs_index)
+    {
+        for (size_t i = 0; i < enclave->num_bindings; i++)
+            _tcs_index_remove(_tcs_index, enclave->bindings[i].tcs);
+    }
+}
+
+/* Look up the enclave that owns the TCS without taking any lock */
+static oe_enclave_t* _tcs_index_find(uint64_t tcs)
+{
+    oe_enclave_t* enclave = NULL;
+    tcs_index_t* index;
+
+    if (tcs == 0 || tcs == _TCS_INDEX_REMOVED)
+        return NULL;
+
+    /* This is a full barrier, which orders it before the load of the table */
+    oe_atomic_increment(&_tcs_index_readers);
+
+    if ((index = _tcs_index))
+    {
+        size_t i = _tcs_index_hash(tcs, index->capacity);
+
+        OE_ATOMIC_MEMORY_BARRIER_ACQUIRE();
+
+        for (size_t n = 0; n < index->capacity; n++)
+        {
+            tcs_index_entry_t* entry = &index->entries[i];
+            uint64_t entry_tcs = entry->tcs;
+
+            if (entry_tcs == 0)
+                break;
+
+            if (entry_tcs == tcs)
+            {
+                OE_ATOMIC_MEMORY_BARRIER_ACQUIRE();
+                enclave = entry->enclave;
+                OE_ATOMIC_MEMORY_BARRIER_ACQUIRE();
+
+                /* The entry was removed while its enclave was being read */
+                if (entry->tcs != tcs)
+                    enclave = NULL;
+
+                break;
+            }
+
+            i = (i + 1) & (index->capacity - 1);
+        }
+    }
+
+    oe_atomic_decrement(&_tcs_index_readers);
+
+    return enclave;
+}
+
 /*
 **==============================================================================
 **
@@ -64,6 +312,16 @@ uint32_t oe_push_enclave_instance(oe_enclave_t* enclave)
 
     new_entry->enclave = enclave;
 
+    // Index the TCSs of the enclave.
+    if (!_tcs_index_add_enclave(enclave))
+    {
+        OE_TRACE_ERROR("Failed to index the TCSs of the enclave\n");
+        free(new_entry);
+        goto cleanup;
+    }
+
+    _tcs_index_reclaim();
+
     // Insert to the beginning of the list.
     OE_LIST_INSERT_HEAD(&oe_enclave_list_head, new_entry, next_entry);
 
@@ -117,6 +375,8 @@ uint32_t oe_remove_enclave_instance(oe_enclave_t* enclave)
         {
             if (tmp->enclave == enclave)
             {
+                _tcs_index_remove_enclave(enclave);
+                _tcs_index_reclaim();
                 OE_LIST_REMOVE(tmp, next_entry);
                 free(tmp);
                 ret = 0;
@@ -150,55 +410,15 @@ cleanup:
 **     Query the owner enclave for the given TCS.
 **     Return the owner enclave if success, otherwise return NULL.
 **
+**     This function does not take any lock so that it can be called from
+**     the exception handler.
+**
 **==============================================================================
 */
 
 oe_enclave_t* oe_query_enclave_instance(void* tcs)
 {
-    oe_enclave_t* ret = NULL;
-    bool locked = false;
-
-    // Take the lock.
-    if (oe_mutex_lock(&oe_enclave_list_lock) != 0)
-    {
-        OE_TRACE_ERROR("oe_mutex_lock failed\n");
-        goto cleanup;
-    }
-
-    locked = true;
-
-    // Enumerate the enclave list, find which enclave owns the TCS.
-    {
-        EnclaveEntry* tmp;
-        OE_LIST_FOREACH(tmp, &oe_enclave_list_head, next_entry)
-        {
-            oe_enclave_t* enclave = tmp->enclave;
-
-            oe_mutex_lock(&enclave->lock);
-
-            for (uint32_t i = 0; i < OE_COUNTOF(enclave->bindings); i++)
-            {
-                if (enclave->bindings[i].tcs == (uint64_t)tcs)
-                {
-                    ret = enclave;
-                    break;
-                }
-            }
-
-            oe_mutex_unlock(&enclave->lock);
-        }
-    }
-
-cleanup:
-    if (locked)
-    {
-        // Release the lock if it is taken.
-        if (oe_mutex_unlock(&oe_enclave_list_lock) != 0)
-        {
-            OE_TRACE_ERROR("oe_mutex_unlock failed\n");
-            abort();
-        }
-    }
+    oe_enclave_t* ret = _tcs_index_find((uint64_t)tcs);
 
     if (!ret)
         OE_TRACE_ERROR("tcs=0x%x\n", tcs);
@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 
 #include <openenclave/bits/sgx/sgxtypes.h>
+#include <openenclave/internal/atomic.h>
 #include <openenclave/internal/calls.h>
 #include <openenclave/internal/constants_x64.h>
 #include <openenclave/internal/registers.h>
@@ -137,23 +138,82 @@ int __oe_host_stack_bridge(
  */
 #define OE_DEFAULT_OCALL_BUFFER_SIZE (16 * 1024)
 
+/**
+ * Max size that ocall buffers grow to when the enclave asks for it.
+ */
+#define OE_DEFAULT_OCALL_BUFFER_MAX_SIZE (1024 * 1024)
+
 /**
  * Setup the ecall_context.
  */
-OE_INLINE void _setup_ecall_context(oe_ecall_context_t* ecall_context)
+OE_INLINE void _setup_ecall_context(
+    oe_enclave_t* enclave,
+    oe_ecall_context_t* ecall_context)
 {
     oe_thread_binding_t* binding = oe_get_thread_binding();
+    uint64_t size = oe_atomic_load(&enclave->ocall_buffer_size);
+
+    if (size == 0)
+        size = OE_DEFAULT_OCALL_BUFFER_SIZE;
+
+    // Grow the buffer if the enclave asked for it. Nested ecalls keep the
+    // buffer since it may hold the parameters of the ocall they are made
+    // from.
+    if (binding->ocall_buffer && binding->ocall_buffer_size < size &&
+        binding->count == 1)
+    {
+        void* buffer = malloc(size);
+        if (buffer)
+        {
+            free(binding->ocall_buffer);
+            binding->ocall_buffer = buffer;
+            binding->ocall_buffer_size = size;
+        }
+    }
+
     if (binding->ocall_buffer == NULL)
     {
         // Lazily allocate buffer for making ocalls. Bound to the tcs.
         // Will be cleaned up by enclave during termination.
-        binding->ocall_buffer = malloc(OE_DEFAULT_OCALL_BUFFER_SIZE);
-        binding->ocall_buffer_size = OE_DEFAULT_OCALL_BUFFER_SIZE;
+        binding->ocall_buffer = malloc(size);
+        binding->ocall_buffer_size = size;
     }
     ecall_context->ocall_buffer = binding->ocall_buffer;
     ecall_context->ocall_buffer_size = binding->ocall_buffer_size;
 }
 
+/**
+ * Apply the ocall buffer size requested by the enclave during an ecall to the
+ * enclave, capped to its max size. The bindings grow on their next ecall.
+ */
+static void _update_ocall_buffer_size(
+    oe_enclave_t* enclave,
+    const oe_ecall_context_t* ecall_context)
+{
+    uint64_t requested = ecall_context->ocall_buffer_requested_size;
+    uint64_t max_size = enclave->ocall_buffer_max_size;
+    uint64_t size = 0;
+
+    if (requested == 0)
+        return;
+
+    if (max_size == 0)
+        max_size = OE_DEFAULT_OCALL_BUFFER_MAX_SIZE;
+
+    if (requested > max_size)
+        requested = max_size;
+
+    do
+    {
+        size = oe_atomic_load(&enclave->ocall_buffer_size);
+        if (requested <= size)
+            return;
+    } while (!oe_atomic_compare_and_swap(
+        (volatile int64_t*)&enclave->ocall_buffer_size,
+        (int64_t)size,
+        (int64_t)requested));
+}
+
 /**
  * oe_enter Executes the ENCLU instruction and transfers control to the enclave.
  *
@@ -193,7 +253,7 @@ void oe_enter(
     uint16_t fcw = 0;
 
     oe_ecall_context_t ecall_context = {{0}};
-    _setup_ecall_context(&ecall_context);
+    _setup_ecall_context(enclave, &ecall_context);
 
     while (1)
     {
@@ -243,6 +303,8 @@ void oe_enter(
             break;
     }
 
+    _update_ocall_buffer_size(enclave, &ecall_context);
+
     *arg3 = arg1;
     *arg4 = arg2;
 }
@@ -280,7 +342,7 @@ void oe_enter_sim(
     void* host_gs = oe_get_gs_register_base();
     sgx_tcs_t* sgx_tcs = (sgx_tcs_t*)tcs;
     oe_ecall_context_t ecall_context = {{0}};
-    _setup_ecall_context(&ecall_context);
+    _setup_ecall_context(enclave, &ecall_context);
 
     while (1)
     {
@@ -359,6 +421,8 @@ void oe_enter_sim(
             break;
     }
 
+    _update_ocall_buffer_size(enclave, &ecall_context);
+
     *arg3 = arg1;
     *arg4 = arg2;
 }
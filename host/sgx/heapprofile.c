@@ -0,0 +1,450 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include "heapprofile.h"
+#include <openenclave/internal/calls.h>
+#include <openenclave/internal/heapprofile.h>
+#include <openenclave/internal/raise.h>
+#include <openenclave/internal/result.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "enclave.h"
+
+/*
+**==============================================================================
+**
+** Heap profile
+**
+**     oe_get_heap_profile() copies the samples out of the enclave and
+**     encodes them as a pprof profile, which is a protocol buffer message
+**     (see https://github.com/google/pprof/blob/master/proto/profile.proto).
+**     Only the fields that a heap profile needs are written. Locations have
+**     addresses but no lines, so pprof symbolizes them from the enclave image
+**     of the only mapping.
+**
+**==============================================================================
+*/
+
+/* Field numbers of the messages of profile.proto */
+#define PROFILE_SAMPLE_TYPE 1
+#define PROFILE_SAMPLE 2
+#define PROFILE_MAPPING 3
+#define PROFILE_LOCATION 4
+#define PROFILE_STRING_TABLE 6
+#define PROFILE_PERIOD_TYPE 11
+#define PROFILE_PERIOD 12
+#define PROFILE_COMMENT 13
+#define VALUE_TYPE_TYPE 1
+#define VALUE_TYPE_UNIT 2
+#define SAMPLE_LOCATION_ID 1
+#define SAMPLE_VALUE 2
+#define SAMPLE_LABEL 3
+#define LABEL_KEY 1
+#define LABEL_NUM 3
+#define LABEL_NUM_UNIT 4
+#define MAPPING_ID 1
+#define MAPPING_MEMORY_START 2
+#define MAPPING_MEMORY_LIMIT 3
+#define MAPPING_FILENAME 5
+#define LOCATION_ID 1
+#define LOCATION_MAPPING_ID 2
+#define LOCATION_ADDRESS 3
+
+#define WIRE_TYPE_VARINT 0
+#define WIRE_TYPE_LENGTH_DELIMITED 2
+
+/* Indexes of the string table */
+enum
+{
+    STRING_EMPTY,
+    STRING_INUSE_OBJECTS,
+    STRING_COUNT,
+    STRING_INUSE_SPACE,
+    STRING_BYTES,
+    STRING_SPACE,
+    STRING_FILENAME,
+    STRING_COMMENT
+};
+
+typedef struct _buffer
+{
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} buffer_t;
+
+static void _put_data(buffer_t* buffer, const void* data, size_t size)
+{
+    if (buffer->failed)
+        return;
+
+    if (size > buffer->capacity - buffer->size)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity : 256;
+        uint8_t* new_data = NULL;
+
+        while (size > capacity - buffer->size)
+            capacity *= 2;
+
+        if (!(new_data = realloc(buffer->data, capacity)))
+        {
+            buffer->failed = true;
+            return;
+        }
+
+        buffer->data = new_data;
+        buffer->capacity = capacity;
+    }
+
+    if (size)
+        memcpy(buffer->data + buffer->size, data, size);
+
+    buffer->size += size;
+}
+
+static void _put_varint(buffer_t* buffer, uint64_t value)
+{
+    uint8_t bytes[10];
+    size_t num_bytes = 0;
+
+    do
+    {
+        bytes[num_bytes] = (uint8_t)(value & 0x7f);
+        value >>= 7;
+        if (value)
+            bytes[num_bytes] |= 0x80;
+        num_bytes++;
+    } while (value);
+
+    _put_data(buffer, bytes, num_bytes);
+}
+
+static void _put_varint_field(buffer_t* buffer, uint32_t field, uint64_t value)
+{
+    _put_varint(buffer, (uint64_t)field << 3 | WIRE_TYPE_VARINT);
+    _put_varint(buffer, value);
+}
+
+static void _put_bytes_field(
+    buffer_t* buffer,
+    uint32_t field,
+    const void* data,
+    size_t size)
+{
+    _put_varint(buffer, (uint64_t)field << 3 | WIRE_TYPE_LENGTH_DELIMITED);
+    _put_varint(buffer, size);
+    _put_data(buffer, data, size);
+}
+
+/* Append a nested message and empty it for the next one */
+static void _put_message_field(
+    buffer_t* buffer,
+    uint32_t field,
+    buffer_t* message)
+{
+    if (message->failed)
+        buffer->failed = true;
+
+    _put_bytes_field(buffer, field, message->data, message->size);
+    message->size = 0;
+}
+
+static int _compare_addresses(const void* left, const void* right)
+{
+    uint64_t a = *(const uint64_t*)left;
+    uint64_t b = *(const uint64_t*)right;
+
+    return a < b ? -1 : a > b;
+}
+
+/* Return 1 - exp(-x) for x >= 0, the chance that an allocation of x sample
+ * intervals is sampled. Computed here so that oehost does not need libm:
+ * expm1(-x) = expm1(-x / 2^k) * (2 + expm1(-x / 2^k)) for k halvings */
+static double _sample_probability(double x)
+{
+    double m = 0;
+    int k = 0;
+
+    if (x > 64)
+        return 1.0;
+
+    while (x > 1.0 / 1024)
+    {
+        x /= 2;
+        k++;
+    }
+
+    m = -x * (1 - x / 2 * (1 - x / 3 * (1 - x / 4)));
+    while (k--)
+        m *= 2 + m;
+
+    return -m;
+}
+
+/* Make a system ECALL and return the result of its handler */
+static oe_result_t _ecall(oe_enclave_t* enclave, uint16_t func, void* arg)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    uint64_t result_out = 0;
+
+    OE_CHECK(oe_ecall(enclave, func, (uint64_t)arg, &result_out));
+
+    if (result_out > OE_UINT32_MAX)
+        OE_RAISE(OE_FAILURE);
+
+    if (!oe_is_valid_result((uint32_t)result_out))
+        OE_RAISE(OE_FAILURE);
+
+    result = (oe_result_t)result_out;
+
+done:
+    return result;
+}
+
+oe_result_t oe_start_enclave_heap_profiler(
+    oe_enclave_t* enclave,
+    const oe_enclave_setting_heap_profiler_t* setting)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_start_heap_profiler_args_t args = {0};
+
+    if (!enclave || !setting)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    args.sample_interval = setting->sample_interval;
+    args.max_samples = setting->max_samples;
+
+    OE_CHECK(_ecall(enclave, OE_ECALL_START_HEAP_PROFILER, &args));
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+/* Copy the samples out of the enclave. More samples may be taken between
+ * the call that sizes the buffer and the call that fills it, so retry with
+ * some room to spare */
+static oe_result_t _get_samples(
+    oe_enclave_t* enclave,
+    oe_get_heap_profile_args_t* args)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    memset(args, 0, sizeof(*args));
+
+    while ((result = _ecall(enclave, OE_ECALL_GET_HEAP_PROFILE, args)) ==
+           OE_BUFFER_TOO_SMALL)
+    {
+        free(args->samples);
+        args->max_samples = args->num_samples + args->num_samples / 8 + 16;
+
+        if (!(args->samples = calloc(
+                  args->max_samples, sizeof(oe_heap_profile_sample_t))))
+            OE_RAISE(OE_OUT_OF_MEMORY);
+    }
+
+    OE_CHECK_NO_TRACE(result);
+
+done:
+    return result;
+}
+
+static oe_result_t _encode_profile(
+    oe_enclave_t* enclave,
+    const oe_get_heap_profile_args_t* args,
+    buffer_t* profile)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    buffer_t message = {0};
+    buffer_t nested = {0};
+    uint64_t* addresses = NULL;
+    size_t num_addresses = 0;
+    char comment[128];
+
+    // Number the distinct addresses of the call stacks. The ID of the
+    // location of an address is its index plus one.
+    for (size_t i = 0; i < args->num_samples; i++)
+        num_addresses += args->samples[i].num_frames;
+
+    if (num_addresses &&
+        !(addresses = calloc(num_addresses, sizeof(uint64_t))))
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    num_addresses = 0;
+    for (size_t i = 0; i < args->num_samples; i++)
+    {
+        const oe_heap_profile_sample_t* sample = &args->samples[i];
+
+        for (uint64_t j = 0; j < sample->num_frames; j++)
+            addresses[num_addresses++] = sample->frames[j];
+    }
+
+    if (num_addresses)
+    {
+        size_t num_unique = 1;
+
+        qsort(addresses, num_addresses, sizeof(uint64_t), _compare_addresses);
+        for (size_t i = 1; i < num_addresses; i++)
+        {
+            if (addresses[i] != addresses[num_unique - 1])
+                addresses[num_unique++] = addresses[i];
+        }
+
+        num_addresses = num_unique;
+    }
+
+    // Sample types: inuse_objects/count and inuse_space/bytes.
+    _put_varint_field(&message, VALUE_TYPE_TYPE, STRING_INUSE_OBJECTS);
+    _put_varint_field(&message, VALUE_TYPE_UNIT, STRING_COUNT);
+    _put_message_field(profile, PROFILE_SAMPLE_TYPE, &message);
+    _put_varint_field(&message, VALUE_TYPE_TYPE, STRING_INUSE_SPACE);
+    _put_varint_field(&message, VALUE_TYPE_UNIT, STRING_BYTES);
+    _put_message_field(profile, PROFILE_SAMPLE_TYPE, &message);
+
+    // A sample of size bytes stands for 1 / p allocations of its size, where
+    // p = 1 - exp(-size / sample_interval) is the chance that an allocation
+    // of that size is sampled.
+    for (size_t i = 0; i < args->num_samples; i++)
+    {
+        const oe_heap_profile_sample_t* sample = &args->samples[i];
+        double scale = 1.0;
+
+        if (sample->size)
+            scale = 1.0 / _sample_probability(
+                              (double)sample->size /
+                              (double)args->sample_interval);
+
+        for (uint64_t j = 0; j < sample->num_frames; j++)
+        {
+            const uint64_t* address = bsearch(
+                &sample->frames[j],
+                addresses,
+                num_addresses,
+                sizeof(uint64_t),
+                _compare_addresses);
+            _put_varint(&nested, (uint64_t)(address - addresses) + 1);
+        }
+        _put_message_field(&message, SAMPLE_LOCATION_ID, &nested);
+
+        _put_varint(&nested, (uint64_t)(scale + 0.5));
+        _put_varint(&nested, (uint64_t)((double)sample->size * scale + 0.5));
+        _put_message_field(&message, SAMPLE_VALUE, &nested);
+
+        _put_varint_field(&nested, LABEL_KEY, STRING_BYTES);
+        _put_varint_field(&nested, LABEL_NUM, sample->size);
+        _put_varint_field(&nested, LABEL_NUM_UNIT, STRING_BYTES);
+        _put_message_field(&message, SAMPLE_LABEL, &nested);
+
+        _put_message_field(profile, PROFILE_SAMPLE, &message);
+    }
+
+    // The enclave image is the only mapping.
+    _put_varint_field(&message, MAPPING_ID, 1);
+    _put_varint_field(&message, MAPPING_MEMORY_START, enclave->start_address);
+    _put_varint_field(
+        &message, MAPPING_MEMORY_LIMIT, enclave->base_address + enclave->size);
+    _put_varint_field(&message, MAPPING_FILENAME, STRING_FILENAME);
+    _put_message_field(profile, PROFILE_MAPPING, &message);
+
+    for (size_t i = 0; i < num_addresses; i++)
+    {
+        _put_varint_field(&message, LOCATION_ID, i + 1);
+        _put_varint_field(&message, LOCATION_MAPPING_ID, 1);
+        _put_varint_field(&message, LOCATION_ADDRESS, addresses[i]);
+        _put_message_field(profile, PROFILE_LOCATION, &message);
+    }
+
+    // The string table, in the order of the indexes above.
+    {
+        const char* path = enclave->path ? enclave->path : "";
+        const char* strings[] = {
+            "", "inuse_objects", "count", "inuse_space", "bytes", "space"};
+
+        for (size_t i = 0; i < OE_COUNTOF(strings); i++)
+            _put_bytes_field(
+                profile, PROFILE_STRING_TABLE, strings[i], strlen(strings[i]));
+
+        _put_bytes_field(profile, PROFILE_STRING_TABLE, path, strlen(path));
+
+        snprintf(
+            comment,
+            sizeof(comment),
+            "%llu samples were dropped because the enclave table was full",
+            (unsigned long long)args->num_dropped);
+        _put_bytes_field(
+            profile, PROFILE_STRING_TABLE, comment, strlen(comment));
+    }
+
+    _put_varint_field(&message, VALUE_TYPE_TYPE, STRING_SPACE);
+    _put_varint_field(&message, VALUE_TYPE_UNIT, STRING_BYTES);
+    _put_message_field(profile, PROFILE_PERIOD_TYPE, &message);
+    _put_varint_field(profile, PROFILE_PERIOD, args->sample_interval);
+
+    if (args->num_dropped)
+        _put_varint_field(profile, PROFILE_COMMENT, STRING_COMMENT);
+
+    if (profile->failed || message.failed || nested.failed)
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    result = OE_OK;
+
+done:
+    free(message.data);
+    free(nested.data);
+    free(addresses);
+
+    return result;
+}
+
+oe_result_t oe_get_heap_profile(
+    oe_enclave_t* enclave,
+    uint8_t** profile,
+    size_t* profile_size)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_get_heap_profile_args_t args = {0};
+    buffer_t buffer = {0};
+
+    if (profile)
+        *profile = NULL;
+
+    if (profile_size)
+        *profile_size = 0;
+
+    if (!enclave || enclave->magic != ENCLAVE_MAGIC || !profile ||
+        !profile_size)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    OE_CHECK_NO_TRACE(_get_samples(enclave, &args));
+
+    // Do not trust the enclave with the bounds of the host buffer.
+    if (args.num_samples > args.max_samples || !args.sample_interval)
+        OE_RAISE(OE_UNEXPECTED);
+
+    for (size_t i = 0; i < args.num_samples; i++)
+    {
+        if (args.samples[i].num_frames > OE_HEAP_PROFILE_MAX_FRAMES)
+            OE_RAISE(OE_UNEXPECTED);
+    }
+
+    OE_CHECK(_encode_profile(enclave, &args, &buffer));
+
+    *profile = buffer.data;
+    *profile_size = buffer.size;
+    buffer.data = NULL;
+    result = OE_OK;
+
+done:
+    free(buffer.data);
+    free(args.samples);
+
+    return result;
+}
+
+void oe_free_heap_profile(uint8_t* profile)
+{
+    free(profile);
+}
@@ -0,0 +1,202 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/calls.h>
+#include <openenclave/internal/heapstats.h>
+#include <openenclave/internal/raise.h>
+#include <openenclave/internal/result.h>
+#include <stdlib.h>
+#include <string.h>
+#include "enclave.h"
+#include "heapstats.h"
+
+/* Make a system ECALL and return the result of its handler */
+static oe_result_t _ecall(oe_enclave_t* enclave, uint16_t func, void* arg)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    uint64_t result_out = 0;
+
+    OE_CHECK(oe_ecall(enclave, func, (uint64_t)arg, &result_out));
+
+    if (result_out > OE_UINT32_MAX)
+        OE_RAISE(OE_FAILURE);
+
+    if (!oe_is_valid_result((uint32_t)result_out))
+        OE_RAISE(OE_FAILURE);
+
+    result = (oe_result_t)result_out;
+
+done:
+    return result;
+}
+
+oe_result_t oe_start_enclave_heap_statistics(
+    oe_enclave_t* enclave,
+    const oe_enclave_setting_heap_statistics_t* setting)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_start_heap_statistics_args_t args = {0};
+
+    if (!enclave || !setting)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    args.attribute_ecalls = setting->attribute_ecalls;
+
+    OE_CHECK(_ecall(enclave, OE_ECALL_START_HEAP_STATISTICS, &args));
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+/* Copy the counters out of the enclave. More threads may start counting
+ * between the call that sizes the buffers and the call that fills them, so
+ * retry with the new sizes */
+static oe_result_t _get_counters(
+    oe_enclave_t* enclave,
+    oe_get_heap_statistics_args_t* args)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    memset(args, 0, sizeof(*args));
+
+    while ((result = _ecall(enclave, OE_ECALL_GET_HEAP_STATISTICS, args)) ==
+           OE_BUFFER_TOO_SMALL)
+    {
+        free(args->threads);
+        free(args->ecalls);
+        args->ecalls = NULL;
+        args->max_threads = args->num_threads;
+        args->max_ecalls = args->num_ecalls;
+
+        if (!(args->threads = calloc(
+                  args->max_threads + 1, sizeof(oe_heap_thread_counters_t))) ||
+            !(args->ecalls = calloc(
+                  args->max_ecalls + 1, sizeof(oe_heap_ecall_counters_t))))
+            OE_RAISE(OE_OUT_OF_MEMORY);
+    }
+
+    OE_CHECK_NO_TRACE(result);
+
+done:
+    return result;
+}
+
+static int _compare_threads(const void* a, const void* b)
+{
+    const oe_heap_thread_statistics_t* x = a;
+    const oe_heap_thread_statistics_t* y = b;
+
+    return (x->tcs_index > y->tcs_index) - (x->tcs_index < y->tcs_index);
+}
+
+oe_result_t oe_get_heap_statistics(
+    oe_enclave_t* enclave,
+    oe_heap_statistics_t** statistics)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_get_heap_statistics_args_t args = {0};
+    oe_heap_statistics_t* s = NULL;
+    size_t num_ecalls = 0;
+
+    if (statistics)
+        *statistics = NULL;
+
+    if (!enclave || enclave->magic != ENCLAVE_MAGIC || !statistics)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    OE_CHECK_NO_TRACE(_get_counters(enclave, &args));
+
+    // Do not trust the enclave with the bounds of the host buffers. Each TCS
+    // has one thread.
+    if (args.num_threads > args.max_threads ||
+        args.num_threads > enclave->num_bindings ||
+        args.num_ecalls > args.max_ecalls)
+        OE_RAISE(OE_UNEXPECTED);
+
+    for (size_t i = 0; i < args.num_ecalls; i++)
+    {
+        const oe_heap_ecall_counters_t* counters = &args.ecalls[i];
+
+        if (counters->calls || counters->allocations || counters->frees)
+            num_ecalls++;
+    }
+
+    // The statistics and their arrays are freed together.
+    if (!(s = calloc(
+              1,
+              sizeof(oe_heap_statistics_t) +
+                  args.num_threads * sizeof(oe_heap_thread_statistics_t) +
+                  num_ecalls * sizeof(oe_heap_ecall_statistics_t))))
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    s->threads = (oe_heap_thread_statistics_t*)(s + 1);
+    s->ecalls = (oe_heap_ecall_statistics_t*)(s->threads + args.num_threads);
+
+    for (size_t i = 0; i < args.num_threads; i++)
+    {
+        const oe_heap_thread_counters_t* counters = &args.threads[i];
+        oe_heap_thread_statistics_t* thread = &s->threads[s->num_threads++];
+        size_t index = 0;
+
+        while (index < enclave->num_bindings &&
+               enclave->bindings[index].tcs != counters->tcs)
+            index++;
+
+        if (index == enclave->num_bindings)
+            OE_RAISE(OE_UNEXPECTED);
+
+        thread->tcs_index = (uint32_t)index;
+        thread->ecall_function_id = counters->ecall_function_id
+                                        ? counters->ecall_function_id - 1
+                                        : OE_HEAP_STATISTICS_NO_ECALL;
+        thread->allocations = counters->allocations;
+        thread->frees = counters->frees;
+        thread->bytes_allocated = counters->bytes_allocated;
+        thread->bytes_freed = counters->bytes_freed;
+        thread->bytes_in_flight =
+            (int64_t)(counters->bytes_allocated - counters->bytes_freed);
+        thread->peak_bytes_in_flight = counters->peak_bytes_in_flight;
+    }
+
+    qsort(
+        s->threads,
+        s->num_threads,
+        sizeof(oe_heap_thread_statistics_t),
+        _compare_threads);
+
+    for (size_t i = 0; i < args.num_ecalls; i++)
+    {
+        const oe_heap_ecall_counters_t* counters = &args.ecalls[i];
+        oe_heap_ecall_statistics_t* ecall = NULL;
+
+        if (!counters->calls && !counters->allocations && !counters->frees)
+            continue;
+
+        ecall = &s->ecalls[s->num_ecalls++];
+        ecall->function_id = i;
+        ecall->calls = counters->calls;
+        ecall->allocations = counters->allocations;
+        ecall->frees = counters->frees;
+        ecall->bytes_allocated = counters->bytes_allocated;
+        ecall->bytes_freed = counters->bytes_freed;
+    }
+
+    *statistics = s;
+    s = NULL;
+    result = OE_OK;
+
+done:
+    free(s);
+    free(args.threads);
+    free(args.ecalls);
+
+    return result;
+}
+
+void oe_free_heap_statistics(oe_heap_statistics_t* statistics)
+{
+    free(statistics);
+}
@@ -0,0 +1,15 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_HOST_SGX_HEAPSTATS_H
+#define _OE_HOST_SGX_HEAPSTATS_H
+
+#include <openenclave/host.h>
+
+/* Apply the OE_ENCLAVE_SETTING_HEAP_STATISTICS setting, which makes the
+ * enclave start counting its allocations */
+oe_result_t oe_start_enclave_heap_statistics(
+    oe_enclave_t* enclave,
+    const oe_enclave_setting_heap_statistics_t* setting);
+
+#endif /* _OE_HOST_SGX_HEAPSTATS_H */
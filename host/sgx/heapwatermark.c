@@ -0,0 +1,40 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include "heapwatermark.h"
+#include <openenclave/internal/heapwatermark.h>
+#include <openenclave/internal/raise.h>
+#include "enclave.h"
+
+oe_result_t oe_configure_enclave_heap_watermark(
+    oe_enclave_t* enclave,
+    const oe_enclave_setting_heap_watermark_t* setting)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    if (!enclave || !setting || !setting->callback)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    enclave->heap_watermark_context = setting->context;
+    enclave->heap_watermark_callback = setting->callback;
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+void oe_handle_heap_watermark(oe_enclave_t* enclave, uint64_t arg_in)
+{
+    uint32_t percent = oe_get_heap_watermark_percent(arg_in);
+
+    // The enclave only sets watermarks from 1 to 100 percent.
+    if (!enclave->heap_watermark_callback || percent == 0 || percent > 100)
+        return;
+
+    enclave->heap_watermark_callback(
+        enclave,
+        percent,
+        oe_get_heap_watermark_exceeded(arg_in),
+        enclave->heap_watermark_context);
+}
@@ -0,0 +1,18 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_HOST_SGX_HEAPWATERMARK_H
+#define _OE_HOST_SGX_HEAPWATERMARK_H
+
+#include <openenclave/host.h>
+
+/* Apply the OE_ENCLAVE_SETTING_HEAP_WATERMARK setting, which registers the
+ * callback of the heap watermarks of the enclave */
+oe_result_t oe_configure_enclave_heap_watermark(
+    oe_enclave_t* enclave,
+    const oe_enclave_setting_heap_watermark_t* setting);
+
+/* Handler of OE_OCALL_HEAP_WATERMARK */
+void oe_handle_heap_watermark(oe_enclave_t* enclave, uint64_t arg_in);
+
+#endif /* _OE_HOST_SGX_HEAPWATERMARK_H */
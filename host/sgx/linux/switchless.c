@@ -4,7 +4,10 @@
 #include <openenclave/internal/switchless.h>
 
 #include <linux/futex.h>
+#include <pthread.h>
+#include <sched.h>
 #include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 
 static void _worker_wait(volatile int* event)
@@ -69,3 +72,51 @@ void oe_enclave_worker_wake(oe_enclave_worker_context_t* context)
 {
     _worker_wake(&context->event);
 }
+
+uint64_t oe_switchless_get_time_in_microseconds(void)
+{
+    struct timespec ts;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+        return 0;
+
+    return (uint64_t)ts.tv_sec * 1000000 + (uint64_t)ts.tv_nsec / 1000;
+}
+
+void oe_switchless_manager_wait(
+    oe_switchless_call_manager_t* manager,
+    uint32_t milliseconds)
+{
+    struct timespec timeout = {
+        (time_t)(milliseconds / 1000), (long)(milliseconds % 1000) * 1000000};
+
+    // oe_switchless_manager_wake sets the event after is_stopping, so the
+    // futex returns immediately if the manager stopped after this check.
+    // Timeouts and spurious wakes are harmless: the caller re-checks.
+    if (!manager->is_stopping)
+        syscall(
+            __NR_futex,
+            &manager->scaling_event,
+            FUTEX_WAIT_PRIVATE,
+            0,
+            &timeout,
+            NULL,
+            0);
+}
+
+void oe_switchless_manager_wake(oe_switchless_call_manager_t* manager)
+{
+    _worker_wake(&manager->scaling_event);
+}
+
+int oe_switchless_set_thread_affinity(oe_thread_t thread, uint32_t cpu)
+{
+    cpu_set_t cpus;
+
+    if (cpu >= CPU_SETSIZE)
+        return -1;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    return pthread_setaffinity_np((pthread_t)thread, sizeof(cpus), &cpus);
+}
@@ -14,3 +14,18 @@ void oe_sgx_thread_wake_wait_ocall(
     HandleThreadWake(enclave, waiter_tcs);
     HandleThreadWait(enclave, self_tcs);
 }
+
+void oe_sgx_thread_wake_multiple_ocall(
+    oe_enclave_t* enclave,
+    const uint64_t* tcs,
+    size_t num_tcs)
+{
+    if (!tcs)
+        return;
+
+    for (size_t i = 0; i < num_tcs; i++)
+    {
+        if (tcs[i])
+            HandleThreadWake(enclave, tcs[i]);
+    }
+}
@@ -8,21 +8,180 @@
 #include <openenclave/internal/raise.h>
 #include <openenclave/internal/switchless.h>
 #include <openenclave/internal/utils.h>
+#include <stdlib.h>
+#include <string.h>
 #include "../calls.h"
 #include "../hostthread.h"
+#include "../memalign.h"
 #include "enclave.h"
 #include "platform_u.h"
+#include "threadpool.h"
 
 /**
  * Number of iterations an ocall worker thread would spin before going to sleep
+ * under the default fixed spin policy.
  */
 #define OE_HOST_WORKER_SPIN_COUNT_THRESHOLD (4096U)
 
 /**
  * Number of iterations an ecall worker thread would spin before going to sleep
+ * under the default fixed spin policy.
  */
 #define OE_ENCLAVE_WORKER_SPIN_COUNT_THRESHOLD (4096U)
 
+/**
+ * Number of microseconds a worker thread would spin before going to sleep
+ * under the default timed spin policy.
+ */
+#define OE_WORKER_SPIN_TIME_THRESHOLD (50U)
+
+/**
+ * Maximum number of microseconds a worker thread would spin before going to
+ * sleep under the default adaptive spin policy.
+ */
+#define OE_WORKER_ADAPTIVE_SPIN_TIME_MAX (1000U)
+
+/**
+ * Interval, in milliseconds, at which elastic worker pools are resized.
+ */
+#define OE_SWITCHLESS_SCALING_INTERVAL (10U)
+
+/**
+ * An elastic pool grows by one worker when at least this percentage of the
+ * calls of a scaling interval fell back to regular calls.
+ */
+#define OE_SWITCHLESS_GROW_MISS_PERCENT (1U)
+
+/**
+ * An elastic pool shrinks by one worker when a worker has not handled any call
+ * for this many consecutive scaling intervals and no call fell back.
+ */
+#define OE_SWITCHLESS_SHRINK_IDLE_INTERVALS (100U)
+
+/**
+ * Number of iterations a stopping ocall worker waits for a reserved slot of
+ * its queue to be published before skipping it. A caller that reserved a
+ * slot may never publish it, for instance if its enclave thread aborted.
+ */
+#define OE_HOST_WORKER_DRAIN_SPIN_COUNT (1U << 20)
+
+OE_STATIC_ASSERT(OE_SWITCHLESS_MAX_WORKERS == OE_SGX_MAX_TCS);
+
+/**
+ * Number of spin iterations used to measure the duration of one iteration.
+ */
+#define OE_SPIN_CALIBRATION_COUNT (16384U)
+
+/**
+ * Number of spin iterations a worker thread performs per millisecond. Time
+ * based spin budgets are converted to iterations using this rate, which lets
+ * enclave workers, which have no access to a clock, honor them.
+ */
+static uint64_t _spin_count_per_millisecond;
+static oe_once_type _spin_calibration_once = OE_H_ONCE_INITIALIZER;
+
+static void _calibrate_spin_count(void)
+{
+    uint64_t start = oe_switchless_get_time_in_microseconds();
+
+    for (uint32_t i = 0; i < OE_SPIN_CALIBRATION_COUNT; i++)
+        oe_yield_cpu();
+
+    uint64_t elapsed = oe_switchless_get_time_in_microseconds() - start;
+    if (elapsed == 0)
+        elapsed = 1;
+
+    _spin_count_per_millisecond = OE_SPIN_CALIBRATION_COUNT * 1000ULL / elapsed;
+    if (_spin_count_per_millisecond == 0)
+        _spin_count_per_millisecond = 1;
+}
+
+/* Convert a duration in microseconds to a number of spin iterations */
+static uint64_t _microseconds_to_spin_count(uint64_t microseconds)
+{
+    oe_once(&_spin_calibration_once, _calibrate_spin_count);
+
+    // Saturate absurdly long durations instead of overflowing.
+    if (microseconds > OE_UINT64_MAX / _spin_count_per_millisecond)
+        return OE_UINT64_MAX / 1000;
+
+    return microseconds * _spin_count_per_millisecond / 1000;
+}
+
+/*
+** Compute the initial spin_count_threshold and the adaptive_spin_count_max of
+** a worker from the spin policy of the manager.
+*/
+static oe_result_t _get_spin_count_thresholds(
+    uint32_t spin_policy,
+    uint64_t spin_budget,
+    uint64_t default_spin_count,
+    uint64_t* spin_count_threshold,
+    uint64_t* adaptive_spin_count_max)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    *adaptive_spin_count_max = 0;
+
+    switch (spin_policy)
+    {
+        case OE_SWITCHLESS_SPIN_POLICY_FIXED:
+            *spin_count_threshold = spin_budget ? spin_budget
+                                                : default_spin_count;
+            break;
+
+        case OE_SWITCHLESS_SPIN_POLICY_TIMED:
+            *spin_count_threshold = _microseconds_to_spin_count(
+                spin_budget ? spin_budget : OE_WORKER_SPIN_TIME_THRESHOLD);
+            break;
+
+        case OE_SWITCHLESS_SPIN_POLICY_ADAPTIVE:
+            *adaptive_spin_count_max = _microseconds_to_spin_count(
+                spin_budget ? spin_budget : OE_WORKER_ADAPTIVE_SPIN_TIME_MAX);
+            if (*adaptive_spin_count_max <
+                OE_SWITCHLESS_ADAPTIVE_MIN_SPIN_COUNT)
+                *adaptive_spin_count_max =
+                    OE_SWITCHLESS_ADAPTIVE_MIN_SPIN_COUNT;
+
+            // Start with the maximum so that the first calls are fast.
+            *spin_count_threshold = *adaptive_spin_count_max;
+            break;
+
+        default:
+            OE_RAISE(OE_INVALID_PARAMETER);
+    }
+
+    // A threshold of zero would make workers sleep on every iteration.
+    if (*spin_count_threshold == 0)
+        *spin_count_threshold = 1;
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+/*
+** Put a worker to sleep until it is woken up. Under the adaptive policy, also
+** record how long it slept so that the gap between calls can be measured.
+*/
+static void _host_worker_sleep(oe_host_worker_context_t* context)
+{
+    context->sleep_count++;
+
+    if (context->adaptive_spin_count_max)
+    {
+        uint64_t start = oe_switchless_get_time_in_microseconds();
+        oe_host_worker_wait(context);
+        context->sleep_spin_count = _microseconds_to_spin_count(
+            oe_switchless_get_time_in_microseconds() - start);
+    }
+    else
+    {
+        oe_host_worker_wait(context);
+    }
+}
+
 /**
  * Declare the prototypes of the following functions to avoid missing-prototypes
  * warning.
@@ -82,37 +241,98 @@ OE_WEAK_ALIAS(
 static void* _switchless_ocall_worker(void* arg)
 {
     oe_host_worker_context_t* context = (oe_host_worker_context_t*)arg;
+    const uint64_t adaptive_spin_count_max = context->adaptive_spin_count_max;
+    uint64_t spin_count_threshold = context->spin_count_threshold;
+    uint64_t average_gap = 0;
+    uint64_t gap = 0;
+    uint64_t drain_spin_count = 0;
 
-    while (!context->is_stopping)
+    // Once stopping, handle the calls left in the queue before exiting so
+    // that the asynchronous calls posted by the enclave are not lost.
+    while (!context->is_stopping ||
+           context->queue_head != oe_atomic_load(&context->queue_tail))
     {
+        void* volatile* slot =
+            &context->queue[context->queue_head & context->queue_mask];
         volatile oe_call_host_function_args_t* local_call_arg = NULL;
-        if ((local_call_arg = context->call_arg) != NULL)
+        if ((local_call_arg = *slot) != NULL)
         {
-            // Handle the switchless call, but do not clear the slot yet. Since
-            // the slot is not empty, any new incoming switchless call request
-            // will be scheduled in another available work thread and get
-            // handled immediately.
-            oe_handle_call_host_function(
+            // Take the call. The caller waits for the slot to be cleared to
+            // measure how long the call was queued.
+            *slot = NULL;
+
+            // Handle the switchless call. The caller waits for the result
+            // field to be set, unless the call is asynchronous. Nobody waits
+            // for an asynchronous call, and its block is freed here.
+            bool is_async =
+                (local_call_arg->flags & OE_CALL_HOST_FUNCTION_FLAG_ASYNC) != 0;
+            oe_result_t result = oe_handle_call_host_function(
                 (uint64_t)local_call_arg, context->enc);
+            if (is_async)
+            {
+                free((void*)local_call_arg);
+            }
+            else if (result != OE_OK)
+            {
+                OE_ATOMIC_MEMORY_BARRIER_RELEASE();
+                local_call_arg->result = result;
+            }
 
-            // After handling the switchless call, mark this worker thread
-            // as free by clearing the slot.
-            context->call_arg = NULL;
+            // Move on to the next slot. Advancing the head allows callers to
+            // reuse the slot, which was cleared above.
+            OE_ATOMIC_MEMORY_BARRIER_RELEASE();
+            context->queue_head++;
+
+            // Adapt the spin budget to the gap that preceded this message.
+            if (adaptive_spin_count_max)
+            {
+                spin_count_threshold =
+                    oe_switchless_adapt_spin_count_threshold(
+                        &average_gap,
+                        gap + context->spin_count,
+                        adaptive_spin_count_max);
+                context->spin_count_threshold = spin_count_threshold;
+                gap = 0;
+            }
 
             // Reset spin count for next message.
             context->total_spin_count += context->spin_count;
             context->spin_count = 0;
+            drain_spin_count = 0;
+        }
+        else if (
+            context->is_stopping &&
+            ++drain_spin_count >= OE_HOST_WORKER_DRAIN_SPIN_COUNT)
+        {
+            // The slot was reserved but is still not published. Skip it so
+            // that the drain ends.
+            context->queue_head++;
+            drain_spin_count = 0;
+        }
+        else if (context->is_parked && !context->is_stopping)
+        {
+            // A parked worker does not spin. It is woken up when it is
+            // unparked or when a call raced with the parking.
+            context->total_spin_count += context->spin_count;
+            context->spin_count = 0;
+            context->sleep_count++;
+            oe_host_worker_wait(context);
         }
         else
         {
             // If there is no message, increment spin count until threshold is
             // reached.
-            if (++context->spin_count >= OE_HOST_WORKER_SPIN_COUNT_THRESHOLD)
+            // A stopping worker waits for the last calls to be published
+            // without sleeping.
+            if (++context->spin_count >= spin_count_threshold &&
+                !context->is_stopping)
             {
                 // Reset spin count and go to sleep until event is fired.
                 context->total_spin_count += context->spin_count;
+                gap += context->spin_count;
                 context->spin_count = 0;
-                oe_host_worker_wait(context);
+                _host_worker_sleep(context);
+                gap += context->sleep_spin_count;
             }
 
             /* Yield CPU */
@@ -124,8 +344,21 @@ static void* _switchless_ocall_worker(void* arg)
 
 void oe_sgx_sleep_switchless_worker_ocall(oe_enclave_worker_context_t* context)
 {
-    // Wait for messages.
-    oe_enclave_worker_wait(context);
+    // Wait for messages. Under the adaptive policy, also report how long the
+    // worker slept so that the enclave can measure the gap between calls.
+    context->sleep_count++;
+
+    if (context->adaptive_spin_count_max)
+    {
+        uint64_t start = oe_switchless_get_time_in_microseconds();
+        oe_enclave_worker_wait(context);
+        context->sleep_spin_count = _microseconds_to_spin_count(
+            oe_switchless_get_time_in_microseconds() - start);
+    }
+    else
+    {
+        oe_enclave_worker_wait(context);
+    }
 }
 
 /*
@@ -136,19 +369,290 @@ static void* _switchless_ecall_worker(void* arg)
 {
     oe_enclave_worker_context_t* context = (oe_enclave_worker_context_t*)arg;
 
-    // Enter enclave to process ecall messages.
-    if (oe_sgx_switchless_enclave_worker_thread_ecall(context->enc, context) !=
-        OE_OK)
+    while (!context->is_stopping)
+    {
+        // A parked worker stays out of the enclave, so that it does not
+        // occupy a TCS, until it is unparked or a call raced with the
+        // parking.
+        if (context->is_parked &&
+            oe_atomic_load(&context->queue_head) ==
+                oe_atomic_load(&context->queue_tail))
+        {
+            context->sleep_count++;
+            oe_enclave_worker_wait(context);
+            continue;
+        }
+
+        // Enter enclave to process ecall messages. The enclave returns when
+        // the worker is stopping or parked.
+        oe_result_t result = oe_sgx_switchless_enclave_worker_thread_ecall(
+            context->enc, context);
+
+        // All the TCSs may be in use by regular ecalls when an unparked worker
+        // re-enters the enclave. Retry until one is released.
+        if (result == OE_OUT_OF_THREADS)
+        {
+            oe_yield_cpu();
+            continue;
+        }
+
+        if (result != OE_OK)
+        {
+            OE_TRACE_ERROR("Switchless enclave worker thread failed\n");
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+typedef enum _scaling_action
+{
+    SCALING_ACTION_NONE,
+    SCALING_ACTION_GROW,
+    SCALING_ACTION_SHRINK,
+} scaling_action_t;
+
+typedef struct _scaling_observation
+{
+    uint64_t num_calls;
+    size_t idle_worker;
+    size_t parked_worker;
+} scaling_observation_t;
+
+/*
+** Record the activity of one worker of a pool during the last scaling
+** interval.
+*/
+static void _observe_worker(
+    oe_switchless_worker_pool_t* pool,
+    scaling_observation_t* observation,
+    size_t index,
+    uint64_t queue_head,
+    bool is_parked)
+{
+    uint64_t num_calls = queue_head - pool->queue_heads[index];
+
+    pool->queue_heads[index] = queue_head;
+
+    if (is_parked)
+    {
+        pool->idle_intervals[index] = 0;
+        observation->parked_worker = index;
+        return;
+    }
+
+    observation->num_calls += num_calls;
+
+    if (num_calls)
+        pool->idle_intervals[index] = 0;
+    else if (
+        ++pool->idle_intervals[index] >= OE_SWITCHLESS_SHRINK_IDLE_INTERVALS)
+        observation->idle_worker = index;
+}
+
+/*
+** Decide whether to grow or shrink a pool after observing all its workers.
+** On return, **index** is the worker to unpark or park.
+*/
+static scaling_action_t _get_scaling_action(
+    oe_switchless_worker_pool_t* pool,
+    const scaling_observation_t* observation,
+    uint64_t miss_count,
+    size_t* index)
+{
+    uint64_t num_misses = miss_count - pool->miss_count;
+
+    pool->miss_count = miss_count;
+
+    // Grow when callers fall back to regular calls because all the active
+    // workers are busy.
+    if (num_misses && observation->parked_worker != OE_SIZE_MAX &&
+        pool->num_active_workers < pool->max_workers &&
+        num_misses * 100 >= (num_misses + observation->num_calls) *
+                                OE_SWITCHLESS_GROW_MISS_PERCENT)
+    {
+        *index = observation->parked_worker;
+        pool->num_active_workers++;
+        return SCALING_ACTION_GROW;
+    }
+
+    // Shrink when a worker has been idle for a while and the others keep up.
+    if (!num_misses && observation->idle_worker != OE_SIZE_MAX &&
+        pool->num_active_workers > pool->min_workers)
+    {
+        *index = observation->idle_worker;
+        pool->idle_intervals[*index] = 0;
+        pool->num_active_workers--;
+        return SCALING_ACTION_SHRINK;
+    }
+
+    return SCALING_ACTION_NONE;
+}
+
+static void _scale_host_workers(oe_switchless_call_manager_t* manager)
+{
+    oe_switchless_worker_pool_t* pool = &manager->host_worker_pool;
+    oe_host_worker_context_t* contexts = manager->host_worker_contexts;
+    scaling_observation_t observation = {0, OE_SIZE_MAX, OE_SIZE_MAX};
+    uint64_t miss_count = oe_atomic_load(&contexts[0].miss_count);
+    size_t index = 0;
+
+    for (size_t i = 0; i < manager->num_host_workers; i++)
+        _observe_worker(
+            pool,
+            &observation,
+            i,
+            oe_atomic_load(&contexts[i].queue_head),
+            contexts[i].is_parked);
+
+    switch (_get_scaling_action(pool, &observation, miss_count, &index))
+    {
+        case SCALING_ACTION_GROW:
+            OE_TRACE_INFO("Unparking switchless host worker %d\n", (int)index);
+            contexts[index].is_parked = false;
+            oe_host_worker_wake(&contexts[index]);
+            break;
+
+        case SCALING_ACTION_SHRINK:
+            OE_TRACE_INFO("Parking switchless host worker %d\n", (int)index);
+            contexts[index].is_parked = true;
+            break;
+
+        default:
+            break;
+    }
+}
+
+static void _scale_enclave_workers(oe_switchless_call_manager_t* manager)
+{
+    oe_switchless_worker_pool_t* pool = &manager->enclave_worker_pool;
+    oe_enclave_worker_context_t* contexts = manager->enclave_worker_contexts;
+    scaling_observation_t observation = {0, OE_SIZE_MAX, OE_SIZE_MAX};
+    uint64_t miss_count = oe_atomic_load(&contexts[0].miss_count);
+    size_t index = 0;
+
+    for (size_t i = 0; i < manager->num_enclave_workers; i++)
+        _observe_worker(
+            pool,
+            &observation,
+            i,
+            oe_atomic_load(&contexts[i].queue_head),
+            contexts[i].is_parked);
+
+    switch (_get_scaling_action(pool, &observation, miss_count, &index))
+    {
+        case SCALING_ACTION_GROW:
+            OE_TRACE_INFO(
+                "Unparking switchless enclave worker %d\n", (int)index);
+            contexts[index].is_parked = false;
+            oe_enclave_worker_wake(&contexts[index]);
+            break;
+
+        case SCALING_ACTION_SHRINK:
+            // Wake the worker so that it leaves the enclave if it is asleep.
+            OE_TRACE_INFO("Parking switchless enclave worker %d\n", (int)index);
+            contexts[index].is_parked = true;
+            oe_enclave_worker_wake(&contexts[index]);
+            break;
+
+        default:
+            break;
+    }
+}
+
+/*
+** The thread function that grows and shrinks elastic worker pools
+**
+*/
+static void* _switchless_scaling_thread(void* arg)
+{
+    oe_switchless_call_manager_t* manager = (oe_switchless_call_manager_t*)arg;
+
+    while (!manager->is_stopping)
     {
-        OE_TRACE_ERROR("Switchless enclave worker thread failed\n");
+        oe_switchless_manager_wait(manager, OE_SWITCHLESS_SCALING_INTERVAL);
+        if (manager->is_stopping)
+            break;
+
+        if (manager->host_worker_pool.min_workers <
+            manager->host_worker_pool.max_workers)
+            _scale_host_workers(manager);
+
+        if (manager->enclave_worker_pool.min_workers <
+            manager->enclave_worker_pool.max_workers)
+            _scale_enclave_workers(manager);
     }
 
     return NULL;
 }
 
+/*
+** Initialize the scaling state of a pool of **num_workers** workers.
+*/
+static oe_result_t _init_worker_pool(
+    oe_switchless_worker_pool_t* pool,
+    size_t min_workers,
+    size_t num_workers)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    // By default, all the workers are active at all times.
+    if (min_workers == 0 || min_workers > num_workers)
+        min_workers = num_workers;
+
+    pool->min_workers = min_workers;
+    pool->max_workers = num_workers;
+    pool->num_active_workers = min_workers;
+
+    pool->queue_heads = calloc(num_workers, sizeof(uint64_t));
+    if (pool->queue_heads == NULL)
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    pool->idle_intervals = calloc(num_workers, sizeof(uint32_t));
+    if (pool->idle_intervals == NULL)
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+static void _free_worker_pool(oe_switchless_worker_pool_t* pool)
+{
+    free(pool->queue_heads);
+    free(pool->idle_intervals);
+}
+
+/*
+** Apply the CPU affinity hint of the **index**-th worker, if any.
+*/
+static void _set_worker_affinity(
+    const oe_enclave_setting_switchless_workers_t* workers,
+    oe_thread_t thread,
+    size_t index)
+{
+    if (workers->worker_cpus == NULL || workers->num_worker_cpus == 0)
+        return;
+
+    uint32_t cpu = workers->worker_cpus[index % workers->num_worker_cpus];
+    if (oe_switchless_set_thread_affinity(thread, cpu) != 0)
+        OE_TRACE_WARNING(
+            "Failed to run switchless worker thread on CPU %u\n", cpu);
+}
+
 static oe_result_t oe_stop_worker_threads(oe_switchless_call_manager_t* manager)
 {
     oe_result_t result = OE_UNEXPECTED;
+
+    // Stop resizing the pools first.
+    manager->is_stopping = true;
+    oe_switchless_manager_wake(manager);
+    if (manager->scaling_thread != (oe_thread_t)NULL)
+        if (oe_thread_join(manager->scaling_thread))
+            OE_RAISE(OE_THREAD_JOIN_ERROR);
+
     for (size_t i = 0; i < manager->num_host_workers; i++)
     {
         manager->host_worker_contexts[i].is_stopping = true;
@@ -184,25 +688,82 @@ done:
     return result;
 }
 
+/*
+** Round the requested queue depth up to a power of two so that slots can be
+** indexed by masking the head and tail counters.
+*/
+static size_t _get_queue_depth(size_t requested)
+{
+    size_t depth = 1;
+
+    if (requested == 0)
+        requested = OE_SWITCHLESS_DEFAULT_QUEUE_DEPTH;
+
+    if (requested > OE_SWITCHLESS_MAX_QUEUE_DEPTH)
+        requested = OE_SWITCHLESS_MAX_QUEUE_DEPTH;
+
+    while (depth < requested)
+        depth <<= 1;
+
+    return depth;
+}
+
+/* Allocate a zeroed array of worker contexts, each on its own cache lines */
+static void* _allocate_contexts(size_t count, size_t size)
+{
+    void* contexts = NULL;
+
+    // Allocate at least one context, since memalign() may return NULL for
+    // a pool without workers. The number of workers is at most
+    // OE_SGX_MAX_TCS, so the size cannot overflow.
+    size_t total = (count ? count : 1) * size;
+
+    if ((contexts = oe_memalign(OE_SWITCHLESS_CONTEXT_ALIGNMENT, total)))
+        memset(contexts, 0, total);
+
+    return contexts;
+}
+
 oe_result_t oe_start_switchless_manager(
     oe_enclave_t* enclave,
-    size_t num_host_workers,
-    size_t num_enclave_workers)
+    const oe_enclave_setting_context_switchless_t* setting,
+    const oe_enclave_setting_switchless_workers_t* workers)
 {
+    static const oe_enclave_setting_switchless_workers_t default_workers;
     oe_result_t result = OE_UNEXPECTED;
+    size_t num_host_workers = 0;
+    size_t num_enclave_workers = 0;
+    size_t num_pool_threads = 0;
+    size_t queue_depth = 0;
+    uint32_t spin_policy = 0;
+    uint64_t spin_budget = 0;
     oe_result_t result_out = 0;
     oe_switchless_call_manager_t* manager = NULL;
     oe_host_worker_context_t* host_contexts = NULL;
     oe_thread_t* host_threads = NULL;
     oe_enclave_worker_context_t* enclave_contexts = NULL;
     oe_thread_t* enclave_threads = NULL;
+    void** host_queues = NULL;
+    void** enclave_queues = NULL;
+    uint64_t host_spin_count_threshold = 0;
+    uint64_t enclave_spin_count_threshold = 0;
+    uint64_t adaptive_spin_count_max = 0;
 
-    if (enclave == NULL)
+    if (enclave == NULL || setting == NULL)
         OE_RAISE(OE_INVALID_PARAMETER);
 
     if (enclave->switchless_manager != NULL)
         OE_RAISE(OE_UNEXPECTED);
 
+    if (workers == NULL)
+        workers = &default_workers;
+
+    num_host_workers = setting->max_host_workers;
+    num_enclave_workers = setting->max_enclave_workers;
+    queue_depth = workers->queue_depth;
+    spin_policy = (uint32_t)workers->spin_policy;
+    spin_budget = workers->spin_budget;
+
     if (num_host_workers == 0 && num_enclave_workers == 0)
         OE_RAISE(OE_UNEXPECTED);
 
@@ -216,12 +777,41 @@ oe_result_t oe_start_switchless_manager(
     if (num_enclave_workers > enclave->num_bindings)
         num_enclave_workers = (uint32_t)enclave->num_bindings;
 
+    // The workers of the thread pool hold their TCSs until the pool is
+    // stopped. Keep at least one TCS for regular ecalls besides them.
+    num_pool_threads = oe_get_enclave_thread_pool_size(enclave);
+    if (num_pool_threads && num_enclave_workers &&
+        num_enclave_workers >= enclave->num_bindings - num_pool_threads)
+        OE_RAISE_MSG(
+            OE_OUT_OF_THREADS,
+            "%zu switchless enclave workers and %zu thread pool workers "
+            "leave no TCS out of %zu for regular ecalls",
+            num_enclave_workers,
+            num_pool_threads,
+            enclave->num_bindings);
+
+    queue_depth = _get_queue_depth(queue_depth);
+
+    OE_CHECK(_get_spin_count_thresholds(
+        spin_policy,
+        spin_budget,
+        OE_HOST_WORKER_SPIN_COUNT_THRESHOLD,
+        &host_spin_count_threshold,
+        &adaptive_spin_count_max));
+    OE_CHECK(_get_spin_count_thresholds(
+        spin_policy,
+        spin_budget,
+        OE_ENCLAVE_WORKER_SPIN_COUNT_THRESHOLD,
+        &enclave_spin_count_threshold,
+        &adaptive_spin_count_max));
+
     // Allocate memory for the manager and its arrays
     manager = calloc(1, sizeof(oe_switchless_call_manager_t));
     if (manager == NULL)
         OE_RAISE(OE_OUT_OF_MEMORY);
 
-    host_contexts = calloc(num_host_workers, sizeof(oe_host_worker_context_t));
+    host_contexts = _allocate_contexts(
+        num_host_workers, sizeof(oe_host_worker_context_t));
     if (host_contexts == NULL)
         OE_RAISE(OE_OUT_OF_MEMORY);
 
@@ -229,8 +819,8 @@ oe_result_t oe_start_switchless_manager(
     if (host_threads == NULL)
         OE_RAISE(OE_OUT_OF_MEMORY);
 
-    enclave_contexts =
-        calloc(num_enclave_workers, sizeof(oe_enclave_worker_context_t));
+    enclave_contexts = _allocate_contexts(
+        num_enclave_workers, sizeof(oe_enclave_worker_context_t));
     if (enclave_contexts == NULL)
         OE_RAISE(OE_OUT_OF_MEMORY);
 
@@ -238,18 +828,59 @@ oe_result_t oe_start_switchless_manager(
     if (enclave_threads == NULL)
         OE_RAISE(OE_OUT_OF_MEMORY);
 
+    // Allocate the queues of all the workers of each kind in one block.
+    // queue_depth is at most OE_SWITCHLESS_MAX_QUEUE_DEPTH and the number of
+    // workers at most OE_SGX_MAX_TCS, so the sizes cannot overflow.
+    host_queues = calloc(num_host_workers * queue_depth, sizeof(void*));
+    if (host_queues == NULL)
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    enclave_queues = calloc(num_enclave_workers * queue_depth, sizeof(void*));
+    if (enclave_queues == NULL)
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
     manager->num_host_workers = num_host_workers;
     manager->host_worker_contexts = host_contexts;
     manager->host_worker_threads = host_threads;
+    manager->host_worker_queues = host_queues;
     manager->num_enclave_workers = num_enclave_workers;
     manager->enclave_worker_contexts = enclave_contexts;
     manager->enclave_worker_threads = enclave_threads;
+    manager->enclave_worker_queues = enclave_queues;
+    manager->queue_depth = queue_depth;
+    manager->spin_policy = spin_policy;
+    manager->spin_budget = spin_budget;
+
+    // Callers of both kinds read the affinity from the first context.
+    if (num_host_workers > 0)
+        host_contexts[0].caller_affinity = workers->caller_affinity;
+    if (num_enclave_workers > 0)
+        enclave_contexts[0].caller_affinity = workers->caller_affinity;
+
+    // Workers beyond the min of each pool start parked.
+    OE_CHECK(_init_worker_pool(
+        &manager->host_worker_pool,
+        workers->min_host_workers,
+        num_host_workers));
+    OE_CHECK(_init_worker_pool(
+        &manager->enclave_worker_pool,
+        workers->min_enclave_workers,
+        num_enclave_workers));
 
     // Start the host worker threads, and assign each one a private context.
     for (size_t i = 0; i < num_host_workers; i++)
     {
         OE_TRACE_INFO("Creating switchless host worker thread %d\n", (int)i);
         manager->host_worker_contexts[i].enc = enclave;
+        manager->host_worker_contexts[i].queue =
+            &host_queues[i * queue_depth];
+        manager->host_worker_contexts[i].queue_mask = queue_depth - 1;
+        manager->host_worker_contexts[i].spin_count_threshold =
+            host_spin_count_threshold;
+        manager->host_worker_contexts[i].adaptive_spin_count_max =
+            adaptive_spin_count_max;
+        manager->host_worker_contexts[i].is_parked =
+            (i >= manager->host_worker_pool.min_workers);
         if (oe_thread_create(
                 &manager->host_worker_threads[i],
                 _switchless_ocall_worker,
@@ -257,6 +888,7 @@ oe_result_t oe_start_switchless_manager(
         {
             OE_RAISE(OE_THREAD_CREATE_ERROR);
         }
+        _set_worker_affinity(workers, manager->host_worker_threads[i], i);
     }
 
     // Inform the enclave about the switchless manager through an ECALL
@@ -277,8 +909,15 @@ oe_result_t oe_start_switchless_manager(
     {
         OE_TRACE_INFO("Creating switchless enclave worker thread %d\n", (int)i);
         manager->enclave_worker_contexts[i].enc = enclave;
+        manager->enclave_worker_contexts[i].queue =
+            &enclave_queues[i * queue_depth];
+        manager->enclave_worker_contexts[i].queue_mask = queue_depth - 1;
         manager->enclave_worker_contexts[i].spin_count_threshold =
-            OE_ENCLAVE_WORKER_SPIN_COUNT_THRESHOLD;
+            enclave_spin_count_threshold;
+        manager->enclave_worker_contexts[i].adaptive_spin_count_max =
+            adaptive_spin_count_max;
+        manager->enclave_worker_contexts[i].is_parked =
+            (i >= manager->enclave_worker_pool.min_workers);
         if (oe_thread_create(
                 &manager->enclave_worker_threads[i],
                 _switchless_ecall_worker,
@@ -286,6 +925,12 @@ oe_result_t oe_start_switchless_manager(
         {
             OE_RAISE(OE_THREAD_CREATE_ERROR);
         }
+        _set_worker_affinity(
+            workers, manager->enclave_worker_threads[i], num_host_workers + i);
+
+        // Parked workers do not enter the enclave until they are needed.
+        if (manager->enclave_worker_contexts[i].is_parked)
+            continue;
 
         // Wait until the enclave worker thread has started.
         // If so, spin_count and/or total_spin_count will be non zero.
@@ -298,6 +943,19 @@ oe_result_t oe_start_switchless_manager(
         }
     }
 
+    // Start resizing the pools if any of them is elastic.
+    if (manager->host_worker_pool.min_workers < num_host_workers ||
+        manager->enclave_worker_pool.min_workers < num_enclave_workers)
+    {
+        if (oe_thread_create(
+                &manager->scaling_thread,
+                _switchless_scaling_thread,
+                manager) != 0)
+        {
+            OE_RAISE(OE_THREAD_CREATE_ERROR);
+        }
+    }
+
     // Each enclave has at most one switchless manager.
     enclave->switchless_manager = manager;
 
@@ -331,13 +989,19 @@ oe_result_t oe_stop_switchless_manager(oe_enclave_t* enclave)
 
         // Free all allocated buffers.
         if (manager->host_worker_contexts != NULL)
-            free(manager->host_worker_contexts);
+            oe_memalign_free(manager->host_worker_contexts);
         if (manager->host_worker_threads != NULL)
             free(manager->host_worker_threads);
         if (manager->enclave_worker_contexts != NULL)
-            free(manager->enclave_worker_contexts);
+            oe_memalign_free(manager->enclave_worker_contexts);
         if (manager->enclave_worker_threads != NULL)
             free(manager->enclave_worker_threads);
+        if (manager->host_worker_queues != NULL)
+            free(manager->host_worker_queues);
+        if (manager->enclave_worker_queues != NULL)
+            free(manager->enclave_worker_queues);
+        _free_worker_pool(&manager->host_worker_pool);
+        _free_worker_pool(&manager->enclave_worker_pool);
         free(manager);
     }
     result = OE_OK;
@@ -350,6 +1014,33 @@ void oe_sgx_wake_switchless_worker_ocall(oe_host_worker_context_t* context)
     oe_host_worker_wake(context);
 }
 
+/* The hint of each host thread for oe_switchless_get_preferred_worker() */
+static oe_once_type _caller_hint_once = OE_H_ONCE_INITIALIZER;
+static oe_thread_key _caller_hint_key;
+static bool _caller_hint_key_created;
+
+static void _create_caller_hint_key(void)
+{
+    _caller_hint_key_created = oe_thread_key_create(&_caller_hint_key) == 0;
+}
+
+/* Return the hint of the calling thread, or zero if it has none */
+static uint64_t _get_caller_hint(void)
+{
+    oe_once(&_caller_hint_once, _create_caller_hint_key);
+
+    if (!_caller_hint_key_created)
+        return 0;
+
+    return (uint64_t)(uintptr_t)oe_thread_getspecific(_caller_hint_key);
+}
+
+static void _set_caller_hint(uint64_t hint)
+{
+    if (_caller_hint_key_created)
+        oe_thread_setspecific(_caller_hint_key, (void*)(uintptr_t)hint);
+}
+
 /*
 **==============================================================================
 **
@@ -373,7 +1064,11 @@ static oe_result_t _switchless_call_enclave_function_impl(
     oe_call_enclave_function_args_t args;
     oe_switchless_call_manager_t* manager = enclave->switchless_manager;
     oe_enclave_worker_context_t* contexts = NULL;
-    size_t tries = 0;
+    size_t num_workers = 0;
+    size_t preferred = 0;
+    size_t index = 0;
+    uint64_t slot = 0;
+    bool caller_affinity = false;
 
     /* Reject invalid parameters */
     if (!enclave)
@@ -391,80 +1086,122 @@ static oe_result_t _switchless_call_enclave_function_impl(
     }
 
     /* Do the switchless ECALL only if the manager is initialized. */
-    if (manager)
+    if (manager && manager->num_enclave_workers > 0)
     {
         contexts = manager->enclave_worker_contexts;
+        num_workers = manager->num_enclave_workers;
+        caller_affinity = contexts[0].caller_affinity != 0;
+        preferred = oe_switchless_get_preferred_worker(
+            _get_caller_hint(), &manager->next_caller, num_workers);
+
         // Schedule the switchless call.
         OE_ATOMIC_MEMORY_BARRIER_RELEASE();
         args.result = __OE_RESULT_MAX; // Means the call hasn't been processed.
 
-        // Cycle through the worker contexts until we find a free worker.
-        tries = manager->num_enclave_workers;
-        while (tries--)
+        // Prefer a worker whose queue is empty (pass 0) so that the call is
+        // handled immediately. Otherwise, queue the call behind the pending
+        // calls of any worker with room (pass 1). Each caller starts at its
+        // preferred worker so that concurrent callers do not all race for
+        // the same queue. With caller affinity, the preferred worker is used
+        // whenever it has room.
+        for (int pass = 0; pass < 2 && !switchless_call_posted; pass++)
         {
-            // Check if the worker's slot is free.
-            if (contexts[tries].call_arg == NULL)
+            for (size_t i = 0; i < num_workers; i++)
             {
-                // Try to atomically grab the slot by placing args in the slot.
-                // If the atomic operation was successful, then the worker
-                // thread will execute this switchless ecall. If the atomic
-                // operation failed, this means that the slot was grabbed by
-                // another switchless ocall and therefore, we must scan for
-                // another worker thread with a free slot.
-                if (oe_atomic_compare_and_swap_ptr(
-                        (void* volatile*)&contexts[tries].call_arg,
-                        NULL,
-                        &args))
-                {
-                    // The worker thread has been marked to execute this
-                    // switchless call. Determine if it needs to be woken up or
-                    // not.
-                    //
-                    // If event is 0, it means that it has gone to sleep. Wake
-                    // it by making an ocall
-                    // (oe_sgx_wake_switchless_worker_ocall). Note: it is
-                    // important to use an atomic cas operation to set the value
-                    // to 1 before making the ocall. Setting the value to 1
-                    // prevents the host worker from simulataneously going to
-                    // sleep. If instead, just a compare operation is used to
-                    // determine if the host thread is sleeping or not, the host
-                    // thread could go to sleep after the enclave has determined
-                    // that the host is not sleeping, causing a deadlock.
-                    //
-                    // If event is 1, that indicates a pending wake
-                    // notification.
-                    uint32_t oldval = 0;
-                    uint32_t newval = 1;
-                    // Weak operation could sporadically fail.
-                    // We need a strong operation.
-                    if (oe_atomic_compare_and_swap_32(
-                            (uint32_t*)&contexts[tries].event, oldval, newval))
-                    {
-                        // The pevious value of the event was 0 which means that
-                        // the worker was previously sleeping. Wake it.
-                        oe_enclave_worker_wake(&contexts[tries]);
-                    }
+                index = preferred + i;
+                if (index >= num_workers)
+                    index -= num_workers;
+
+                oe_enclave_worker_context_t* context = &contexts[index];
+                if (context->is_parked)
+                    continue;
 
+                uint64_t head = oe_atomic_load(&context->queue_head);
+                uint64_t tail = oe_atomic_load(&context->queue_tail);
+
+                bool is_idle = (head == tail);
+                bool is_full = (tail - head > context->queue_mask);
+                bool is_affine = (caller_affinity && i == 0);
+
+                if (is_full || (pass == 0 && !is_idle && !is_affine))
+                    continue;
+
+                // Try to atomically claim a slot in the worker's queue. If
+                // this fails, the queue was filled by other callers and we
+                // must scan for another worker.
+                if (oe_switchless_queue_post(
+                        (void* volatile*)context->queue,
+                        context->queue_mask,
+                        &context->queue_head,
+                        &context->queue_tail,
+                        &context->cas_failure_count,
+                        &args,
+                        &slot))
+                {
                     switchless_call_posted = true;
-                    // Wait for the  call to complete.
-                    while (true)
-                    {
-                        if (oe_atomic_load(
-                                (uint64_t*)&contexts[tries].call_arg) !=
-                            (uint64_t)&args)
-                            break;
-
-                        /* Yield CPU */
-                        oe_yield_cpu();
-                    }
                     break;
                 }
             }
         }
+
+        if (switchless_call_posted)
+        {
+            _set_caller_hint(
+                oe_switchless_update_hint(preferred, index, caller_affinity));
+
+            // The worker thread has been marked to execute this switchless
+            // call. Determine if it needs to be woken up or not.
+            //
+            // If event is 0, it means that it has gone to sleep. Wake it.
+            // Note: it is important to use an atomic cas operation to set the
+            // value to 1 before waking the worker. Setting the value to 1
+            // prevents the worker from simultaneously going to sleep. If
+            // instead, just a compare operation is used to determine if the
+            // worker is sleeping or not, the worker could go to sleep after
+            // the host has determined that the worker is not sleeping,
+            // causing a deadlock.
+            //
+            // If event is 1, that indicates a pending wake notification.
+            uint32_t oldval = 0;
+            uint32_t newval = 1;
+            // Weak operation could sporadically fail.
+            // We need a strong operation.
+            if (oe_atomic_compare_and_swap_32(
+                    (uint32_t*)&contexts[index].event, oldval, newval))
+            {
+                // The pevious value of the event was 0 which means that
+                // the worker was previously sleeping. Wake it.
+                oe_atomic_increment(&contexts[index].wake_count);
+                oe_enclave_worker_wake(&contexts[index]);
+            }
+
+            oe_switchless_wait_for_worker(
+                (void* volatile*)contexts[index].queue,
+                contexts[index].queue_mask,
+                slot,
+                &args,
+                contexts[index].queue_wait_histogram);
+
+            // Wait for the call to complete. The worker sets the result
+            // once it is done with args.
+            while (true)
+            {
+                OE_ATOMIC_MEMORY_BARRIER_ACQUIRE();
+                if (*(volatile oe_result_t*)&args.result != __OE_RESULT_MAX)
+                    break;
+
+                /* Yield CPU */
+                oe_yield_cpu();
+            }
+        }
     }
 
     if (!switchless_call_posted)
     {
+        // Record the miss so that an elastic pool can grow.
+        if (contexts)
+            oe_atomic_increment(&contexts[0].miss_count);
+
         // Dispatch as normal ecall.
         OE_CHECK(oe_ecall(
             enclave, OE_ECALL_CALL_ENCLAVE_FUNCTION, (uint64_t)&args, NULL));
@@ -480,6 +1217,116 @@ done:
     return result;
 }
 
+/* Convert a number of spin iterations to an estimated duration */
+static uint64_t _spin_count_to_nanoseconds(uint64_t spin_count)
+{
+    oe_once(&_spin_calibration_once, _calibrate_spin_count);
+
+    // Saturate absurdly long durations instead of overflowing.
+    if (spin_count > OE_UINT64_MAX / 1000000)
+        return OE_UINT64_MAX;
+
+    return spin_count * 1000000 / _spin_count_per_millisecond;
+}
+
+static void _add_worker_statistics(
+    oe_switchless_call_statistics_t* statistics,
+    const oe_switchless_worker_statistics_t* worker,
+    volatile uint64_t* queue_wait_histogram)
+{
+    statistics->workers[statistics->num_workers++] = *worker;
+    statistics->posted_calls += worker->posted_calls;
+    statistics->wakeups += worker->wakeups;
+    statistics->sleeps += worker->sleeps;
+    statistics->spin_count += worker->spin_count;
+    statistics->cas_failures += worker->cas_failures;
+
+    for (size_t i = 0; i < OE_SWITCHLESS_QUEUE_WAIT_BUCKETS; i++)
+        statistics->queue_wait_histogram[i] +=
+            oe_atomic_load(&queue_wait_histogram[i]);
+}
+
+/*
+**==============================================================================
+**
+** oe_get_switchless_statistics()
+**
+**==============================================================================
+*/
+oe_result_t oe_get_switchless_statistics(
+    oe_enclave_t* enclave,
+    oe_switchless_statistics_t* statistics)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    oe_switchless_call_manager_t* manager = NULL;
+
+    if (!enclave || !statistics)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    memset(statistics, 0, sizeof(*statistics));
+
+    for (size_t i = 0; i < OE_SWITCHLESS_QUEUE_WAIT_BUCKETS; i++)
+    {
+        uint64_t bound = (i + 1 < OE_SWITCHLESS_QUEUE_WAIT_BUCKETS)
+                             ? _spin_count_to_nanoseconds(1ULL << i)
+                             : OE_UINT64_MAX;
+        statistics->ocalls.queue_wait_bounds[i] = bound;
+        statistics->ecalls.queue_wait_bounds[i] = bound;
+    }
+
+    if (!(manager = enclave->switchless_manager))
+    {
+        result = OE_OK;
+        goto done;
+    }
+
+    for (size_t i = 0; i < manager->num_host_workers; i++)
+    {
+        oe_host_worker_context_t* context = &manager->host_worker_contexts[i];
+        oe_switchless_worker_statistics_t worker = {
+            oe_atomic_load(&context->queue_tail),
+            oe_atomic_load(&context->queue_head),
+            oe_atomic_load(&context->wake_count),
+            oe_atomic_load(&context->sleep_count),
+            oe_atomic_load(&context->total_spin_count),
+            oe_atomic_load(&context->cas_failure_count),
+            context->is_parked};
+
+        _add_worker_statistics(
+            &statistics->ocalls, &worker, context->queue_wait_histogram);
+    }
+
+    for (size_t i = 0; i < manager->num_enclave_workers; i++)
+    {
+        oe_enclave_worker_context_t* context =
+            &manager->enclave_worker_contexts[i];
+        oe_switchless_worker_statistics_t worker = {
+            oe_atomic_load(&context->queue_tail),
+            oe_atomic_load(&context->queue_head),
+            oe_atomic_load(&context->wake_count),
+            oe_atomic_load(&context->sleep_count),
+            oe_atomic_load(&context->total_spin_count),
+            oe_atomic_load(&context->cas_failure_count),
+            context->is_parked};
+
+        _add_worker_statistics(
+            &statistics->ecalls, &worker, context->queue_wait_histogram);
+    }
+
+    if (manager->num_host_workers > 0)
+        statistics->ocalls.fallback_calls =
+            oe_atomic_load(&manager->host_worker_contexts[0].miss_count);
+
+    if (manager->num_enclave_workers > 0)
+        statistics->ecalls.fallback_calls =
+            oe_atomic_load(&manager->enclave_worker_contexts[0].miss_count);
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
 /*
 **==============================================================================
 **
@@ -0,0 +1,220 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include "threadpool.h"
+#include <openenclave/internal/atomic.h>
+#include <openenclave/internal/calls.h>
+#include <openenclave/internal/raise.h>
+#include <openenclave/internal/result.h>
+#include <openenclave/internal/trace.h>
+#include <stdlib.h>
+#include "../hostthread.h"
+#include "enclave.h"
+
+typedef struct _worker
+{
+    oe_enclave_t* enclave;
+    oe_thread_t thread;
+
+    /* The identifier of the thread as seen by itself, which is set before the
+     * thread enters the enclave */
+    oe_thread_t self;
+    volatile uint64_t started;
+
+    /* Set when the thread left the enclave */
+    volatile uint64_t exited;
+    oe_result_t result;
+} worker_t;
+
+struct _oe_thread_pool
+{
+    worker_t workers[OE_SGX_MAX_TCS];
+    size_t num_threads;
+};
+
+/* Make a system ECALL and return the result of its handler */
+static oe_result_t _ecall(oe_enclave_t* enclave, uint16_t func, uint64_t arg)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    uint64_t result_out = 0;
+
+    OE_CHECK(oe_ecall(enclave, func, arg, &result_out));
+
+    if (result_out > OE_UINT32_MAX)
+        OE_RAISE(OE_FAILURE);
+
+    if (!oe_is_valid_result((uint32_t)result_out))
+        OE_RAISE(OE_FAILURE);
+
+    result = (oe_result_t)result_out;
+
+done:
+    return result;
+}
+
+/*
+** The thread function of the pool, which returns when the pool is stopped
+*/
+static void* _thread_pool_worker(void* arg)
+{
+    worker_t* worker = (worker_t*)arg;
+
+    worker->self = oe_thread_self();
+    oe_atomic_store(&worker->started, 1);
+
+    // The TCS of the worker was reserved when the pool was started, so the
+    // ECALL does not run out of threads.
+    worker->result = _ecall(worker->enclave, OE_ECALL_THREAD_POOL_WORKER, 0);
+
+    if (worker->result != OE_OK)
+        OE_TRACE_ERROR(
+            "Enclave thread pool worker failed: %s\n",
+            oe_result_str(worker->result));
+
+    oe_atomic_store(&worker->exited, 1);
+
+    return NULL;
+}
+
+/* Whether the thread holds a TCS of the enclave */
+static bool _holds_tcs(oe_enclave_t* enclave, oe_thread_t thread)
+{
+    uint64_t busy_bindings = ~oe_atomic_load(&enclave->free_bindings);
+
+    for (size_t i = 0; i < enclave->num_bindings; i++)
+    {
+        if ((busy_bindings & (1ULL << i)) &&
+            oe_thread_equal(enclave->bindings[i].thread, thread))
+            return true;
+    }
+
+    return false;
+}
+
+/* Wait until the worker has entered the enclave. Returns the result of the
+ * worker if it left the enclave instead */
+static oe_result_t _wait_for_worker(oe_enclave_t* enclave, worker_t* worker)
+{
+    while (!oe_atomic_load(&worker->started))
+        oe_yield_cpu();
+
+    while (!_holds_tcs(enclave, worker->self))
+    {
+        if (oe_atomic_load(&worker->exited))
+            return worker->result == OE_OK ? OE_UNEXPECTED : worker->result;
+
+        oe_yield_cpu();
+    }
+
+    return OE_OK;
+}
+
+oe_result_t oe_start_enclave_thread_pool(
+    oe_enclave_t* enclave,
+    const oe_enclave_setting_thread_pool_t* setting)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    struct _oe_thread_pool* pool = NULL;
+    size_t num_reserved = 0;
+
+    if (!enclave || !setting)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    if (enclave->thread_pool)
+        OE_RAISE(OE_ALREADY_INITIALIZED);
+
+    if (setting->num_threads == 0)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    // The workers hold their TCSs until the pool is stopped. Keep at least
+    // one TCS for regular ecalls, which also stop the pool, besides the
+    // TCSs that the switchless enclave workers may hold.
+    if (enclave->switchless_manager)
+        num_reserved = enclave->switchless_manager->num_enclave_workers;
+
+    if (setting->num_threads >= enclave->num_bindings ||
+        num_reserved >= enclave->num_bindings - setting->num_threads)
+        OE_RAISE_MSG(
+            OE_OUT_OF_THREADS,
+            "%u thread pool workers and %zu switchless enclave workers "
+            "leave no TCS out of %zu for regular ecalls",
+            setting->num_threads,
+            num_reserved,
+            enclave->num_bindings);
+
+    if (!(pool = calloc(1, sizeof(*pool))))
+        OE_RAISE(OE_OUT_OF_MEMORY);
+
+    OE_CHECK(
+        _ecall(enclave, OE_ECALL_START_THREAD_POOL, setting->num_threads));
+
+    enclave->thread_pool = pool;
+    for (size_t i = 0; i < setting->num_threads; i++)
+    {
+        worker_t* worker = &pool->workers[i];
+
+        worker->enclave = enclave;
+
+        if (oe_thread_create(&worker->thread, _thread_pool_worker, worker))
+        {
+            // Stopping the pool frees it.
+            pool = NULL;
+            oe_stop_enclave_thread_pool(enclave);
+            OE_RAISE(OE_THREAD_CREATE_ERROR);
+        }
+
+        pool->num_threads++;
+    }
+
+    // Wait for the workers to enter the enclave, so that regular ecalls made
+    // once the enclave is created do not take the TCSs reserved for them.
+    for (size_t i = 0; i < pool->num_threads; i++)
+    {
+        if ((result = _wait_for_worker(enclave, &pool->workers[i])) != OE_OK)
+        {
+            pool = NULL;
+            oe_stop_enclave_thread_pool(enclave);
+            OE_RAISE(result);
+        }
+    }
+
+    pool = NULL;
+    result = OE_OK;
+
+done:
+    free(pool);
+
+    return result;
+}
+
+size_t oe_get_enclave_thread_pool_size(oe_enclave_t* enclave)
+{
+    return enclave->thread_pool ? enclave->thread_pool->num_threads : 0;
+}
+
+oe_result_t oe_stop_enclave_thread_pool(oe_enclave_t* enclave)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    struct _oe_thread_pool* pool = NULL;
+
+    if (!enclave)
+        OE_RAISE(OE_INVALID_PARAMETER);
+
+    if (!(pool = enclave->thread_pool))
+        return OE_OK;
+
+    OE_CHECK(_ecall(enclave, OE_ECALL_STOP_THREAD_POOL, 0));
+
+    for (size_t i = 0; i < pool->num_threads; i++)
+    {
+        if (oe_thread_join(pool->workers[i].thread))
+            OE_RAISE(OE_THREAD_JOIN_ERROR);
+    }
+
+    enclave->thread_pool = NULL;
+    free(pool);
+    result = OE_OK;
+
+done:
+    return result;
+}
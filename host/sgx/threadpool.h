@@ -0,0 +1,23 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_HOST_SGX_THREADPOOL_H
+#define _OE_HOST_SGX_THREADPOOL_H
+
+#include <openenclave/host.h>
+
+/* Start the threads of the OE_ENCLAVE_SETTING_THREAD_POOL setting, which
+ * enter the enclave and run its pthreads until the pool is stopped */
+oe_result_t oe_start_enclave_thread_pool(
+    oe_enclave_t* enclave,
+    const oe_enclave_setting_thread_pool_t* setting);
+
+/* Return the number of threads of the pool of the enclave, which hold a TCS
+ * each, or 0 without a pool */
+size_t oe_get_enclave_thread_pool_size(oe_enclave_t* enclave);
+
+/* Make the threads of the pool leave the enclave once they finished the
+ * queued tasks, and wait for them. Does nothing without a pool */
+oe_result_t oe_stop_enclave_thread_pool(oe_enclave_t* enclave);
+
+#endif /* _OE_HOST_SGX_THREADPOOL_H */
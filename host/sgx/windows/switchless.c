@@ -47,3 +47,50 @@ void oe_enclave_worker_wake(oe_enclave_worker_context_t* context)
 {
     _worker_wake(&context->event);
 }
+
+uint64_t oe_switchless_get_time_in_microseconds(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0)
+        QueryPerformanceFrequency(&frequency);
+
+    // Split the conversion to avoid overflowing on long uptimes.
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 /
+               (uint64_t)frequency.QuadPart;
+}
+
+void oe_switchless_manager_wait(
+    oe_switchless_call_manager_t* manager,
+    uint32_t milliseconds)
+{
+    // oe_switchless_manager_wake sets the event after is_stopping, so the
+    // wait returns immediately if the manager stopped after this check.
+    // Timeouts and spurious wakes are harmless: the caller re-checks.
+    if (!manager->is_stopping)
+    {
+        uint32_t zero = 0;
+        WaitOnAddress(
+            (volatile long*)&manager->scaling_event,
+            &zero,
+            sizeof(manager->scaling_event),
+            milliseconds);
+    }
+}
+
+void oe_switchless_manager_wake(oe_switchless_call_manager_t* manager)
+{
+    _worker_wake((volatile long*)&manager->scaling_event);
+}
+
+int oe_switchless_set_thread_affinity(oe_thread_t thread, uint32_t cpu)
+{
+    if (cpu >= sizeof(DWORD_PTR) * 8)
+        return -1;
+
+    return SetThreadAffinityMask((HANDLE)thread, (DWORD_PTR)1 << cpu) ? 0
+                                                                       : -1;
+}
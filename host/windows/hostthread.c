@@ -138,17 +138,129 @@ int oe_thread_key_create(oe_thread_key* key)
     return 0;
 }
 
+/* Only fiber local storage (FLS) supports destructors, so a key created with
+ * a destructor also holds an FLS index. The value stays in the TLS index, and
+ * the FLS slot of each thread that sets a value points to the key, so that
+ * the trampoline finds the destructor and the value when the thread exits.
+ * Such keys are indices in _destructor_keys tagged with DESTRUCTOR_KEY_FLAG,
+ * which TLS indices never have. */
+
+#define DESTRUCTOR_KEY_FLAG 0x80000000
+#define MAX_DESTRUCTOR_KEYS 64
+
+typedef struct _destructor_key
+{
+    DWORD tls_index;
+    DWORD fls_index;
+    void (*destructor)(void* value);
+} destructor_key_t;
+
+static destructor_key_t _destructor_keys[MAX_DESTRUCTOR_KEYS];
+static SRWLOCK _destructor_keys_lock = SRWLOCK_INIT;
+
+static void WINAPI _destructor_trampoline(void* data)
+{
+    destructor_key_t* dk = (destructor_key_t*)data;
+    void (*destructor)(void* value) = dk->destructor;
+    void* value;
+
+    /* The key was deleted, which does not call destructors */
+    if (!destructor)
+        return;
+
+    if ((value = TlsGetValue(dk->tls_index)))
+    {
+        TlsSetValue(dk->tls_index, NULL);
+        destructor(value);
+    }
+}
+
+static destructor_key_t* _get_destructor_key(oe_thread_key key)
+{
+    if (!(key & DESTRUCTOR_KEY_FLAG))
+        return NULL;
+
+    return &_destructor_keys[key & ~DESTRUCTOR_KEY_FLAG];
+}
+
+int oe_thread_key_create_with_destructor(
+    oe_thread_key* key,
+    void (*destructor)(void* value))
+{
+    int ret = 1;
+    DWORD tls_index = TLS_OUT_OF_INDEXES;
+    DWORD fls_index = FLS_OUT_OF_INDEXES;
+    DWORD i;
+
+    if (!destructor)
+        return oe_thread_key_create(key);
+
+    AcquireSRWLockExclusive(&_destructor_keys_lock);
+
+    for (i = 0; i < MAX_DESTRUCTOR_KEYS; i++)
+    {
+        if (!_destructor_keys[i].destructor)
+            break;
+    }
+
+    if (i == MAX_DESTRUCTOR_KEYS)
+        goto done;
+
+    if ((tls_index = TlsAlloc()) == TLS_OUT_OF_INDEXES)
+        goto done;
+
+    if ((fls_index = FlsAlloc(_destructor_trampoline)) == FLS_OUT_OF_INDEXES)
+    {
+        TlsFree(tls_index);
+        goto done;
+    }
+
+    _destructor_keys[i].tls_index = tls_index;
+    _destructor_keys[i].fls_index = fls_index;
+    _destructor_keys[i].destructor = destructor;
+    *key = i | DESTRUCTOR_KEY_FLAG;
+    ret = 0;
+
+done:
+    ReleaseSRWLockExclusive(&_destructor_keys_lock);
+    return ret;
+}
+
 int oe_thread_key_delete(oe_thread_key key)
 {
-    return !TlsFree(key);
+    destructor_key_t* dk = _get_destructor_key(key);
+    int ret;
+
+    if (!dk)
+        return !TlsFree(key);
+
+    AcquireSRWLockExclusive(&_destructor_keys_lock);
+
+    /* FlsFree() calls the trampoline for the threads that set a value, which
+     * then returns without calling the destructor. */
+    dk->destructor = NULL;
+    ret = !FlsFree(dk->fls_index) | !TlsFree(dk->tls_index);
+
+    ReleaseSRWLockExclusive(&_destructor_keys_lock);
+    return ret;
 }
 
 int oe_thread_setspecific(oe_thread_key key, void* value)
 {
-    return !TlsSetValue(key, value);
+    destructor_key_t* dk = _get_destructor_key(key);
+
+    if (!dk)
+        return !TlsSetValue(key, value);
+
+    if (!TlsSetValue(dk->tls_index, value))
+        return 1;
+
+    return !FlsSetValue(dk->fls_index, value ? dk : NULL);
 }
 
 void* oe_thread_getspecific(oe_thread_key key)
 {
-    return TlsGetValue(key);
+    destructor_key_t* dk = _get_destructor_key(key);
+
+    return TlsGetValue(dk ? dk->tls_index : key);
 }
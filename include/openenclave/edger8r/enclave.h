@@ -155,6 +155,57 @@ void* oe_allocate_switchless_ocall_buffer(size_t size);
  */
 void oe_free_switchless_ocall_buffer(void* buffer);
 
+/**
+ * Allocate a buffer of given size for doing an asynchronous ocall.
+ *
+ * The buffer is allocated in host memory and holds the input and output
+ * buffers of the call, in that order. It should be treated as untrusted.
+ *
+ * @param size The size in bytes of the buffer.
+ * @returns pointer to the allocated buffer.
+ * @return NULL if allocation failed.
+ */
+void* oe_allocate_async_ocall_buffer(size_t size);
+
+/**
+ * Free a buffer allocated for an asynchronous ocall that was not passed to
+ * oe_call_host_function_async().
+ *
+ * @param buffer The buffer allocated via oe_allocate_async_ocall_buffer.
+ */
+void oe_free_async_ocall_buffer(void* buffer);
+
+/**
+ * Perform a high-level host function call (OCALL) asynchronously.
+ *
+ * Post the call of the host function matching the given function_id to a
+ * switchless host worker thread and return without waiting for the call.
+ * The host function has the same signature as for oe_call_host_function().
+ * Its outputs are discarded, so this is only used for host functions that
+ * return void and have no out parameters. If no host worker thread is
+ * available, the call is made as a regular OCALL before this function
+ * returns.
+ *
+ * The buffer is owned by the callee, whether the call succeeds or not.
+ * Use oe_flush_async_ocalls() to wait for the posted calls.
+ *
+ * @param function_id The id of the host function that will be called.
+ * @param buffer Buffer allocated via oe_allocate_async_ocall_buffer() that
+ * contains the input data followed by space for the output data.
+ * @param input_buffer_size Size of the input data.
+ * @param output_buffer_size Size of the output data.
+ *
+ * @return OE_OK the call was posted or made.
+ * @return OE_NOT_FOUND if the function_id does not correspond to a function.
+ * @return OE_INVALID_PARAMETER a parameter is invalid.
+ * @return OE_FAILURE the call failed.
+ */
+oe_result_t oe_call_host_function_async(
+    size_t function_id,
+    void* buffer,
+    size_t input_buffer_size,
+    size_t output_buffer_size);
+
 /**
  * Forward declarations of malloc and free for deep-copy out parameter support.
  */
@@ -76,6 +76,81 @@ oe_result_t oe_call_enclave_function(
     size_t output_buffer_size,
     size_t* output_bytes_written);
 
+/**
+ * Describes one enclave function call in a batch submitted with
+ * oe_call_enclave_function_batch().
+ */
+typedef struct _oe_enclave_function_call
+{
+    /* The global id of the enclave function that will be called. */
+    uint64_t* global_id;
+
+    /* The name of the function that will be called. */
+    const char* name;
+
+    /* Buffer containing inputs data. */
+    const void* input_buffer;
+    size_t input_buffer_size;
+
+    /* Buffer where the outputs of the enclave function are written to. */
+    void* output_buffer;
+    size_t output_buffer_size;
+
+    /* Number of bytes written in the output buffer (out). */
+    size_t output_bytes_written;
+
+    /* Result of this call (out). */
+    oe_result_t result;
+} oe_enclave_function_call_t;
+
+/**
+ * Perform a batch of high-level enclave function calls (ECALLs).
+ *
+ * The calls are executed in order by the enclave within a single enclave
+ * entry, which amortizes the transition cost across all of them. Each call
+ * is marshalled exactly like a call made with oe_call_enclave_function().
+ * A failing call does not stop the batch; its status is reported in its
+ * **result** field.
+ *
+ * @param enclave The enclave to call into.
+ * @param calls The array of calls to perform.
+ * @param num_calls The number of elements in **calls**.
+ *
+ * @return OE_OK the batch was executed. Check the per-call results.
+ * @return OE_NOT_FOUND if the name of a call does not correspond to a
+ * function.
+ * @return OE_INVALID_PARAMETER a parameter is invalid.
+ * @return OE_OUT_OF_MEMORY the batch could not be allocated.
+ *
+ */
+oe_result_t oe_call_enclave_function_batch(
+    oe_enclave_t* enclave,
+    oe_enclave_function_call_t* calls,
+    size_t num_calls);
+
+/**
+ * Allocate a marshalling buffer of given size for doing an ecall.
+ *
+ * Buffers are taken from a per-thread pool of size-classed buffers, so that
+ * consecutive ecalls made by a thread reuse the same memory. The buffer is
+ * aligned on OE_EDGER8R_BUFFER_ALIGNMENT and its contents are undefined.
+ *
+ * @param size The size in bytes of the buffer.
+ * @returns pointer to the allocated buffer.
+ * @return NULL if allocation failed.
+ */
+void* oe_allocate_ecall_buffer(size_t size);
+
+/**
+ * Free the buffer allocated for ecalls.
+ *
+ * The buffer is returned to the pool of the calling thread, which need not
+ * be the thread that allocated it.
+ *
+ * @param buffer The buffer allocated via oe_allocate_ecall_buffer.
+ */
+void oe_free_ecall_buffer(void* buffer);
+
 /**
  * Placeholder.
  */
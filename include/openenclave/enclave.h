@@ -130,6 +130,11 @@ bool oe_is_outside_enclave(const void* ptr, size_t size);
  * the host, which calls malloc(). To free the memory, it must be passed to
  * oe_host_free().
  *
+ * If the host donated a host heap region at enclave creation (see
+ * **host_heap_size** in **oe_enclave_setting_shared_memory_t**), allocations
+ * of up to 4 KB are served from the region without an OCALL. The host must
+ * not free such memory with free().
+ *
  * @param[in] size The number of bytes to be allocated.
  *
  * @returns The allocated memory or NULL if unable to allocate the memory.
@@ -205,6 +210,131 @@ void oe_host_free(void* ptr);
  */
 char* oe_host_strndup(const char* str, size_t n);
 
+/**
+ * Statistics of the shared memory arenas, from which the buffers of
+ * switchless OCALLs are allocated. Each enclave thread has its own arena,
+ * made of chunks of host memory that are chained as the arena grows.
+ */
+typedef struct _oe_shared_memory_arena_statistics
+{
+    /** Bytes allocated from the arena of the current thread. */
+    uint64_t used;
+    /** Bytes of host memory held by the arena of the current thread. */
+    uint64_t capacity;
+    /** The number of chunks held by the arena of the current thread. */
+    uint64_t num_chunks;
+    /** Peak of **used** since the arena of the current thread was created. */
+    uint64_t thread_high_water;
+    /** Peak of **used** across all the threads of the enclave. */
+    uint64_t high_water;
+    /** The number of chunks allocated from the host by all the threads. */
+    uint64_t num_chunk_allocations;
+    /**
+     * The number of allocations that failed because the host was out of
+     * memory or an arena reached its max size. The callers then fall back to
+     * other allocators.
+     */
+    uint64_t num_failures;
+} oe_shared_memory_arena_statistics_t;
+
+/**
+ * Get the statistics of the shared memory arenas.
+ *
+ * The arena of a thread is created by its first allocation and freed when
+ * the outermost ECALL of the thread returns. Its chunk size and max size are
+ * set at enclave creation with the **OE_ENCLAVE_SETTING_SHARED_MEMORY**
+ * setting.
+ *
+ * @param[out] statistics The statistics.
+ *
+ * @returns OE_OK on success.
+ * @returns OE_INVALID_PARAMETER if **statistics** is NULL.
+ * @returns OE_UNSUPPORTED if the platform has no shared memory arenas.
+ *
+ */
+oe_result_t oe_get_shared_memory_arena_statistics(
+    oe_shared_memory_arena_statistics_t* statistics);
+
+/**
+ * The number of buckets of the histogram of the OCALL buffer misses.
+ */
+#define OE_OCALL_BUFFER_HISTOGRAM_SIZE 32
+
+/**
+ * Statistics of the buffers of the OCALLs. Each ECALL comes with a buffer of
+ * host memory for the parameters of its OCALLs. An OCALL whose parameters do
+ * not fit in it misses, and allocates its buffer from the host with two more
+ * OCALLs.
+ */
+typedef struct _oe_ocall_buffer_statistics
+{
+    /** The number of OCALL buffers allocated by all the threads. */
+    uint64_t num_allocations;
+    /** The number of these allocations that missed the ECALL buffer. */
+    uint64_t num_misses;
+    /** The size of the OCALL buffer of the current ECALL. */
+    uint64_t buffer_size;
+    /**
+     * The size that the enclave asked the host to grow the OCALL buffers to,
+     * or 0 if it did not.
+     */
+    uint64_t requested_buffer_size;
+    /**
+     * The misses by size. Bucket i counts the sizes larger than 2^(i-1) and
+     * at most 2^i. The last bucket counts all the larger sizes too.
+     */
+    uint64_t miss_histogram[OE_OCALL_BUFFER_HISTOGRAM_SIZE];
+} oe_ocall_buffer_statistics_t;
+
+/**
+ * Get the statistics of the OCALL buffers.
+ *
+ * When an OCALL size keeps missing, the host grows the OCALL buffers to fit
+ * it, up to the max size set with the **OE_ENCLAVE_SETTING_SHARED_MEMORY**
+ * setting. The buffer of a thread grows at its next outermost ECALL.
+ *
+ * @param[out] statistics The statistics.
+ *
+ * @returns OE_OK on success.
+ * @returns OE_INVALID_PARAMETER if **statistics** is NULL.
+ * @returns OE_UNSUPPORTED if the platform has no OCALL buffers.
+ *
+ */
+oe_result_t oe_get_ocall_buffer_statistics(
+    oe_ocall_buffer_statistics_t* statistics);
+
+/**
+ * Wait for the asynchronous OCALLs that have been posted.
+ *
+ * Host functions declared with the **async** attribute in the EDL are posted
+ * to the switchless host worker threads and the enclave does not wait for
+ * them to run. This function returns once all the asynchronous OCALLs that
+ * were posted by any enclave thread before it was called have run. Calls
+ * posted concurrently with this function may not have run.
+ *
+ * Asynchronous OCALLs that are still pending when the enclave is terminated
+ * run before oe_terminate_enclave() returns.
+ *
+ * @returns OE_OK on success.
+ *
+ */
+oe_result_t oe_flush_async_ocalls(void);
+
+/**
+ * Allow the host to start the sampling heap profiler of the enclave.
+ *
+ * The profile discloses the sizes and call stacks of the allocations of the
+ * enclave to the host, so the creation of the enclave with the
+ * **OE_ENCLAVE_SETTING_HEAP_PROFILER** setting fails with OE_UNSUPPORTED
+ * unless the enclave uses this macro once, at file scope, in one of its
+ * source files:
+ *
+ *     OE_ALLOW_HEAP_PROFILER();
+ *
+ */
+#define OE_ALLOW_HEAP_PROFILER() \
+    OE_EXTERNC const bool oe_heap_profiler_allowed = true
+
 /**
  * Abort execution of the enclave.
  *
@@ -113,12 +113,44 @@ typedef void (*oe_ocall_func_t)(
 typedef enum _oe_enclave_setting_type
 {
     OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS = 0xdc73a628,
+    OE_ENCLAVE_SETTING_SWITCHLESS_WORKERS = 0x8e25f1a9,
+    OE_ENCLAVE_SETTING_SHARED_MEMORY = 0x5d1c83b7,
+    OE_ENCLAVE_SETTING_THREAD_POOL = 0x3e9a51c4,
+    OE_ENCLAVE_SETTING_HEAP_PROFILER = 0x71b3e05d,
+    OE_ENCLAVE_SETTING_HEAP_WATERMARK = 0x2c8f47b6,
+    OE_ENCLAVE_SETTING_HEAP_STATISTICS = 0x4a6d2e93,
 #ifdef OE_WITH_EXPERIMENTAL_EEID
     OE_EXTENDED_ENCLAVE_INITIALIZATION_DATA = 0x976a8f66,
 #endif
     OE_SGX_ENCLAVE_CONFIG_DATA = 0x78b5b41d
 } oe_enclave_setting_type_t;
 
+/**
+ * The policy that decides how long an idle context-switchless worker thread
+ * spins, waiting for a call, before going to sleep. Spinning longer lowers
+ * the latency of calls that arrive after a gap at the cost of CPU time.
+ */
+typedef enum _oe_switchless_spin_policy
+{
+    /**
+     * Spin for a fixed number of iterations (**spin_budget**, default 4096).
+     */
+    OE_SWITCHLESS_SPIN_POLICY_FIXED = 0,
+    /**
+     * Spin for a fixed amount of time (**spin_budget** in microseconds,
+     * default 50).
+     */
+    OE_SWITCHLESS_SPIN_POLICY_TIMED = 1,
+    /**
+     * Adapt the amount of spinning to the observed inter-arrival times of
+     * calls. Workers spin long enough to catch calls that arrive in quick
+     * succession and go to sleep quickly when calls are sparse. The amount
+     * of spinning never exceeds **spin_budget** microseconds (default 1000).
+     */
+    OE_SWITCHLESS_SPIN_POLICY_ADAPTIVE = 2,
+    __OE_SWITCHLESS_SPIN_POLICY_MAX = OE_ENUM_MAX,
+} oe_switchless_spin_policy_t;
+
 /**
  * The setting for context-switchless calls.
  */
@@ -137,6 +169,301 @@ typedef struct _oe_enclave_setting_context_switchless
     size_t max_enclave_workers;
 } oe_enclave_setting_context_switchless_t;
 
+/**
+ * The setting for the worker threads of context-switchless calls. It tunes
+ * the workers of **OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS** and can only be
+ * passed together with that setting. Without it, the workers use the
+ * defaults of the fields below.
+ */
+typedef struct _oe_enclave_setting_switchless_workers
+{
+    /**
+     * The number of calls that can be pending on each worker thread. Callers
+     * fall back to regular calls only when the queues of all the workers are
+     * full. The value is rounded up to a power of two and capped at 1024.
+     * The default (0) is 1, i.e., a call is posted only to an idle worker.
+     */
+    size_t queue_depth;
+    /**
+     * The policy that decides how long idle worker threads spin before going
+     * to sleep. The default is OE_SWITCHLESS_SPIN_POLICY_FIXED.
+     */
+    oe_switchless_spin_policy_t spin_policy;
+    /**
+     * The spin budget of **spin_policy**. Its unit depends on the policy. The
+     * default (0) selects the default budget of the policy.
+     */
+    uint64_t spin_budget;
+    /**
+     * The min number of active worker threads for context-switchless ocalls.
+     * When it is lower than **max_host_workers** of
+     * **oe_enclave_setting_context_switchless_t**, the set of active workers
+     * grows when calls fall back to regular ocalls because all the workers
+     * are busy, and shrinks when workers stay idle. The default (0) keeps
+     * **max_host_workers** workers active at all times.
+     */
+    size_t min_host_workers;
+    /**
+     * The min number of active worker threads for context-switchless ecalls.
+     * See **min_host_workers**. Inactive enclave workers do not occupy a TCS.
+     */
+    size_t min_enclave_workers;
+    /**
+     * Optional CPU affinity hints for the worker threads. Host workers, then
+     * enclave workers, are assigned the CPUs of this array in round-robin
+     * order. Hints that the OS rejects are ignored.
+     */
+    const uint32_t* worker_cpus;
+    /**
+     * The number of entries in **worker_cpus**.
+     */
+    size_t num_worker_cpus;
+    /**
+     * Each calling thread is assigned a preferred worker, and callers are
+     * spread across the workers so that they do not contend for the same
+     * queue. By default (false), a call goes to an idle worker if there is
+     * one, and the caller then prefers that worker. If true, a call goes to
+     * the preferred worker of the caller whenever its queue has room, even if
+     * other workers are idle. This keeps the calls of a thread on one worker,
+     * which suits callers that benefit from a warm worker cache, and requires
+     * a **queue_depth** above 1 to have an effect when the worker is busy.
+     */
+    bool caller_affinity;
+} oe_enclave_setting_switchless_workers_t;
+
+/**
+ * The max number of worker threads of each kind reported by
+ * **oe_get_switchless_statistics()**.
+ */
+#define OE_SWITCHLESS_MAX_WORKERS 32
+
+/**
+ * The number of buckets of the queue-wait histograms reported by
+ * **oe_get_switchless_statistics()**.
+ */
+#define OE_SWITCHLESS_QUEUE_WAIT_BUCKETS 16
+
+/**
+ * Statistics of one switchless worker thread.
+ */
+typedef struct _oe_switchless_worker_statistics
+{
+    /** The number of calls posted to the worker. */
+    uint64_t posted_calls;
+    /** The number of posted calls that the worker has completed. */
+    uint64_t completed_calls;
+    /** The number of times a caller woke the worker up. */
+    uint64_t wakeups;
+    /** The number of times the worker went to sleep. */
+    uint64_t sleeps;
+    /** The number of iterations the worker spun while waiting for calls. */
+    uint64_t spin_count;
+    /**
+     * The number of times a caller lost the race for a slot of the queue of
+     * the worker to another caller.
+     */
+    uint64_t cas_failures;
+    /** Whether the worker is parked. See **min_host_workers**. */
+    bool is_parked;
+} oe_switchless_worker_statistics_t;
+
+/**
+ * Statistics of the switchless calls in one direction.
+ */
+typedef struct _oe_switchless_call_statistics
+{
+    /** The number of worker threads. Zero if there are none. */
+    size_t num_workers;
+    /** The number of calls posted to the workers. */
+    uint64_t posted_calls;
+    /**
+     * The number of calls that fell back to regular calls because the queues
+     * of all the workers were full.
+     */
+    uint64_t fallback_calls;
+    /** The total of the **wakeups** of the workers. */
+    uint64_t wakeups;
+    /** The total of the **sleeps** of the workers. */
+    uint64_t sleeps;
+    /** The total of the **spin_count** of the workers. */
+    uint64_t spin_count;
+    /** The total of the **cas_failures** of the workers. */
+    uint64_t cas_failures;
+    /**
+     * The number of posted calls by how long they waited in a queue before a
+     * worker took them. Bucket i counts the waits shorter than
+     * **queue_wait_bounds[i]** nanoseconds, and not shorter than the bound
+     * of bucket i - 1. The last bucket counts all the longer waits.
+     */
+    uint64_t queue_wait_histogram[OE_SWITCHLESS_QUEUE_WAIT_BUCKETS];
+    /**
+     * The upper bounds, in nanoseconds, of the buckets of
+     * **queue_wait_histogram**. The waits are measured in spin iterations
+     * and converted using the speed of an iteration on this machine, so the
+     * bounds are estimates. The last bound is UINT64_MAX.
+     */
+    uint64_t queue_wait_bounds[OE_SWITCHLESS_QUEUE_WAIT_BUCKETS];
+    /** The statistics of the first **num_workers** workers. */
+    oe_switchless_worker_statistics_t workers[OE_SWITCHLESS_MAX_WORKERS];
+} oe_switchless_call_statistics_t;
+
+/**
+ * Statistics of the switchless calls of an enclave. See
+ * **oe_get_switchless_statistics()**.
+ */
+typedef struct _oe_switchless_statistics
+{
+    /** Switchless OCALLs, handled by host worker threads. */
+    oe_switchless_call_statistics_t ocalls;
+    /** Switchless ECALLs, handled by enclave worker threads. */
+    oe_switchless_call_statistics_t ecalls;
+} oe_switchless_statistics_t;
+
+/**
+ * The setting for the memory that the enclave shares with the host.
+ */
+typedef struct _oe_enclave_setting_shared_memory
+{
+    /**
+     * The size of the chunks of host memory that the shared memory arena of
+     * each enclave thread is made of. The buffers of switchless OCALLs are
+     * allocated from the arena, and a chunk is added to the arena of a thread
+     * when its chunks are full. At most 1 GB. The default (0) is 1 MB.
+     */
+    size_t arena_chunk_size;
+    /**
+     * The max size of the chunks of the arena of each enclave thread. Larger
+     * allocations fall back to individual host allocations. At most 1 GB,
+     * which is the default (0).
+     */
+    size_t arena_max_size;
+    /**
+     * The size of a region of host memory that the host donates to the
+     * enclave at creation. oe_host_malloc() then serves allocations of up to
+     * 4 KB from the region without making an OCALL, and oe_host_free() returns
+     * them to it. Memory from the region must not be freed by the host with
+     * free(). When the region is used up, the enclave allocates another one
+     * of the same size from the host. At least 64 KB. The region is used in
+     * slabs of 64 KB, and a remainder that does not make a whole slab is
+     * left unused. The default (0) disables the region, and each host
+     * allocation makes an OCALL.
+     */
+    size_t host_heap_size;
+    /**
+     * The max size of the regions of host memory of **host_heap_size**. The
+     * default (0) is 8 times **host_heap_size**.
+     */
+    size_t host_heap_max_size;
+    /**
+     * The initial size of the buffer that each enclave thread is given for
+     * the parameters of its OCALLs. An OCALL whose parameters do not fit
+     * allocates its buffer with two more OCALLs. The default (0) is 16 KB.
+     */
+    size_t ocall_buffer_size;
+    /**
+     * The max size that the OCALL buffers grow to when OCALLs keep missing
+     * them. Set it to **ocall_buffer_size** to keep the size fixed. The
+     * default (0) is 1 MB.
+     */
+    size_t ocall_buffer_max_size;
+} oe_enclave_setting_shared_memory_t;
+
+/**
+ * The setting for the threads that the host donates to the enclave. Each
+ * thread enters the enclave at creation and stays in it, holding a TCS, until
+ * the enclave is terminated. pthread_create() in the enclave then runs its
+ * threads on them when no pthread hooks are registered.
+ *
+ * At most **num_threads** pthreads run at a time. A pthread that is not
+ * started yet runs when a thread of the pool is free or when it is joined.
+ * So more than **num_threads** pthreads that block on each other, such as
+ * the threads of a barrier, deadlock unless the pthreads that they wait for
+ * are joined.
+ */
+typedef struct _oe_enclave_setting_thread_pool
+{
+    /**
+     * The number of threads. Together with the switchless enclave workers
+     * (see **max_enclave_workers** in
+     * **oe_enclave_setting_context_switchless_t**), they must leave at least
+     * one TCS of the enclave (NumTCS) for regular ECALLs. Otherwise enclave
+     * creation fails with OE_OUT_OF_THREADS.
+     */
+    uint32_t num_threads;
+} oe_enclave_setting_thread_pool_t;
+
+/**
+ * The setting for the sampling heap profiler of the enclave. When the
+ * setting is passed, the enclave records the size and call stack of about
+ * one allocation per **sample_interval** bytes that it allocates with
+ * malloc() and friends, until the allocation is freed. The enclave must
+ * allow it with OE_ALLOW_HEAP_PROFILER(), or oe_create_enclave() fails with
+ * OE_UNSUPPORTED. The profiler is not active in enclaves linked with
+ * oedebugmalloc. See **oe_get_heap_profile**.
+ */
+typedef struct _oe_enclave_setting_heap_profiler
+{
+    /**
+     * The mean number of bytes allocated between two samples. Larger
+     * intervals lower the overhead and the accuracy. The default (0) is
+     * 512 KB.
+     */
+    uint64_t sample_interval;
+    /**
+     * The number of samples that the enclave can hold at once. Samples of
+     * allocations made while the table is full are dropped. Each sample
+     * takes about 300 bytes of enclave heap. The default (0) is 1024 and the
+     * max is 65536.
+     */
+    uint32_t max_samples;
+} oe_enclave_setting_heap_profiler_t;
+
+/**
+ * The setting for the heap statistics of the enclave. The enclave only
+ * counts its allocations when the setting is passed, so that malloc() and
+ * friends do not pay for the counters otherwise. See
+ * **oe_get_heap_statistics**.
+ */
+typedef struct _oe_enclave_setting_heap_statistics
+{
+    /**
+     * Whether the heap usage of the threads is also attributed to the ECALLs
+     * that they run.
+     */
+    bool attribute_ecalls;
+} oe_enclave_setting_heap_statistics_t;
+
+/**
+ * Type of the callback of **OE_ENCLAVE_SETTING_HEAP_WATERMARK**.
+ *
+ * @param[in] enclave The instance of the enclave.
+ * @param[in] percent The watermark, in percent of the heap size of the
+ * enclave.
+ * @param[in] exceeded True if the heap usage rose past the watermark, false
+ * if it fell back below it.
+ * @param[in] context The context of the setting.
+ */
+typedef void (*oe_enclave_heap_watermark_callback_t)(
+    oe_enclave_t* enclave,
+    uint32_t percent,
+    bool exceeded,
+    void* context);
+
+/**
+ * The setting for the notifications of the heap watermarks that the enclave
+ * sets with oe_set_heap_watermarks(). The callback is called on the enclave
+ * thread that crossed the watermark, as an OCALL, so it may call into the
+ * enclave. It is not called for the watermarks crossed before the enclave
+ * is initialized.
+ */
+typedef struct _oe_enclave_setting_heap_watermark
+{
+    /** The function to call when a watermark is crossed. */
+    oe_enclave_heap_watermark_callback_t callback;
+    /** The context to pass to the callback. */
+    void* context;
+} oe_enclave_setting_heap_watermark_t;
+
 /**
  * The setting for config_id/config_svn on Ice Lake platform.
  */
@@ -165,10 +492,17 @@ typedef struct _oe_enclave_setting
     {
         const oe_enclave_setting_context_switchless_t*
             context_switchless_setting;
+        const oe_enclave_setting_switchless_workers_t*
+            switchless_workers_setting;
 #ifdef OE_WITH_EXPERIMENTAL_EEID
         oe_eeid_t* eeid;
 #endif
         const oe_sgx_enclave_setting_config_data* config_data;
+        const oe_enclave_setting_shared_memory_t* shared_memory_setting;
+        const oe_enclave_setting_thread_pool_t* thread_pool_setting;
+        const oe_enclave_setting_heap_profiler_t* heap_profiler_setting;
+        const oe_enclave_setting_heap_watermark_t* heap_watermark_setting;
+        const oe_enclave_setting_heap_statistics_t* heap_statistics_setting;
         /* Add new setting types here. */
     } u;
 } oe_enclave_setting_t;
@@ -245,6 +579,188 @@ oe_result_t oe_create_enclave(
  */
 oe_result_t oe_terminate_enclave(oe_enclave_t* enclave);
 
+/**
+ * Get the statistics of the switchless calls of an enclave.
+ *
+ * The statistics are read from counters that the callers and the worker
+ * threads maintain as they go, so this function can be called at any time
+ * while the enclave is running, for instance to tune the number of workers.
+ * The counters are read one by one while calls are in progress, so they are
+ * not a consistent snapshot. Counters only increase; take the difference
+ * between two calls to get the rates of an interval.
+ *
+ * If switchless calls are not enabled for the enclave (see
+ * **OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS**), the statistics report no
+ * workers.
+ *
+ * @param[in] enclave The instance of the enclave.
+ * @param[out] statistics The statistics of the switchless calls.
+ *
+ * @retval OE_OK The statistics were retrieved.
+ * @retval OE_INVALID_PARAMETER One of the parameters is NULL.
+ * @retval OE_UNSUPPORTED Switchless calls are not supported on this platform.
+ */
+oe_result_t oe_get_switchless_statistics(
+    oe_enclave_t* enclave,
+    oe_switchless_statistics_t* statistics);
+
+/**
+ * Get a heap profile of an enclave.
+ *
+ * The profile covers the allocations that the enclave sampled since its
+ * creation and has not freed yet (see **OE_ENCLAVE_SETTING_HEAP_PROFILER**).
+ * It is a pprof profile, a protocol buffer in the format of
+ * https://github.com/google/pprof/blob/master/proto/profile.proto, with the
+ * sample types inuse_objects and inuse_space. The values are scaled up from
+ * the samples to estimate all the allocations. The call stacks are addresses
+ * of the enclave image, which pprof symbolizes from the enclave binary, for
+ * instance with `pprof -symbolize=local enclave.signed profile.pb`. Compare
+ * two profiles with `pprof -base` to find the growth in between.
+ *
+ * This function can be called at any time while the enclave is running.
+ *
+ * @param[in] enclave The instance of the enclave.
+ * @param[out] profile This points to the profile upon success. Free it with
+ * **oe_free_heap_profile**.
+ * @param[out] profile_size This is set to the size of the profile in bytes.
+ *
+ * @retval OE_OK The profile was retrieved.
+ * @retval OE_INVALID_PARAMETER One of the parameters is NULL.
+ * @retval OE_UNSUPPORTED The heap profiler is not enabled for the enclave, or
+ * not supported on this platform.
+ * @retval OE_OUT_OF_MEMORY Failed to allocate memory.
+ */
+oe_result_t oe_get_heap_profile(
+    oe_enclave_t* enclave,
+    uint8_t** profile,
+    size_t* profile_size);
+
+/**
+ * Frees a profile obtained from oe_get_heap_profile.
+ *
+ * @param[in] profile The profile to free.
+ */
+void oe_free_heap_profile(uint8_t* profile);
+
+/**
+ * The value of **ecall_function_id** for an enclave thread that does not run
+ * an ECALL.
+ */
+#define OE_HEAP_STATISTICS_NO_ECALL OE_UINT64_MAX
+
+/**
+ * Heap usage of an enclave thread. See **oe_get_heap_statistics()**.
+ */
+typedef struct _oe_heap_thread_statistics
+{
+    /** The index of the TCS of the thread, from 0 to NumTCS - 1. */
+    uint32_t tcs_index;
+    /**
+     * The function id of the ECALL that the thread runs, or
+     * **OE_HEAP_STATISTICS_NO_ECALL**. With nested ECALLs, this is the
+     * innermost one.
+     */
+    uint64_t ecall_function_id;
+    /** The number of blocks that the thread allocated. */
+    uint64_t allocations;
+    /** The number of blocks that the thread freed. */
+    uint64_t frees;
+    /** The usable size of the blocks that the thread allocated. */
+    uint64_t bytes_allocated;
+    /** The usable size of the blocks that the thread freed. */
+    uint64_t bytes_freed;
+    /**
+     * **bytes_allocated** minus **bytes_freed**. It is negative for a thread
+     * that frees more of the blocks of other threads than it allocates.
+     */
+    int64_t bytes_in_flight;
+    /** The peak of **bytes_in_flight**. */
+    uint64_t peak_bytes_in_flight;
+} oe_heap_thread_statistics_t;
+
+/**
+ * Heap usage of the calls of an ECALL. See **oe_get_heap_statistics()**.
+ */
+typedef struct _oe_heap_ecall_statistics
+{
+    /**
+     * The function id of the ECALL, which is the value of
+     * `<edl name>_fcn_id_<ECALL name>` in the code that oeedger8r generates.
+     */
+    uint64_t function_id;
+    /** The number of calls that returned. */
+    uint64_t calls;
+    /** The number of blocks that the calls allocated. */
+    uint64_t allocations;
+    /** The number of blocks that the calls freed. */
+    uint64_t frees;
+    /** The usable size of the blocks that the calls allocated. */
+    uint64_t bytes_allocated;
+    /** The usable size of the blocks that the calls freed. */
+    uint64_t bytes_freed;
+} oe_heap_ecall_statistics_t;
+
+/**
+ * Heap usage of an enclave by thread and by ECALL. See
+ * **oe_get_heap_statistics()**.
+ */
+typedef struct _oe_heap_statistics
+{
+    /** The number of elements of **threads**. */
+    size_t num_threads;
+    /**
+     * The enclave threads that allocated memory or ran an ECALL, by
+     * increasing **tcs_index**.
+     */
+    oe_heap_thread_statistics_t* threads;
+    /** The number of elements of **ecalls**. */
+    size_t num_ecalls;
+    /**
+     * The ECALLs that were called or allocated memory, by increasing
+     * **function_id**.
+     */
+    oe_heap_ecall_statistics_t* ecalls;
+} oe_heap_statistics_t;
+
+/**
+ * Get the heap usage of an enclave by thread and by ECALL.
+ *
+ * When the enclave is created with the **OE_ENCLAVE_SETTING_HEAP_STATISTICS**
+ * setting, each enclave thread (each TCS) counts the blocks that it
+ * allocates and frees with malloc() and friends, and their usable size,
+ * from the creation of the enclave. With **attribute_ecalls**, the counts of
+ * a thread are also attributed to the ECALL that it runs, so the statistics
+ * tell which threads and which ECALLs drive the allocations. When ECALLs are
+ * nested, only the innermost one is attributed the usage. The usage of an
+ * ECALL is attributed when it returns or makes a nested ECALL. Without the
+ * setting, the statistics are empty. The counters are not maintained in
+ * enclaves linked with oedebugmalloc.
+ *
+ * This function can be called at any time while the enclave is running.
+ * The counters are read while the threads update them, so they are not a
+ * consistent snapshot. Counters only increase; take the difference between
+ * two calls to get the rates of an interval.
+ *
+ * @param[in] enclave The instance of the enclave.
+ * @param[out] statistics This points to the statistics upon success. Free
+ * them with **oe_free_heap_statistics**.
+ *
+ * @retval OE_OK The statistics were retrieved.
+ * @retval OE_INVALID_PARAMETER One of the parameters is NULL.
+ * @retval OE_UNSUPPORTED Heap statistics are not supported on this platform.
+ * @retval OE_OUT_OF_MEMORY Failed to allocate memory.
+ */
+oe_result_t oe_get_heap_statistics(
+    oe_enclave_t* enclave,
+    oe_heap_statistics_t** statistics);
+
+/**
+ * Frees statistics obtained from oe_get_heap_statistics.
+ *
+ * @param[in] statistics The statistics to free.
+ */
+void oe_free_heap_statistics(oe_heap_statistics_t* statistics);
+
 #if (OE_API_VERSION < 2)
 #error "Only OE_API_VERSION of 2 is supported"
 #else
@@ -76,6 +76,15 @@ typedef enum _oe_func
     OE_ECALL_CALL_ENCLAVE_FUNCTION,
     OE_ECALL_VIRTUAL_EXCEPTION_HANDLER,
     OE_ECALL_CALL_AT_EXIT_FUNCTIONS,
+    OE_ECALL_CALL_ENCLAVE_FUNCTION_BATCH,
+    OE_ECALL_CONFIGURE_SHARED_MEMORY,
+    OE_ECALL_START_THREAD_POOL,
+    OE_ECALL_THREAD_POOL_WORKER,
+    OE_ECALL_STOP_THREAD_POOL,
+    OE_ECALL_START_HEAP_PROFILER,
+    OE_ECALL_GET_HEAP_PROFILE,
+    OE_ECALL_GET_HEAP_STATISTICS,
+    OE_ECALL_START_HEAP_STATISTICS,
     /* Caution: always add new ECALL function numbers here */
     OE_ECALL_MAX,
 
@@ -85,6 +94,7 @@ typedef enum _oe_func
     OE_OCALL_MALLOC,
     OE_OCALL_FREE,
     OE_OCALL_GET_TIME,
+    OE_OCALL_HEAP_WATERMARK,
     /* Caution: always add new OCALL function numbers here */
     OE_OCALL_MAX, /* This value is never used */
 
@@ -191,6 +201,47 @@ typedef struct _oe_call_enclave_function_args
     oe_result_t result;
 } oe_call_enclave_function_args_t;
 
+/*
+**==============================================================================
+**
+** oe_call_enclave_function_batch_args_t
+**
+**     Argument of OE_ECALL_CALL_ENCLAVE_FUNCTION_BATCH. The enclave executes
+**     the calls in order within a single enclave entry and reports the
+**     per-call results through calls[i].result.
+**
+**==============================================================================
+*/
+
+typedef struct _oe_call_enclave_function_batch_args
+{
+    oe_call_enclave_function_args_t* calls;
+    size_t num_calls;
+    size_t num_completed;
+} oe_call_enclave_function_batch_args_t;
+
+/*
+**==============================================================================
+**
+** oe_configure_shared_memory_args_t
+**
+**     Argument of OE_ECALL_CONFIGURE_SHARED_MEMORY, which applies the
+**     OE_ENCLAVE_SETTING_SHARED_MEMORY setting. Zero fields keep the defaults.
+**     The enclave owns host_heap, which is allocated by the host, if the call
+**     succeeds.
+**
+**==============================================================================
+*/
+
+typedef struct _oe_configure_shared_memory_args
+{
+    uint64_t arena_chunk_size;
+    uint64_t arena_max_size;
+    void* host_heap;
+    uint64_t host_heap_size;
+    uint64_t host_heap_max_size;
+} oe_configure_shared_memory_args_t;
+
 /*
 **==============================================================================
 **
@@ -208,8 +259,17 @@ typedef struct _oe_call_host_function_args
     size_t output_buffer_size;
     size_t output_bytes_written;
     oe_result_t result;
+    uint32_t flags;
 } oe_call_host_function_args_t;
 
+/* The caller does not wait for the call. The host worker that handles the
+ * switchless call frees the block that starts with the args and holds the
+ * input and output buffers. See oe_call_host_function_async() */
+#define OE_CALL_HOST_FUNCTION_FLAG_ASYNC 0x00000001
+
+/* The flags fill the tail padding of the args, which keeps their layout */
+OE_STATIC_ASSERT(sizeof(oe_call_host_function_args_t) == 56);
+
 /*
 **==============================================================================
 **
@@ -0,0 +1,90 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_INTERNAL_HEAPPROFILE_H
+#define _OE_INTERNAL_HEAPPROFILE_H
+
+#include <openenclave/bits/defs.h>
+#include <openenclave/bits/result.h>
+#include <openenclave/bits/types.h>
+
+OE_EXTERNC_BEGIN
+
+/*
+**==============================================================================
+**
+** Sampling heap profiler
+**
+**     The host enables the profiler at enclave creation (see the
+**     OE_ENCLAVE_SETTING_HEAP_PROFILER setting). oe_malloc() and friends then
+**     sample about one allocation per sample_interval bytes and record its
+**     size and call stack in a fixed-size table until it is freed. The host
+**     pulls the recorded samples with OE_ECALL_GET_HEAP_PROFILE and encodes
+**     them as a pprof profile.
+**
+**==============================================================================
+*/
+
+#define OE_HEAP_PROFILE_MAX_FRAMES 32
+
+typedef struct _oe_heap_profile_sample
+{
+    /* Size requested by the sampled allocation */
+    uint64_t size;
+
+    /* Return addresses, innermost first */
+    uint64_t num_frames;
+    uint64_t frames[OE_HEAP_PROFILE_MAX_FRAMES];
+} oe_heap_profile_sample_t;
+
+/* Argument of OE_ECALL_START_HEAP_PROFILER */
+typedef struct _oe_start_heap_profiler_args
+{
+    uint64_t sample_interval;
+    uint64_t max_samples;
+} oe_start_heap_profiler_args_t;
+
+/* Argument of OE_ECALL_GET_HEAP_PROFILE. The enclave copies the samples of
+ * the live sampled allocations to samples, which is a host buffer, and
+ * returns OE_BUFFER_TOO_SMALL if there are more than max_samples of them */
+typedef struct _oe_get_heap_profile_args
+{
+    oe_heap_profile_sample_t* samples;
+    uint64_t max_samples;
+
+    /* Set by the enclave */
+    uint64_t num_samples;
+    uint64_t sample_interval;
+    uint64_t num_dropped;
+} oe_get_heap_profile_args_t;
+
+#ifdef OE_BUILD_ENCLAVE
+
+/* Set once the profiler is started. oe_malloc() and friends only call into
+ * the profiler while it is set */
+extern bool oe_heap_profiler_enabled;
+
+/* Count an allocation toward the next sample and sample it if it is due */
+void oe_heap_profiler_record_allocation(void* ptr, size_t size);
+
+/* Drop the sample of a block that is about to be freed, if it has one */
+void oe_heap_profiler_record_free(void* ptr);
+
+/* Drop the sample of a block that realloc() is about to move or free and
+ * copy it to sample. Return false if the block has no sample */
+bool oe_heap_profiler_take_sample(void* ptr, oe_heap_profile_sample_t* sample);
+
+/* Put back the sample taken from a block that realloc() failed to move */
+void oe_heap_profiler_restore_sample(
+    void* ptr,
+    const oe_heap_profile_sample_t* sample);
+
+/* Handlers of OE_ECALL_START_HEAP_PROFILER and OE_ECALL_GET_HEAP_PROFILE */
+oe_result_t oe_handle_start_heap_profiler(uint64_t arg_in);
+oe_result_t oe_handle_get_heap_profile(uint64_t arg_in);
+
+#endif // OE_BUILD_ENCLAVE
+
+OE_EXTERNC_END
+
+#endif /* _OE_INTERNAL_HEAPPROFILE_H */
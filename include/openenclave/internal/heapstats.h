@@ -0,0 +1,125 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_INTERNAL_HEAPSTATS_H
+#define _OE_INTERNAL_HEAPSTATS_H
+
+#include <openenclave/bits/defs.h>
+#include <openenclave/bits/result.h>
+#include <openenclave/bits/types.h>
+
+OE_EXTERNC_BEGIN
+
+/*
+**==============================================================================
+**
+** Heap statistics
+**
+**     Once the host enables the statistics at enclave creation (see the
+**     OE_ENCLAVE_SETTING_HEAP_STATISTICS setting), oe_malloc() and friends
+**     count the blocks that each enclave thread (each TCS) allocates and
+**     frees, and their usable bytes. The counts of a thread may also be
+**     attributed to the ECALL that it runs. The host pulls the counters with
+**     OE_ECALL_GET_HEAP_STATISTICS.
+**
+**==============================================================================
+*/
+
+/* Argument of OE_ECALL_START_HEAP_STATISTICS */
+typedef struct _oe_start_heap_statistics_args
+{
+    uint64_t attribute_ecalls;
+} oe_start_heap_statistics_args_t;
+
+/* Counters of an enclave thread, as copied to the host */
+typedef struct _oe_heap_thread_counters
+{
+    /* Address of the TCS of the thread */
+    uint64_t tcs;
+
+    /* Function id of the ECALL that the thread runs, plus one, or zero */
+    uint64_t ecall_function_id;
+
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes_allocated;
+    uint64_t bytes_freed;
+    uint64_t peak_bytes_in_flight;
+} oe_heap_thread_counters_t;
+
+/* Counters of the calls of an ECALL, indexed by function id */
+typedef struct _oe_heap_ecall_counters
+{
+    /* Calls that returned */
+    uint64_t calls;
+
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes_allocated;
+    uint64_t bytes_freed;
+} oe_heap_ecall_counters_t;
+
+/* Argument of OE_ECALL_GET_HEAP_STATISTICS. The enclave copies the counters
+ * of the threads and of the ECALLs to threads and ecalls, which are host
+ * buffers, and returns OE_BUFFER_TOO_SMALL if there are more than
+ * max_threads threads or max_ecalls ECALLs */
+typedef struct _oe_get_heap_statistics_args
+{
+    oe_heap_thread_counters_t* threads;
+    uint64_t max_threads;
+    oe_heap_ecall_counters_t* ecalls;
+    uint64_t max_ecalls;
+
+    /* Set by the enclave */
+    uint64_t num_threads;
+    uint64_t num_ecalls;
+} oe_get_heap_statistics_args_t;
+
+#ifdef OE_BUILD_ENCLAVE
+
+/* An ECALL in progress on a thread. The heap usage of the thread is
+ * attributed to its innermost ECALL */
+typedef struct _oe_heap_ecall_scope
+{
+    uint64_t function_id;
+
+    /* Counters of the thread when they were last attributed */
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes_allocated;
+    uint64_t bytes_freed;
+
+    struct _oe_heap_ecall_scope* outer;
+} oe_heap_ecall_scope_t;
+
+/* Set once the statistics are started. oe_malloc() and friends only count
+ * the blocks while it is set */
+extern bool oe_heap_statistics_enabled;
+
+/* Set with oe_heap_statistics_enabled if the ECALLs are attributed their heap
+ * usage. The ECALL dispatcher only enters and exits the scopes of ECALLs
+ * while it is set */
+extern bool oe_heap_statistics_ecalls_enabled;
+
+/* Count a block of the given usable size that the current thread allocated
+ * or freed */
+void oe_heap_statistics_record_allocation(size_t size);
+void oe_heap_statistics_record_free(size_t size);
+
+/* Attribute the heap usage of the current thread to an ECALL until the
+ * matching exit. scope must stay valid until then */
+void oe_heap_statistics_enter_ecall(
+    oe_heap_ecall_scope_t* scope,
+    uint64_t function_id);
+void oe_heap_statistics_exit_ecall(oe_heap_ecall_scope_t* scope);
+
+/* Handlers of OE_ECALL_START_HEAP_STATISTICS and
+ * OE_ECALL_GET_HEAP_STATISTICS */
+oe_result_t oe_handle_start_heap_statistics(uint64_t arg_in);
+oe_result_t oe_handle_get_heap_statistics(uint64_t arg_in);
+
+#endif // OE_BUILD_ENCLAVE
+
+OE_EXTERNC_END
+
+#endif /* _OE_INTERNAL_HEAPSTATS_H */
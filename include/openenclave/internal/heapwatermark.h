@@ -0,0 +1,63 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_INTERNAL_HEAPWATERMARK_H
+#define _OE_INTERNAL_HEAPWATERMARK_H
+
+#include <openenclave/bits/defs.h>
+#include <openenclave/bits/types.h>
+
+OE_EXTERNC_BEGIN
+
+/*
+**==============================================================================
+**
+** Heap watermarks
+**
+**     The enclave notifies the application when the share of the heap that
+**     the allocator has taken rises past or falls below the watermarks set
+**     with oe_set_heap_watermarks(). The host is notified with
+**     OE_OCALL_HEAP_WATERMARK.
+**
+**==============================================================================
+*/
+
+/* Argument of OE_OCALL_HEAP_WATERMARK: the watermark in percent of the heap
+ * in the low 32 bits, and whether the heap usage rose past it in bit 32 */
+OE_INLINE uint64_t oe_make_heap_watermark_arg(uint32_t percent, bool exceeded)
+{
+    return ((uint64_t)exceeded << 32) | percent;
+}
+
+OE_INLINE uint32_t oe_get_heap_watermark_percent(uint64_t arg)
+{
+    return (uint32_t)arg;
+}
+
+OE_INLINE bool oe_get_heap_watermark_exceeded(uint64_t arg)
+{
+    return (arg >> 32) & 1;
+}
+
+/* Report the number of bytes that the allocator has taken from the enclave
+ * heap. The allocator calls this whenever it grows or shrinks its part of
+ * the heap, with its lock held, so that this is never on the path of an
+ * allocation that the allocator serves from memory that it already has */
+void oe_heap_watermark_update(size_t heap_used);
+
+#ifdef OE_BUILD_ENCLAVE
+
+/* Set when a watermark was crossed and not notified yet. The safe points
+ * only call oe_heap_watermark_notify() while it is set */
+extern bool oe_heap_watermark_pending;
+
+/* Call the callbacks of the pending watermarks. Must be called at a safe
+ * point, where the thread holds no lock of oecore or of the allocator, such
+ * as when an ECALL returns */
+void oe_heap_watermark_notify(void);
+
+#endif // OE_BUILD_ENCLAVE
+
+OE_EXTERNC_END
+
+#endif /* _OE_INTERNAL_HEAPWATERMARK_H */
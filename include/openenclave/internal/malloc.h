@@ -19,6 +19,53 @@ typedef void (*oe_allocation_failure_callback_t)(
 void oe_set_allocation_failure_callback(
     oe_allocation_failure_callback_t function);
 
+#define OE_MAX_HEAP_WATERMARKS 8
+
+/* Called when the heap usage rises past (exceeded is true) or falls below
+ * (exceeded is false) the watermark of the given percent of the heap size */
+typedef void (*oe_heap_watermark_callback_t)(
+    uint32_t percent,
+    bool exceeded,
+    size_t heap_used,
+    size_t heap_size,
+    void* arg);
+
+/*
+ * Set soft watermarks on the heap usage of the enclave, so that it can shed
+ * memory before allocations fail, for instance at 70, 85 and 95 percent.
+ *
+ * The heap usage is the number of bytes that the allocator has taken from
+ * the enclave heap, which includes the free blocks that it keeps. It is
+ * only checked when the allocator grows or shrinks its part of the heap, so
+ * allocations served from free blocks cost nothing more. Only the default
+ * allocator (dlmalloc) reports its heap usage.
+ *
+ * Each crossing of a watermark is notified once, in order: to the callback,
+ * and to the host with the OE_ENCLAVE_SETTING_HEAP_WATERMARK setting. The
+ * notifications are not delivered from allocations, whose callers may hold
+ * locks, but when an ECALL returns, when a pthread of the thread pool
+ * returns, or from oe_poll_heap_watermarks(), by the thread that gets there
+ * first. The callback may allocate and free memory. Watermarks that the
+ * heap usage already exceeds are notified as if they were crossed when they
+ * are set. Passing no watermarks removes them.
+ *
+ * Returns OE_INVALID_PARAMETER if there are more than OE_MAX_HEAP_WATERMARKS
+ * watermarks or if they are not increasing from 1 to 100 percent.
+ */
+oe_result_t oe_set_heap_watermarks(
+    const uint32_t* percents,
+    size_t num_percents,
+    oe_heap_watermark_callback_t callback,
+    void* arg);
+
+/*
+ * Deliver the crossings of the heap watermarks that are pending. Long-running
+ * ECALLs call this at points where they hold no lock that the callback may
+ * need, since the crossings are otherwise only delivered when the ECALL
+ * returns.
+ */
+void oe_poll_heap_watermarks(void);
+
 /* Dump the list of all in-use allocations */
 void oe_debug_malloc_dump(void);
 
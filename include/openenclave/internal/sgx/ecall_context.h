@@ -21,6 +21,10 @@ typedef struct _oe_ecall_context
     uint64_t debug_eexit_rip;
     uint64_t debug_eexit_rbp;
     uint64_t debug_eexit_rsp;
+
+    // Size the enclave asks the host to grow the ocall buffers to, set when
+    // ocalls do not fit in ocall_buffer.
+    uint64_t ocall_buffer_requested_size;
 } oe_ecall_context_t;
 
 /**
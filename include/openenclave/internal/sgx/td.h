@@ -81,7 +81,7 @@ oe_thread_data_t* oe_get_thread_data(void);
  * Due to the inability to use OE_OFFSETOF on a struct while defining its
  * members, this value is computed and hard-coded.
  */
-#define OE_THREAD_SPECIFIC_DATA_SIZE (3756)
+#define OE_THREAD_SPECIFIC_DATA_SIZE (3560)
 
 typedef struct _oe_callsite oe_callsite_t;
 
@@ -94,16 +94,113 @@ typedef struct _oe_tls_atexit
 
 /* This structure manages a pool of shared memory (memory visible to both
  * the enclave and the host). An instance of this structure is maintained
- * for each thread. This structure is used in enclave/core/arena.c.
+ * for each thread. The pool is a chain of chunks of host memory, which are
+ * described by enclave memory. This structure is used in
+ * enclave/core/sgx/arena.c.
  */
 typedef struct _oe_shared_memory_arena_t
 {
-    uint8_t* buffer;
-    uint64_t capacity;
+    /* The chunk that allocations are made from, followed by the chunks that
+     * filled up before it */
+    struct _oe_arena_chunk* chunks;
+
+    /* Chunks released by oe_arena_release(), kept for reuse */
+    struct _oe_arena_chunk* spare_chunks;
+
+    /* Bytes allocated from the chunks */
     uint64_t used;
+
+    /* Bytes of host memory held by the chunks, including the spare ones */
+    uint64_t capacity;
+
+    /* Peak of used since the pool was created */
+    uint64_t high_water;
 } oe_shared_memory_arena_t;
 
-OE_CHECK_SIZE(sizeof(oe_shared_memory_arena_t), 24);
+OE_CHECK_SIZE(sizeof(oe_shared_memory_arena_t), 40);
+
+/* This structure caches the enclave buffer that incoming ECALLs copy their
+ * marshalling arguments into, so that it can be reused across calls. An
+ * instance of this structure is maintained for each thread. This structure
+ * is used in enclave/core/sgx/ecallbuffer.c.
+ */
+typedef struct _oe_ecall_buffer
+{
+    uint8_t* data;
+    uint64_t capacity;
+
+    /* Non-zero while an ECALL uses the buffer */
+    uint32_t in_use;
+
+    /* Non-zero once the thread is on the list of threads with a buffer */
+    uint32_t registered;
+
+    /* Consecutive calls that used at most a quarter of the buffer */
+    uint64_t underused_calls;
+
+    /* Calls served from the buffer, and calls that had to allocate */
+    uint64_t hits;
+    uint64_t misses;
+
+    /* Next thread on the list of threads with a buffer */
+    struct _td* next;
+} oe_ecall_buffer_t;
+
+OE_CHECK_SIZE(sizeof(oe_ecall_buffer_t), 56);
+
+/* This structure counts the heap allocations of a thread, which the host
+ * reads with oe_get_heap_statistics(). An instance of this structure is
+ * maintained for each thread. This structure is used in
+ * enclave/core/sgx/heapstats.c.
+ */
+typedef struct _oe_thread_heap_statistics
+{
+    /* Blocks allocated and freed by the thread */
+    uint64_t allocations;
+    uint64_t frees;
+
+    /* Usable bytes of these blocks */
+    uint64_t bytes_allocated;
+    uint64_t bytes_freed;
+
+    /* Peak of bytes_allocated - bytes_freed */
+    uint64_t peak_bytes_in_flight;
+
+    /* Function id of the innermost ECALL of the thread, plus one */
+    uint64_t ecall_function_id;
+
+    /* Innermost ECALL of the thread, whose heap usage is being counted */
+    struct _oe_heap_ecall_scope* ecall_scope;
+
+    /* Non-zero once the thread is on the list of threads with statistics */
+    uint64_t registered;
+
+    /* Next thread on the list of threads with statistics */
+    struct _td* next;
+} oe_thread_heap_statistics_t;
+
+OE_CHECK_SIZE(sizeof(oe_thread_heap_statistics_t), 72);
+
+/* This structure counts the OCALL buffers allocated by a thread, which
+ * oe_get_ocall_buffer_statistics() sums over the threads. An instance of this
+ * structure is maintained for each thread. This structure is used in
+ * enclave/core/sgx/hostcalls.c.
+ */
+typedef struct _oe_thread_ocall_buffer_statistics
+{
+    /* Buffers allocated, and those that did not fit in the buffer of the
+     * ecall context */
+    uint64_t allocations;
+    uint64_t misses;
+
+    /* Non-zero once the thread is on the list of threads with statistics */
+    uint64_t registered;
+
+    /* Next thread on the list of threads with statistics */
+    struct _td* next;
+} oe_thread_ocall_buffer_statistics_t;
+
+OE_CHECK_SIZE(sizeof(oe_thread_ocall_buffer_statistics_t), 32);
 
 OE_PACK_BEGIN
 typedef struct _td
@@ -123,7 +220,13 @@ typedef struct _td
     /* Return arguments from OCALL */
     uint16_t oret_func;
     uint16_t oret_result;
-    uint16_t padding[2];
+
+    /* Row of reader slots of this thread, plus one (see thread.c) */
+    uint16_t reader_row;
+
+    /* Index of the thread pool worker on this thread, plus one, while the
+     * thread runs as a worker (see threadpool.c) */
+    uint16_t thread_pool_worker;
     uint64_t oret_arg;
 
     /* List of oe_callsite_t structures (most recent call is first) */
@@ -151,9 +254,12 @@ typedef struct _td
 
     /* POSIX errno (renamed to prevent clash with errno macro) */
     int32_t errnum;
-    int32_t padding2;
 
-    /* Thread-specific shared memory pool (see enclave/core/arena.c) */
+    /* Number of OCALLs in progress. Threads waiting for a mutex held by this
+     * thread stop spinning while it is non-zero (see thread.c) */
+    volatile uint32_t ocall_depth;
+
+    /* Thread-specific shared memory pool (see enclave/core/sgx/arena.c) */
     oe_shared_memory_arena_t arena;
 
     /* TLS atexit functions (see enclave/core/sgx/threadlocal.c) */
@@ -168,6 +274,24 @@ typedef struct _td
     /* The error code for PF and GP exceptions. */
     uint32_t error_code;
 
+    /* Preferred host worker for switchless OCALLs, plus one (see
+     * enclave/core/sgx/switchlesscalls.c) */
+    uint32_t switchless_hint;
+
+    /* Reusable ECALL marshalling buffer (see enclave/core/sgx/ecallbuffer.c) */
+    oe_ecall_buffer_t ecall_buffer;
+
+    /* Bytes left to allocate until the next heap profile sample, and the
+     * random state that draws the intervals (see heapprofile.c) */
+    int64_t heap_profile_bytes_left;
+    uint64_t heap_profile_random;
+
+    /* Heap usage counters (see enclave/core/sgx/heapstats.c) */
+    oe_thread_heap_statistics_t heap_statistics;
+
+    /* OCALL buffer counters (see enclave/core/sgx/hostcalls.c) */
+    oe_thread_ocall_buffer_statistics_t ocall_buffer_statistics;
+
     /* Reserved for thread specific data. */
     uint8_t thread_specific_data[OE_THREAD_SPECIFIC_DATA_SIZE];
 } oe_sgx_td_t;
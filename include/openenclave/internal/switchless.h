@@ -6,52 +6,354 @@
 
 #include <openenclave/bits/defs.h>
 #include <openenclave/bits/types.h>
+#include <openenclave/internal/atomic.h>
 #include <openenclave/internal/bits/sgx/switchless.h>
 #include <openenclave/internal/calls.h>
 #include <openenclave/internal/thread.h>
+#include <openenclave/internal/utils.h>
 
 /**
  * oe_host_worker_context_t is used both by the host (windows/linux) and the
  * enclave (ELF). Lock down the layout.
  */
-OE_STATIC_ASSERT(sizeof(oe_host_worker_context_t) == 40);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, call_arg) == 0);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, enc) == 8);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, is_stopping) == 16);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, event) == 20);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, spin_count) == 24);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, total_spin_count) == 32);
+OE_STATIC_ASSERT(sizeof(oe_host_worker_context_t) == 256);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, queue) == 0);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, queue_mask) == 8);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, queue_head) == 16);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, queue_tail) == 24);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, enc) == 32);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, is_stopping) == 40);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, is_parked) == 41);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, event) == 44);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, spin_count) == 48);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_host_worker_context_t, spin_count_threshold) == 56);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, total_spin_count) == 64);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_host_worker_context_t, adaptive_spin_count_max) == 72);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_host_worker_context_t, sleep_spin_count) == 80);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, miss_count) == 88);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_host_worker_context_t, cas_failure_count) == 96);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_host_worker_context_t, caller_affinity) == 104);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, wake_count) == 112);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_host_worker_context_t, sleep_count) == 120);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_host_worker_context_t, queue_wait_histogram) == 128);
 
 /**
  * oe_enclave_worker_context_t is used both by the host (windows/linux) and the
  * enclave (ELF). Lock down the layout.
  */
-OE_STATIC_ASSERT(sizeof(oe_enclave_worker_context_t) == 48);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, call_arg) == 0);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, enc) == 8);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, is_stopping) == 16);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, event) == 20);
-OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, spin_count) == 24);
+OE_STATIC_ASSERT(sizeof(oe_enclave_worker_context_t) == 256);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, queue) == 0);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, queue_mask) == 8);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, queue_head) == 16);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, queue_tail) == 24);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, enc) == 32);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, is_stopping) == 40);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, is_parked) == 41);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, event) == 44);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, spin_count) == 48);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_enclave_worker_context_t, spin_count_threshold) == 56);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_enclave_worker_context_t, total_spin_count) == 64);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_enclave_worker_context_t, adaptive_spin_count_max) == 72);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_enclave_worker_context_t, sleep_spin_count) == 80);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_enclave_worker_context_t, miss_count) == 88);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_enclave_worker_context_t, cas_failure_count) == 96);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_enclave_worker_context_t, caller_affinity) == 104);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, wake_count) == 112);
+OE_STATIC_ASSERT(OE_OFFSETOF(oe_enclave_worker_context_t, sleep_count) == 120);
+OE_STATIC_ASSERT(
+    OE_OFFSETOF(oe_enclave_worker_context_t, queue_wait_histogram) == 128);
+
+/**
+ * Alignment of the arrays of worker contexts. Each context spans cache lines
+ * of its own.
+ */
+#define OE_SWITCHLESS_CONTEXT_ALIGNMENT 64
+
+/**
+ * Number of buckets of the queue_wait_histogram of a worker context. The
+ * histograms are reported as is by oe_get_switchless_statistics(), so this
+ * is identical to the definition in openenclave/host.h.
+ */
+#define OE_SWITCHLESS_QUEUE_WAIT_BUCKETS 16
+
 OE_STATIC_ASSERT(
-    OE_OFFSETOF(oe_enclave_worker_context_t, spin_count_threshold) == 32);
+    OE_SWITCHLESS_QUEUE_WAIT_BUCKETS * sizeof(uint64_t) ==
+    sizeof(((oe_host_worker_context_t*)0)->queue_wait_histogram));
 OE_STATIC_ASSERT(
-    OE_OFFSETOF(oe_enclave_worker_context_t, total_spin_count) == 40);
+    OE_SWITCHLESS_QUEUE_WAIT_BUCKETS * sizeof(uint64_t) ==
+    sizeof(((oe_enclave_worker_context_t*)0)->queue_wait_histogram));
+
+/**
+ * Number of calls that can be pending on a worker thread when the queue depth
+ * is not configured. This matches the historical single-slot behavior.
+ */
+#define OE_SWITCHLESS_DEFAULT_QUEUE_DEPTH 1
+
+/**
+ * Upper bound on the number of calls that can be pending on a worker thread.
+ */
+#define OE_SWITCHLESS_MAX_QUEUE_DEPTH 1024
+
+/**
+ * Post **arg** to the queue of a switchless worker.
+ *
+ * Any number of callers may post to the same queue concurrently. Only the
+ * owning worker consumes from it: it takes the call in slot
+ * (queue_head & mask) and clears the slot, handles the call and then
+ * advances queue_head. The caller learns that its call was taken when the
+ * slot no longer holds **arg**.
+ *
+ * @param slots The ring of queue_mask + 1 slots.
+ * @param mask The queue_mask of the worker. The ring size must be a power
+ * of two.
+ * @param head The queue_head of the worker.
+ * @param tail The queue_tail of the worker.
+ * @param cas_failures The cas_failure_count of the worker, incremented each
+ * time another caller claims the slot first.
+ * @param arg The call argument to post.
+ * @param slot On success, the index of the slot the call was posted to. The
+ * slot is slots[*slot & mask].
+ *
+ * @returns true if the call was posted and false if the queue is full.
+ */
+OE_INLINE bool oe_switchless_queue_post(
+    void* volatile* slots,
+    uint64_t mask,
+    volatile uint64_t* head,
+    volatile uint64_t* tail,
+    volatile uint64_t* cas_failures,
+    void* arg,
+    uint64_t* slot)
+{
+    uint64_t t = oe_atomic_load(tail);
+
+    // Claim slot t by advancing the tail.
+    while (true)
+    {
+        if (t - oe_atomic_load(head) > mask)
+            return false;
+
+        if (oe_atomic_compare_and_swap(
+                (int64_t volatile*)tail, (int64_t)t, (int64_t)(t + 1)))
+            break;
+
+        oe_atomic_increment(cas_failures);
+        t = oe_atomic_load(tail);
+    }
+
+    // The worker cleared slot t before advancing the head past t - mask - 1,
+    // so the slot is free. Publish the call. The worker waits for the slot
+    // to become non-null.
+    OE_ATOMIC_MEMORY_BARRIER_RELEASE();
+    slots[t & mask] = arg;
+    *slot = t;
+
+    return true;
+}
+
+/**
+ * Wait until the worker takes the call posted by oe_switchless_queue_post()
+ * and record how long the call waited in the queue.
+ *
+ * @param slots The ring of the worker.
+ * @param mask The queue_mask of the worker.
+ * @param slot The slot returned by oe_switchless_queue_post().
+ * @param arg The call argument that was posted.
+ * @param histogram The queue_wait_histogram of the worker.
+ */
+OE_INLINE void oe_switchless_wait_for_worker(
+    void* volatile* slots,
+    uint64_t mask,
+    uint64_t slot,
+    void* arg,
+    volatile uint64_t* histogram)
+{
+    uint64_t spin_count = 0;
+    size_t bucket = 0;
+
+    while (slots[slot & mask] == arg)
+    {
+        spin_count++;
+        oe_yield_cpu();
+    }
+
+    // Bucket i counts waits below 2^i spin iterations.
+    while (spin_count && bucket < OE_SWITCHLESS_QUEUE_WAIT_BUCKETS - 1)
+    {
+        spin_count >>= 1;
+        bucket++;
+    }
+
+    oe_atomic_increment(&histogram[bucket]);
+}
+
+/**
+ * Return the worker at which a caller starts looking for a worker with room.
+ *
+ * If all the callers scanned the workers in the same order, concurrent callers
+ * would race for the queue of the same worker while the other workers sit
+ * idle. Instead, each caller keeps a hint: one plus the index of the worker
+ * it prefers, or zero before its first switchless call. New callers are
+ * spread across the workers in round-robin order.
+ *
+ * @param hint The hint of the caller.
+ * @param next_caller The counter used to spread new callers.
+ * @param num_workers The number of workers. Must be non-zero.
+ *
+ * @returns The index of the preferred worker of the caller.
+ */
+OE_INLINE size_t oe_switchless_get_preferred_worker(
+    uint64_t hint,
+    volatile uint64_t* next_caller,
+    size_t num_workers)
+{
+    if (hint == 0)
+        hint = oe_atomic_increment(next_caller);
+
+    return (size_t)((hint - 1) % num_workers);
+}
+
+/**
+ * Return the hint of a caller after its call was posted to worker **index**.
+ *
+ * By default, the caller comes back to the last worker that accepted one of
+ * its calls, so that callers which collided move apart and stay apart. With
+ * caller affinity, the caller keeps its preferred worker.
+ *
+ * @param preferred The preferred worker of the caller for this call.
+ * @param index The worker the call was posted to.
+ * @param caller_affinity The caller_affinity of the first context.
+ *
+ * @returns The new hint of the caller.
+ */
+OE_INLINE uint64_t oe_switchless_update_hint(
+    size_t preferred,
+    size_t index,
+    bool caller_affinity)
+{
+    return (uint64_t)(caller_affinity ? preferred : index) + 1;
+}
+
+/**
+ * Lower bound on the spin_count_threshold chosen by the adaptive spin policy.
+ */
+#define OE_SWITCHLESS_ADAPTIVE_MIN_SPIN_COUNT 64
+
+/**
+ * Update the spin_count_threshold of a worker that uses the adaptive spin
+ * policy.
+ *
+ * The policy keeps a moving average of the number of iterations a worker
+ * spends idle between two calls and spins for twice that long. If the average
+ * gap is too long to be covered by spinning, spinning mostly burns CPU time
+ * and the worker goes to sleep almost immediately instead.
+ *
+ * @param average_gap The moving average of the idle gaps, updated in place.
+ * @param gap The idle gap, in spin iterations, that preceded the call the
+ * worker has just received. This includes the time the worker slept.
+ * @param max_spin_count The upper bound on the threshold.
+ *
+ * @returns The new spin_count_threshold.
+ */
+OE_INLINE uint64_t oe_switchless_adapt_spin_count_threshold(
+    uint64_t* average_gap,
+    uint64_t gap,
+    uint64_t max_spin_count)
+{
+    uint64_t threshold = 0;
+
+    // Saturate long gaps so that the moving average cannot overflow.
+    if (gap > max_spin_count)
+        gap = max_spin_count + 1;
+
+    *average_gap = (*average_gap * 7 + gap) / 8;
+    threshold = *average_gap * 2;
+
+    if (threshold > max_spin_count ||
+        threshold < OE_SWITCHLESS_ADAPTIVE_MIN_SPIN_COUNT)
+        threshold = OE_SWITCHLESS_ADAPTIVE_MIN_SPIN_COUNT;
+
+    return threshold;
+}
+
+/**
+ * Scaling state of the workers of one kind (host or enclave). Workers are
+ * never destroyed before the manager stops; the pool shrinks by parking idle
+ * workers and grows by unparking them.
+ */
+typedef struct _oe_switchless_worker_pool
+{
+    /* Bounds on the number of active (unparked) workers */
+    size_t min_workers;
+    size_t max_workers;
+    size_t num_active_workers;
+
+    /* Total number of misses at the end of the last scaling interval */
+    uint64_t miss_count;
+
+    /* Per worker: queue_head at the end of the last scaling interval */
+    uint64_t* queue_heads;
+
+    /* Per worker: number of consecutive intervals without calls */
+    uint32_t* idle_intervals;
+} oe_switchless_worker_pool_t;
 
 typedef struct _oe_switchless_call_manager
 {
     oe_host_worker_context_t* host_worker_contexts;
     oe_thread_t* host_worker_threads;
+    void** host_worker_queues;
     size_t num_host_workers;
+    oe_switchless_worker_pool_t host_worker_pool;
 
     oe_enclave_worker_context_t* enclave_worker_contexts;
     oe_thread_t* enclave_worker_threads;
+    void** enclave_worker_queues;
     size_t num_enclave_workers;
+    oe_switchless_worker_pool_t enclave_worker_pool;
+
+    /* Number of slots in the queue of each worker */
+    size_t queue_depth;
+
+    /* The oe_switchless_spin_policy_t of the workers and its budget */
+    uint32_t spin_policy;
+    uint64_t spin_budget;
+
+    /* Spreads the host threads that make switchless ecalls across the
+     * enclave workers. See oe_switchless_get_preferred_worker() */
+    volatile uint64_t next_caller;
+
+    /* The thread that grows and shrinks the pools, if they are elastic */
+    oe_thread_t scaling_thread;
+    bool is_stopping;
+    int32_t scaling_event;
 } oe_switchless_call_manager_t;
 
+struct _oe_enclave_setting_context_switchless;
+struct _oe_enclave_setting_switchless_workers;
+
+/**
+ * Start the switchless workers of the enclave. **workers** may be NULL, in
+ * which case the workers use the defaults of
+ * **oe_enclave_setting_switchless_workers_t**.
+ */
 oe_result_t oe_start_switchless_manager(
     oe_enclave_t* enclave,
-    size_t num_host_workers,
-    size_t num_enclave_workers);
+    const struct _oe_enclave_setting_context_switchless* setting,
+    const struct _oe_enclave_setting_switchless_workers* workers);
 
 oe_result_t oe_stop_switchless_manager(oe_enclave_t* enclave);
 
@@ -63,4 +365,17 @@ void oe_enclave_worker_wait(oe_enclave_worker_context_t* context);
 
 void oe_enclave_worker_wake(oe_enclave_worker_context_t* context);
 
+/* Return a monotonic time in microseconds, used to calibrate spin budgets */
+uint64_t oe_switchless_get_time_in_microseconds(void);
+
+/* Wait until the manager is stopping or at most **milliseconds** */
+void oe_switchless_manager_wait(
+    oe_switchless_call_manager_t* manager,
+    uint32_t milliseconds);
+
+void oe_switchless_manager_wake(oe_switchless_call_manager_t* manager);
+
+/* Hint the OS to run **thread** on **cpu**. Returns zero on success */
+int oe_switchless_set_thread_affinity(oe_thread_t thread, uint32_t cpu);
+
 #endif /* _OE_SWITCHLESS_H */
@@ -228,6 +228,7 @@ OE_DECLARE_SYSCALL3(SYS_mkdirat);
 OE_DECLARE_SYSCALL6(SYS_mmap);
 OE_DECLARE_SYSCALL2(SYS_munmap);
 OE_DECLARE_SYSCALL5(SYS_mount);
+OE_DECLARE_SYSCALL5(SYS_mremap);
 OE_DECLARE_SYSCALL2_M(SYS_nanosleep);
 OE_DECLARE_SYSCALL4(SYS_newfstatat);
 #if __x86_64__ || _M_X64
@@ -0,0 +1,62 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_INTERNAL_THREADPOOL_H
+#define _OE_INTERNAL_THREADPOOL_H
+
+#include <openenclave/bits/defs.h>
+#include <openenclave/bits/result.h>
+#include <openenclave/bits/types.h>
+
+OE_EXTERNC_BEGIN
+
+/*
+**==============================================================================
+**
+** Enclave thread pool
+**
+**     The host can donate threads to the enclave at creation (see the
+**     OE_ENCLAVE_SETTING_THREAD_POOL setting). Each thread enters the enclave
+**     with OE_ECALL_THREAD_POOL_WORKER and runs tasks until the enclave is
+**     terminated. pthread_create() runs its threads as tasks of the pool when
+**     no pthread hooks are registered.
+**
+**==============================================================================
+*/
+
+typedef struct _oe_thread_pool_task oe_thread_pool_task_t;
+
+/* Queue a task that calls start_routine(arg). The task must be joined or
+ * detached. Return OE_UNSUPPORTED if the host did not start a thread pool,
+ * and OE_OUT_OF_THREADS if the pool is stopping.
+ *
+ * The pool runs at most as many tasks at a time as it has workers, and a
+ * task that is not started yet only runs when a worker is free or when it is
+ * joined. So tasks that block until other tasks make progress, such as the
+ * threads of a barrier, deadlock when they outnumber the workers, unless the
+ * tasks that they wait for are joined by a thread outside the pool */
+oe_result_t oe_thread_pool_create(
+    oe_thread_pool_task_t** task,
+    void* (*start_routine)(void*),
+    void* arg);
+
+/* Wait for a task and return its result. A task that no worker has started
+ * yet runs on the calling thread instead */
+oe_result_t oe_thread_pool_join(oe_thread_pool_task_t* task, void** retval);
+
+/* Let a task free itself when it completes */
+oe_result_t oe_thread_pool_detach(oe_thread_pool_task_t* task);
+
+#ifdef OE_BUILD_ENCLAVE
+
+/* Handlers of OE_ECALL_START_THREAD_POOL, OE_ECALL_THREAD_POOL_WORKER and
+ * OE_ECALL_STOP_THREAD_POOL */
+oe_result_t oe_start_thread_pool(uint64_t num_workers);
+oe_result_t oe_run_thread_pool_worker(void);
+oe_result_t oe_stop_thread_pool(void);
+
+#endif // OE_BUILD_ENCLAVE
+
+OE_EXTERNC_END
+
+#endif /* _OE_INTERNAL_THREADPOOL_H */
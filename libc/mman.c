@@ -1,35 +1,525 @@
 // Copyright (c) Open Enclave SDK contributors.
 // Licensed under the MIT License.
 
+#define _GNU_SOURCE
+
 #include <openenclave/corelibc/errno.h>
 #include <openenclave/internal/raise.h>
 #include <openenclave/internal/safemath.h>
 #include <openenclave/internal/thread.h>
 #include <openenclave/internal/utils.h>
+#include <stdarg.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "mman.h"
 #include "openenclave/bits/defs.h"
 #include "openenclave/bits/result.h"
 #include "syscall.h"
 
-static oe_mapping_t* _mappings;
+/*
+**==============================================================================
+**
+** Anonymous mappings are carved from segments, which are page-aligned blocks
+** of the enclave heap. Mappings smaller than OE_MMAN_SEGMENT_SIZE share
+** segments of that size and larger ones get a segment of their own.
+**
+** The pages of each segment are tiled by extents, each of which is either
+** mapped or free. The extents of all the segments are kept in an AVL tree
+** ordered by address, and each node of the tree also records the size of the
+** largest free extent in its subtree. So mmap() finds the lowest free extent
+** that fits, and munmap() and mremap() find the extents of an address, in
+** O(log n) steps. munmap() splits extents at the bounds of the range that it
+** unmaps, merges the freed pages with the free extents next to them and
+** returns a segment to the heap as soon as all of its pages are free.
+**
+** Pages are zeroed when they are mapped rather than when their segment is
+** carved or when they are unmapped, so neither carving nor unmapping touches
+** the pages themselves.
+**
+**==============================================================================
+*/
+
+#define OE_MMAN_SEGMENT_SIZE (64 * OE_PAGE_SIZE)
+
+typedef struct _extent
+{
+    uint64_t start;
+    uint64_t end;
+
+    /* Bounds of the segment that the extent belongs to */
+    uint64_t segment_start;
+    uint64_t segment_end;
+
+    bool mapped;
+
+    /* Links and height of the node, and size of the largest free extent in
+     * the subtree rooted at the node */
+    struct _extent* left;
+    struct _extent* right;
+    struct _extent* parent;
+    int height;
+    uint64_t max_free;
+} extent_t;
+
+/* Nodes that an operation may insert into the tree, allocated before it takes
+ * the lock, and nodes that it removes from the tree, freed after it releases
+ * the lock */
+typedef struct _nodes
+{
+    extent_t* spare[4];
+    extent_t* dead;
+} nodes_t;
+
+static extent_t* _root;
 static oe_spinlock_t _lock;
 
-static void _clear_mappings(void)
+static int _height(const extent_t* node)
+{
+    return node ? node->height : 0;
+}
+
+static uint64_t _max_free(const extent_t* node)
+{
+    return node ? node->max_free : 0;
+}
+
+static void _update(extent_t* node)
+{
+    int left_height = _height(node->left);
+    int right_height = _height(node->right);
+    uint64_t max_free = node->mapped ? 0 : node->end - node->start;
+
+    node->height =
+        1 + (left_height > right_height ? left_height : right_height);
+
+    if (_max_free(node->left) > max_free)
+        max_free = node->left->max_free;
+
+    if (_max_free(node->right) > max_free)
+        max_free = node->right->max_free;
+
+    node->max_free = max_free;
+}
+
+static void _replace_child(extent_t* parent, extent_t* old, extent_t* new)
+{
+    if (!parent)
+        _root = new;
+    else if (parent->left == old)
+        parent->left = new;
+    else
+        parent->right = new;
+
+    if (new)
+        new->parent = parent;
+}
+
+static extent_t* _rotate_left(extent_t* node)
+{
+    extent_t* right = node->right;
+
+    _replace_child(node->parent, node, right);
+    node->right = right->left;
+    if (node->right)
+        node->right->parent = node;
+    right->left = node;
+    node->parent = right;
+
+    _update(node);
+    _update(right);
+    return right;
+}
+
+static extent_t* _rotate_right(extent_t* node)
+{
+    extent_t* left = node->left;
+
+    _replace_child(node->parent, node, left);
+    node->left = left->right;
+    if (node->left)
+        node->left->parent = node;
+    left->right = node;
+    node->parent = left;
+
+    _update(node);
+    _update(left);
+    return left;
+}
+
+/* Update the node and all its ancestors, rebalancing them on the way up. Must
+ * be called whenever the node changes size or state */
+static void _retrace(extent_t* node)
+{
+    while (node)
+    {
+        int balance;
+
+        _update(node);
+        balance = _height(node->left) - _height(node->right);
+
+        if (balance > 1)
+        {
+            if (_height(node->left->left) < _height(node->left->right))
+                _rotate_left(node->left);
+            node = _rotate_right(node);
+        }
+        else if (balance < -1)
+        {
+            if (_height(node->right->right) < _height(node->right->left))
+                _rotate_right(node->right);
+            node = _rotate_left(node);
+        }
+
+        node = node->parent;
+    }
+}
+
+static void _insert(extent_t* node)
+{
+    extent_t* parent = NULL;
+    extent_t** link = &_root;
+
+    while (*link)
+    {
+        parent = *link;
+        link = node->start < parent->start ? &parent->left : &parent->right;
+    }
+
+    node->left = NULL;
+    node->right = NULL;
+    node->parent = parent;
+    *link = node;
+    _retrace(node);
+}
+
+static void _remove(extent_t* node)
+{
+    extent_t* retrace;
+
+    if (node->left && node->right)
+    {
+        /* Move the successor of the node, which has no left child, to the
+         * place of the node */
+        extent_t* successor = node->right;
+        while (successor->left)
+            successor = successor->left;
+
+        if (successor->parent == node)
+            retrace = successor;
+        else
+        {
+            retrace = successor->parent;
+            _replace_child(successor->parent, successor, successor->right);
+            successor->right = node->right;
+            successor->right->parent = successor;
+        }
+
+        _replace_child(node->parent, node, successor);
+        successor->left = node->left;
+        successor->left->parent = successor;
+    }
+    else
+    {
+        retrace = node->parent;
+        _replace_child(
+            node->parent, node, node->left ? node->left : node->right);
+    }
+
+    _retrace(retrace);
+}
+
+static extent_t* _next(extent_t* node)
+{
+    if (node->right)
+    {
+        node = node->right;
+        while (node->left)
+            node = node->left;
+        return node;
+    }
+
+    while (node->parent && node->parent->right == node)
+        node = node->parent;
+
+    return node->parent;
+}
+
+static extent_t* _prev(extent_t* node)
+{
+    if (node->left)
+    {
+        node = node->left;
+        while (node->right)
+            node = node->right;
+        return node;
+    }
+
+    while (node->parent && node->parent->left == node)
+        node = node->parent;
+
+    return node->parent;
+}
+
+/* Find the lowest extent that ends above addr */
+static extent_t* _lower_bound(uint64_t addr)
+{
+    extent_t* node = _root;
+    extent_t* result = NULL;
+
+    while (node)
+    {
+        if (node->end > addr)
+        {
+            result = node;
+            node = node->left;
+        }
+        else
+            node = node->right;
+    }
+
+    return result;
+}
+
+/* Find the lowest free extent of at least length bytes */
+static extent_t* _find_free(uint64_t length)
+{
+    extent_t* node = _root;
+
+    while (node)
+    {
+        if (_max_free(node->left) >= length)
+            node = node->left;
+        else if (!node->mapped && node->end - node->start >= length)
+            return node;
+        else if (_max_free(node->right) >= length)
+            node = node->right;
+        else
+            break;
+    }
+
+    return NULL;
+}
+
+static oe_result_t _reserve_nodes(nodes_t* nodes, size_t count)
+{
+    oe_result_t result = OE_UNEXPECTED;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!(nodes->spare[i] = (extent_t*)malloc(sizeof(extent_t))))
+        {
+            oe_errno = OE_ENOMEM;
+            OE_RAISE(OE_OUT_OF_MEMORY);
+        }
+    }
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+static extent_t* _new_node(
+    nodes_t* nodes,
+    uint64_t start,
+    uint64_t end,
+    const extent_t* segment,
+    bool mapped)
+{
+    extent_t* node = NULL;
+
+    for (size_t i = 0; i < OE_COUNTOF(nodes->spare) && !node; i++)
+    {
+        node = nodes->spare[i];
+        nodes->spare[i] = NULL;
+    }
+
+    /* Operations reserve as many nodes as they can insert */
+    oe_assert(node);
+
+    node->start = start;
+    node->end = end;
+    node->segment_start = segment->segment_start;
+    node->segment_end = segment->segment_end;
+    node->mapped = mapped;
+    return node;
+}
+
+/* Free the unused spare nodes and the removed nodes. A removed free extent
+ * that spans its whole segment is the last extent of the segment, so the
+ * segment is returned to the heap along with it */
+static void _release_nodes(nodes_t* nodes)
+{
+    for (size_t i = 0; i < OE_COUNTOF(nodes->spare); i++)
+        free(nodes->spare[i]);
+
+    while (nodes->dead)
+    {
+        extent_t* node = nodes->dead;
+        nodes->dead = node->left;
+
+        if (node->start == node->segment_start &&
+            node->end == node->segment_end)
+            free((void*)node->segment_start);
+
+        free(node);
+    }
+}
+
+static void _remove_node(nodes_t* nodes, extent_t* node)
+{
+    _remove(node);
+    node->left = nodes->dead;
+    nodes->dead = node;
+}
+
+/* Map the first length bytes of a free extent */
+static extent_t* _map_extent(nodes_t* nodes, extent_t* node, uint64_t length)
+{
+    extent_t* mapped;
+
+    if (node->end - node->start == length)
+    {
+        node->mapped = true;
+        _retrace(node);
+        return node;
+    }
+
+    mapped = _new_node(nodes, node->start, node->start + length, node, true);
+    node->start += length;
+    _retrace(node);
+    _insert(mapped);
+    return mapped;
+}
+
+/* Free a mapped extent, merge it with the free extents next to it in its
+ * segment and remove the segment if it is all free */
+static void _free_extent(nodes_t* nodes, extent_t* node)
+{
+    extent_t* prev = _prev(node);
+    extent_t* next = _next(node);
+
+    node->mapped = false;
+
+    if (prev && !prev->mapped && prev->segment_start == node->segment_start)
+    {
+        _remove_node(nodes, prev);
+        node->start = prev->start;
+    }
+
+    if (next && !next->mapped && next->segment_start == node->segment_start)
+    {
+        _remove_node(nodes, next);
+        node->end = next->end;
+    }
+
+    if (node->start == node->segment_start && node->end == node->segment_end)
+        _remove_node(nodes, node);
+    else
+        _retrace(node);
+}
+
+/* Free the mapped pages in [start, end). Splits at most two extents, the
+ * ones that contain start and end */
+static void _unmap(nodes_t* nodes, uint64_t start, uint64_t end)
+{
+    uint64_t addr = start;
+    extent_t* node;
+
+    while (addr < end && (node = _lower_bound(addr)) && node->start < end)
+    {
+        uint64_t range_start = node->start > addr ? node->start : addr;
+        uint64_t range_end = node->end < end ? node->end : end;
+
+        if (node->mapped)
+        {
+            if (range_end < node->end)
+            {
+                _insert(_new_node(nodes, range_end, node->end, node, true));
+                node->end = range_end;
+            }
+
+            if (range_start > node->start)
+            {
+                extent_t* head =
+                    _new_node(nodes, node->start, range_start, node, true);
+                node->start = range_start;
+                _insert(head);
+            }
+
+            _free_extent(nodes, node);
+        }
+
+        addr = range_end;
+    }
+}
+
+/* Map length bytes, carving a new segment from the heap if no free extent is
+ * large enough. The pages are not zeroed. Uses at most two nodes */
+static oe_result_t _map(nodes_t* nodes, uint64_t length, uint64_t* start)
 {
-    oe_mapping_t* m = _mappings;
-    _mappings = 0;
-    while (m)
+    oe_result_t result = OE_UNEXPECTED;
+    extent_t* node = NULL;
+    void* segment = NULL;
+    uint64_t segment_size =
+        length > OE_MMAN_SEGMENT_SIZE ? length : OE_MMAN_SEGMENT_SIZE;
+    int ret = 0;
+
+    oe_spin_lock(&_lock);
+    if ((node = _find_free(length)))
+        *start = _map_extent(nodes, node, length)->start;
+    oe_spin_unlock(&_lock);
+
+    if (!node)
     {
-        oe_mapping_t* next = m->next;
-        free((void*)m->start);
-        m->start = 0;
-        free(m->status_vector);
-        m->status_vector = NULL;
-        free(m);
-        m = next;
+        extent_t bounds;
+
+        if ((ret = posix_memalign(&segment, OE_PAGE_SIZE, segment_size)) != 0)
+        {
+            // posix_memalign does not set errno (by spec).
+            // Set it ourselves.
+            oe_errno = ret;
+            OE_RAISE_MSG(
+                OE_OUT_OF_MEMORY, "posix_memalign failed with code %d", ret);
+        }
+
+        bounds.segment_start = (uint64_t)segment;
+        bounds.segment_end = (uint64_t)segment + segment_size;
+
+        oe_spin_lock(&_lock);
+        node = _new_node(
+            nodes, bounds.segment_start, bounds.segment_end, &bounds, false);
+        _insert(node);
+        *start = _map_extent(nodes, node, length)->start;
+        oe_spin_unlock(&_lock);
     }
+
+    result = OE_OK;
+
+done:
+    return result;
+}
+
+static void _free_tree(extent_t* node)
+{
+    if (!node)
+        return;
+
+    _free_tree(node->left);
+    _free_tree(node->right);
+
+    if (node->start == node->segment_start)
+        free((void*)node->segment_start);
+
+    free(node);
+}
+
+static void _clear_mappings(void)
+{
+    extent_t* root = _root;
+    _root = NULL;
+    _free_tree(root);
 }
 
 static void _call_atexit(void)
@@ -172,11 +662,10 @@ void* oe_mmap(
     off_t offset)
 {
     oe_result_t result = OE_UNEXPECTED;
-    void* ptr = NULL;
-    void* vector = NULL;
-    oe_mapping_t* m = NULL;
-    size_t vector_length = 0;
-    int ret = 0;
+    nodes_t nodes;
+    uint64_t start = 0;
+
+    memset(&nodes, 0, sizeof(nodes));
 
     OE_CHECK(_validate_mmap_parameters(addr, length, prot, flags, fd, offset));
 
@@ -184,160 +673,157 @@ void* oe_mmap(
 
     // length is rounded up to nearest page size.
     OE_CHECK(oe_safe_round_up_u64(length, OE_PAGE_SIZE, &length));
-    OE_CHECK(oe_safe_round_up_u64(length / 8, 8, &vector_length));
 
-    // Allocate objects.
-    vector = (uint8_t*)calloc(vector_length, 1);
-    m = (oe_mapping_t*)malloc(sizeof(*m));
-    if (!vector || !m)
-    {
-        oe_errno = OE_ENOMEM;
-        OE_RAISE(OE_OUT_OF_MEMORY);
-    }
+    OE_CHECK(_reserve_nodes(&nodes, 2));
+    OE_CHECK(_map(&nodes, length, &start));
+    memset((void*)start, 0, length);
 
-    if (((ret = posix_memalign(&ptr, OE_PAGE_SIZE, length)) != 0) || !m)
-    {
-        // posix_memalign does not set errno (by spec).
-        // Set it ourselves.
-        oe_errno = ret;
-        OE_RAISE_MSG(
-            OE_OUT_OF_MEMORY, "posix_memalign failed with code %d", ret);
-    }
+    result = OE_OK;
+
+done:
+    _release_nodes(&nodes);
+    return (result == OE_OK) ? (void*)start : MAP_FAILED;
+}
+
+int oe_munmap(void* addr, uint64_t length)
+{
+    oe_result_t result = OE_UNEXPECTED;
+    nodes_t nodes;
+    uint64_t start = (uint64_t)addr;
+    uint64_t end = 0;
 
-    // Set up mapping.
-    m->start = (uint64_t)ptr;
-    OE_CHECK(oe_safe_add_u64((uint64_t)m->start, length, (uint64_t*)&m->end));
-    m->status_vector = vector;
-    memset(ptr, 0, length);
+    memset(&nodes, 0, sizeof(nodes));
 
-    // Set relevant bits of status vector to 1.
+    OE_CHECK(oe_safe_add_u64(start, length, &end));
+    OE_CHECK(oe_safe_round_up_u64(end, OE_PAGE_SIZE, &end));
+
+    if ((start % OE_PAGE_SIZE) != 0)
     {
-        int bv_idx = 0;
-        uint8_t bit_mask = 0x01;
-        // Since m->end has been rounded to OE_PAGE_SIZE and been validated via
-        // oe_safe_add_u64, it is safe to add OE_PAGE_SIZE to `a` since it won't
-        // overflow.
-        for (uint64_t a = m->start; a < m->end; a += OE_PAGE_SIZE)
-        {
-            m->status_vector[bv_idx] |= bit_mask;
-            bit_mask <<= 1;
-            if (!bit_mask)
-            {
-                // Move to next byte in status vector.
-                ++bv_idx;
-                bit_mask = 0x01;
-            }
-        }
+        oe_errno = OE_EINVAL;
+        goto done;
     }
 
-    // Update mappings list.
+    OE_CHECK(_reserve_nodes(&nodes, 2));
+
     oe_spin_lock(&_lock);
-    m->next = _mappings;
-    _mappings = m;
+    _unmap(&nodes, start, end);
     oe_spin_unlock(&_lock);
-
+    oe_errno = 0;
     result = OE_OK;
-
 done:
-    if (result != OE_OK)
-    {
-        free(vector);
-        free(ptr);
-        free(m);
-        return MAP_FAILED;
-    }
-    return ptr;
+    _release_nodes(&nodes);
+    return (result == OE_OK) ? 0 : -1;
 }
 
-static void _munmap(
-    oe_mapping_t* prev,
-    oe_mapping_t* m,
-    uint64_t start,
-    uint64_t end)
+// See https://www.man7.org/linux/man-pages/man2/mremap.2.html for
+// semantics of mremap. The range being remapped must lie within a single
+// mapping. Only MREMAP_MAYMOVE is supported.
+void* oe_mremap(
+    void* old_address,
+    size_t old_size,
+    size_t new_size,
+    int flags,
+    void* new_address)
 {
-    while (m)
+    oe_result_t result = OE_UNEXPECTED;
+    nodes_t nodes;
+    extent_t* node = NULL;
+    extent_t* next = NULL;
+    uint64_t old_start = (uint64_t)old_address;
+    uint64_t old_end = 0;
+    uint64_t new_end = 0;
+    uint64_t start = 0;
+    bool in_place = false;
+
+    OE_UNUSED(new_address);
+    memset(&nodes, 0, sizeof(nodes));
+
+    // Duplicating a mapping (old_size of 0) and MREMAP_FIXED are not
+    // supported.
+    if ((old_start % OE_PAGE_SIZE) != 0 || old_size == 0 || new_size == 0 ||
+        (flags & ~MREMAP_MAYMOVE))
     {
-        if (end <= m->start || start >= m->end)
-        {
-            // Specified address range does not intersect with current mapping.
-            prev = m;
-            m = m->next;
-            continue;
-        }
-
-        // Specified address range intersects with current mapping.
-
-        // Unmap part of address range that lies to the left of current mapping.
-        if (start < m->start)
-            _munmap(m, m->next, start, m->start);
+        oe_errno = OE_EINVAL;
+        OE_RAISE_MSG(
+            OE_INVALID_PARAMETER,
+            "unsupported mremap parameters, flags=%d",
+            flags);
+    }
 
-        // Unmap part of address range that lies to the right of current
-        // mapping.
-        if (end > m->end)
-            _munmap(m, m->next, m->end, end);
+    OE_CHECK(oe_safe_round_up_u64(old_size, OE_PAGE_SIZE, &old_size));
+    OE_CHECK(oe_safe_round_up_u64(new_size, OE_PAGE_SIZE, &new_size));
+    OE_CHECK(oe_safe_add_u64(old_start, old_size, &old_end));
+    OE_CHECK(oe_safe_add_u64(old_start, new_size, &new_end));
 
-        bool delete = true;
-        if (start > m->start || end < m->end)
-        {
-            // Partial unmapping.
-            uint8_t bit_mask = 1;
-            int bv_idx = 0;
+    // Moving the mapping may use two nodes for the new mapping and two more
+    // to unmap the old one.
+    OE_CHECK(_reserve_nodes(&nodes, 4));
 
-            // Mark all pages in given address range as unmapped.
-            for (uint64_t a = m->start; a < m->end; a += OE_PAGE_SIZE)
-            {
-                // If pages lies in the specified range, unset its status.
-                if (start <= a && a < end)
-                    m->status_vector[bv_idx] &= ~bit_mask;
-
-                bit_mask <<= 1;
-                if (!bit_mask)
-                {
-                    // Retain the mapping if any bit in the vector is set.
-                    delete = delete &&!m->status_vector[bv_idx];
-                    bit_mask = 1;
-                    bv_idx++;
-                }
-            }
-            delete = delete &&!m->status_vector[bv_idx];
-        }
+    oe_spin_lock(&_lock);
+    node = _lower_bound(old_start);
+    if (!node || !node->mapped || node->start > old_start ||
+        node->end < old_end)
+    {
+        oe_spin_unlock(&_lock);
+        oe_errno = OE_EFAULT;
+        OE_RAISE_MSG(OE_INVALID_PARAMETER, "range is not a single mapping");
+    }
 
-        if (delete)
+    if (new_end <= old_end)
+    {
+        // Shrink the mapping by unmapping its tail.
+        _unmap(&nodes, new_end, old_end);
+        in_place = true;
+    }
+    else if (
+        old_end == node->end && (next = _next(node)) && !next->mapped &&
+        next->segment_start == node->segment_start && next->end >= new_end)
+    {
+        // Grow the mapping into the free pages that follow it.
+        if (next->end == new_end)
+            _remove_node(&nodes, next);
+        else
         {
-            if (prev)
-                prev->next = m->next;
-            else
-                _mappings = m->next;
-            free(m->status_vector);
-            free((void*)m->start);
-            free(m);
+            next->start = new_end;
+            _retrace(next);
         }
 
-        break;
+        node->end = new_end;
+        in_place = true;
     }
-}
+    oe_spin_unlock(&_lock);
 
-int oe_munmap(void* addr, uint64_t length)
-{
-    oe_result_t result = OE_UNEXPECTED;
-    uint64_t start = (uint64_t)addr;
-    uint64_t end = 0;
-    OE_CHECK(oe_safe_add_u64(start, length, &end));
-    OE_CHECK(oe_safe_round_up_u64(end, OE_PAGE_SIZE, &end));
+    if (in_place)
+    {
+        if (new_end > old_end)
+            memset((void*)old_end, 0, new_end - old_end);
 
-    if ((start % OE_PAGE_SIZE) != 0)
+        start = old_start;
+    }
+    else
     {
-        oe_errno = OE_EINVAL;
-        goto done;
+        if (!(flags & MREMAP_MAYMOVE))
+        {
+            oe_errno = OE_ENOMEM;
+            OE_RAISE(OE_OUT_OF_MEMORY);
+        }
+
+        // Move the mapping. Only the pages past the old size need zeroing.
+        OE_CHECK(_map(&nodes, new_size, &start));
+        memcpy((void*)start, old_address, old_size);
+        memset((void*)(start + old_size), 0, new_size - old_size);
+
+        oe_spin_lock(&_lock);
+        _unmap(&nodes, old_start, old_end);
+        oe_spin_unlock(&_lock);
     }
 
-    oe_spin_lock(&_lock);
-    _munmap(NULL, _mappings, start, end);
-    oe_spin_unlock(&_lock);
     oe_errno = 0;
     result = OE_OK;
+
 done:
-    return (result == OE_OK) ? 0 : -1;
+    _release_nodes(&nodes);
+    return (result == OE_OK) ? (void*)start : MAP_FAILED;
 }
 
 void* mmap(void* start, size_t len, int prot, int flags, int fd, off_t off)
@@ -350,13 +836,67 @@ int munmap(void* start, size_t len)
     return (int)syscall(SYS_munmap, start, len);
 }
 
+void* mremap(
+    void* old_address,
+    size_t old_len,
+    size_t new_len,
+    int flags,
+    ...)
+{
+    void* new_address = NULL;
+
+    if (flags & MREMAP_FIXED)
+    {
+        va_list ap;
+        va_start(ap, flags);
+        new_address = va_arg(ap, void*);
+        va_end(ap);
+    }
+
+    return (void*)__syscall(
+        SYS_mremap, old_address, old_len, new_len, flags, new_address);
+}
+
 // Needed for MUSL
 OE_WEAK_ALIAS(mmap, __mmap);
 OE_WEAK_ALIAS(mmap, mmap64);
 OE_WEAK_ALIAS(munmap, __munmap);
+OE_WEAK_ALIAS(mremap, __mremap);
+
+// Utility functions for tests.
+size_t oe_test_get_mappings(oe_mapping_t* mappings, size_t count)
+{
+    size_t num_mappings = 0;
+
+    oe_spin_lock(&_lock);
+    for (extent_t* node = _lower_bound(0); node; node = _next(node))
+    {
+        if (!node->mapped)
+            continue;
+
+        if (num_mappings < count)
+        {
+            mappings[num_mappings].start = node->start;
+            mappings[num_mappings].end = node->end;
+        }
+        num_mappings++;
+    }
+    oe_spin_unlock(&_lock);
+
+    return num_mappings;
+}
 
-// Utility function for tests.
-oe_mapping_t* oe_test_get_mappings(void)
+size_t oe_test_get_segment_count(void)
 {
-    return _mappings;
+    size_t num_segments = 0;
+
+    oe_spin_lock(&_lock);
+    for (extent_t* node = _lower_bound(0); node; node = _next(node))
+    {
+        if (node->start == node->segment_start)
+            num_segments++;
+    }
+    oe_spin_unlock(&_lock);
+
+    return num_segments;
 }
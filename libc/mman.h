@@ -14,12 +14,24 @@ void* oe_mmap(
 
 int oe_munmap(void* addr, uint64_t length);
 
+void* oe_mremap(
+    void* old_address,
+    size_t old_size,
+    size_t new_size,
+    int flags,
+    void* new_address);
+
 typedef struct _mapping
 {
     uint64_t start;
     uint64_t end;
-    uint8_t* status_vector;
-    struct _mapping* next;
 } oe_mapping_t;
 
-oe_mapping_t* oe_test_get_mappings(void);
+// Utility functions for tests.
+
+// Copies up to count mapped address ranges, in increasing address order, to
+// mappings and returns the total number of mapped ranges.
+size_t oe_test_get_mappings(oe_mapping_t* mappings, size_t count);
+
+// Returns the number of segments carved from the heap for mappings.
+size_t oe_test_get_segment_count(void);
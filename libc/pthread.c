@@ -10,6 +10,8 @@
 #include <openenclave/internal/pthreadhooks.h>
 #include <openenclave/internal/sgx/td.h>
 #include <openenclave/internal/thread.h>
+#include <openenclave/internal/threadpool.h>
+#include <errno.h>
 #include <pthread.h>
 
 #ifdef pthread_equal
@@ -69,18 +71,44 @@ void oe_register_pthread_hooks(oe_pthread_hooks_t* pthread_hooks)
     _pthread_hooks = pthread_hooks;
 }
 
-int pthread_create(
+/* Without hooks, threads run as tasks of the thread pool that the host
+ * donated to the enclave (see OE_ENCLAVE_SETTING_THREAD_POOL). The pthread_t
+ * of such a thread is its task, so it differs from pthread_self() in the
+ * thread, and thread-local variables are those of the pool worker. */
+static int _thread_pool_create(
     pthread_t* thread,
     const pthread_attr_t* attr,
     void* (*start_routine)(void*),
     void* arg)
 {
-    if (!_pthread_hooks || !_pthread_hooks->create)
+    oe_thread_pool_task_t* task = NULL;
+    oe_result_t result = oe_thread_pool_create(&task, start_routine, arg);
+
+    if (result == OE_UNSUPPORTED)
     {
         oe_assert("pthread_create(): panic" == NULL);
         return -1;
     }
 
+    if (result != OE_OK)
+        return EAGAIN;
+
+    if (attr && attr->_a_detach)
+        oe_thread_pool_detach(task);
+
+    *thread = (pthread_t)task;
+    return 0;
+}
+
+int pthread_create(
+    pthread_t* thread,
+    const pthread_attr_t* attr,
+    void* (*start_routine)(void*),
+    void* arg)
+{
+    if (!_pthread_hooks || !_pthread_hooks->create)
+        return _thread_pool_create(thread, attr, start_routine, arg);
+
     return _pthread_hooks->create(thread, attr, start_routine, arg);
 }
 
@@ -88,8 +116,14 @@ int pthread_join(pthread_t thread, void** retval)
 {
     if (!_pthread_hooks || !_pthread_hooks->join)
     {
-        oe_assert("pthread_join(): panic" == NULL);
-        return -1;
+        if (oe_thread_pool_join((oe_thread_pool_task_t*)thread, retval) !=
+            OE_OK)
+        {
+            oe_assert("pthread_join(): panic" == NULL);
+            return -1;
+        }
+
+        return 0;
     }
 
     return _pthread_hooks->join(thread, retval);
@@ -99,8 +133,13 @@ int pthread_detach(pthread_t thread)
 {
     if (!_pthread_hooks || !_pthread_hooks->detach)
     {
-        oe_assert("pthread_detach(): panic" == NULL);
-        return -1;
+        if (oe_thread_pool_detach((oe_thread_pool_task_t*)thread) != OE_OK)
+        {
+            oe_assert("pthread_detach(): panic" == NULL);
+            return -1;
+        }
+
+        return 0;
     }
 
     return _pthread_hooks->detach(thread);
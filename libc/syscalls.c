@@ -50,6 +50,16 @@ OE_WEAK OE_DEFINE_SYSCALL2(SYS_munmap)
     return (long)oe_munmap(addr, length);
 }
 
+OE_WEAK OE_DEFINE_SYSCALL5(SYS_mremap)
+{
+    void* old_address = (void*)arg1;
+    size_t old_size = (size_t)arg2;
+    size_t new_size = (size_t)arg3;
+    int flags = (int)arg4;
+    void* new_address = (void*)arg5;
+    return (long)oe_mremap(old_address, old_size, new_size, flags, new_address);
+}
+
 OE_WEAK OE_DEFINE_SYSCALL2(SYS_clock_gettime)
 {
     clockid_t clock_id = (clockid_t)arg1;
@@ -224,6 +234,8 @@ long __syscall(long n, long x1, long x2, long x3, long x4, long x5, long x6)
         OE_SYSCALL_DISPATCH(SYS_clock_gettime, x1, x2);
         OE_SYSCALL_DISPATCH(SYS_gettimeofday, x1, x2);
         OE_SYSCALL_DISPATCH(SYS_mmap, x1, x2, x3, x4, x5, x6);
+        OE_SYSCALL_DISPATCH(SYS_munmap, x1, x2);
+        OE_SYSCALL_DISPATCH(SYS_mremap, x1, x2, x3, x4, x5);
 
         default:
             /* Drop through and let the code below handle the syscall. */
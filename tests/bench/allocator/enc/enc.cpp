@@ -0,0 +1,378 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/advanced/mallinfo.h>
+#include <openenclave/enclave.h>
+#include <openenclave/internal/tests.h>
+#include <stdlib.h>
+#include <string.h>
+#include "allocator_t.h"
+
+// Name of the allocator that the enclave is linked with, set by CMake.
+#ifndef BENCH_ALLOCATOR_NAME
+#define BENCH_ALLOCATOR_NAME "unknown"
+#endif
+
+// Blocks that a consumer of the producer/consumer pattern keeps.
+#define CONSUMER_WINDOW 256
+
+// Capacity of the queue between a producer and its consumer.
+#define QUEUE_SIZE 1024
+
+// Blocks that a thread keeps in the size-class churn pattern.
+#define CHURN_WINDOW 256
+
+// Buffers that a thread reallocates in the large realloc pattern.
+#define REALLOC_BUFFERS 2
+
+// Blocks that a thread allocates in a round of the free storm pattern.
+#define STORM_BATCH 256
+
+// Each thread keeps at most STORM_BATCH blocks at the end of a pattern.
+OE_STATIC_ASSERT(CONSUMER_WINDOW <= STORM_BATCH);
+OE_STATIC_ASSERT(CHURN_WINDOW <= STORM_BATCH);
+OE_STATIC_ASSERT(REALLOC_BUFFERS <= STORM_BATCH);
+
+struct block_t
+{
+    void* ptr;
+    size_t size;
+};
+
+/* Keeps the threads, which spin on shared state, on separate cache lines */
+struct OE_ALIGNED(64) queue_t
+{
+    block_t blocks[QUEUE_SIZE];
+    OE_ALIGNED(64) uint64_t head;
+    OE_ALIGNED(64) uint64_t tail;
+};
+
+struct OE_ALIGNED(64) live_bytes_t
+{
+    int64_t bytes;
+};
+
+struct context_t
+{
+    uint32_t index;
+    uint64_t random;
+    thread_result_t* result;
+};
+
+static pattern_t _pattern;
+static uint32_t _num_threads;
+static uint64_t _iterations;
+static heap_result_t _heap_result;
+
+static uint32_t _barrier_count;
+static uint32_t _barrier_generation;
+
+// Queues of the producer/consumer pairs, live bytes of each thread, batches
+// of the free storm pattern and blocks that each thread holds at the end of
+// the pattern.
+static queue_t _queues[NUM_TCS / 2 + 1];
+static live_bytes_t _live_bytes[NUM_TCS];
+static block_t _batches[NUM_TCS][2][STORM_BATCH];
+static block_t _kept[NUM_TCS][STORM_BATCH];
+
+static uint64_t _rdtsc(void)
+{
+    // The benchmark runs in simulation mode, where RDTSC is allowed.
+    return __builtin_ia32_rdtsc();
+}
+
+static uint64_t _random(context_t* context)
+{
+    // xorshift64
+    uint64_t x = context->random;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return context->random = x;
+}
+
+/* Pick a size in [2^min_shift, 2^max_shift) with a log-uniform distribution,
+ * which is closer to real workloads than a uniform one */
+static size_t _random_size(
+    context_t* context,
+    size_t min_shift,
+    size_t max_shift)
+{
+    size_t shift = min_shift + _random(context) % (max_shift - min_shift);
+    size_t base = (size_t)1 << shift;
+    return base + _random(context) % base;
+}
+
+static size_t _bucket(uint64_t cycles)
+{
+    if (cycles < 16)
+        return cycles;
+
+    size_t shift = 63 - (size_t)__builtin_clzll(cycles);
+    return 16 + (shift - 4) * 8 + ((cycles >> (shift - 3)) & 7);
+}
+
+static void _record(context_t* context, uint64_t start)
+{
+    context->result->histogram[_bucket(_rdtsc() - start)]++;
+    context->result->operations++;
+}
+
+static void* _malloc(context_t* context, size_t size)
+{
+    uint64_t start = _rdtsc();
+    void* ptr = malloc(size);
+    _record(context, start);
+
+    OE_TEST(ptr);
+    *(uint8_t*)ptr = 1;
+    _live_bytes[context->index].bytes += (int64_t)size;
+    return ptr;
+}
+
+static void* _realloc(
+    context_t* context,
+    void* ptr,
+    size_t old_size,
+    size_t new_size)
+{
+    uint64_t start = _rdtsc();
+    ptr = realloc(ptr, new_size);
+    _record(context, start);
+
+    OE_TEST(ptr);
+    ((uint8_t*)ptr)[new_size - 1] = 1;
+    _live_bytes[context->index].bytes += (int64_t)new_size - (int64_t)old_size;
+    return ptr;
+}
+
+static void _free(context_t* context, block_t* block)
+{
+    uint64_t start = _rdtsc();
+    free(block->ptr);
+    _record(context, start);
+
+    _live_bytes[context->index].bytes -= (int64_t)block->size;
+    block->ptr = NULL;
+}
+
+static void _wait_barrier(void)
+{
+    uint32_t generation =
+        __atomic_load_n(&_barrier_generation, __ATOMIC_ACQUIRE);
+
+    if (__atomic_add_fetch(&_barrier_count, 1, __ATOMIC_ACQ_REL) ==
+        _num_threads)
+    {
+        __atomic_store_n(&_barrier_count, 0, __ATOMIC_RELAXED);
+        __atomic_store_n(
+            &_barrier_generation, generation + 1, __ATOMIC_RELEASE);
+        return;
+    }
+
+    while (__atomic_load_n(&_barrier_generation, __ATOMIC_ACQUIRE) ==
+           generation)
+        asm volatile("pause");
+}
+
+/* Keep block in a window of recent blocks, freeing the oldest one */
+static void _keep(
+    context_t* context,
+    block_t* window,
+    uint64_t i,
+    block_t block)
+{
+    block_t* slot = &window[i % CONSUMER_WINDOW];
+
+    if (slot->ptr)
+        _free(context, slot);
+
+    *slot = block;
+}
+
+/* Producers (even threads) allocate blocks and pass them through a queue to
+ * consumers (odd threads), which free them. A thread without a partner is
+ * its own consumer */
+static void _run_producer_consumer(context_t* context, block_t* kept)
+{
+    queue_t* queue = &_queues[context->index / 2];
+    bool producer = context->index % 2 == 0;
+    bool consumer = !producer || context->index + 1 == _num_threads;
+
+    for (uint64_t i = 0; i < _iterations; i++)
+    {
+        block_t block = {NULL, 0};
+
+        if (producer)
+        {
+            block.size = _random_size(context, 4, 10);
+            block.ptr = _malloc(context, block.size);
+        }
+
+        if (producer && consumer)
+        {
+            _keep(context, kept, i, block);
+        }
+        else if (producer)
+        {
+            while (queue->tail -
+                       __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) ==
+                   QUEUE_SIZE)
+                asm volatile("pause");
+
+            queue->blocks[queue->tail % QUEUE_SIZE] = block;
+            __atomic_store_n(&queue->tail, queue->tail + 1, __ATOMIC_RELEASE);
+        }
+        else
+        {
+            while (__atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) ==
+                   queue->head)
+                asm volatile("pause");
+
+            block = queue->blocks[queue->head % QUEUE_SIZE];
+            __atomic_store_n(&queue->head, queue->head + 1, __ATOMIC_RELEASE);
+            _keep(context, kept, i, block);
+        }
+    }
+}
+
+/* Replace random blocks of a window with blocks of random size classes */
+static void _run_size_class_churn(context_t* context, block_t* kept)
+{
+    for (uint64_t i = 0; i < _iterations; i++)
+    {
+        block_t* slot = &kept[_random(context) % CHURN_WINDOW];
+
+        if (slot->ptr)
+            _free(context, slot);
+
+        slot->size = _random_size(context, 3, 12);
+        slot->ptr = _malloc(context, slot->size);
+    }
+}
+
+/* Grow and shrink a few large buffers with realloc() */
+static void _run_large_realloc(context_t* context, block_t* kept)
+{
+    for (uint64_t i = 0; i < _iterations; i++)
+    {
+        block_t* buffer = &kept[_random(context) % REALLOC_BUFFERS];
+        size_t size = _random_size(context, 12, 17);
+
+        buffer->ptr = _realloc(context, buffer->ptr, buffer->size, size);
+        buffer->size = size;
+    }
+}
+
+/* In each round, all the threads allocate a batch of blocks and then free the
+ * batch that the next thread allocated in the previous round, so the frees
+ * of all the threads hit blocks of other threads at the same time */
+static void _run_free_storm(context_t* context, block_t* kept)
+{
+    uint64_t num_rounds = _iterations / STORM_BATCH;
+    uint32_t next = (context->index + 1) % _num_threads;
+
+    if (num_rounds == 0)
+        num_rounds = 1;
+
+    for (uint64_t round = 0; round < num_rounds; round++)
+    {
+        block_t* batch = _batches[context->index][round % 2];
+
+        for (size_t i = 0; i < STORM_BATCH; i++)
+        {
+            batch[i].size = _random_size(context, 4, 10);
+            batch[i].ptr = _malloc(context, batch[i].size);
+        }
+
+        _wait_barrier();
+
+        if (round > 0)
+        {
+            batch = _batches[next][(round - 1) % 2];
+            for (size_t i = 0; i < STORM_BATCH; i++)
+                _free(context, &batch[i]);
+        }
+
+        _wait_barrier();
+    }
+
+    memcpy(
+        kept,
+        _batches[context->index][(num_rounds - 1) % 2],
+        sizeof(_batches[0][0]));
+}
+
+void enc_get_allocator_name(char* name, size_t size)
+{
+    OE_TEST(size > 0);
+    strncpy(name, BENCH_ALLOCATOR_NAME, size - 1);
+    name[size - 1] = '\0';
+}
+
+void enc_setup(pattern_t pattern, uint32_t num_threads, uint64_t iterations)
+{
+    OE_TEST(num_threads > 0 && num_threads <= NUM_TCS);
+    _pattern = pattern;
+    _num_threads = num_threads;
+    _iterations = iterations;
+}
+
+void enc_run(uint32_t thread_index, uint64_t seed, thread_result_t* result)
+{
+    context_t context = {thread_index, seed | 1, result};
+    block_t* kept;
+
+    OE_TEST(thread_index < _num_threads);
+    kept = _kept[thread_index];
+    memset(result, 0, sizeof(*result));
+
+    _wait_barrier();
+    result->start_tsc = _rdtsc();
+
+    if (_pattern == PATTERN_PRODUCER_CONSUMER)
+        _run_producer_consumer(&context, kept);
+    else if (_pattern == PATTERN_SIZE_CLASS_CHURN)
+        _run_size_class_churn(&context, kept);
+    else if (_pattern == PATTERN_LARGE_REALLOC)
+        _run_large_realloc(&context, kept);
+    else
+        _run_free_storm(&context, kept);
+
+    result->end_tsc = _rdtsc();
+
+    // Take the heap usage while all the threads hold their blocks.
+    _wait_barrier();
+    if (thread_index == 0)
+    {
+        oe_mallinfo_t info;
+        int64_t live_bytes = 0;
+
+        OE_TEST(oe_allocator_mallinfo(&info) == OE_OK);
+
+        for (uint32_t t = 0; t < _num_threads; t++)
+            live_bytes += _live_bytes[t].bytes;
+
+        _heap_result.live_bytes = (uint64_t)live_bytes;
+        _heap_result.current_heap_bytes = info.current_allocated_heap_size;
+        _heap_result.peak_heap_bytes = info.peak_allocated_heap_size;
+        _heap_result.max_heap_bytes = info.max_total_heap_size;
+    }
+    _wait_barrier();
+
+    for (size_t i = 0; i < STORM_BATCH; i++)
+        free(kept[i].ptr);
+}
+
+void enc_get_heap_result(heap_result_t* result)
+{
+    *result = _heap_result;
+}
+
+OE_SET_ENCLAVE_SGX(
+    1,        /* ProductID */
+    1,        /* SecurityVersion */
+    true,     /* Debug */
+    16384,    /* NumHeapPages */
+    64,       /* NumStackPages */
+    NUM_TCS); /* NumTCS */
@@ -0,0 +1,291 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <x86intrin.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "allocator_u.h"
+#include "bench.h"
+
+using namespace std;
+
+/*
+ * Benchmarks of the pluggable enclave allocators.
+ *
+ * Each enclave passed on the command line is linked with one allocator
+ * (dlmalloc or snmalloc). For each allocator, pattern and number of threads
+ * from 1 to --max-threads, the benchmark creates a new enclave in simulation
+ * mode, so that the peak heap usage is that of the run, and makes the threads
+ * enter it together and run the pattern:
+ *
+ * - producer_consumer: pairs of threads pass blocks from the thread that
+ *   allocates them to the thread that frees them
+ * - size_class_churn: each thread replaces random blocks of a window with
+ *   blocks of random sizes from 8 B to 8 KB
+ * - large_realloc: each thread reallocates a few buffers to random sizes from
+ *   4 KB to 128 KB
+ * - free_storm: all the threads allocate a batch of blocks and then all free
+ *   the batch of another thread at the same time
+ *
+ * The enclave times each allocator call with RDTSC. The heap usage comes from
+ * oe_allocator_mallinfo(), taken while the threads hold the blocks that they
+ * keep at the end of the pattern.
+ *
+ * Usage: host ENCLAVE... [--iterations N] [--max-threads N]
+ *                        [--format csv|json] [--output FILE]
+ */
+
+struct result_t
+{
+    string allocator;
+    string pattern;
+    size_t num_threads;
+    uint64_t num_operations;
+    double total_microseconds;
+    double p99_nanoseconds;
+    heap_result_t heap;
+};
+
+struct pattern_info_t
+{
+    const char* name;
+    pattern_t pattern;
+};
+
+static const pattern_info_t _patterns[] = {
+    {"producer_consumer", PATTERN_PRODUCER_CONSUMER},
+    {"size_class_churn", PATTERN_SIZE_CLASS_CHURN},
+    {"large_realloc", PATTERN_LARGE_REALLOC},
+    {"free_storm", PATTERN_FREE_STORM},
+};
+
+static uint64_t _num_iterations = 100000;
+static size_t _max_threads = 8;
+static vector<result_t> _results;
+
+/* Inverse of the bucketing of latencies in the enclave. Returns the middle of
+ * the range of latencies that fall in the bucket */
+static double _get_bucket_cycles(size_t bucket)
+{
+    if (bucket < 16)
+        return (double)bucket;
+
+    size_t shift = (bucket - 16) / 8 + 4;
+    uint64_t low = (8 + (bucket - 16) % 8) << (shift - 3);
+    return (double)low + (double)((uint64_t)1 << (shift - 3)) / 2;
+}
+
+static double _get_p99_cycles(const vector<thread_result_t>& threads)
+{
+    const size_t num_buckets = OE_COUNTOF(threads[0].histogram);
+    vector<uint64_t> histogram(num_buckets);
+    uint64_t count = 0;
+    uint64_t seen = 0;
+
+    for (size_t t = 0; t < threads.size(); t++)
+    {
+        for (size_t b = 0; b < num_buckets; b++)
+        {
+            histogram[b] += threads[t].histogram[b];
+            count += threads[t].histogram[b];
+        }
+    }
+
+    for (size_t b = 0; b < num_buckets; b++)
+    {
+        seen += histogram[b];
+        if (seen * 100 >= count * 99)
+            return _get_bucket_cycles(b);
+    }
+
+    return 0;
+}
+
+/* Start the threads together so that they contend from the first call */
+static void _run(
+    const char* path,
+    const string& allocator,
+    const pattern_info_t& pattern,
+    size_t num_threads)
+{
+    oe_enclave_t* enclave = NULL;
+    vector<thread> threads;
+    vector<thread_result_t> thread_results(num_threads);
+    mutex start_mutex;
+    condition_variable start_cond;
+    bool started = false;
+    result_t result = {};
+    oe_result_t r;
+
+    // A new enclave for each run, so that the peak heap usage is that of the
+    // run. Waiting threads spin in the enclave, which does not require SGX
+    // hardware in simulation mode.
+    const uint32_t flags = oe_get_create_flags() | OE_ENCLAVE_FLAG_SIMULATE;
+
+    if ((r = oe_create_allocator_enclave(
+             path, OE_ENCLAVE_TYPE_SGX, flags, NULL, 0, &enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", r);
+
+    OE_TEST(
+        enc_setup(
+            enclave,
+            pattern.pattern,
+            (uint32_t)num_threads,
+            _num_iterations) == OE_OK);
+
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        threads.push_back(thread([&, t]() {
+            {
+                unique_lock<mutex> lk(start_mutex);
+                start_cond.wait(lk, [&]() { return started; });
+            }
+
+            OE_TEST(
+                enc_run(enclave, (uint32_t)t, t + 1, &thread_results[t]) ==
+                OE_OK);
+        }));
+    }
+
+    auto start = chrono::steady_clock::now();
+    uint64_t start_tsc = __rdtsc();
+
+    {
+        lock_guard<mutex> lk(start_mutex);
+        started = true;
+    }
+    start_cond.notify_all();
+
+    for (size_t t = 0; t < num_threads; t++)
+        threads[t].join();
+
+    // Calibrate the TSC against the steady clock over the run.
+    double tsc_per_microsecond =
+        (double)(__rdtsc() - start_tsc) /
+        chrono::duration<double, micro>(chrono::steady_clock::now() - start)
+            .count();
+
+    uint64_t first_tsc = thread_results[0].start_tsc;
+    uint64_t last_tsc = thread_results[0].end_tsc;
+
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        first_tsc = min(first_tsc, thread_results[t].start_tsc);
+        last_tsc = max(last_tsc, thread_results[t].end_tsc);
+        result.num_operations += thread_results[t].operations;
+    }
+
+    OE_TEST(enc_get_heap_result(enclave, &result.heap) == OE_OK);
+    OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+
+    result.allocator = allocator;
+    result.pattern = pattern.name;
+    result.num_threads = num_threads;
+    result.total_microseconds =
+        (double)(last_tsc - first_tsc) / tsc_per_microsecond;
+    result.p99_nanoseconds =
+        _get_p99_cycles(thread_results) / tsc_per_microsecond * 1000;
+    _results.push_back(result);
+}
+
+static string _get_allocator_name(const char* path)
+{
+    oe_enclave_t* enclave = NULL;
+    char name[32];
+    oe_result_t r;
+
+    const uint32_t flags = oe_get_create_flags() | OE_ENCLAVE_FLAG_SIMULATE;
+
+    if ((r = oe_create_allocator_enclave(
+             path, OE_ENCLAVE_TYPE_SGX, flags, NULL, 0, &enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", r);
+
+    OE_TEST(enc_get_allocator_name(enclave, name, sizeof(name)) == OE_OK);
+    OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+
+    return name;
+}
+
+static void _run_benchmarks(const vector<const char*>& paths)
+{
+    for (size_t e = 0; e < paths.size(); e++)
+    {
+        string allocator = _get_allocator_name(paths[e]);
+
+        for (size_t p = 0; p < OE_COUNTOF(_patterns); p++)
+        {
+            for (size_t n = 1; n <= _max_threads; n *= 2)
+                _run(paths[e], allocator, _patterns[p], n);
+        }
+    }
+}
+
+/* Share of the heap in use that does not hold live blocks */
+static double _get_fragmentation(const heap_result_t& heap)
+{
+    if (heap.current_heap_bytes == 0 ||
+        heap.live_bytes > heap.current_heap_bytes)
+        return 0;
+
+    return 1 - (double)heap.live_bytes / (double)heap.current_heap_bytes;
+}
+
+static vector<bench_record_t> _get_records(void)
+{
+    vector<bench_record_t> records;
+
+    for (size_t i = 0; i < _results.size(); i++)
+    {
+        const result_t& r = _results[i];
+        bench_record_t record;
+
+        record.add_string("allocator", r.allocator)
+            .add_string("pattern", r.pattern)
+            .add_uint("threads", r.num_threads)
+            .add_uint("operations", r.num_operations)
+            .add_double("total_us", r.total_microseconds, 1)
+            .add_double(
+                "operations_per_second",
+                (double)r.num_operations / r.total_microseconds * 1000000,
+                0)
+            .add_double("p99_ns", r.p99_nanoseconds, 1)
+            .add_uint("live_bytes", r.heap.live_bytes)
+            .add_uint("current_heap_bytes", r.heap.current_heap_bytes)
+            .add_uint("peak_heap_bytes", r.heap.peak_heap_bytes)
+            .add_double("fragmentation", _get_fragmentation(r.heap), 3);
+        records.push_back(record);
+    }
+
+    return records;
+}
+
+int main(int argc, const char* argv[])
+{
+    bench_options_t options;
+
+    options.count = _num_iterations;
+    options.max_threads = _max_threads;
+    bench_parse_options(argc, argv, "--iterations", true, options);
+    _num_iterations = options.count;
+
+    // Each thread holds a TCS for the whole run.
+    _max_threads = min(options.max_threads, (size_t)NUM_TCS);
+
+    _run_benchmarks(options.enclaves);
+
+    bench_write_records(options, _get_records());
+
+    // Keep stdout machine-readable.
+    fprintf(stderr, "=== passed all tests (bench_allocator)\n");
+
+    return 0;
+}
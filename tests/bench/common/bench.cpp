@@ -0,0 +1,168 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include "bench.h"
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace std;
+
+static void _usage(
+    const char* program,
+    const char* count_option,
+    bool multiple_enclaves)
+{
+    fprintf(
+        stderr,
+        "Usage: %s %s [%s N] [--max-threads N] [--format csv|json] "
+        "[--output FILE]\n",
+        program,
+        multiple_enclaves ? "ENCLAVE..." : "ENCLAVE",
+        count_option);
+    exit(1);
+}
+
+void bench_parse_options(
+    int argc,
+    const char* argv[],
+    const char* count_option,
+    bool multiple_enclaves,
+    bench_options_t& options)
+{
+    options.enclaves.clear();
+    options.format = "csv";
+    options.output = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            options.enclaves.push_back(argv[i]);
+            continue;
+        }
+
+        if (i + 1 >= argc)
+            _usage(argv[0], count_option, multiple_enclaves);
+
+        if (strcmp(argv[i], count_option) == 0)
+            options.count = strtoull(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--max-threads") == 0)
+            options.max_threads = strtoul(argv[++i], NULL, 10);
+        else if (strcmp(argv[i], "--format") == 0)
+            options.format = argv[++i];
+        else if (strcmp(argv[i], "--output") == 0)
+            options.output = argv[++i];
+        else
+            _usage(argv[0], count_option, multiple_enclaves);
+    }
+
+    if (options.enclaves.empty() ||
+        (!multiple_enclaves && options.enclaves.size() > 1) ||
+        options.count == 0 || options.max_threads == 0 ||
+        (options.format != "csv" && options.format != "json"))
+        _usage(argv[0], count_option, multiple_enclaves);
+}
+
+bench_record_t& bench_record_t::_add(
+    const char* name,
+    const string& value,
+    bool quoted,
+    bool null)
+{
+    field_t field = {name, value, quoted, null};
+    _fields.push_back(field);
+    return *this;
+}
+
+bench_record_t& bench_record_t::add_string(
+    const char* name,
+    const string& value)
+{
+    return _add(name, value, true, false);
+}
+
+bench_record_t& bench_record_t::add_uint(const char* name, uint64_t value)
+{
+    return _add(name, to_string((unsigned long long)value), false, false);
+}
+
+bench_record_t& bench_record_t::add_double(
+    const char* name,
+    double value,
+    int precision)
+{
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", precision, value);
+    return _add(name, buffer, false, false);
+}
+
+bench_record_t& bench_record_t::add_null(const char* name)
+{
+    return _add(name, "", false, true);
+}
+
+void bench_write_records(
+    const bench_options_t& options,
+    const vector<bench_record_t>& records)
+{
+    FILE* stream = stdout;
+
+    if (options.output && !(stream = fopen(options.output, "w")))
+        oe_put_err("fopen(%s) failed", options.output);
+
+    if (options.format == "json")
+    {
+        fprintf(stream, "{\n  \"benchmarks\": [\n");
+
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            const vector<bench_record_t::field_t>& fields = records[i]._fields;
+
+            fprintf(stream, "    {");
+
+            for (size_t f = 0; f < fields.size(); f++)
+            {
+                const char* quote = fields[f].quoted ? "\"" : "";
+
+                fprintf(
+                    stream,
+                    "%s\"%s\": %s%s%s",
+                    f ? ", " : "",
+                    fields[f].name,
+                    quote,
+                    fields[f].null ? "null" : fields[f].value.c_str(),
+                    quote);
+            }
+
+            fprintf(stream, "}%s\n", i + 1 < records.size() ? "," : "");
+        }
+
+        fprintf(stream, "  ]\n}\n");
+    }
+    else if (!records.empty())
+    {
+        const vector<bench_record_t::field_t>& header = records[0]._fields;
+
+        for (size_t f = 0; f < header.size(); f++)
+            fprintf(stream, "%s%s", f ? "," : "", header[f].name);
+
+        fprintf(stream, "\n");
+
+        for (size_t i = 0; i < records.size(); i++)
+        {
+            const vector<bench_record_t::field_t>& fields = records[i]._fields;
+
+            for (size_t f = 0; f < fields.size(); f++)
+                fprintf(
+                    stream, "%s%s", f ? "," : "", fields[f].value.c_str());
+
+            fprintf(stream, "\n");
+        }
+    }
+
+    if (stream != stdout)
+        fclose(stream);
+}
@@ -0,0 +1,86 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#ifndef _OE_TESTS_BENCH_COMMON_BENCH_H
+#define _OE_TESTS_BENCH_COMMON_BENCH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * Option parsing and result output shared by the host side of the
+ * benchmarks.
+ *
+ * The benchmarks take one or more enclave paths followed by:
+ *
+ *     --<count> N        the number of calls or iterations of each run
+ *     --max-threads N    the largest number of threads (1, 2, 4, ...)
+ *     --format csv|json  the format of the results (csv by default)
+ *     --output FILE      the file to write the results to (stdout by default)
+ *
+ * Results are records of named fields, written as CSV with one row per record
+ * or as JSON with one object per record in a "benchmarks" array.
+ */
+
+struct bench_options_t
+{
+    std::vector<const char*> enclaves;
+    uint64_t count;
+    size_t max_threads;
+    std::string format;
+    const char* output;
+};
+
+/* Parse the command line. count_option names the option that sets the count,
+ * such as "--calls". Prints the usage and exits if the command line is
+ * invalid or does not have exactly one enclave path (or at least one if
+ * multiple_enclaves is true). options holds the default count and
+ * max_threads on input */
+void bench_parse_options(
+    int argc,
+    const char* argv[],
+    const char* count_option,
+    bool multiple_enclaves,
+    bench_options_t& options);
+
+class bench_record_t
+{
+  public:
+    bench_record_t& add_string(const char* name, const std::string& value);
+    bench_record_t& add_uint(const char* name, uint64_t value);
+    bench_record_t& add_double(const char* name, double value, int precision);
+
+    /* A field without a value: empty in CSV and null in JSON */
+    bench_record_t& add_null(const char* name);
+
+  private:
+    friend void bench_write_records(
+        const bench_options_t& options,
+        const std::vector<bench_record_t>& records);
+
+    struct field_t
+    {
+        const char* name;
+        std::string value;
+        bool quoted;
+        bool null;
+    };
+
+    bench_record_t& _add(
+        const char* name,
+        const std::string& value,
+        bool quoted,
+        bool null);
+
+    std::vector<field_t> _fields;
+};
+
+/* Write the records in the format and to the output of the options. All the
+ * records must have the same fields in the same order */
+void bench_write_records(
+    const bench_options_t& options,
+    const std::vector<bench_record_t>& records);
+
+#endif /* _OE_TESTS_BENCH_COMMON_BENCH_H */
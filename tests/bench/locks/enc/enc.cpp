@@ -0,0 +1,104 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/tests.h>
+#include <openenclave/internal/thread.h>
+#include <pthread.h>
+#include "locks_t.h"
+
+// Writers increment every entry, so readers check that they see the entries
+// of a single write.
+#define NUM_ENTRIES 16
+
+static pthread_rwlock_t _rwlock = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t _mutex = PTHREAD_MUTEX_INITIALIZER;
+static oe_spinlock_t _spinlock = OE_SPINLOCK_INITIALIZER;
+static volatile uint32_t _tas_spinlock;
+static volatile uint64_t _entries[NUM_ENTRIES];
+
+/* The test-and-set spinlock that oe_spinlock_t used to be, as a baseline */
+static void _tas_spin_lock(volatile uint32_t* spinlock)
+{
+    while (__atomic_exchange_n(spinlock, 1, __ATOMIC_ACQUIRE) != 0)
+    {
+        while (*spinlock)
+            asm volatile("pause");
+    }
+}
+
+static void _tas_spin_unlock(volatile uint32_t* spinlock)
+{
+    __atomic_store_n(spinlock, 0, __ATOMIC_RELEASE);
+}
+
+static void _read_entries(void)
+{
+    for (size_t i = 1; i < NUM_ENTRIES; i++)
+        OE_TEST(_entries[i] == _entries[0]);
+}
+
+static void _write_entries(void)
+{
+    for (size_t i = 0; i < NUM_ENTRIES; i++)
+        _entries[i]++;
+}
+
+static void _lock(lock_kind_t kind, bool write)
+{
+    if (kind == LOCK_MUTEX)
+        OE_TEST(pthread_mutex_lock(&_mutex) == 0);
+    else if (kind == LOCK_SPINLOCK)
+        OE_TEST(oe_spin_lock(&_spinlock) == OE_OK);
+    else if (kind == LOCK_TAS_SPINLOCK)
+        _tas_spin_lock(&_tas_spinlock);
+    else if (write)
+        OE_TEST(pthread_rwlock_wrlock(&_rwlock) == 0);
+    else
+        OE_TEST(pthread_rwlock_rdlock(&_rwlock) == 0);
+}
+
+static void _unlock(lock_kind_t kind)
+{
+    if (kind == LOCK_MUTEX)
+        OE_TEST(pthread_mutex_unlock(&_mutex) == 0);
+    else if (kind == LOCK_SPINLOCK)
+        OE_TEST(oe_spin_unlock(&_spinlock) == OE_OK);
+    else if (kind == LOCK_TAS_SPINLOCK)
+        _tas_spin_unlock(&_tas_spinlock);
+    else
+        OE_TEST(pthread_rwlock_unlock(&_rwlock) == 0);
+}
+
+void enc_run(
+    lock_kind_t kind,
+    uint64_t iterations,
+    uint32_t writes_per_1000,
+    uint64_t seed)
+{
+    uint64_t state = seed | 1;
+
+    for (uint64_t i = 0; i < iterations; i++)
+    {
+        // Knuth's MMIX LCG, so that each thread picks its own writes.
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        bool write = (state >> 33) % 1000 < writes_per_1000;
+
+        _lock(kind, write);
+
+        if (write)
+            _write_entries();
+        else
+            _read_entries();
+
+        _unlock(kind);
+    }
+}
+
+OE_SET_ENCLAVE_SGX(
+    1,        /* ProductID */
+    1,        /* SecurityVersion */
+    true,     /* Debug */
+    1024,     /* NumHeapPages */
+    64,       /* NumStackPages */
+    NUM_TCS); /* NumTCS */
@@ -0,0 +1,194 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "locks_u.h"
+
+using namespace std;
+
+/*
+ * Scalability benchmarks of the enclave locks.
+ *
+ * Each benchmark makes 1 to --max-threads host threads enter the enclave at
+ * the same time and run critical sections on a single lock. The critical
+ * sections read or write a small shared table; the share of writes varies
+ * from none to 10%. The enclave runs in simulation mode, so waiting threads
+ * sleep on the host like they would on SGX hardware.
+ *
+ * The pthread rwlock is expected to scale with the number of threads when
+ * there are few writes. The pthread mutex serializes all the critical
+ * sections and serves as the reference. The oe_spinlock_t ticket lock is
+ * compared with a test-and-set spinlock, which it replaced.
+ *
+ * Usage: host ENCLAVE [--iterations N] [--max-threads N] [--format csv|json]
+ *                     [--output FILE]
+ */
+
+struct result_t
+{
+    string lock;
+    uint32_t writes_per_1000;
+    size_t num_threads;
+    uint64_t num_operations;
+    double total_microseconds;
+};
+
+struct lock_info_t
+{
+    const char* name;
+    lock_kind_t kind;
+};
+
+static const lock_info_t _locks[] = {
+    {"rwlock", LOCK_RWLOCK},
+    {"mutex", LOCK_MUTEX},
+    {"spinlock", LOCK_SPINLOCK},
+    {"tas_spinlock", LOCK_TAS_SPINLOCK},
+};
+
+static const uint32_t _writes_per_1000[] = {0, 10, 100};
+
+static oe_enclave_t* _enclave;
+static uint64_t _num_iterations = 100000;
+static size_t _max_threads = 8;
+static vector<result_t> _results;
+
+static double _get_microseconds_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start)
+        .count();
+}
+
+/* Start the threads together so that they contend from the first iteration */
+static void _run(
+    const lock_info_t& lock,
+    uint32_t writes_per_1000,
+    size_t num_threads)
+{
+    vector<thread> threads;
+    mutex start_mutex;
+    condition_variable start_cond;
+    bool started = false;
+    result_t result = {};
+
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        threads.push_back(thread([&, t]() {
+            {
+                unique_lock<mutex> lk(start_mutex);
+                start_cond.wait(lk, [&]() { return started; });
+            }
+
+            OE_TEST(
+                enc_run(
+                    _enclave,
+                    lock.kind,
+                    _num_iterations,
+                    writes_per_1000,
+                    t + 1) == OE_OK);
+        }));
+    }
+
+    auto start = chrono::steady_clock::now();
+
+    {
+        lock_guard<mutex> lk(start_mutex);
+        started = true;
+    }
+    start_cond.notify_all();
+
+    for (size_t t = 0; t < num_threads; t++)
+        threads[t].join();
+
+    result.total_microseconds = _get_microseconds_since(start);
+    result.lock = lock.name;
+    result.writes_per_1000 = writes_per_1000;
+    result.num_threads = num_threads;
+    result.num_operations = _num_iterations * num_threads;
+    _results.push_back(result);
+}
+
+static void _run_benchmarks(void)
+{
+    for (size_t l = 0; l < OE_COUNTOF(_locks); l++)
+    {
+        for (size_t w = 0; w < OE_COUNTOF(_writes_per_1000); w++)
+        {
+            for (size_t n = 1; n <= _max_threads; n *= 2)
+                _run(_locks[l], _writes_per_1000[w], n);
+        }
+    }
+}
+
+static vector<bench_record_t> _get_records(void)
+{
+    vector<bench_record_t> records;
+
+    for (size_t i = 0; i < _results.size(); i++)
+    {
+        const result_t& r = _results[i];
+        bench_record_t record;
+
+        record.add_string("lock", r.lock)
+            .add_uint("writes_per_1000", r.writes_per_1000)
+            .add_uint("threads", r.num_threads)
+            .add_uint("operations", r.num_operations)
+            .add_double("total_us", r.total_microseconds, 1)
+            .add_double(
+                "operations_per_second",
+                (double)r.num_operations / r.total_microseconds * 1000000,
+                0);
+        records.push_back(record);
+    }
+
+    return records;
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+    bench_options_t options;
+
+    options.count = _num_iterations;
+    options.max_threads = _max_threads;
+    bench_parse_options(argc, argv, "--iterations", false, options);
+    _num_iterations = options.count;
+
+    // Each thread holds a TCS for the whole benchmark.
+    _max_threads = min(options.max_threads, (size_t)NUM_TCS);
+
+    // Waiting threads sleep on the host in simulation mode too, which does
+    // not require SGX hardware.
+    const uint32_t flags = oe_get_create_flags() | OE_ENCLAVE_FLAG_SIMULATE;
+
+    if ((result = oe_create_locks_enclave(
+             options.enclaves[0],
+             OE_ENCLAVE_TYPE_SGX,
+             flags,
+             NULL,
+             0,
+             &_enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    _run_benchmarks();
+
+    OE_TEST(oe_terminate_enclave(_enclave) == OE_OK);
+
+    bench_write_records(options, _get_records());
+
+    // Keep stdout machine-readable.
+    fprintf(stderr, "=== passed all tests (bench_locks)\n");
+
+    return 0;
+}
@@ -0,0 +1,85 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/tests.h>
+#include <stdlib.h>
+#include "transitions_t.h"
+
+void enc_empty()
+{
+}
+
+void enc_empty_switchless()
+{
+}
+
+void enc_in(uint8_t* buffer, size_t size)
+{
+    OE_UNUSED(buffer);
+    OE_UNUSED(size);
+}
+
+void enc_out(uint8_t* buffer, size_t size)
+{
+    OE_UNUSED(buffer);
+    OE_UNUSED(size);
+}
+
+void enc_deepcopy(payload_t* payload)
+{
+    OE_UNUSED(payload);
+}
+
+void enc_ocall_empty(uint64_t count, bool switchless)
+{
+    for (uint64_t i = 0; i < count; i++)
+    {
+        if (switchless)
+            OE_TEST(host_empty_switchless() == OE_OK);
+        else
+            OE_TEST(host_empty() == OE_OK);
+    }
+}
+
+void enc_ocall_in(uint64_t count, size_t size)
+{
+    uint8_t* buffer = (uint8_t*)calloc(1, size ? size : 1);
+    OE_TEST(buffer != NULL);
+
+    for (uint64_t i = 0; i < count; i++)
+        OE_TEST(host_in(size ? buffer : NULL, size) == OE_OK);
+
+    free(buffer);
+}
+
+void enc_ocall_out(uint64_t count, size_t size)
+{
+    uint8_t* buffer = (uint8_t*)malloc(size ? size : 1);
+    OE_TEST(buffer != NULL);
+
+    for (uint64_t i = 0; i < count; i++)
+        OE_TEST(host_out(size ? buffer : NULL, size) == OE_OK);
+
+    free(buffer);
+}
+
+uint64_t enc_nested(uint64_t depth)
+{
+    uint64_t result = 0;
+
+    if (depth == 0)
+        return 0;
+
+    OE_TEST(host_nested(&result, depth - 1) == OE_OK);
+    return result + 1;
+}
+
+// The heap holds copies of the largest (1 MB) payloads.
+OE_SET_ENCLAVE_SGX(
+    1,        /* ProductID */
+    1,        /* SecurityVersion */
+    true,     /* Debug */
+    8192,     /* NumHeapPages */
+    64,       /* NumStackPages */
+    NUM_TCS); /* NumTCS */
@@ -0,0 +1,344 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "bench.h"
+#include "transitions_u.h"
+
+using namespace std;
+
+/*
+ * Micro-benchmarks of the ECALL/OCALL transition layer.
+ *
+ * Each benchmark reports the latency and throughput of one kind of call:
+ * regular and switchless ECALLs and OCALLs, nested calls, [in], [out] and
+ * deep-copied parameters of various sizes, and ECALLs made concurrently by
+ * several host threads. The enclave runs in simulation mode, so the numbers
+ * measure the software cost of the transitions rather than the cost of the
+ * SGX instructions.
+ *
+ * Results are written as CSV (the default) or JSON, one record per benchmark,
+ * payload size and number of threads, so that they can be compared across
+ * runs. OCALL benchmarks are timed from a single ECALL that makes all the
+ * OCALLs, so they only report the mean latency.
+ *
+ * Usage: host ENCLAVE [--calls N] [--max-threads N] [--format csv|json]
+ *                     [--output FILE]
+ */
+
+// An enclave rejects ECALLs from the threads in its OCALLs, so each nested
+// ECALL goes into another instance of the enclave.
+#define NESTING_DEPTH 2
+
+struct result_t
+{
+    string benchmark;
+    size_t payload_size;
+    size_t num_threads;
+    size_t num_calls;
+    double total_microseconds;
+    double mean_microseconds;
+
+    // Only benchmarks that time each call have percentiles.
+    bool has_percentiles;
+    double p50_microseconds;
+    double p99_microseconds;
+};
+
+static const size_t _payload_sizes[] =
+    {0, 64, 1024, 16 * 1024, 256 * 1024, 1024 * 1024};
+
+static oe_enclave_t* _enclave;
+static oe_enclave_t* _nested_enclaves[NESTING_DEPTH];
+static uint64_t _num_calls = 10000;
+static size_t _max_threads = 8;
+static vector<result_t> _results;
+
+void host_empty()
+{
+}
+
+void host_empty_switchless()
+{
+}
+
+void host_in(uint8_t* buffer, size_t size)
+{
+    OE_UNUSED(buffer);
+    OE_UNUSED(size);
+}
+
+void host_out(uint8_t* buffer, size_t size)
+{
+    OE_UNUSED(buffer);
+    OE_UNUSED(size);
+}
+
+uint64_t host_nested(uint64_t depth)
+{
+    uint64_t result = 0;
+    OE_TEST(enc_nested(_nested_enclaves[depth], &result, depth) == OE_OK);
+    return result;
+}
+
+static double _get_microseconds_since(chrono::steady_clock::time_point start)
+{
+    return chrono::duration<double, micro>(chrono::steady_clock::now() - start)
+        .count();
+}
+
+/* Make fewer calls with large payloads, so that each benchmark copies about
+ * as much data as _num_calls calls with 1 KB payloads */
+static size_t _get_num_calls(size_t payload_size)
+{
+    size_t num_calls = _num_calls;
+
+    if (payload_size > 1024)
+        num_calls = num_calls * 1024 / payload_size;
+
+    return max(num_calls, (size_t)10);
+}
+
+static double _percentile(const vector<double>& latencies, double percentile)
+{
+    size_t index = (size_t)(percentile / 100 * (double)(latencies.size() - 1));
+    return latencies[index];
+}
+
+/* Time each call made by each of the threads */
+static void _run_per_call(
+    const string& benchmark,
+    size_t payload_size,
+    size_t num_threads,
+    size_t num_calls,
+    const function<oe_result_t()>& call)
+{
+    vector<vector<double>> latencies(num_threads);
+    vector<thread> threads;
+    vector<double> all_latencies;
+    result_t result = {};
+    double sum = 0;
+
+    auto start = chrono::steady_clock::now();
+
+    for (size_t t = 0; t < num_threads; t++)
+    {
+        threads.push_back(thread([&, t]() {
+            latencies[t].reserve(num_calls);
+
+            for (size_t i = 0; i < num_calls; i++)
+            {
+                auto call_start = chrono::steady_clock::now();
+                oe_result_t call_result;
+
+                // More threads than TCSs is fine; the calls are retried.
+                while ((call_result = call()) == OE_OUT_OF_THREADS)
+                    this_thread::yield();
+
+                OE_TEST(call_result == OE_OK);
+                latencies[t].push_back(_get_microseconds_since(call_start));
+            }
+        }));
+    }
+
+    for (size_t t = 0; t < num_threads; t++)
+        threads[t].join();
+
+    result.total_microseconds = _get_microseconds_since(start);
+
+    for (size_t t = 0; t < num_threads; t++)
+        all_latencies.insert(
+            all_latencies.end(), latencies[t].begin(), latencies[t].end());
+
+    sort(all_latencies.begin(), all_latencies.end());
+
+    for (size_t i = 0; i < all_latencies.size(); i++)
+        sum += all_latencies[i];
+
+    result.benchmark = benchmark;
+    result.payload_size = payload_size;
+    result.num_threads = num_threads;
+    result.num_calls = all_latencies.size();
+    result.mean_microseconds = sum / (double)all_latencies.size();
+    result.has_percentiles = true;
+    result.p50_microseconds = _percentile(all_latencies, 50);
+    result.p99_microseconds = _percentile(all_latencies, 99);
+    _results.push_back(result);
+}
+
+/* Time a single ECALL that makes num_calls OCALLs */
+static void _run_in_enclave(
+    const string& benchmark,
+    size_t payload_size,
+    size_t num_calls,
+    const function<oe_result_t()>& call)
+{
+    result_t result = {};
+
+    auto start = chrono::steady_clock::now();
+    OE_TEST(call() == OE_OK);
+    result.total_microseconds = _get_microseconds_since(start);
+
+    result.benchmark = benchmark;
+    result.payload_size = payload_size;
+    result.num_threads = 1;
+    result.num_calls = num_calls;
+    result.mean_microseconds = result.total_microseconds / (double)num_calls;
+    _results.push_back(result);
+}
+
+static void _run_benchmarks(void)
+{
+    // Empty calls, which measure the cost of the transitions alone.
+    for (size_t n = 1; n <= _max_threads; n *= 2)
+    {
+        _run_per_call("ecall", 0, n, _num_calls, []() {
+            return enc_empty(_enclave);
+        });
+        _run_per_call("ecall_switchless", 0, n, _num_calls, []() {
+            return enc_empty_switchless(_enclave);
+        });
+    }
+
+    _run_in_enclave("ocall", 0, _num_calls, []() {
+        return enc_ocall_empty(_enclave, _num_calls, false);
+    });
+    _run_in_enclave("ocall_switchless", 0, _num_calls, []() {
+        return enc_ocall_empty(_enclave, _num_calls, true);
+    });
+
+    // ECALL -> OCALL -> ECALL -> ... nested NESTING_DEPTH times, each time
+    // into another enclave.
+    _run_per_call(
+        "nested_ocall_depth_" + to_string(NESTING_DEPTH),
+        0,
+        1,
+        _num_calls,
+        []() {
+            uint64_t result = 0;
+            oe_result_t r = enc_nested(_enclave, &result, NESTING_DEPTH);
+            OE_TEST(r != OE_OK || result == NESTING_DEPTH);
+            return r;
+        });
+
+    // Parameters that are copied across the boundary.
+    for (size_t i = 0; i < OE_COUNTOF(_payload_sizes); i++)
+    {
+        size_t size = _payload_sizes[i];
+        size_t num_calls = _get_num_calls(size);
+        vector<uint8_t> buffer(max(size, (size_t)1));
+        uint8_t* data = size ? buffer.data() : NULL;
+        payload_t payload = {size, data};
+
+        _run_per_call("ecall_in", size, 1, num_calls, [&]() {
+            return enc_in(_enclave, data, size);
+        });
+        _run_per_call("ecall_out", size, 1, num_calls, [&]() {
+            return enc_out(_enclave, data, size);
+        });
+        _run_per_call("ecall_deepcopy", size, 1, num_calls, [&]() {
+            return enc_deepcopy(_enclave, &payload);
+        });
+        _run_in_enclave("ocall_in", size, num_calls, [&]() {
+            return enc_ocall_in(_enclave, num_calls, size);
+        });
+        _run_in_enclave("ocall_out", size, num_calls, [&]() {
+            return enc_ocall_out(_enclave, num_calls, size);
+        });
+    }
+}
+
+static vector<bench_record_t> _get_records(void)
+{
+    vector<bench_record_t> records;
+
+    for (size_t i = 0; i < _results.size(); i++)
+    {
+        const result_t& r = _results[i];
+        bench_record_t record;
+
+        record.add_string("benchmark", r.benchmark)
+            .add_uint("payload_bytes", r.payload_size)
+            .add_uint("threads", r.num_threads)
+            .add_uint("calls", r.num_calls)
+            .add_double("total_us", r.total_microseconds, 1)
+            .add_double("mean_us", r.mean_microseconds, 3);
+
+        if (r.has_percentiles)
+            record.add_double("p50_us", r.p50_microseconds, 3)
+                .add_double("p99_us", r.p99_microseconds, 3);
+        else
+            record.add_null("p50_us").add_null("p99_us");
+
+        record.add_double(
+            "calls_per_second",
+            (double)r.num_calls / r.total_microseconds * 1000000,
+            0);
+        records.push_back(record);
+    }
+
+    return records;
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+    bench_options_t options;
+
+    options.count = _num_calls;
+    options.max_threads = _max_threads;
+    bench_parse_options(argc, argv, "--calls", false, options);
+    _num_calls = options.count;
+    _max_threads = options.max_threads;
+
+    // The transitions are measured in software, which does not require SGX
+    // hardware.
+    const uint32_t flags = oe_get_create_flags() | OE_ENCLAVE_FLAG_SIMULATE;
+
+    oe_enclave_setting_context_switchless_t switchless_setting = {1, 1};
+    oe_enclave_setting_t setting;
+    setting.setting_type = OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS;
+    setting.u.context_switchless_setting = &switchless_setting;
+
+    if ((result = oe_create_transitions_enclave(
+             options.enclaves[0],
+             OE_ENCLAVE_TYPE_SGX,
+             flags,
+             &setting,
+             1,
+             &_enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    for (size_t i = 0; i < NESTING_DEPTH; i++)
+        OE_TEST(
+            oe_create_transitions_enclave(
+                options.enclaves[0],
+                OE_ENCLAVE_TYPE_SGX,
+                flags,
+                NULL,
+                0,
+                &_nested_enclaves[i]) == OE_OK);
+
+    _run_benchmarks();
+
+    for (size_t i = 0; i < NESTING_DEPTH; i++)
+        OE_TEST(oe_terminate_enclave(_nested_enclaves[i]) == OE_OK);
+
+    OE_TEST(oe_terminate_enclave(_enclave) == OE_OK);
+
+    bench_write_records(options, _get_records());
+
+    // Keep stdout machine-readable.
+    fprintf(stderr, "=== passed all tests (bench_transitions)\n");
+
+    return 0;
+}
@@ -16,6 +16,7 @@
 #endif
 
 uint64_t prev;
+oe_ecall_buffer_t ecall_buffer;
 
 void TestECall(oe_enclave_t* enclave)
 {
@@ -57,6 +58,10 @@ void TestECall(oe_enclave_t* enclave)
 #endif
 
     prev = args.thread_data.last_sp;
+
+    // The marshalling buffer of the TCS is in use during the call.
+    OE_TEST(args.thread_data.ecall_buffer.in_use);
+    ecall_buffer = args.thread_data.ecall_buffer;
 }
 
 int main(int argc, const char* argv[])
@@ -87,6 +92,16 @@ int main(int argc, const char* argv[])
         TestECall(enclave);
     }
 
+    // The calls are made by a single thread, which is bound to the same TCS
+    // every time, so its marshalling buffer is allocated once and reused.
+    printf(
+        "ecall buffer: capacity=%llu hits=%llu misses=%llu\n",
+        OE_LLU(ecall_buffer.capacity),
+        OE_LLU(ecall_buffer.hits),
+        OE_LLU(ecall_buffer.misses));
+    OE_TEST(ecall_buffer.misses == 1);
+    OE_TEST(ecall_buffer.hits >= N - 1);
+
     if ((result = oe_terminate_enclave(enclave)) != OE_OK)
     {
         oe_put_err("oe_terminate_enclave(): result=%u", result);
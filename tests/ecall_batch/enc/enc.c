@@ -0,0 +1,27 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include "ecall_batch_t.h"
+
+static uint64_t _total;
+
+void enc_accumulate(uint64_t value)
+{
+    _total += value;
+}
+
+uint64_t enc_get_total(void)
+{
+    uint64_t total = _total;
+    _total = 0;
+    return total;
+}
+
+OE_SET_ENCLAVE_SGX(
+    1,    /* ProductID */
+    1,    /* SecurityVersion */
+    true, /* Debug */
+    1024, /* NumHeapPages */
+    64,   /* NumStackPages */
+    2);   /* NumTCS */
@@ -0,0 +1,229 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/calls.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "ecall_batch_u.h"
+
+// Increase this number to have a meaningful performance measurement
+#define NUM_ECALLS (100000)
+
+#define MAX_BATCH_SIZE (64)
+
+#if defined(__linux__)
+
+double get_relative_time_in_microseconds()
+{
+    struct timespec current_time;
+    clock_gettime(CLOCK_REALTIME, &current_time);
+    return (double)current_time.tv_sec * 1000000 +
+           (double)current_time.tv_nsec / 1000.0;
+}
+
+#elif defined(_WIN32)
+
+#include <Windows.h>
+
+static double frequency;
+double get_relative_time_in_microseconds()
+{
+    LARGE_INTEGER current_time;
+    QueryPerformanceCounter(&current_time);
+    return current_time.QuadPart / frequency;
+}
+
+#endif
+
+/*
+ * The marshalling structure generated by oeedger8r, padded so that the
+ * buffer sizes satisfy OE_EDGER8R_BUFFER_ALIGNMENT.
+ */
+typedef struct OE_ALIGNED(16) _accumulate_buffer
+{
+    enc_accumulate_args_t args;
+} accumulate_buffer_t;
+
+OE_STATIC_ASSERT(
+    sizeof(accumulate_buffer_t) % OE_EDGER8R_BUFFER_ALIGNMENT == 0);
+
+static uint64_t _enc_accumulate_global_id = OE_GLOBAL_ECALL_ID_NULL;
+
+static accumulate_buffer_t _inputs[MAX_BATCH_SIZE];
+static accumulate_buffer_t _outputs[MAX_BATCH_SIZE];
+static oe_enclave_function_call_t _calls[MAX_BATCH_SIZE];
+
+static uint64_t _expected_total(size_t count)
+{
+    return (uint64_t)count * (count + 1) / 2;
+}
+
+static double make_regular_ecalls(oe_enclave_t* enclave)
+{
+    double start, end;
+    uint64_t total = 0;
+
+    start = get_relative_time_in_microseconds();
+    for (uint64_t i = 1; i <= NUM_ECALLS; i++)
+        OE_TEST(enc_accumulate(enclave, i) == OE_OK);
+    end = get_relative_time_in_microseconds();
+
+    OE_TEST(enc_get_total(enclave, &total) == OE_OK);
+    OE_TEST(total == _expected_total(NUM_ECALLS));
+
+    return end - start;
+}
+
+static double make_batched_ecalls(oe_enclave_t* enclave, size_t batch_size)
+{
+    double start, end;
+    uint64_t total = 0;
+    uint64_t value = 1;
+
+    start = get_relative_time_in_microseconds();
+    while (value <= NUM_ECALLS)
+    {
+        size_t n = 0;
+
+        for (; n < batch_size && value <= NUM_ECALLS; n++, value++)
+        {
+            memset(&_inputs[n], 0, sizeof(_inputs[n]));
+            _inputs[n].args.value = value;
+
+            _calls[n].global_id = &_enc_accumulate_global_id;
+            _calls[n].name = "enc_accumulate";
+            _calls[n].input_buffer = &_inputs[n];
+            _calls[n].input_buffer_size = sizeof(_inputs[n]);
+            _calls[n].output_buffer = &_outputs[n];
+            _calls[n].output_buffer_size = sizeof(_outputs[n]);
+        }
+
+        OE_TEST(oe_call_enclave_function_batch(enclave, _calls, n) == OE_OK);
+
+        for (size_t i = 0; i < n; i++)
+        {
+            oe_call_function_return_args_t* return_args =
+                (oe_call_function_return_args_t*)&_outputs[i];
+
+            OE_TEST(_calls[i].result == OE_OK);
+            OE_TEST(return_args->result == OE_OK);
+        }
+    }
+    end = get_relative_time_in_microseconds();
+
+    OE_TEST(enc_get_total(enclave, &total) == OE_OK);
+    OE_TEST(total == _expected_total(NUM_ECALLS));
+
+    return end - start;
+}
+
+static void test_batch_errors(oe_enclave_t* enclave)
+{
+    static uint64_t unknown_global_id = OE_GLOBAL_ECALL_ID_NULL;
+    uint64_t total = 0;
+
+    OE_TEST(
+        oe_call_enclave_function_batch(NULL, _calls, 1) ==
+        OE_INVALID_PARAMETER);
+    OE_TEST(
+        oe_call_enclave_function_batch(enclave, NULL, 1) ==
+        OE_INVALID_PARAMETER);
+    OE_TEST(
+        oe_call_enclave_function_batch(enclave, _calls, 0) ==
+        OE_INVALID_PARAMETER);
+
+    // Unknown function names are rejected before entering the enclave.
+    memset(&_inputs[0], 0, sizeof(_inputs[0]));
+    _calls[0].global_id = &unknown_global_id;
+    _calls[0].name = "enc_does_not_exist";
+    _calls[0].input_buffer = &_inputs[0];
+    _calls[0].input_buffer_size = sizeof(_inputs[0]);
+    _calls[0].output_buffer = &_outputs[0];
+    _calls[0].output_buffer_size = sizeof(_outputs[0]);
+    OE_TEST(oe_call_enclave_function_batch(enclave, _calls, 1) == OE_NOT_FOUND);
+
+    // A call with an invalid buffer fails on its own without affecting the
+    // rest of the batch.
+    for (size_t i = 0; i < 3; i++)
+    {
+        memset(&_inputs[i], 0, sizeof(_inputs[i]));
+        _inputs[i].args.value = 1;
+        _calls[i].global_id = &_enc_accumulate_global_id;
+        _calls[i].name = "enc_accumulate";
+        _calls[i].input_buffer = &_inputs[i];
+        _calls[i].input_buffer_size = sizeof(_inputs[i]);
+        _calls[i].output_buffer = &_outputs[i];
+        _calls[i].output_buffer_size = sizeof(_outputs[i]);
+    }
+    _calls[1].input_buffer_size = sizeof(_inputs[1]) - 1;
+
+    OE_TEST(oe_call_enclave_function_batch(enclave, _calls, 3) == OE_OK);
+    OE_TEST(_calls[0].result == OE_OK);
+    OE_TEST(_calls[1].result == OE_INVALID_PARAMETER);
+    OE_TEST(_calls[2].result == OE_OK);
+
+    OE_TEST(enc_get_total(enclave, &total) == OE_OK);
+    OE_TEST(total == 2);
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+    oe_enclave_t* enclave = NULL;
+    const size_t batch_sizes[] = {1, 8, MAX_BATCH_SIZE};
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s ENCLAVE_PATH\n", argv[0]);
+        return 1;
+    }
+
+#if defined(_WIN32)
+    LARGE_INTEGER freq;
+    QueryPerformanceFrequency(&freq);
+    frequency = (double)freq.QuadPart / 1000000; // convert to microseconds
+#endif
+
+    const uint32_t flags = oe_get_create_flags();
+
+    if ((result = oe_create_ecall_batch_enclave(
+             argv[1], OE_ENCLAVE_TYPE_SGX, flags, NULL, 0, &enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    test_batch_errors(enclave);
+
+    // Measure one-call-per-entry performance.
+    double regular_microseconds = make_regular_ecalls(enclave);
+    printf(
+        "%d regular ECALLs took %d milliseconds (%.0f calls/sec)\n",
+        NUM_ECALLS,
+        (int)(regular_microseconds / 1000),
+        NUM_ECALLS / (regular_microseconds / 1000000));
+
+    // Measure batched performance.
+    for (size_t i = 0; i < OE_COUNTOF(batch_sizes); i++)
+    {
+        double batch_microseconds =
+            make_batched_ecalls(enclave, batch_sizes[i]);
+        printf(
+            "%d batched ECALLs (batch size %d) took %d milliseconds "
+            "(%.0f calls/sec, speedup factor %.2f)\n",
+            NUM_ECALLS,
+            (int)batch_sizes[i],
+            (int)(batch_microseconds / 1000),
+            NUM_ECALLS / (batch_microseconds / 1000000),
+            regular_microseconds / batch_microseconds);
+    }
+
+    result = oe_terminate_enclave(enclave);
+    OE_TEST(result == OE_OK);
+
+    printf("=== passed all tests (ecall_batch)\n");
+
+    return 0;
+}
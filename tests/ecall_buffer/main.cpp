@@ -0,0 +1,74 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/edger8r/host.h>
+#include <openenclave/host.h>
+#include <openenclave/internal/tests.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#define NUM_THREADS 8
+
+static void _test_pool(void)
+{
+    void* buffers[4];
+
+    // Buffers are suitably aligned for marshalling structures.
+    for (size_t i = 0; i < OE_COUNTOF(buffers); i++)
+    {
+        buffers[i] = oe_allocate_ecall_buffer(48 * (i + 1));
+        OE_TEST(buffers[i] != NULL);
+        OE_TEST((uintptr_t)buffers[i] % OE_EDGER8R_BUFFER_ALIGNMENT == 0);
+    }
+
+    // A freed buffer is reused by the next allocation of the same size class.
+    oe_free_ecall_buffer(buffers[0]);
+    OE_TEST(oe_allocate_ecall_buffer(48) == buffers[0]);
+
+    for (size_t i = 0; i < OE_COUNTOF(buffers); i++)
+        oe_free_ecall_buffer(buffers[i]);
+
+    // Large buffers are not pooled but remain usable.
+    buffers[0] = oe_allocate_ecall_buffer(1024 * 1024);
+    OE_TEST(buffers[0] != NULL);
+    memset(buffers[0], 0, 1024 * 1024);
+    oe_free_ecall_buffer(buffers[0]);
+
+    oe_free_ecall_buffer(NULL);
+}
+
+static void _test_threads(void)
+{
+    std::thread threads[NUM_THREADS];
+    void* buffers[NUM_THREADS];
+
+    // Each thread has its own pool, which is freed when the thread exits.
+    for (size_t i = 0; i < NUM_THREADS; i++)
+        threads[i] = std::thread(_test_pool);
+
+    for (size_t i = 0; i < NUM_THREADS; i++)
+        threads[i].join();
+
+    // A buffer may be freed by another thread than the one that allocated it,
+    // and then goes to the pool of that thread.
+    for (size_t i = 0; i < NUM_THREADS; i++)
+        OE_TEST((buffers[i] = oe_allocate_ecall_buffer(256)) != NULL);
+
+    for (size_t i = 0; i < NUM_THREADS; i++)
+    {
+        threads[i] = std::thread(oe_free_ecall_buffer, buffers[i]);
+        threads[i].join();
+    }
+}
+
+int main()
+{
+    _test_pool();
+    _test_threads();
+
+    printf("=== passed all tests (ecall_buffer)\n");
+
+    return 0;
+}
@@ -0,0 +1,35 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/tests.h>
+#include "ecall_threads_t.h"
+
+uint64_t enc_increment(uint64_t value)
+{
+    return value + 1;
+}
+
+uint64_t enc_nested(uint64_t depth)
+{
+    uint64_t result = 0;
+
+    if (depth == 0)
+        return 0;
+
+    OE_TEST(host_nested(&result, depth - 1) == OE_OK);
+    return result + 1;
+}
+
+void enc_cross_nested()
+{
+    OE_TEST(host_cross_nested() == OE_OK);
+}
+
+OE_SET_ENCLAVE_SGX(
+    1,                             /* ProductID */
+    1,                             /* SecurityVersion */
+    true,                          /* Debug */
+    OE_TEST_MT_HEAP_SIZE(NUM_TCS), /* NumHeapPages */
+    16,                            /* NumStackPages */
+    NUM_TCS);                      /* NumTCS */
@@ -0,0 +1,174 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "ecall_threads_u.h"
+
+using namespace std;
+
+extern "C" void test_tcs_index(const char* path, uint32_t flags);
+
+/*
+ * Measures the throughput of regular ECALLs made concurrently by a growing
+ * number of host threads. Each ECALL binds the calling thread to a free TCS
+ * and releases it on return, so this stresses the host-side TCS binding pool.
+ * With more host threads than TCSs, some ECALLs fail with OE_OUT_OF_THREADS
+ * and are retried.
+ */
+
+// Increase the number of calls to have a meaningful performance measurement
+#define NUM_ECALLS_PER_THREAD (20000)
+
+// Deep enough to go from the first enclave through the second one and back
+#define NESTING_DEPTH (2)
+
+static const size_t _thread_counts[] = {1, 2, 4, 8, 16, 32, 64};
+
+static oe_enclave_t* _enclaves[2];
+static oe_result_t _nested_results[NESTING_DEPTH];
+
+uint64_t host_nested(uint64_t depth)
+{
+    uint64_t result = 0;
+
+    // Alternate between the enclaves. An enclave rejects an ECALL from a
+    // thread that is in one of its OCALLs, so the chain stops at the first
+    // ECALL into an enclave that the thread is already in.
+    _nested_results[depth] =
+        enc_nested(_enclaves[depth % 2], &result, depth);
+    return result;
+}
+
+void host_cross_nested()
+{
+    uint64_t value = 0;
+
+    // The ECALL into the other enclave returns before the thread tries to
+    // re-enter the first enclave. The host must still find the binding of
+    // the thread, so that the ECALL reaches the TCS of the outer one, which
+    // rejects it, instead of running on another TCS.
+    OE_TEST(enc_increment(_enclaves[1], &value, 1) == OE_OK);
+    OE_TEST(value == 2);
+    OE_TEST(enc_increment(_enclaves[0], &value, 1) == OE_REENTRANT_ECALL);
+}
+
+static void _make_ecalls(oe_enclave_t* enclave, atomic<uint64_t>* retries)
+{
+    for (uint64_t i = 0; i < NUM_ECALLS_PER_THREAD; i++)
+    {
+        uint64_t value = 0;
+        oe_result_t result;
+
+        while ((result = enc_increment(enclave, &value, i)) ==
+               OE_OUT_OF_THREADS)
+        {
+            (*retries)++;
+            this_thread::yield();
+        }
+
+        OE_TEST(result == OE_OK);
+        OE_TEST(value == i + 1);
+    }
+}
+
+static void _run_workload(oe_enclave_t* enclave, size_t num_threads)
+{
+    vector<thread> threads;
+    atomic<uint64_t> retries(0);
+
+    auto start = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < num_threads; i++)
+        threads.push_back(thread(_make_ecalls, enclave, &retries));
+
+    for (size_t i = 0; i < num_threads; i++)
+        threads[i].join();
+
+    double seconds =
+        chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double num_calls = (double)(num_threads * NUM_ECALLS_PER_THREAD);
+
+    printf(
+        "threads=%2d calls=%8d time=%8.1fms throughput=%10.0f calls/sec "
+        "retries=%d\n",
+        (int)num_threads,
+        (int)num_calls,
+        seconds * 1000,
+        num_calls / seconds,
+        (int)retries.load());
+}
+
+static void _test_nested_ecalls(const char* path, uint32_t flags)
+{
+    uint64_t result = 0;
+
+    // A nested ECALL into the same enclave is rejected. The outer ECALL
+    // still returns.
+    OE_TEST(enc_nested(_enclaves[0], &result, 1) == OE_OK);
+    OE_TEST(result == 1);
+    OE_TEST(_nested_results[0] == OE_REENTRANT_ECALL);
+
+    // A nested ECALL into another enclave runs, but the ECALL that it nests
+    // back into the first enclave is rejected, even though the thread-specific
+    // binding refers to the other enclave.
+    OE_TEST(
+        oe_create_ecall_threads_enclave(
+            path, OE_ENCLAVE_TYPE_SGX, flags, NULL, 0, &_enclaves[1]) ==
+        OE_OK);
+
+    OE_TEST(enc_nested(_enclaves[0], &result, NESTING_DEPTH) == OE_OK);
+    OE_TEST(result == NESTING_DEPTH);
+    OE_TEST(_nested_results[1] == OE_OK);
+    OE_TEST(_nested_results[0] == OE_REENTRANT_ECALL);
+
+    // So is an ECALL into the first enclave made after the nested ECALL into
+    // the other one returned.
+    OE_TEST(enc_cross_nested(_enclaves[0]) == OE_OK);
+
+    // The rejected ECALLs released the TCSs that they found.
+    OE_TEST(enc_increment(_enclaves[0], &result, 1) == OE_OK);
+    OE_TEST(result == 2);
+
+    OE_TEST(oe_terminate_enclave(_enclaves[1]) == OE_OK);
+    _enclaves[1] = NULL;
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s ENCLAVE\n", argv[0]);
+        exit(1);
+    }
+
+    // The binding pool lives on the host, so the benchmark does not require
+    // SGX hardware.
+    const uint32_t flags = oe_get_create_flags() | OE_ENCLAVE_FLAG_SIMULATE;
+
+    if ((result = oe_create_ecall_threads_enclave(
+             argv[1], OE_ENCLAVE_TYPE_SGX, flags, NULL, 0, &_enclaves[0])) !=
+        OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    _test_nested_ecalls(argv[1], flags);
+    test_tcs_index(argv[1], flags);
+
+    for (size_t i = 0; i < OE_COUNTOF(_thread_counts); i++)
+        _run_workload(_enclaves[0], _thread_counts[i]);
+
+    OE_TEST(oe_terminate_enclave(_enclaves[0]) == OE_OK);
+
+    printf("=== passed all tests (ecall_threads)\n");
+
+    return 0;
+}
@@ -0,0 +1,81 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/tests.h>
+#include "../../../host/sgx/enclave.h"
+#include "ecall_threads_u.h"
+
+/*
+ * Checks that oe_query_enclave_instance() finds the enclave of every TCS
+ * through the TCS index while enclaves are created and terminated. The
+ * enclaves have more TCSs in total than the initial capacity of the index,
+ * so the index is rebuilt.
+ */
+
+#define NUM_ENCLAVES 4
+
+static void _check_enclave(oe_enclave_t* enclave)
+{
+    for (size_t i = 0; i < enclave->num_bindings; i++)
+        OE_TEST(
+            oe_query_enclave_instance((void*)enclave->bindings[i].tcs) ==
+            enclave);
+
+    // Addresses inside the enclave that are not TCSs are not indexed.
+    OE_TEST(
+        oe_query_enclave_instance((void*)(enclave->bindings[0].tcs + 1)) ==
+        NULL);
+}
+
+void test_tcs_index(const char* path, uint32_t flags)
+{
+    oe_enclave_t* enclaves[NUM_ENCLAVES] = {NULL};
+    uint64_t terminated_tcs[OE_SGX_MAX_TCS];
+    size_t num_terminated = 0;
+
+    for (size_t i = 0; i < NUM_ENCLAVES; i++)
+        OE_TEST(
+            oe_create_ecall_threads_enclave(
+                path, OE_ENCLAVE_TYPE_SGX, flags, NULL, 0, &enclaves[i]) ==
+            OE_OK);
+
+    for (size_t i = 0; i < NUM_ENCLAVES; i++)
+        _check_enclave(enclaves[i]);
+
+    OE_TEST(oe_query_enclave_instance(NULL) == NULL);
+
+    // Remove an enclave from the middle of the index.
+    for (size_t i = 0; i < enclaves[1]->num_bindings; i++)
+        terminated_tcs[num_terminated++] = enclaves[1]->bindings[i].tcs;
+
+    OE_TEST(oe_terminate_enclave(enclaves[1]) == OE_OK);
+    enclaves[1] = NULL;
+
+    for (size_t i = 0; i < NUM_ENCLAVES; i++)
+    {
+        if (enclaves[i])
+            _check_enclave(enclaves[i]);
+    }
+
+    // The TCSs of the terminated enclave are gone from the index.
+    for (size_t i = 0; i < num_terminated; i++)
+        OE_TEST(oe_query_enclave_instance((void*)terminated_tcs[i]) == NULL);
+
+    // A new enclave may reuse the address range of the terminated one and
+    // the removed entries of the index.
+    OE_TEST(
+        oe_create_ecall_threads_enclave(
+            path, OE_ENCLAVE_TYPE_SGX, flags, NULL, 0, &enclaves[1]) == OE_OK);
+
+    for (size_t i = 0; i < NUM_ENCLAVES; i++)
+        _check_enclave(enclaves[i]);
+
+    for (size_t i = 0; i < NUM_ENCLAVES; i++)
+    {
+        uint64_t tcs = enclaves[i]->bindings[0].tcs;
+
+        OE_TEST(oe_terminate_enclave(enclaves[i]) == OE_OK);
+        OE_TEST(oe_query_enclave_instance((void*)tcs) == NULL);
+    }
+}
@@ -42,6 +42,9 @@ void enc_edl_opt_out()
     OE_TEST(oe_sgx_sleep_switchless_worker_ocall(NULL) == OE_UNSUPPORTED);
     OE_TEST(oe_sgx_wake_switchless_worker_ocall(NULL) == OE_UNSUPPORTED);
 
+    /* sgx/thread.edl */
+    OE_TEST(oe_sgx_thread_wake_multiple_ocall(NULL, NULL, 0) == OE_UNSUPPORTED);
+
     /* sgx/attestation */
     {
         oe_result_t result = OE_OK;
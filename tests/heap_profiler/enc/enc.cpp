@@ -0,0 +1,40 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/tests.h>
+#include <stdlib.h>
+#include <vector>
+#include "heap_profiler_t.h"
+
+static std::vector<void*> _blocks;
+
+void enc_allocate(uint64_t count, uint64_t size)
+{
+    _blocks.reserve(_blocks.size() + count);
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        void* block = malloc(size);
+        OE_TEST(block != NULL);
+        _blocks.push_back(block);
+    }
+}
+
+void enc_free_all()
+{
+    for (void* block : _blocks)
+        free(block);
+
+    std::vector<void*>().swap(_blocks);
+}
+
+OE_ALLOW_HEAP_PROFILER();
+
+OE_SET_ENCLAVE_SGX(
+    1,    /* ProductID */
+    1,    /* SecurityVersion */
+    true, /* Debug */
+    8192, /* NumHeapPages */
+    64,   /* NumStackPages */
+    2);   /* NumTCS */
@@ -0,0 +1,226 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "heap_profiler_u.h"
+
+/*
+ * Samples the allocations of an enclave with the
+ * OE_ENCLAVE_SETTING_HEAP_PROFILER setting and checks the estimates of the
+ * pprof profiles returned by oe_get_heap_profile().
+ */
+
+#define SAMPLE_INTERVAL (32 * 1024)
+#define NUM_BLOCKS 2048
+#define BLOCK_SIZE (8 * 1024)
+
+struct profile_t
+{
+    std::vector<std::string> strings;
+    uint64_t num_samples;
+    int64_t inuse_objects;
+    int64_t inuse_space;
+    int64_t period;
+};
+
+static uint64_t _read_varint(const uint8_t*& p, const uint8_t* end)
+{
+    uint64_t value = 0;
+
+    for (int shift = 0; p < end && shift < 64; shift += 7)
+    {
+        uint8_t byte = *p++;
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+
+    OE_TEST("truncated varint" == NULL);
+    return 0;
+}
+
+/* Call f(field, value, data, size) for each field of a protocol buffer
+ * message. Varint fields have a value, length-delimited fields data */
+template <typename F>
+static void _for_each_field(const uint8_t* p, const uint8_t* end, F f)
+{
+    while (p < end)
+    {
+        uint64_t key = _read_varint(p, end);
+        uint64_t value = 0;
+        const uint8_t* data = NULL;
+
+        if ((key & 7) == 0)
+        {
+            value = _read_varint(p, end);
+        }
+        else
+        {
+            OE_TEST((key & 7) == 2);
+            value = _read_varint(p, end);
+            OE_TEST(value <= (uint64_t)(end - p));
+            data = p;
+            p += value;
+        }
+
+        f(key >> 3, value, data);
+    }
+}
+
+/* Add the values of a sample to the totals of the profile */
+static void _decode_sample(const uint8_t* data, size_t size, profile_t& profile)
+{
+    auto f = [&](uint64_t field, uint64_t value, const uint8_t* p) {
+        const uint8_t* end = p + value;
+
+        if (field != 2) // value (packed)
+            return;
+
+        profile.inuse_objects += (int64_t)_read_varint(p, end);
+        profile.inuse_space += (int64_t)_read_varint(p, end);
+        OE_TEST(p == end);
+    };
+
+    profile.num_samples++;
+    _for_each_field(data, data + size, f);
+}
+
+/* Decode the fields of a pprof profile that the test checks */
+static profile_t _decode_profile(const uint8_t* data, size_t size)
+{
+    profile_t profile = {};
+
+    auto f = [&](uint64_t field, uint64_t value, const uint8_t* p) {
+        if (field == 2) // sample
+            _decode_sample(p, value, profile);
+        else if (field == 6) // string_table
+            profile.strings.push_back(std::string((const char*)p, value));
+        else if (field == 12) // period
+            profile.period = (int64_t)value;
+    };
+
+    _for_each_field(data, data + size, f);
+
+    return profile;
+}
+
+static profile_t _get_profile(oe_enclave_t* enclave)
+{
+    uint8_t* data = NULL;
+    size_t size = 0;
+    profile_t profile;
+
+    OE_TEST(oe_get_heap_profile(enclave, &data, &size) == OE_OK);
+    OE_TEST(data != NULL && size > 0);
+    profile = _decode_profile(data, size);
+    oe_free_heap_profile(data);
+
+    return profile;
+}
+
+static void _test_profile(oe_enclave_t* enclave)
+{
+    const int64_t total = (int64_t)NUM_BLOCKS * BLOCK_SIZE;
+    profile_t before = _get_profile(enclave);
+
+    OE_TEST(before.period == SAMPLE_INTERVAL);
+    OE_TEST(before.strings.size() > 4);
+    OE_TEST(before.strings[0].empty());
+    OE_TEST(before.strings[1] == "inuse_objects");
+    OE_TEST(before.strings[3] == "inuse_space");
+
+    OE_TEST(enc_allocate(enclave, NUM_BLOCKS, BLOCK_SIZE) == OE_OK);
+
+    // About total / SAMPLE_INTERVAL = 512 samples, so the estimates are
+    // within a few percent of the truth.
+    profile_t during = _get_profile(enclave);
+    int64_t space = during.inuse_space - before.inuse_space;
+    int64_t objects = during.inuse_objects - before.inuse_objects;
+
+    printf(
+        "%llu samples: %lld bytes in %lld blocks (actual %lld in %d)\n",
+        (unsigned long long)during.num_samples,
+        (long long)space,
+        (long long)objects,
+        (long long)total,
+        NUM_BLOCKS);
+
+    OE_TEST(during.num_samples > before.num_samples);
+    OE_TEST(space > total * 3 / 4 && space < total * 5 / 4);
+    OE_TEST(objects > NUM_BLOCKS * 3 / 4 && objects < NUM_BLOCKS * 5 / 4);
+
+    // The samples go away with the blocks.
+    OE_TEST(enc_free_all(enclave) == OE_OK);
+
+    profile_t after = _get_profile(enclave);
+    OE_TEST(after.inuse_space < total / 4);
+}
+
+static void _test_not_enabled(const char* path)
+{
+    oe_enclave_t* enclave = NULL;
+    uint8_t* data = NULL;
+    size_t size = 0;
+
+    OE_TEST(
+        oe_create_heap_profiler_enclave(
+            path,
+            OE_ENCLAVE_TYPE_SGX,
+            oe_get_create_flags(),
+            NULL,
+            0,
+            &enclave) == OE_OK);
+
+    OE_TEST(oe_get_heap_profile(enclave, &data, &size) == OE_UNSUPPORTED);
+    OE_TEST(data == NULL && size == 0);
+
+    OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+    oe_enclave_t* enclave = NULL;
+    oe_enclave_setting_heap_profiler_t heap_profiler_setting = {
+        SAMPLE_INTERVAL, 4096};
+    oe_enclave_setting_t setting;
+    uint8_t* data = NULL;
+    size_t size = 0;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s ENCLAVE_PATH\n", argv[0]);
+        return 1;
+    }
+
+    setting.setting_type = OE_ENCLAVE_SETTING_HEAP_PROFILER;
+    setting.u.heap_profiler_setting = &heap_profiler_setting;
+
+    if ((result = oe_create_heap_profiler_enclave(
+             argv[1],
+             OE_ENCLAVE_TYPE_SGX,
+             oe_get_create_flags(),
+             &setting,
+             1,
+             &enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    OE_TEST(oe_get_heap_profile(NULL, &data, &size) == OE_INVALID_PARAMETER);
+    OE_TEST(oe_get_heap_profile(enclave, NULL, &size) == OE_INVALID_PARAMETER);
+
+    _test_profile(enclave);
+
+    OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+
+    _test_not_enabled(argv[1]);
+
+    printf("=== passed all tests (heap_profiler)\n");
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/tests.h>
+#include <stdlib.h>
+#include <vector>
+#include "heap_statistics_t.h"
+
+#define MAX_NESTED_BLOCKS 1024
+
+static std::vector<void*> _blocks;
+static void* _nested_blocks[MAX_NESTED_BLOCKS];
+
+void enc_allocate(uint64_t count, uint64_t size)
+{
+    _blocks.reserve(_blocks.size() + count);
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        void* block = malloc(size);
+        OE_TEST(block != NULL);
+        _blocks.push_back(block);
+    }
+}
+
+void enc_free_all()
+{
+    for (void* block : _blocks)
+        free(block);
+
+    std::vector<void*>().swap(_blocks);
+}
+
+void enc_nested(uint64_t count, uint64_t size)
+{
+    OE_TEST(count <= MAX_NESTED_BLOCKS);
+    OE_TEST(host_nested(count, size) == OE_OK);
+
+    for (uint64_t i = 0; i < count; i++)
+    {
+        _nested_blocks[i] = malloc(size);
+        OE_TEST(_nested_blocks[i] != NULL);
+    }
+
+    for (uint64_t i = 0; i < count; i++)
+        free(_nested_blocks[i]);
+}
+
+OE_SET_ENCLAVE_SGX(
+    1,    /* ProductID */
+    1,    /* SecurityVersion */
+    true, /* Debug */
+    1024, /* NumHeapPages */
+    64,   /* NumStackPages */
+    2);   /* NumTCS */
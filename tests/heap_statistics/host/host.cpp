@@ -0,0 +1,258 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <cstdio>
+#include "heap_statistics_u.h"
+
+/*
+ * Checks the heap usage by thread and by ECALL returned by
+ * oe_get_heap_statistics(), including the attribution of nested ECALLs, and
+ * that nothing is counted without the OE_ENCLAVE_SETTING_HEAP_STATISTICS
+ * setting.
+ */
+
+#define NUM_BLOCKS 512
+#define BLOCK_SIZE 1000
+#define NUM_TCS 2
+
+static oe_enclave_t* _enclave;
+static bool _nested_called;
+
+struct totals_t
+{
+    uint64_t allocations;
+    uint64_t frees;
+    uint64_t bytes_allocated;
+    uint64_t bytes_freed;
+};
+
+static oe_heap_statistics_t* _get_statistics()
+{
+    oe_heap_statistics_t* statistics = NULL;
+
+    OE_TEST(oe_get_heap_statistics(_enclave, &statistics) == OE_OK);
+    OE_TEST(statistics != NULL);
+    OE_TEST(statistics->num_threads <= NUM_TCS);
+
+    for (size_t i = 0; i < statistics->num_threads; i++)
+    {
+        const oe_heap_thread_statistics_t* thread = &statistics->threads[i];
+
+        OE_TEST(thread->tcs_index < NUM_TCS);
+        OE_TEST(
+            i == 0 || thread->tcs_index > statistics->threads[i - 1].tcs_index);
+        OE_TEST(
+            thread->bytes_in_flight ==
+            (int64_t)(thread->bytes_allocated - thread->bytes_freed));
+        OE_TEST(
+            thread->bytes_in_flight <= (int64_t)thread->peak_bytes_in_flight);
+    }
+
+    for (size_t i = 1; i < statistics->num_ecalls; i++)
+        OE_TEST(
+            statistics->ecalls[i].function_id >
+            statistics->ecalls[i - 1].function_id);
+
+    return statistics;
+}
+
+static totals_t _get_thread_totals(const oe_heap_statistics_t* statistics)
+{
+    totals_t totals = {};
+
+    for (size_t i = 0; i < statistics->num_threads; i++)
+    {
+        totals.allocations += statistics->threads[i].allocations;
+        totals.frees += statistics->threads[i].frees;
+        totals.bytes_allocated += statistics->threads[i].bytes_allocated;
+        totals.bytes_freed += statistics->threads[i].bytes_freed;
+    }
+
+    return totals;
+}
+
+static oe_heap_ecall_statistics_t _get_ecall(
+    const oe_heap_statistics_t* statistics,
+    uint64_t function_id)
+{
+    oe_heap_ecall_statistics_t ecall = {};
+
+    ecall.function_id = function_id;
+
+    for (size_t i = 0; i < statistics->num_ecalls; i++)
+    {
+        if (statistics->ecalls[i].function_id == function_id)
+            ecall = statistics->ecalls[i];
+    }
+
+    return ecall;
+}
+
+/* The statistics count the usable size of the blocks, which is at least the
+ * requested size */
+static bool _is_block_bytes(uint64_t bytes, uint64_t num_blocks)
+{
+    return bytes >= num_blocks * BLOCK_SIZE &&
+           bytes < num_blocks * BLOCK_SIZE * 2;
+}
+
+void host_nested(uint64_t count, uint64_t size)
+{
+    oe_heap_statistics_t* statistics = _get_statistics();
+    size_t num_in_ecall = 0;
+
+    // The thread that makes this OCALL runs enc_nested().
+    for (size_t i = 0; i < statistics->num_threads; i++)
+    {
+        if (statistics->threads[i].ecall_function_id ==
+            heap_statistics_fcn_id_enc_nested)
+            num_in_ecall++;
+        else
+            OE_TEST(
+                statistics->threads[i].ecall_function_id ==
+                OE_HEAP_STATISTICS_NO_ECALL);
+    }
+
+    OE_TEST(num_in_ecall == 1);
+    oe_free_heap_statistics(statistics);
+
+    OE_TEST(enc_allocate(_enclave, count, size) == OE_OK);
+    _nested_called = true;
+}
+
+static void _test_statistics()
+{
+    oe_heap_statistics_t* before = _get_statistics();
+    oe_heap_statistics_t* allocated = NULL;
+    oe_heap_statistics_t* freed = NULL;
+    oe_heap_statistics_t* nested = NULL;
+    totals_t totals_before = _get_thread_totals(before);
+    totals_t totals = {};
+    oe_heap_ecall_statistics_t ecall = {};
+
+    // The threads and the ECALL count the blocks of enc_allocate(), plus
+    // the buffer of the vector that holds them.
+    OE_TEST(enc_allocate(_enclave, NUM_BLOCKS, BLOCK_SIZE) == OE_OK);
+    allocated = _get_statistics();
+    totals = _get_thread_totals(allocated);
+
+    OE_TEST(totals.allocations - totals_before.allocations >= NUM_BLOCKS + 1);
+    OE_TEST(
+        totals.bytes_allocated - totals_before.bytes_allocated >=
+        NUM_BLOCKS * BLOCK_SIZE);
+
+    ecall = _get_ecall(allocated, heap_statistics_fcn_id_enc_allocate);
+    OE_TEST(ecall.calls == 1);
+    OE_TEST(ecall.allocations == NUM_BLOCKS + 1);
+    OE_TEST(ecall.frees == 0);
+    OE_TEST(_is_block_bytes(ecall.bytes_allocated, NUM_BLOCKS + 1));
+
+    for (size_t i = 0; i < allocated->num_threads; i++)
+        OE_TEST(
+            allocated->threads[i].ecall_function_id ==
+            OE_HEAP_STATISTICS_NO_ECALL);
+
+    OE_TEST(enc_free_all(_enclave) == OE_OK);
+    freed = _get_statistics();
+
+    ecall = _get_ecall(freed, heap_statistics_fcn_id_enc_free_all);
+    OE_TEST(ecall.calls == 1);
+    OE_TEST(ecall.allocations == 0);
+    OE_TEST(ecall.frees == NUM_BLOCKS + 1);
+    OE_TEST(_is_block_bytes(ecall.bytes_freed, NUM_BLOCKS + 1));
+
+    // The nested enc_allocate() is attributed its blocks, and enc_nested()
+    // only those that it allocates itself, plus the buffer of the arguments
+    // of the nested ECALL.
+    OE_TEST(enc_nested(_enclave, NUM_BLOCKS, BLOCK_SIZE) == OE_OK);
+    OE_TEST(_nested_called);
+    nested = _get_statistics();
+
+    ecall = _get_ecall(nested, heap_statistics_fcn_id_enc_allocate);
+    OE_TEST(ecall.calls == 2);
+    OE_TEST(ecall.allocations == 2 * (NUM_BLOCKS + 1));
+
+    ecall = _get_ecall(nested, heap_statistics_fcn_id_enc_nested);
+    OE_TEST(ecall.calls == 1);
+    OE_TEST(ecall.allocations >= NUM_BLOCKS);
+    OE_TEST(ecall.allocations < 2 * NUM_BLOCKS);
+    OE_TEST(ecall.frees >= NUM_BLOCKS);
+    OE_TEST(ecall.frees < 2 * NUM_BLOCKS);
+    OE_TEST(_is_block_bytes(ecall.bytes_allocated, NUM_BLOCKS));
+    OE_TEST(_is_block_bytes(ecall.bytes_freed, NUM_BLOCKS));
+
+    OE_TEST(enc_free_all(_enclave) == OE_OK);
+
+    oe_free_heap_statistics(before);
+    oe_free_heap_statistics(allocated);
+    oe_free_heap_statistics(freed);
+    oe_free_heap_statistics(nested);
+}
+
+/* Without the setting, the enclave does not count its allocations */
+static void _test_disabled(const char* path)
+{
+    oe_heap_statistics_t* statistics = NULL;
+
+    OE_TEST(
+        oe_create_heap_statistics_enclave(
+            path,
+            OE_ENCLAVE_TYPE_SGX,
+            oe_get_create_flags(),
+            NULL,
+            0,
+            &_enclave) == OE_OK);
+
+    OE_TEST(enc_allocate(_enclave, NUM_BLOCKS, BLOCK_SIZE) == OE_OK);
+    OE_TEST(enc_free_all(_enclave) == OE_OK);
+
+    statistics = _get_statistics();
+    OE_TEST(statistics->num_threads == 0);
+    OE_TEST(statistics->num_ecalls == 0);
+    oe_free_heap_statistics(statistics);
+
+    OE_TEST(oe_terminate_enclave(_enclave) == OE_OK);
+    _enclave = NULL;
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+    oe_heap_statistics_t* statistics = NULL;
+    oe_enclave_setting_heap_statistics_t heap_statistics_setting = {true};
+    oe_enclave_setting_t setting;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s ENCLAVE_PATH\n", argv[0]);
+        return 1;
+    }
+
+    _test_disabled(argv[1]);
+
+    setting.setting_type = OE_ENCLAVE_SETTING_HEAP_STATISTICS;
+    setting.u.heap_statistics_setting = &heap_statistics_setting;
+
+    if ((result = oe_create_heap_statistics_enclave(
+             argv[1],
+             OE_ENCLAVE_TYPE_SGX,
+             oe_get_create_flags(),
+             &setting,
+             1,
+             &_enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    OE_TEST(oe_get_heap_statistics(NULL, &statistics) == OE_INVALID_PARAMETER);
+    OE_TEST(oe_get_heap_statistics(_enclave, NULL) == OE_INVALID_PARAMETER);
+
+    _test_statistics();
+
+    OE_TEST(oe_terminate_enclave(_enclave) == OE_OK);
+
+    printf("=== passed all tests (heap_statistics)\n");
+
+    return 0;
+}
@@ -0,0 +1,144 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/malloc.h>
+#include <openenclave/internal/tests.h>
+#include <stdlib.h>
+#include "heap_watermark_t.h"
+
+#define BLOCK_SIZE (64 * 1024)
+#define MAX_BLOCKS 256
+#define MAX_EVENTS 16
+
+struct event_t
+{
+    uint32_t percent;
+    bool exceeded;
+};
+
+static const uint32_t _percents[] = {25, 50};
+static void* _blocks[MAX_BLOCKS];
+static event_t _events[MAX_EVENTS];
+static size_t _num_events;
+static int _arg;
+
+static void _callback(
+    uint32_t percent,
+    bool exceeded,
+    size_t heap_used,
+    size_t heap_size,
+    void* arg)
+{
+    OE_TEST(arg == &_arg);
+    OE_TEST(heap_size > 0);
+    OE_TEST(_num_events < MAX_EVENTS);
+
+    // The heap usage only changes when the heap grows or shrinks, which may
+    // have happened again before the notification.
+    OE_TEST(heap_used <= heap_size);
+
+    _events[_num_events].percent = percent;
+    _events[_num_events].exceeded = exceeded;
+    _num_events++;
+}
+
+static bool _exceeded(uint32_t percent)
+{
+    bool exceeded = false;
+
+    for (size_t i = 0; i < _num_events; i++)
+    {
+        if (_events[i].percent == percent)
+            exceeded = _events[i].exceeded;
+    }
+
+    return exceeded;
+}
+
+void enc_test_parameters()
+{
+    // Above the heap usage of the enclave, so that none is notified.
+    const uint32_t too_many[OE_MAX_HEAP_WATERMARKS + 1] = {
+        60, 65, 70, 75, 80, 85, 90, 95, 100};
+    const uint32_t zero[] = {0, 50};
+    const uint32_t over[] = {50, 101};
+    const uint32_t decreasing[] = {50, 25};
+    const uint32_t equal[] = {50, 50};
+
+    OE_TEST(
+        oe_set_heap_watermarks(too_many, OE_COUNTOF(too_many), NULL, NULL) ==
+        OE_INVALID_PARAMETER);
+    OE_TEST(
+        oe_set_heap_watermarks(zero, OE_COUNTOF(zero), NULL, NULL) ==
+        OE_INVALID_PARAMETER);
+    OE_TEST(
+        oe_set_heap_watermarks(over, OE_COUNTOF(over), NULL, NULL) ==
+        OE_INVALID_PARAMETER);
+    OE_TEST(
+        oe_set_heap_watermarks(
+            decreasing, OE_COUNTOF(decreasing), NULL, NULL) ==
+        OE_INVALID_PARAMETER);
+    OE_TEST(
+        oe_set_heap_watermarks(equal, OE_COUNTOF(equal), NULL, NULL) ==
+        OE_INVALID_PARAMETER);
+    OE_TEST(
+        oe_set_heap_watermarks(NULL, 1, NULL, NULL) == OE_INVALID_PARAMETER);
+
+    OE_TEST(
+        oe_set_heap_watermarks(too_many, OE_MAX_HEAP_WATERMARKS, NULL, NULL) ==
+        OE_OK);
+    OE_TEST(oe_set_heap_watermarks(NULL, 0, NULL, NULL) == OE_OK);
+}
+
+size_t enc_test_watermarks()
+{
+    size_t num_blocks = 0;
+
+    OE_TEST(
+        oe_set_heap_watermarks(
+            _percents, OE_COUNTOF(_percents), _callback, &_arg) == OE_OK);
+    OE_TEST(_num_events == 0);
+
+    // Grow the heap past the last watermark. The crossings are not delivered
+    // from malloc(), but when they are polled.
+    while (!_exceeded(50))
+    {
+        size_t num_events = _num_events;
+
+        OE_TEST(num_blocks < MAX_BLOCKS);
+        _blocks[num_blocks] = malloc(BLOCK_SIZE);
+        OE_TEST(_blocks[num_blocks] != NULL);
+        num_blocks++;
+
+        OE_TEST(_num_events == num_events);
+        oe_poll_heap_watermarks();
+    }
+
+    OE_TEST(_num_events == 2);
+    OE_TEST(_events[0].percent == 25 && _events[0].exceeded);
+    OE_TEST(_events[1].percent == 50 && _events[1].exceeded);
+
+    // The allocator gives the free space at the top of the heap back, so the
+    // heap usage falls below the watermarks in reverse order.
+    for (size_t i = 0; i < num_blocks; i++)
+        free(_blocks[i]);
+
+    OE_TEST(_num_events == 2);
+    oe_poll_heap_watermarks();
+    OE_TEST(_num_events == 4);
+    OE_TEST(_events[2].percent == 50 && !_events[2].exceeded);
+    OE_TEST(_events[3].percent == 25 && !_events[3].exceeded);
+
+    OE_TEST(oe_set_heap_watermarks(NULL, 0, NULL, NULL) == OE_OK);
+
+    return _num_events;
+}
+
+OE_SET_ENCLAVE_SGX(
+    1,    /* ProductID */
+    1,    /* SecurityVersion */
+    true, /* Debug */
+    2048, /* NumHeapPages */
+    64,   /* NumStackPages */
+    1);   /* NumTCS */
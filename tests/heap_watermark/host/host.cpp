@@ -0,0 +1,85 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <cstdio>
+#include "heap_watermark_u.h"
+
+/*
+ * Checks that the heap watermarks of the enclave are notified to the enclave
+ * and, with OE_ENCLAVE_SETTING_HEAP_WATERMARK, to the host.
+ */
+
+#define MAX_EVENTS 16
+
+struct event_t
+{
+    uint32_t percent;
+    bool exceeded;
+};
+
+static oe_enclave_t* _enclave;
+static event_t _events[MAX_EVENTS];
+static size_t _num_events;
+static int _context;
+
+static void _callback(
+    oe_enclave_t* enclave,
+    uint32_t percent,
+    bool exceeded,
+    void* context)
+{
+    OE_TEST(enclave == _enclave);
+    OE_TEST(context == &_context);
+    OE_TEST(_num_events < MAX_EVENTS);
+
+    _events[_num_events].percent = percent;
+    _events[_num_events].exceeded = exceeded;
+    _num_events++;
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+    oe_enclave_setting_heap_watermark_t watermark = {_callback, &_context};
+    oe_enclave_setting_t setting;
+    size_t num_events = 0;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s ENCLAVE_PATH\n", argv[0]);
+        return 1;
+    }
+
+    setting.setting_type = OE_ENCLAVE_SETTING_HEAP_WATERMARK;
+    setting.u.heap_watermark_setting = &watermark;
+
+    if ((result = oe_create_heap_watermark_enclave(
+             argv[1],
+             OE_ENCLAVE_TYPE_SGX,
+             oe_get_create_flags(),
+             &setting,
+             1,
+             &_enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    OE_TEST(enc_test_parameters(_enclave) == OE_OK);
+    OE_TEST(_num_events == 0);
+
+    // The host gets the same notifications as the enclave, in order.
+    OE_TEST(enc_test_watermarks(_enclave, &num_events) == OE_OK);
+    OE_TEST(num_events == 4);
+    OE_TEST(_num_events == 4);
+    OE_TEST(_events[0].percent == 25 && _events[0].exceeded);
+    OE_TEST(_events[1].percent == 50 && _events[1].exceeded);
+    OE_TEST(_events[2].percent == 50 && !_events[2].exceeded);
+    OE_TEST(_events[3].percent == 25 && !_events[3].exceeded);
+
+    OE_TEST(oe_terminate_enclave(_enclave) == OE_OK);
+
+    printf("=== passed all tests (heap_watermark)\n");
+
+    return 0;
+}
@@ -71,6 +71,60 @@ void test_host_free(void_ptr in_ptr)
     oe_host_free(in_ptr);
 }
 
+void test_host_heap(size_t num_blocks)
+{
+    const size_t max_blocks = 1024;
+    uint8_t* blocks[max_blocks];
+    size_t sizes[max_blocks];
+
+    OE_TEST(num_blocks <= max_blocks);
+
+    /* Allocate blocks of sizes on both sides of the size classes of the host
+     * heap and past its largest class */
+    for (size_t i = 0; i < num_blocks; i++)
+    {
+        sizes[i] = (size_t)1 << (i % 14);
+        if (i % 3 == 0)
+            sizes[i] += i % 7;
+
+        blocks[i] = (uint8_t*)oe_host_malloc(sizes[i]);
+        OE_TEST(blocks[i] != NULL);
+        OE_TEST(oe_is_outside_enclave(blocks[i], sizes[i]));
+        memset(blocks[i], (int)(i & 0xff), sizes[i]);
+    }
+
+    /* Blocks must not overlap */
+    for (size_t i = 0; i < num_blocks; i++)
+    {
+        for (size_t j = 0; j < sizes[i]; j++)
+            OE_TEST(blocks[i][j] == (uint8_t)(i & 0xff));
+    }
+
+    /* Free every other block and reuse the room */
+    for (size_t i = 0; i < num_blocks; i += 2)
+    {
+        oe_host_free(blocks[i]);
+        blocks[i] = (uint8_t*)oe_host_calloc(1, sizes[i]);
+        OE_TEST(blocks[i] != NULL);
+        for (size_t j = 0; j < sizes[i]; j++)
+            OE_TEST(blocks[i][j] == 0);
+        memset(blocks[i], (int)(i & 0xff), sizes[i]);
+    }
+
+    /* Grow the blocks, which keeps their contents */
+    for (size_t i = 1; i < num_blocks; i += 2)
+    {
+        uint8_t* block = (uint8_t*)oe_host_realloc(blocks[i], 2 * sizes[i]);
+        OE_TEST(block != NULL);
+        for (size_t j = 0; j < sizes[i]; j++)
+            OE_TEST(block[j] == (uint8_t)(i & 0xff));
+        blocks[i] = block;
+    }
+
+    for (size_t i = 0; i < num_blocks; i++)
+        oe_host_free(blocks[i]);
+}
+
 OE_SET_ENCLAVE_SGX(
     1,    /* ProductID */
     1,    /* SecurityVersion */
@@ -7,6 +7,12 @@
 #include <cstring>
 #include "hostcalls_u.h"
 
+#define NUM_HOST_HEAP_BLOCKS 1024
+#define HOST_HEAP_SIZE (256 * 1024)
+
+/* Not a multiple of the 64 KB slabs of the host heap */
+#define UNALIGNED_HOST_HEAP_SIZE (HOST_HEAP_SIZE + 1000)
+
 static void _test_host_malloc(oe_enclave_t* enclave)
 {
     void_ptr out_ptr;
@@ -202,6 +208,48 @@ int main(int argc, const char* argv[])
     _test_host_calloc(enclave);
     _test_host_realloc(enclave);
     _test_host_strndup(enclave);
+    OE_TEST(test_host_heap(enclave, NUM_HOST_HEAP_BLOCKS) == OE_OK);
+
+    oe_terminate_enclave(enclave);
+
+    /* Run the tests again with small host allocations served from a region
+     * donated by the host. The region is small so that it is refilled */
+    oe_enclave_setting_shared_memory_t shared_memory_setting = {};
+    shared_memory_setting.host_heap_size = HOST_HEAP_SIZE;
+    oe_enclave_setting_t settings[1];
+    settings[0].setting_type = OE_ENCLAVE_SETTING_SHARED_MEMORY;
+    settings[0].u.shared_memory_setting = &shared_memory_setting;
+
+    if ((result = oe_create_hostcalls_enclave(
+             argv[1],
+             OE_ENCLAVE_TYPE_SGX,
+             flags,
+             settings,
+             OE_COUNTOF(settings),
+             &enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    _test_host_malloc(enclave);
+    _test_host_calloc(enclave);
+    _test_host_realloc(enclave);
+    _test_host_strndup(enclave);
+    OE_TEST(test_host_heap(enclave, NUM_HOST_HEAP_BLOCKS) == OE_OK);
+
+    oe_terminate_enclave(enclave);
+
+    /* The tail of a region that does not make a whole slab is not used */
+    shared_memory_setting.host_heap_size = UNALIGNED_HOST_HEAP_SIZE;
+
+    if ((result = oe_create_hostcalls_enclave(
+             argv[1],
+             OE_ENCLAVE_TYPE_SGX,
+             flags,
+             settings,
+             OE_COUNTOF(settings),
+             &enclave)) != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    OE_TEST(test_host_heap(enclave, NUM_HOST_HEAP_BLOCKS) == OE_OK);
 
     oe_terminate_enclave(enclave);
 
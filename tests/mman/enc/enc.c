@@ -1,9 +1,12 @@
 // Copyright (c) Open Enclave SDK contributors.
 // Licensed under the MIT License.
 
+#define _GNU_SOURCE
+
 #include <errno.h>
 #include <openenclave/internal/tests.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/mman.h>
 #include "../../../libc/mman.h"
 #include "mman_t.h"
@@ -11,18 +14,24 @@
 
 const uint64_t chunk_size = 1024;
 
-static void _test_basic()
+static void* _map(uint64_t length)
 {
-    // Test whether memory can be mmaped and unmapped.
-    uint8_t* ptr = (uint8_t*)mmap(
+    return mmap(
         NULL,
-        chunk_size,
+        length,
         PROT_READ | PROT_WRITE,
         MAP_ANONYMOUS | MAP_PRIVATE,
         -1,
         0);
+}
+
+static void _test_basic()
+{
+    // Test whether memory can be mmaped and unmapped.
+    uint8_t* ptr = (uint8_t*)_map(chunk_size);
     OE_TEST(ptr != MAP_FAILED);
     OE_TEST(errno == 0);
+    OE_TEST(((uint64_t)ptr % OE_PAGE_SIZE) == 0);
 
     // Test that memory is zeroed out.
     for (uint64_t i = 0; i < chunk_size; ++i)
@@ -30,81 +39,65 @@ static void _test_basic()
 
     OE_TEST(munmap(ptr, chunk_size) == 0);
     OE_TEST(errno == 0);
-    OE_TEST(oe_test_get_mappings() == NULL);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 0);
+    OE_TEST(oe_test_get_segment_count() == 0);
 }
 
 static void _test_partial_unmapping(void)
 {
+    oe_mapping_t m[4];
+
     uint64_t p1_length = 5 * OE_PAGE_SIZE;
-    uint64_t p1_start = (uint64_t)mmap(
-        NULL,
-        p1_length - 477,
-        PROT_READ | PROT_WRITE,
-        MAP_ANONYMOUS | MAP_PRIVATE,
-        -1,
-        0);
+    uint64_t p1_start = (uint64_t)_map(p1_length - 477);
     uint64_t p1_end = p1_start + p1_length;
 
-    oe_mapping_t* m = oe_test_get_mappings();
-    OE_TEST(m->start == p1_start);
-    OE_TEST(m->end == p1_end);
+    OE_TEST(oe_test_get_mappings(m, 4) == 1);
+    OE_TEST(m[0].start == p1_start);
+    OE_TEST(m[0].end == p1_end);
 
+    // Small mappings share a segment and are placed next to each other.
     uint64_t p2_length = 3 * OE_PAGE_SIZE;
-    uint64_t p2_start = (uint64_t)mmap(
-        NULL,
-        p2_length - 2048,
-        PROT_READ | PROT_WRITE,
-        MAP_ANONYMOUS | MAP_PRIVATE,
-        -1,
-        0);
+    uint64_t p2_start = (uint64_t)_map(p2_length - 2048);
     uint64_t p2_end = p2_start + p2_length;
-    m = oe_test_get_mappings();
-    OE_TEST(m->start == p2_start);
-    OE_TEST(m->end == p2_end);
+    OE_TEST(p2_start == p1_end);
+    OE_TEST(oe_test_get_segment_count() == 1);
 
-    // Swap p1 and p2 if p2 lies before p1.
-    if (p2_start < p1_start)
-    {
-        uint64_t t = p1_start;
-        p1_start = p2_start;
-        p2_start = t;
+    OE_TEST(oe_test_get_mappings(m, 4) == 2);
+    OE_TEST(m[1].start == p2_start);
+    OE_TEST(m[1].end == p2_end);
 
-        t = p1_end;
-        p1_end = p2_end;
-        p2_end = t;
-    }
+    // Unmap the middle of p1. This splits p1 in two.
+    OE_TEST(munmap((void*)(p1_start + OE_PAGE_SIZE), 2 * OE_PAGE_SIZE) == 0);
+    OE_TEST(errno == 0);
+    OE_TEST(oe_test_get_mappings(m, 4) == 3);
+    OE_TEST(m[0].start == p1_start);
+    OE_TEST(m[0].end == p1_start + OE_PAGE_SIZE);
+    OE_TEST(m[1].start == p1_start + 3 * OE_PAGE_SIZE);
+    OE_TEST(m[1].end == p1_end);
+
+    // The freed pages are reused by the next mapping that fits in them.
+    uint8_t* p3 = (uint8_t*)_map(2 * OE_PAGE_SIZE);
+    OE_TEST((uint64_t)p3 == p1_start + OE_PAGE_SIZE);
+    for (uint64_t i = 0; i < 2 * OE_PAGE_SIZE; ++i)
+        OE_TEST(p3[i] == 0);
+    OE_TEST(munmap(p3, 2 * OE_PAGE_SIZE) == 0);
 
     // Do an unmap that starts within p1 and ends within p2.
     uint64_t start = p1_end - OE_PAGE_SIZE;
     uint64_t end = p2_end - OE_PAGE_SIZE;
     OE_TEST(munmap((void*)start, end - start) == 0);
     OE_TEST(errno == 0);
-
-    // Partial unmapping only changes the status vectors and not the bounds.
-    m = oe_test_get_mappings();
-    OE_TEST(m->start == p2_start);
-    OE_TEST(m->end == p2_end);
-    m = m->next;
-    OE_TEST(m->start == p1_start);
-    OE_TEST(m->end == p1_end);
-
-    // Do another partial unmap.
-    start -= OE_PAGE_SIZE;
-    OE_TEST(munmap((void*)start, end - start) == 0);
+    OE_TEST(oe_test_get_mappings(m, 4) == 3);
+    OE_TEST(m[1].start == p1_start + 3 * OE_PAGE_SIZE);
+    OE_TEST(m[1].end == start);
+    OE_TEST(m[2].start == end);
+    OE_TEST(m[2].end == p2_end);
+
+    // Unmapping the remaining pages returns the segment to the heap.
+    OE_TEST(munmap((void*)p1_start, p2_end - p1_start) == 0);
     OE_TEST(errno == 0);
-    m = oe_test_get_mappings();
-    OE_TEST(m->start == p2_start);
-    OE_TEST(m->end == p2_end);
-    m = m->next;
-    OE_TEST(m->start == p1_start);
-    OE_TEST(m->end == p1_end);
-
-    // Do an unmap till the start.
-    // This ought to delete one mapping completely.
-    OE_TEST(munmap((void*)OE_PAGE_SIZE, start - OE_PAGE_SIZE) == 0);
-    OE_TEST(errno == 0);
-    m = oe_test_get_mappings();
-    OE_TEST(m->next == NULL);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 0);
+    OE_TEST(oe_test_get_segment_count() == 0);
 
     // Do another unmapping that spans entire enclave memory.
     // This ought to get rid of all mappings.
@@ -117,19 +110,121 @@ static void _test_partial_unmapping(void)
     }
     OE_TEST(munmap(0, (1L << 62)) == 0);
     OE_TEST(errno == 0);
-    OE_TEST(oe_test_get_mappings() == NULL);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 0);
+    OE_TEST(oe_test_get_segment_count() == 0);
 
     // Test unmapping a mapping in small chunks.
     start = (uint64_t)mmap(
         NULL, 3 * OE_PAGE_SIZE, PROT_READ, MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-    OE_TEST(oe_test_get_mappings() != NULL);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 1);
 
     OE_TEST(munmap((void*)(start + OE_PAGE_SIZE), 1) == 0);
-    OE_TEST(oe_test_get_mappings() != NULL);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 2);
     OE_TEST(munmap((void*)(start + 2 * OE_PAGE_SIZE), 1) == 0);
-    OE_TEST(oe_test_get_mappings() != NULL);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 1);
     OE_TEST(munmap((void*)start, 1) == 0);
-    OE_TEST(oe_test_get_mappings() == NULL);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 0);
+    OE_TEST(oe_test_get_segment_count() == 0);
+}
+
+static void _test_many_mappings(void)
+{
+    static uint8_t* ptrs[256];
+    const size_t count = OE_COUNTOF(ptrs);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        ptrs[i] = (uint8_t*)_map(OE_PAGE_SIZE);
+        OE_TEST(ptrs[i] != MAP_FAILED);
+        ptrs[i][0] = (uint8_t)i;
+    }
+    OE_TEST(oe_test_get_mappings(NULL, 0) == count);
+
+    // Unmap every other mapping, then map them again into the freed pages.
+    for (size_t i = 0; i < count; i += 2)
+        OE_TEST(munmap(ptrs[i], OE_PAGE_SIZE) == 0);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == count / 2);
+
+    for (size_t i = 0; i < count; i += 2)
+    {
+        ptrs[i] = (uint8_t*)_map(OE_PAGE_SIZE);
+        OE_TEST(ptrs[i] != MAP_FAILED);
+        OE_TEST(ptrs[i][0] == 0);
+        ptrs[i][0] = (uint8_t)i;
+    }
+    OE_TEST(oe_test_get_mappings(NULL, 0) == count);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        OE_TEST(ptrs[i][0] == (uint8_t)i);
+        OE_TEST(munmap(ptrs[i], OE_PAGE_SIZE) == 0);
+    }
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 0);
+    OE_TEST(oe_test_get_segment_count() == 0);
+}
+
+static void _test_mremap(void)
+{
+    uint8_t* ptr = (uint8_t*)_map(2 * OE_PAGE_SIZE);
+    OE_TEST(ptr != MAP_FAILED);
+    memset(ptr, 0xab, 2 * OE_PAGE_SIZE);
+
+    // Grow in place into the free pages that follow the mapping. The new
+    // pages are zeroed.
+    uint8_t* p = (uint8_t*)mremap(ptr, 2 * OE_PAGE_SIZE, 4 * OE_PAGE_SIZE, 0);
+    OE_TEST(p == ptr);
+    OE_TEST(errno == 0);
+    OE_TEST(p[2 * OE_PAGE_SIZE - 1] == 0xab);
+    for (uint64_t i = 2 * OE_PAGE_SIZE; i < 4 * OE_PAGE_SIZE; ++i)
+        OE_TEST(p[i] == 0);
+
+    // Shrink in place.
+    p = (uint8_t*)mremap(ptr, 4 * OE_PAGE_SIZE, OE_PAGE_SIZE, 0);
+    OE_TEST(p == ptr);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 1);
+
+    // A mapping that follows ptr prevents it from growing in place.
+    uint8_t* next = (uint8_t*)_map(OE_PAGE_SIZE);
+    OE_TEST(next == ptr + OE_PAGE_SIZE);
+    OE_TEST(mremap(ptr, OE_PAGE_SIZE, 2 * OE_PAGE_SIZE, 0) == MAP_FAILED);
+    OE_TEST(errno == ENOMEM);
+
+    // Unless it may move.
+    p = (uint8_t*)mremap(ptr, OE_PAGE_SIZE, 2 * OE_PAGE_SIZE, MREMAP_MAYMOVE);
+    OE_TEST(p != MAP_FAILED);
+    OE_TEST(p != ptr);
+    OE_TEST(p[0] == 0xab);
+    OE_TEST(p[OE_PAGE_SIZE - 1] == 0xab);
+    for (uint64_t i = OE_PAGE_SIZE; i < 2 * OE_PAGE_SIZE; ++i)
+        OE_TEST(p[i] == 0);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 2);
+
+    // The range must lie within a single mapping.
+    OE_TEST(mremap(ptr, OE_PAGE_SIZE, OE_PAGE_SIZE, 0) == MAP_FAILED);
+    OE_TEST(errno == EFAULT);
+    OE_TEST(
+        mremap(p, 3 * OE_PAGE_SIZE, OE_PAGE_SIZE, MREMAP_MAYMOVE) ==
+        MAP_FAILED);
+    OE_TEST(errno == EFAULT);
+
+    // Unsupported parameters.
+    OE_TEST(mremap(p, 0, OE_PAGE_SIZE, MREMAP_MAYMOVE) == MAP_FAILED);
+    OE_TEST(errno == EINVAL);
+    OE_TEST(mremap(p, OE_PAGE_SIZE, 0, MREMAP_MAYMOVE) == MAP_FAILED);
+    OE_TEST(errno == EINVAL);
+    OE_TEST(
+        mremap(
+            p,
+            OE_PAGE_SIZE,
+            OE_PAGE_SIZE,
+            MREMAP_MAYMOVE | MREMAP_FIXED,
+            next + OE_PAGE_SIZE) == MAP_FAILED);
+    OE_TEST(errno == EINVAL);
+
+    OE_TEST(munmap(p, 2 * OE_PAGE_SIZE) == 0);
+    OE_TEST(munmap(next, OE_PAGE_SIZE) == 0);
+    OE_TEST(oe_test_get_mappings(NULL, 0) == 0);
+    OE_TEST(oe_test_get_segment_count() == 0);
 }
 
 static void _test_mmap_params(void)
@@ -343,6 +438,8 @@ int enc_main()
 {
     _test_basic();
     _test_partial_unmapping();
+    _test_many_mappings();
+    _test_mremap();
     _test_mmap_params();
     _test_unmap_params();
     return 0;
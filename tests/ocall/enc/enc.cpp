@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 
 #include <openenclave/bits/sgx/sgxtypes.h>
+#include <openenclave/corelibc/stdlib.h>
 #include <openenclave/corelibc/string.h>
 #include <openenclave/edger8r/enclave.h>
 #include <openenclave/enclave.h>
@@ -96,6 +97,35 @@ void enc_test_reentrancy()
     OE_TEST(OE_OK == result);
 }
 
+int enc_make_large_ocalls(
+    size_t size,
+    size_t num_calls,
+    uint64_t* num_misses,
+    uint64_t* buffer_size)
+{
+    oe_ocall_buffer_statistics_t before;
+    oe_ocall_buffer_statistics_t after;
+    void* buffer = oe_malloc(size);
+
+    if (!buffer)
+        return -1;
+
+    memset(buffer, 0xAA, size);
+    OE_TEST(oe_get_ocall_buffer_statistics(&before) == OE_OK);
+
+    for (size_t i = 0; i < num_calls; i++)
+        OE_TEST(host_large_ocall(buffer, size) == OE_OK);
+
+    OE_TEST(oe_get_ocall_buffer_statistics(&after) == OE_OK);
+    OE_TEST(after.num_allocations - before.num_allocations == num_calls);
+
+    *num_misses = after.num_misses - before.num_misses;
+    *buffer_size = after.buffer_size;
+
+    oe_free(buffer);
+    return 0;
+}
+
 OE_SET_ENCLAVE_SGX(
     1,    /* ProductID */
     1,    /* SecurityVersion */
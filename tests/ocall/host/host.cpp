@@ -22,6 +22,113 @@ void host_func2(const unsigned char*)
     g_func2_ok = true;
 }
 
+/* Larger than the default ocall buffer of 16 KB */
+#define LARGE_OCALL_SIZE (64 * 1024)
+#define NUM_LARGE_OCALLS 8
+
+static size_t g_large_ocall_bytes = 0;
+
+void host_large_ocall(const void* buffer, size_t size)
+{
+    OE_TEST(buffer != NULL);
+    OE_TEST(((const unsigned char*)buffer)[size - 1] == 0xAA);
+    g_large_ocall_bytes += size;
+}
+
+static oe_enclave_t* _create_enclave_with_ocall_buffer(
+    const char* path,
+    uint32_t flags,
+    size_t ocall_buffer_size,
+    size_t ocall_buffer_max_size,
+    oe_enclave_t** enclave)
+{
+    oe_enclave_setting_shared_memory_t shared_memory_setting = {};
+    shared_memory_setting.ocall_buffer_size = ocall_buffer_size;
+    shared_memory_setting.ocall_buffer_max_size = ocall_buffer_max_size;
+    oe_enclave_setting_t settings[1];
+    settings[0].setting_type = OE_ENCLAVE_SETTING_SHARED_MEMORY;
+    settings[0].u.shared_memory_setting = &shared_memory_setting;
+
+    *enclave = NULL;
+    oe_create_ocall_enclave(
+        path,
+        OE_ENCLAVE_TYPE_SGX,
+        flags,
+        settings,
+        OE_COUNTOF(settings),
+        enclave);
+    return *enclave;
+}
+
+static void _make_large_ocalls(
+    oe_enclave_t* enclave,
+    size_t size,
+    uint64_t* num_misses,
+    uint64_t* buffer_size)
+{
+    int ret = -1;
+    OE_TEST(
+        enc_make_large_ocalls(
+            enclave,
+            &ret,
+            size,
+            NUM_LARGE_OCALLS,
+            num_misses,
+            buffer_size) == OE_OK);
+    OE_TEST(ret == 0);
+}
+
+static void _test_ocall_buffer_sizing(const char* path, uint32_t flags)
+{
+    oe_enclave_t* enclave = NULL;
+    uint64_t num_misses = 0;
+    uint64_t buffer_size = 0;
+
+    /* Large ocalls miss the buffer of the first ecall. The buffer grows to
+     * fit them at the next ecall */
+    OE_TEST(
+        _create_enclave_with_ocall_buffer(
+            path, flags, 16 * 1024, 256 * 1024, &enclave) != NULL);
+
+    _make_large_ocalls(enclave, 1024, &num_misses, &buffer_size);
+    OE_TEST(num_misses == 0);
+    OE_TEST(buffer_size == 16 * 1024);
+
+    _make_large_ocalls(enclave, LARGE_OCALL_SIZE, &num_misses, &buffer_size);
+    OE_TEST(num_misses == NUM_LARGE_OCALLS);
+    OE_TEST(buffer_size == 16 * 1024);
+
+    _make_large_ocalls(enclave, LARGE_OCALL_SIZE, &num_misses, &buffer_size);
+    OE_TEST(num_misses == 0);
+    OE_TEST(buffer_size > LARGE_OCALL_SIZE && buffer_size <= 256 * 1024);
+
+    OE_TEST(
+        g_large_ocall_bytes ==
+        NUM_LARGE_OCALLS * (2 * LARGE_OCALL_SIZE + 1024));
+    oe_terminate_enclave(enclave);
+
+    /* The buffer does not grow past its max size */
+    OE_TEST(
+        _create_enclave_with_ocall_buffer(
+            path, flags, 16 * 1024, 32 * 1024, &enclave) != NULL);
+
+    _make_large_ocalls(enclave, LARGE_OCALL_SIZE, &num_misses, &buffer_size);
+    OE_TEST(num_misses == NUM_LARGE_OCALLS);
+
+    _make_large_ocalls(enclave, LARGE_OCALL_SIZE, &num_misses, &buffer_size);
+    OE_TEST(num_misses == NUM_LARGE_OCALLS);
+    OE_TEST(buffer_size == 32 * 1024);
+
+    oe_terminate_enclave(enclave);
+
+    /* The initial size must not exceed the max size */
+    OE_TEST(
+        _create_enclave_with_ocall_buffer(
+            path, flags, 64 * 1024, 32 * 1024, &enclave) == NULL);
+
+    printf("=== passed _test_ocall_buffer_sizing()\n");
+}
+
 static oe_enclave_t* g_enclave = NULL;
 static bool g_reentrancy_tested = false;
 void host_test_reentrancy()
@@ -118,6 +225,8 @@ int main(int argc, const char* argv[])
 
     oe_terminate_enclave(enclave);
 
+    _test_ocall_buffer_sizing(argv[1], flags);
+
     printf("=== passed all tests (%s)\n", argv[0]);
 
     return 0;
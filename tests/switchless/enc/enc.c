@@ -2,6 +2,7 @@
 // Licensed under the MIT License.
 
 #include <openenclave/corelibc/string.h>
+#include <openenclave/edger8r/enclave.h>
 #include <openenclave/enclave.h>
 #include <openenclave/internal/print.h>
 #include <openenclave/internal/tests.h>
@@ -105,6 +106,53 @@ int enc_echo_regular(
     return 0;
 }
 
+void enc_test_shared_memory_arena(size_t chunk_size)
+{
+    const size_t num_chunks = 4;
+    const size_t size = chunk_size / 2 + 16;
+    oe_shared_memory_arena_statistics_t statistics;
+    uint64_t num_chunk_allocations = 0;
+    void* buffer = NULL;
+
+    // The arena of this thread is empty at the start of the ECALL.
+    OE_TEST(oe_get_shared_memory_arena_statistics(&statistics) == OE_OK);
+    OE_TEST(statistics.used == 0);
+
+    // Each buffer takes more than half a chunk, so each one is allocated
+    // from a new chunk.
+    for (size_t i = 0; i < num_chunks; i++)
+    {
+        OE_TEST((buffer = oe_allocate_switchless_ocall_buffer(size)) != NULL);
+        memset(buffer, 0, size);
+    }
+
+    // A buffer larger than a chunk gets a chunk of its own.
+    buffer = oe_allocate_switchless_ocall_buffer(2 * chunk_size);
+    OE_TEST(buffer != NULL);
+    memset(buffer, 0, 2 * chunk_size);
+
+    OE_TEST(oe_get_shared_memory_arena_statistics(&statistics) == OE_OK);
+    OE_TEST(statistics.num_chunks == num_chunks + 1);
+    OE_TEST(statistics.used >= num_chunks * size + 2 * chunk_size);
+    OE_TEST(statistics.capacity >= num_chunks * chunk_size + 2 * chunk_size);
+    OE_TEST(statistics.thread_high_water == statistics.used);
+    OE_TEST(statistics.high_water >= statistics.thread_high_water);
+    num_chunk_allocations = statistics.num_chunk_allocations;
+
+    // Freeing the buffers keeps the chunks for reuse.
+    oe_free_switchless_ocall_buffer(buffer);
+    OE_TEST(oe_get_shared_memory_arena_statistics(&statistics) == OE_OK);
+    OE_TEST(statistics.used == 0);
+    OE_TEST(statistics.num_chunks == num_chunks + 1);
+
+    for (size_t i = 0; i < num_chunks; i++)
+        OE_TEST((buffer = oe_allocate_switchless_ocall_buffer(size)) != NULL);
+
+    OE_TEST(oe_get_shared_memory_arena_statistics(&statistics) == OE_OK);
+    OE_TEST(statistics.num_chunk_allocations == num_chunk_allocations);
+    oe_free_switchless_ocall_buffer(buffer);
+}
+
 OE_SET_ENCLAVE_SGX(
     1,                             /* ProductID */
     1,                             /* SecurityVersion */
@@ -19,6 +19,10 @@
 #define NUM_OCALLS (100000)
 #define NUM_ECALLS (100000)
 
+// The default size of the chunks of the shared memory arenas
+#define DEFAULT_ARENA_CHUNK_SIZE (1024 * 1024)
+#define ARENA_CHUNK_SIZE (64 * 1024)
+
 #define STRING_LEN 100
 #define STRING_HELLO "Hello World"
 #define ENCLAVE_PARAM_STRING "enclave string parameter"
@@ -416,6 +420,80 @@ void test_switchless_ecalls(
         (double)regular_microseconds / switchless_max);
 }
 
+static void test_switchless_statistics(
+    oe_enclave_t* enclave_switchless,
+    oe_enclave_t* enclave_normal,
+    bool test_ecalls,
+    uint64_t num_workers,
+    uint64_t num_calls)
+{
+    oe_switchless_statistics_t statistics;
+    const oe_switchless_call_statistics_t* calls =
+        test_ecalls ? &statistics.ecalls : &statistics.ocalls;
+    const oe_switchless_call_statistics_t* other =
+        test_ecalls ? &statistics.ocalls : &statistics.ecalls;
+    uint64_t posted_calls = 0;
+    uint64_t queue_wait_calls = 0;
+
+    OE_TEST(
+        oe_get_switchless_statistics(enclave_switchless, &statistics) ==
+        OE_OK);
+
+    // Every switchless call was either posted to a worker or fell back.
+    OE_TEST(calls->num_workers == num_workers);
+    OE_TEST(calls->posted_calls + calls->fallback_calls == num_calls);
+    OE_TEST(other->num_workers == 0);
+    OE_TEST(other->posted_calls == 0);
+
+    for (size_t i = 0; i < calls->num_workers; i++)
+    {
+        OE_TEST(
+            calls->workers[i].completed_calls ==
+            calls->workers[i].posted_calls);
+        posted_calls += calls->workers[i].posted_calls;
+    }
+    OE_TEST(posted_calls == calls->posted_calls);
+
+    // Every posted call waited in a queue, possibly for no time at all.
+    for (size_t i = 0; i < OE_SWITCHLESS_QUEUE_WAIT_BUCKETS; i++)
+    {
+        queue_wait_calls += calls->queue_wait_histogram[i];
+        if (i > 0)
+            OE_TEST(
+                calls->queue_wait_bounds[i] >=
+                calls->queue_wait_bounds[i - 1]);
+    }
+    OE_TEST(queue_wait_calls == calls->posted_calls);
+    OE_TEST(
+        calls->queue_wait_bounds[OE_SWITCHLESS_QUEUE_WAIT_BUCKETS - 1] ==
+        UINT64_MAX);
+
+    printf(
+        "Switchless %s: posted=%" PRIu64 " fallbacks=%" PRIu64
+        " wakeups=%" PRIu64 " sleeps=%" PRIu64 " spins=%" PRIu64
+        " cas_failures=%" PRIu64 "\n",
+        test_ecalls ? "ECALLs" : "OCALLs",
+        calls->posted_calls,
+        calls->fallback_calls,
+        calls->wakeups,
+        calls->sleeps,
+        calls->spin_count,
+        calls->cas_failures);
+
+    // An enclave without switchless settings has no workers.
+    OE_TEST(
+        oe_get_switchless_statistics(enclave_normal, &statistics) == OE_OK);
+    OE_TEST(statistics.ocalls.num_workers == 0);
+    OE_TEST(statistics.ecalls.num_workers == 0);
+
+    OE_TEST(
+        oe_get_switchless_statistics(NULL, &statistics) ==
+        OE_INVALID_PARAMETER);
+    OE_TEST(
+        oe_get_switchless_statistics(enclave_switchless, NULL) ==
+        OE_INVALID_PARAMETER);
+}
+
 int main(int argc, const char* argv[])
 {
     oe_enclave_t *enclave_switchless = NULL, *enclave_normal = NULL;
@@ -427,13 +505,17 @@ int main(int argc, const char* argv[])
         fprintf(
             stderr,
             "Usage: %s ENCLAVE_PATH [--host-threads n] [--enclave-threads n] "
-            "[--ecalls]\n",
+            "[--queue-depth n] [--min-workers n] [--pin-workers] "
+            "[--test-ecalls]\n",
             argv[0]);
         return 1;
     }
 
     uint64_t num_host_threads = 1;
     uint64_t num_enclave_threads = 2;
+    uint64_t queue_depth = 0;
+    uint64_t min_workers = 0;
+    bool pin_workers = false;
     bool test_ecalls = false;
 
     {
@@ -452,6 +534,22 @@ int main(int argc, const char* argv[])
                     goto print_usage;
                 sscanf_s(argv[i], "%" SCNu64, &num_enclave_threads);
             }
+            else if (strcmp(argv[i], "--queue-depth") == 0)
+            {
+                if (++i == argc)
+                    goto print_usage;
+                sscanf_s(argv[i], "%" SCNu64, &queue_depth);
+            }
+            else if (strcmp(argv[i], "--min-workers") == 0)
+            {
+                if (++i == argc)
+                    goto print_usage;
+                sscanf_s(argv[i], "%" SCNu64, &min_workers);
+            }
+            else if (strcmp(argv[i], "--pin-workers") == 0)
+            {
+                pin_workers = true;
+            }
             else if (strcmp(argv[i], "--test-ecalls") == 0)
             {
                 test_ecalls = true;
@@ -472,15 +570,32 @@ int main(int argc, const char* argv[])
 
     // Enable switchless and configure host
     oe_enclave_setting_context_switchless_t switchless_setting = {0, 0};
+    oe_enclave_setting_switchless_workers_t workers_setting = {queue_depth};
+    static const uint32_t worker_cpus[] = {0};
+    workers_setting.min_host_workers = min_workers;
+    workers_setting.min_enclave_workers = min_workers;
+    if (pin_workers)
+    {
+        workers_setting.worker_cpus = worker_cpus;
+        workers_setting.num_worker_cpus = OE_COUNTOF(worker_cpus);
+    }
 
     if (test_ecalls)
         switchless_setting.max_enclave_workers = num_enclave_threads;
     else
         switchless_setting.max_host_workers = num_host_threads;
 
+    // Use small arena chunks so that switchless OCALLs chain chunks.
+    oe_enclave_setting_shared_memory_t shared_memory_setting = {
+        ARENA_CHUNK_SIZE, 0};
+
     oe_enclave_setting_t settings[] = {
         {.setting_type = OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS,
-         .u.context_switchless_setting = &switchless_setting}};
+         .u.context_switchless_setting = &switchless_setting},
+        {.setting_type = OE_ENCLAVE_SETTING_SWITCHLESS_WORKERS,
+         .u.switchless_workers_setting = &workers_setting},
+        {.setting_type = OE_ENCLAVE_SETTING_SHARED_MEMORY,
+         .u.shared_memory_setting = &shared_memory_setting}};
 
     if ((result = oe_create_switchless_test_enclave(
              argv[1],
@@ -503,6 +618,28 @@ int main(int argc, const char* argv[])
         test_switchless_ocalls(
             enclave_switchless, enclave_normal, num_enclave_threads);
 
+    if (test_ecalls)
+        test_switchless_statistics(
+            enclave_switchless,
+            enclave_normal,
+            true,
+            switchless_setting.max_enclave_workers,
+            num_host_threads * NUM_ECALLS);
+    else
+        test_switchless_statistics(
+            enclave_switchless,
+            enclave_normal,
+            false,
+            switchless_setting.max_host_workers,
+            num_enclave_threads * NUM_OCALLS);
+
+    OE_TEST(
+        enc_test_shared_memory_arena(enclave_switchless, ARENA_CHUNK_SIZE) ==
+        OE_OK);
+    OE_TEST(
+        enc_test_shared_memory_arena(enclave_normal, DEFAULT_ARENA_CHUNK_SIZE) ==
+        OE_OK);
+
     result = oe_terminate_enclave(enclave_switchless);
     OE_TEST(result == OE_OK);
 
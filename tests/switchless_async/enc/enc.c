@@ -0,0 +1,93 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/corelibc/stdlib.h>
+#include <openenclave/edger8r/enclave.h>
+#include <openenclave/enclave.h>
+#include <openenclave/internal/calls.h>
+#include <openenclave/internal/tests.h>
+#include <string.h>
+#include "switchless_async_t.h"
+
+/*
+ * oeedger8r does not generate stubs for asynchronous calls yet, so the test
+ * marshals the calls of host_async_add itself.
+ */
+
+/* switchless_async_fcn_id_host_async_add is defined in switchless_async_t.c,
+ * must be kept in sync */
+static const size_t _host_async_add_id = 0;
+
+/* Marshalling struct cloned from switchless_async_t.c, padded so that the
+ * buffer sizes satisfy OE_EDGER8R_BUFFER_ALIGNMENT */
+typedef struct OE_ALIGNED(16) _async_add_buffer
+{
+    oe_result_t _result;
+    void* deepcopy_out_buffer;
+    size_t deepcopy_out_buffer_size;
+    uint64_t value;
+} async_add_buffer_t;
+
+OE_STATIC_ASSERT(
+    sizeof(async_add_buffer_t) % OE_EDGER8R_BUFFER_ALIGNMENT == 0);
+
+static void _post_async_add(uint64_t value)
+{
+    const size_t size = sizeof(async_add_buffer_t);
+    async_add_buffer_t* buffer = NULL;
+
+    buffer = (async_add_buffer_t*)oe_allocate_async_ocall_buffer(2 * size);
+    OE_TEST(buffer != NULL);
+
+    memset(buffer, 0, 2 * size);
+    buffer->value = value;
+
+    OE_TEST(
+        oe_call_host_function_async(_host_async_add_id, buffer, size, size) ==
+        OE_OK);
+}
+
+static uint64_t _expected_total(uint64_t num_calls)
+{
+    return num_calls * (num_calls + 1) / 2;
+}
+
+void enc_post_async_ocalls(uint64_t num_calls, bool flush)
+{
+    uint64_t total = 0;
+
+    for (uint64_t i = 1; i <= num_calls; i++)
+        _post_async_add(i);
+
+    if (!flush)
+        return;
+
+    OE_TEST(oe_flush_async_ocalls() == OE_OK);
+
+    // All the calls have run once the flush returns.
+    OE_TEST(host_get_async_total(&total) == OE_OK);
+    OE_TEST(total == _expected_total(num_calls));
+}
+
+static uint64_t _num_calls_at_exit;
+
+static void _post_async_ocalls_at_exit(void)
+{
+    // The calls are not flushed. They run before the enclave is terminated.
+    for (uint64_t i = 1; i <= _num_calls_at_exit; i++)
+        _post_async_add(i);
+}
+
+void enc_post_async_ocalls_at_exit(uint64_t num_calls)
+{
+    _num_calls_at_exit = num_calls;
+    OE_TEST(oe_atexit(_post_async_ocalls_at_exit) == 0);
+}
+
+OE_SET_ENCLAVE_SGX(
+    1,                             /* ProductID */
+    1,                             /* SecurityVersion */
+    true,                          /* Debug */
+    OE_TEST_MT_HEAP_SIZE(NUM_TCS), /* NumHeapPages */
+    64,                            /* NumStackPages */
+    NUM_TCS);                      /* NumTCS */
@@ -0,0 +1,132 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/atomic.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "switchless_async_u.h"
+
+#define NUM_WORKERS 2
+#define QUEUE_DEPTH 16
+#define NUM_CALLS 10000
+
+static volatile uint64_t _total;
+static volatile uint64_t _count;
+
+/* Called concurrently by the host workers */
+void host_async_add(uint64_t value)
+{
+    uint64_t total;
+
+    do
+    {
+        total = oe_atomic_load(&_total);
+    } while (!oe_atomic_compare_and_swap(&_total, total, total + value));
+
+    oe_atomic_increment(&_count);
+}
+
+uint64_t host_get_async_total(void)
+{
+    return oe_atomic_load(&_total);
+}
+
+static uint64_t _expected_total(uint64_t num_calls)
+{
+    return num_calls * (num_calls + 1) / 2;
+}
+
+static void _reset(void)
+{
+    _total = 0;
+    _count = 0;
+}
+
+static oe_enclave_t* _create_enclave(const char* path, bool switchless)
+{
+    oe_enclave_t* enclave = NULL;
+    oe_enclave_setting_context_switchless_t switchless_setting = {
+        NUM_WORKERS, 0};
+    oe_enclave_setting_switchless_workers_t workers_setting = {QUEUE_DEPTH};
+    oe_enclave_setting_t settings[] = {
+        {.setting_type = OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS,
+         .u.context_switchless_setting = &switchless_setting},
+        {.setting_type = OE_ENCLAVE_SETTING_SWITCHLESS_WORKERS,
+         .u.switchless_workers_setting = &workers_setting}};
+
+    oe_result_t result = oe_create_switchless_async_enclave(
+        path,
+        OE_ENCLAVE_TYPE_SGX,
+        oe_get_create_flags(),
+        switchless ? settings : NULL,
+        switchless ? OE_COUNTOF(settings) : 0,
+        &enclave);
+    if (result != OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    return enclave;
+}
+
+/* The enclave checks the total after flushing the calls */
+static void _test_flush(const char* path, bool switchless)
+{
+    oe_enclave_t* enclave = _create_enclave(path, switchless);
+
+    _reset();
+    OE_TEST(enc_post_async_ocalls(enclave, NUM_CALLS, true) == OE_OK);
+    OE_TEST(_count == NUM_CALLS);
+
+    if (switchless)
+    {
+        oe_switchless_statistics_t statistics;
+
+        // Asynchronous calls are counted like other switchless calls.
+        OE_TEST(oe_get_switchless_statistics(enclave, &statistics) == OE_OK);
+        OE_TEST(
+            statistics.ocalls.posted_calls + statistics.ocalls.fallback_calls >=
+            NUM_CALLS);
+    }
+
+    OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+
+    printf(
+        "Passed flush of %d asynchronous OCALLs %s\n",
+        NUM_CALLS,
+        switchless ? "with host workers" : "without host workers");
+}
+
+/* Calls that are not flushed run before the enclave is terminated */
+static void _test_terminate(const char* path)
+{
+    oe_enclave_t* enclave = _create_enclave(path, true);
+
+    _reset();
+    OE_TEST(enc_post_async_ocalls(enclave, NUM_CALLS, false) == OE_OK);
+    OE_TEST(enc_post_async_ocalls_at_exit(enclave, NUM_CALLS) == OE_OK);
+    OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+
+    OE_TEST(_count == 2 * NUM_CALLS);
+    OE_TEST(_total == 2 * _expected_total(NUM_CALLS));
+
+    printf("Passed asynchronous OCALLs pending at termination\n");
+}
+
+int main(int argc, const char* argv[])
+{
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s ENCLAVE_PATH\n", argv[0]);
+        return 1;
+    }
+
+    _test_flush(argv[1], true);
+    _test_flush(argv[1], false);
+    _test_terminate(argv[1]);
+
+    printf("=== passed all tests (switchless_async)\n");
+
+    return 0;
+}
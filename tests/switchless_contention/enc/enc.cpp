@@ -0,0 +1,29 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/tests.h>
+#include "switchless_contention_t.h"
+
+uint64_t enc_increment_switchless(uint64_t value)
+{
+    return value + 1;
+}
+
+void enc_make_ocalls(uint64_t num_calls)
+{
+    for (uint64_t i = 0; i < num_calls; i++)
+    {
+        uint64_t value = 0;
+        OE_TEST(host_increment_switchless(&value, i) == OE_OK);
+        OE_TEST(value == i + 1);
+    }
+}
+
+OE_SET_ENCLAVE_SGX(
+    1,                             /* ProductID */
+    1,                             /* SecurityVersion */
+    true,                          /* Debug */
+    OE_TEST_MT_HEAP_SIZE(NUM_TCS), /* NumHeapPages */
+    64,                            /* NumStackPages */
+    NUM_TCS);                      /* NumTCS */
@@ -0,0 +1,198 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "switchless_contention_u.h"
+
+using namespace std;
+
+/*
+ * Measures how concurrent callers of switchless ECALLs and OCALLs contend for
+ * the queues of the workers. Each caller starts looking for a worker with room
+ * at its own preferred worker, so the number of times a caller loses the race
+ * for a slot to another caller (CAS failures) should stay low as the number of
+ * callers grows past the number of workers. The benchmark reports the CAS
+ * failures per call and the latency of the calls for an increasing number of
+ * callers, with and without caller affinity.
+ */
+
+#define NUM_WORKERS 4
+#define QUEUE_DEPTH 4
+
+// Increase the number of calls to have a meaningful performance measurement
+#define NUM_CALLS_PER_CALLER 10000
+
+static const size_t _caller_counts[] = {1, 2, 4, 8, 16};
+
+uint64_t host_increment_switchless(uint64_t value)
+{
+    return value + 1;
+}
+
+static double _percentile(vector<double>& latencies, double percentile)
+{
+    sort(latencies.begin(), latencies.end());
+    size_t index = (size_t)(percentile / 100 * (double)(latencies.size() - 1));
+    return latencies[index];
+}
+
+/* Return the statistics of the switchless ECALLs or OCALLs */
+static oe_switchless_call_statistics_t _get_statistics(
+    oe_enclave_t* enclave,
+    bool ocalls)
+{
+    oe_switchless_statistics_t statistics;
+
+    OE_TEST(oe_get_switchless_statistics(enclave, &statistics) == OE_OK);
+    return ocalls ? statistics.ocalls : statistics.ecalls;
+}
+
+static void _make_ecalls(oe_enclave_t* enclave, vector<double>* latencies)
+{
+    latencies->reserve(NUM_CALLS_PER_CALLER);
+
+    for (uint64_t i = 0; i < NUM_CALLS_PER_CALLER; i++)
+    {
+        uint64_t value = 0;
+
+        auto start = chrono::steady_clock::now();
+        OE_TEST(enc_increment_switchless(enclave, &value, i) == OE_OK);
+        auto end = chrono::steady_clock::now();
+
+        OE_TEST(value == i + 1);
+        latencies->push_back(
+            chrono::duration<double, micro>(end - start).count());
+    }
+}
+
+static void _make_ocalls(oe_enclave_t* enclave, vector<double>* latencies)
+{
+    auto start = chrono::steady_clock::now();
+    OE_TEST(enc_make_ocalls(enclave, NUM_CALLS_PER_CALLER) == OE_OK);
+    auto end = chrono::steady_clock::now();
+
+    // The OCALLs are not timed individually; report their mean latency.
+    latencies->push_back(
+        chrono::duration<double, micro>(end - start).count() /
+        NUM_CALLS_PER_CALLER);
+}
+
+static void _run_workload(
+    oe_enclave_t* enclave,
+    bool caller_affinity,
+    bool ocalls,
+    size_t num_callers)
+{
+    vector<vector<double>> latencies(num_callers);
+    vector<double> all_latencies;
+    vector<thread> threads;
+    oe_switchless_call_statistics_t before = _get_statistics(enclave, ocalls);
+
+    for (size_t i = 0; i < num_callers; i++)
+        threads.push_back(thread(
+            ocalls ? _make_ocalls : _make_ecalls, enclave, &latencies[i]));
+
+    for (size_t i = 0; i < num_callers; i++)
+        threads[i].join();
+
+    oe_switchless_call_statistics_t after = _get_statistics(enclave, ocalls);
+    uint64_t cas_failures = after.cas_failures - before.cas_failures;
+    uint64_t misses = after.fallback_calls - before.fallback_calls;
+
+    for (size_t i = 0; i < num_callers; i++)
+        all_latencies.insert(
+            all_latencies.end(), latencies[i].begin(), latencies[i].end());
+
+    double num_calls = (double)(num_callers * NUM_CALLS_PER_CALLER);
+
+    printf(
+        "%-6s affinity=%-3s callers=%2d cas_failures/call=%7.4f "
+        "misses=%5.1f%% p50=%7.2fus p99=%7.2fus\n",
+        ocalls ? "ocall" : "ecall",
+        caller_affinity ? "on" : "off",
+        (int)num_callers,
+        (double)cas_failures / num_calls,
+        (double)misses / num_calls * 100,
+        _percentile(all_latencies, 50),
+        _percentile(all_latencies, 99));
+}
+
+/* With caller affinity, a single caller always posts to the same worker */
+static void _test_caller_affinity(oe_enclave_t* enclave)
+{
+    oe_switchless_call_statistics_t before = _get_statistics(enclave, false);
+    vector<double> latencies;
+    size_t num_workers_used = 0;
+
+    _make_ecalls(enclave, &latencies);
+
+    oe_switchless_call_statistics_t after = _get_statistics(enclave, false);
+
+    for (size_t i = 0; i < after.num_workers; i++)
+        if (after.workers[i].posted_calls != before.workers[i].posted_calls)
+            num_workers_used++;
+
+    OE_TEST(num_workers_used == 1);
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s ENCLAVE\n", argv[0]);
+        exit(1);
+    }
+
+    // The contention is between host threads and between enclave threads on
+    // memory shared with the host, which does not require SGX hardware.
+    const uint32_t flags = oe_get_create_flags() | OE_ENCLAVE_FLAG_SIMULATE;
+
+    for (int affinity = 0; affinity < 2; affinity++)
+    {
+        oe_enclave_t* enclave = NULL;
+        oe_enclave_setting_context_switchless_t switchless_setting = {};
+        switchless_setting.max_host_workers = NUM_WORKERS;
+        switchless_setting.max_enclave_workers = NUM_WORKERS;
+        oe_enclave_setting_switchless_workers_t workers_setting = {};
+        workers_setting.queue_depth = QUEUE_DEPTH;
+        workers_setting.caller_affinity = (affinity != 0);
+        oe_enclave_setting_t settings[2];
+        settings[0].setting_type = OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS;
+        settings[0].u.context_switchless_setting = &switchless_setting;
+        settings[1].setting_type = OE_ENCLAVE_SETTING_SWITCHLESS_WORKERS;
+        settings[1].u.switchless_workers_setting = &workers_setting;
+
+        if ((result = oe_create_switchless_contention_enclave(
+                 argv[1],
+                 OE_ENCLAVE_TYPE_SGX,
+                 flags,
+                 settings,
+                 OE_COUNTOF(settings),
+                 &enclave)) != OE_OK)
+            oe_put_err("oe_create_enclave(): result=%u", result);
+
+        if (affinity)
+            _test_caller_affinity(enclave);
+
+        for (int ocalls = 0; ocalls < 2; ocalls++)
+            for (size_t i = 0; i < OE_COUNTOF(_caller_counts); i++)
+                _run_workload(
+                    enclave, affinity != 0, ocalls != 0, _caller_counts[i]);
+
+        OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+    }
+
+    printf("=== passed all tests (switchless_contention)\n");
+
+    return 0;
+}
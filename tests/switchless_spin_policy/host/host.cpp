@@ -0,0 +1,206 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+#include "switchless_spin_policy_u.h"
+
+#if defined(__linux__)
+#include <sys/resource.h>
+#elif defined(_WIN32)
+#include <Windows.h>
+#endif
+
+using namespace std;
+
+/*
+ * Measures, for each spin policy, the CPU time consumed by the process and the
+ * latency of switchless ECALLs that arrive with a given gap between them.
+ * Spinning longer lowers the latency of calls after a gap, since the enclave
+ * worker does not have to be woken up, but burns CPU time while idle.
+ */
+
+struct policy_t
+{
+    const char* name;
+    oe_switchless_spin_policy_t policy;
+    uint64_t budget;
+};
+
+struct workload_t
+{
+    uint64_t gap_microseconds;
+    size_t num_calls;
+};
+
+static const policy_t _policies[] = {
+    {"fixed", OE_SWITCHLESS_SPIN_POLICY_FIXED, 0},
+    {"timed", OE_SWITCHLESS_SPIN_POLICY_TIMED, 0},
+    {"adaptive", OE_SWITCHLESS_SPIN_POLICY_ADAPTIVE, 0},
+};
+
+// Increase the number of calls to have a meaningful performance measurement
+static const workload_t _workloads[] = {
+    {0, 20000},
+    {20, 2000},
+    {200, 1000},
+    {2000, 200},
+};
+
+/* Return the CPU time consumed by all the threads of the process */
+static double _get_process_cpu_time_in_microseconds()
+{
+#if defined(__linux__)
+    struct rusage usage;
+    OE_TEST(getrusage(RUSAGE_SELF, &usage) == 0);
+    return (double)(usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+           (double)(usage.ru_utime.tv_usec + usage.ru_stime.tv_usec);
+#elif defined(_WIN32)
+    FILETIME creation, exit, kernel, user;
+    OE_TEST(GetProcessTimes(
+        GetCurrentProcess(), &creation, &exit, &kernel, &user));
+    ULARGE_INTEGER k, u;
+    k.LowPart = kernel.dwLowDateTime;
+    k.HighPart = kernel.dwHighDateTime;
+    u.LowPart = user.dwLowDateTime;
+    u.HighPart = user.dwHighDateTime;
+    // FILETIME is in units of 100 nanoseconds.
+    return (double)(k.QuadPart + u.QuadPart) / 10;
+#endif
+}
+
+static double _percentile(vector<double>& latencies, double percentile)
+{
+    sort(latencies.begin(), latencies.end());
+    size_t index = (size_t)(percentile / 100 * (double)(latencies.size() - 1));
+    return latencies[index];
+}
+
+static void _run_workload(
+    oe_enclave_t* enclave,
+    const policy_t& policy,
+    const workload_t& workload)
+{
+    vector<double> latencies;
+    latencies.reserve(workload.num_calls);
+
+    double cpu_start = _get_process_cpu_time_in_microseconds();
+    auto wall_start = chrono::steady_clock::now();
+
+    for (size_t i = 0; i < workload.num_calls; i++)
+    {
+        uint64_t value = 0;
+
+        if (workload.gap_microseconds)
+            this_thread::sleep_for(
+                chrono::microseconds(workload.gap_microseconds));
+
+        auto start = chrono::steady_clock::now();
+        OE_TEST(enc_increment_switchless(enclave, &value, i) == OE_OK);
+        auto end = chrono::steady_clock::now();
+
+        OE_TEST(value == i + 1);
+        latencies.push_back(
+            chrono::duration<double, micro>(end - start).count());
+    }
+
+    double cpu_time = _get_process_cpu_time_in_microseconds() - cpu_start;
+    double wall_time = chrono::duration<double, micro>(
+                           chrono::steady_clock::now() - wall_start)
+                           .count();
+
+    printf(
+        "policy=%-8s gap=%5dus calls=%5d cpu=%8.1fms (%5.1f%% of wall time) "
+        "p50=%7.2fus p99=%7.2fus\n",
+        policy.name,
+        (int)workload.gap_microseconds,
+        (int)workload.num_calls,
+        cpu_time / 1000,
+        cpu_time / wall_time * 100,
+        _percentile(latencies, 50),
+        _percentile(latencies, 99));
+}
+
+/* Create the enclave with one switchless enclave worker */
+static oe_result_t _create_enclave(
+    const char* path,
+    uint32_t flags,
+    oe_switchless_spin_policy_t policy,
+    uint64_t budget,
+    oe_enclave_t** enclave)
+{
+    oe_enclave_setting_context_switchless_t switchless_setting = {0, 1};
+    oe_enclave_setting_switchless_workers_t workers_setting = {};
+    workers_setting.spin_policy = policy;
+    workers_setting.spin_budget = budget;
+    oe_enclave_setting_t settings[2];
+    settings[0].setting_type = OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS;
+    settings[0].u.context_switchless_setting = &switchless_setting;
+    settings[1].setting_type = OE_ENCLAVE_SETTING_SWITCHLESS_WORKERS;
+    settings[1].u.switchless_workers_setting = &workers_setting;
+
+    return oe_create_switchless_spin_policy_enclave(
+        path,
+        OE_ENCLAVE_TYPE_SGX,
+        flags,
+        settings,
+        OE_COUNTOF(settings),
+        enclave);
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s ENCLAVE\n", argv[0]);
+        exit(1);
+    }
+
+    // The benchmark compares the policies against each other, which does not
+    // require SGX hardware.
+    const uint32_t flags = oe_get_create_flags() | OE_ENCLAVE_FLAG_SIMULATE;
+
+    for (size_t i = 0; i < OE_COUNTOF(_policies); i++)
+    {
+        oe_enclave_t* enclave = NULL;
+
+        if ((result = _create_enclave(
+                 argv[1],
+                 flags,
+                 _policies[i].policy,
+                 _policies[i].budget,
+                 &enclave)) != OE_OK)
+            oe_put_err("oe_create_enclave(): result=%u", result);
+
+        for (size_t j = 0; j < OE_COUNTOF(_workloads); j++)
+            _run_workload(enclave, _policies[i], _workloads[j]);
+
+        OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+    }
+
+    // An unknown policy is rejected.
+    {
+        oe_enclave_t* enclave = NULL;
+
+        OE_TEST(
+            _create_enclave(
+                argv[1],
+                flags,
+                (oe_switchless_spin_policy_t)42,
+                0,
+                &enclave) == OE_INVALID_PARAMETER);
+    }
+
+    printf("=== passed all tests (switchless_spin_policy)\n");
+
+    return 0;
+}
@@ -0,0 +1,180 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/enclave.h>
+#include <openenclave/internal/tests.h>
+#include <pthread.h>
+#include <sched.h>
+#include "thread_pool_t.h"
+
+struct range_t
+{
+    uint64_t begin;
+    uint64_t end;
+    uint64_t sum;
+};
+
+static void* _sum(void* arg)
+{
+    range_t* range = (range_t*)arg;
+
+    for (uint64_t i = range->begin; i < range->end; i++)
+        range->sum += i;
+
+    return &range->sum;
+}
+
+uint64_t enc_parallel_sum(uint64_t count, uint64_t num_threads)
+{
+    range_t* ranges = new range_t[num_threads];
+    pthread_t* threads = new pthread_t[num_threads];
+    uint64_t sum = 0;
+
+    for (uint64_t t = 0; t < num_threads; t++)
+    {
+        ranges[t].begin = count * t / num_threads;
+        ranges[t].end = count * (t + 1) / num_threads;
+        ranges[t].sum = 0;
+        OE_TEST(pthread_create(&threads[t], NULL, _sum, &ranges[t]) == 0);
+    }
+
+    for (uint64_t t = 0; t < num_threads; t++)
+    {
+        void* retval = NULL;
+
+        OE_TEST(pthread_join(threads[t], &retval) == 0);
+        OE_TEST(retval == &ranges[t].sum);
+        sum += ranges[t].sum;
+    }
+
+    delete[] threads;
+    delete[] ranges;
+
+    return sum;
+}
+
+/* Count the leaves of a binary tree of threads. The joins outnumber the
+ * workers of the pool, so they must run the threads that are not started
+ * yet themselves */
+static void* _nested(void* arg)
+{
+    uint64_t depth = (uint64_t)arg;
+    pthread_t children[2];
+    uint64_t leaves = 0;
+
+    if (depth == 0)
+        return (void*)1;
+
+    for (size_t i = 0; i < 2; i++)
+        OE_TEST(
+            pthread_create(&children[i], NULL, _nested, (void*)(depth - 1)) ==
+            0);
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        void* retval = NULL;
+
+        OE_TEST(pthread_join(children[i], &retval) == 0);
+        leaves += (uint64_t)retval;
+    }
+
+    return (void*)leaves;
+}
+
+uint64_t enc_nested_threads(uint64_t depth)
+{
+    return (uint64_t)_nested((void*)depth);
+}
+
+static uint64_t _num_detached_runs;
+
+static void* _count_run(void* arg)
+{
+    OE_UNUSED(arg);
+    __atomic_add_fetch(&_num_detached_runs, 1, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+void enc_detached_threads(uint64_t num_threads)
+{
+    __atomic_store_n(&_num_detached_runs, 0, __ATOMIC_SEQ_CST);
+
+    for (uint64_t t = 0; t < num_threads; t++)
+    {
+        pthread_t thread;
+
+        OE_TEST(pthread_create(&thread, NULL, _count_run, NULL) == 0);
+        OE_TEST(pthread_detach(thread) == 0);
+    }
+
+    // Only the workers of the pool run detached threads.
+    while (__atomic_load_n(&_num_detached_runs, __ATOMIC_SEQ_CST) <
+           num_threads)
+        sched_yield();
+}
+
+static uint64_t _num_blocked;
+static bool _released;
+
+static void* _wait_for_release(void* arg)
+{
+    OE_UNUSED(arg);
+    __atomic_add_fetch(&_num_blocked, 1, __ATOMIC_SEQ_CST);
+
+    while (!__atomic_load_n(&_released, __ATOMIC_SEQ_CST))
+        sched_yield();
+
+    return NULL;
+}
+
+static void* _release(void* arg)
+{
+    OE_UNUSED(arg);
+    __atomic_store_n(&_released, true, __ATOMIC_SEQ_CST);
+    return NULL;
+}
+
+/* Shows the limitation of the pool: with every worker blocked, the pthread
+ * that would unblock them does not start, and the pthreads would deadlock if
+ * it were not joined. Joining it runs it on the calling thread */
+bool enc_blocking_threads(uint64_t num_workers)
+{
+    pthread_t* threads = new pthread_t[num_workers];
+    pthread_t release_thread;
+    bool started = false;
+
+    __atomic_store_n(&_num_blocked, 0, __ATOMIC_SEQ_CST);
+    __atomic_store_n(&_released, false, __ATOMIC_SEQ_CST);
+
+    for (uint64_t t = 0; t < num_workers; t++)
+        OE_TEST(
+            pthread_create(&threads[t], NULL, _wait_for_release, NULL) == 0);
+
+    // Wait for the blocked pthreads to take all the workers.
+    while (__atomic_load_n(&_num_blocked, __ATOMIC_SEQ_CST) < num_workers)
+        sched_yield();
+
+    OE_TEST(pthread_create(&release_thread, NULL, _release, NULL) == 0);
+
+    for (size_t i = 0; i < 1000; i++)
+        sched_yield();
+
+    started = __atomic_load_n(&_released, __ATOMIC_SEQ_CST);
+
+    OE_TEST(pthread_join(release_thread, NULL) == 0);
+
+    for (uint64_t t = 0; t < num_workers; t++)
+        OE_TEST(pthread_join(threads[t], NULL) == 0);
+
+    delete[] threads;
+
+    return started;
+}
+
+OE_SET_ENCLAVE_SGX(
+    1,        /* ProductID */
+    1,        /* SecurityVersion */
+    true,     /* Debug */
+    1024,     /* NumHeapPages */
+    64,       /* NumStackPages */
+    NUM_TCS); /* NumTCS */
@@ -0,0 +1,150 @@
+// Copyright (c) Open Enclave SDK contributors.
+// Licensed under the MIT License.
+
+#include <openenclave/host.h>
+#include <openenclave/internal/error.h>
+#include <openenclave/internal/tests.h>
+#include <cstdio>
+#include <utility>
+#include "thread_pool_u.h"
+
+/*
+ * Runs pthreads in an enclave on the threads of the
+ * OE_ENCLAVE_SETTING_THREAD_POOL setting.
+ */
+
+#define NUM_POOL_THREADS 4
+
+static oe_result_t _create_enclave(
+    const char* path,
+    uint32_t num_threads,
+    oe_enclave_t** enclave)
+{
+    oe_enclave_setting_thread_pool_t thread_pool_setting = {num_threads};
+    oe_enclave_setting_t setting;
+
+    setting.setting_type = OE_ENCLAVE_SETTING_THREAD_POOL;
+    setting.u.thread_pool_setting = &thread_pool_setting;
+
+    return oe_create_thread_pool_enclave(
+        path,
+        OE_ENCLAVE_TYPE_SGX,
+        oe_get_create_flags(),
+        &setting,
+        1,
+        enclave);
+}
+
+static void _test_parallel_sum(oe_enclave_t* enclave)
+{
+    const uint64_t count = 1000000;
+    const uint64_t thread_counts[] = {1, NUM_POOL_THREADS, 64};
+
+    for (size_t i = 0; i < OE_COUNTOF(thread_counts); i++)
+    {
+        uint64_t sum = 0;
+
+        OE_TEST(
+            enc_parallel_sum(enclave, &sum, count, thread_counts[i]) == OE_OK);
+        OE_TEST(sum == count * (count - 1) / 2);
+    }
+}
+
+static void _test_nested_threads(oe_enclave_t* enclave)
+{
+    uint64_t leaves = 0;
+
+    OE_TEST(enc_nested_threads(enclave, &leaves, 6) == OE_OK);
+    OE_TEST(leaves == 64);
+}
+
+static void _test_detached_threads(oe_enclave_t* enclave)
+{
+    OE_TEST(enc_detached_threads(enclave, 100) == OE_OK);
+}
+
+static void _test_blocking_threads(oe_enclave_t* enclave)
+{
+    bool started = true;
+
+    OE_TEST(
+        enc_blocking_threads(enclave, &started, NUM_POOL_THREADS) == OE_OK);
+    OE_TEST(!started);
+}
+
+static void _test_tcs_reservation(const char* path)
+{
+    oe_enclave_t* enclave = NULL;
+    oe_enclave_setting_thread_pool_t thread_pool_setting = {NUM_POOL_THREADS};
+    oe_enclave_setting_context_switchless_t switchless_setting = {};
+    oe_enclave_setting_t settings[2];
+
+    // The pool must leave a TCS for regular ECALLs.
+    OE_TEST(_create_enclave(path, NUM_TCS, &enclave) == OE_OUT_OF_THREADS);
+
+    // So must the pool and the switchless enclave workers together, in
+    // either order of the settings.
+    switchless_setting.max_enclave_workers = NUM_TCS - NUM_POOL_THREADS;
+
+    settings[0].setting_type = OE_ENCLAVE_SETTING_CONTEXT_SWITCHLESS;
+    settings[0].u.context_switchless_setting = &switchless_setting;
+    settings[1].setting_type = OE_ENCLAVE_SETTING_THREAD_POOL;
+    settings[1].u.thread_pool_setting = &thread_pool_setting;
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        OE_TEST(
+            oe_create_thread_pool_enclave(
+                path,
+                OE_ENCLAVE_TYPE_SGX,
+                oe_get_create_flags(),
+                settings,
+                OE_COUNTOF(settings),
+                &enclave) == OE_OUT_OF_THREADS);
+
+        std::swap(settings[0], settings[1]);
+    }
+
+    // One TCS left is enough.
+    switchless_setting.max_enclave_workers--;
+
+    OE_TEST(
+        oe_create_thread_pool_enclave(
+            path,
+            OE_ENCLAVE_TYPE_SGX,
+            oe_get_create_flags(),
+            settings,
+            OE_COUNTOF(settings),
+            &enclave) == OE_OK);
+    OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+}
+
+int main(int argc, const char* argv[])
+{
+    oe_result_t result;
+    oe_enclave_t* enclave = NULL;
+
+    if (argc != 2)
+    {
+        fprintf(stderr, "Usage: %s ENCLAVE_PATH\n", argv[0]);
+        return 1;
+    }
+
+    if ((result = _create_enclave(argv[1], NUM_POOL_THREADS, &enclave)) !=
+        OE_OK)
+        oe_put_err("oe_create_enclave(): result=%u", result);
+
+    _test_parallel_sum(enclave);
+    _test_nested_threads(enclave);
+    _test_detached_threads(enclave);
+    _test_blocking_threads(enclave);
+
+    // Terminating the enclave stops the pool.
+    OE_TEST(oe_terminate_enclave(enclave) == OE_OK);
+
+    _test_tcs_reservation(argv[1]);
+
+    printf("=== passed all tests (thread_pool)\n");
+
+    return 0;
+}